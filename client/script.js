@@ -6,6 +6,19 @@ let schedules = [];
 let feedingData = {};
 let systemStatus = {};
 
+// History answer being collected, chunks arrive until "done"
+let historyRequestId = 0;
+let historyBuckets = [];
+
+// Topics this dashboard shows, each with the shortest interval (ms)
+// between two updates. The feeder only publishes what someone watches.
+const DASHBOARD_TOPICS = { water: 5000, food: 5000, logs: 1000 };
+
+// Live feeding trace, one point per binary frame from the feeder
+const TRACE_INTERVAL = 100; // 10 frames per second
+let tracePoints = [];
+let traceTarget = 0;
+
 // DOM Elements
 const statusIndicator = document.getElementById("status-indicator");
 const foodProgress = document.getElementById("food-progress");
@@ -22,6 +35,11 @@ const waterAmount = document.getElementById("water-amount");
 const waterDisplay = document.getElementById("water-display");
 const feedButton = document.getElementById("feed-button");
 const waterButton = document.getElementById("water-button");
+const feedProfile = document.getElementById("feed-profile");
+const calibrateButton = document.getElementById("calibrate-button");
+const refillButton = document.getElementById("refill-button");
+const foodEmpty = document.getElementById("food-empty");
+const lastMeal = document.getElementById("last-meal");
 const autoWatering = document.getElementById("auto-watering");
 const saveSettings = document.getElementById("save-settings");
 const scheduleContainer = document.getElementById("schedule-container");
@@ -29,12 +47,21 @@ const addScheduleButton = document.getElementById("add-schedule");
 const saveSchedulesButton = document.getElementById("save-schedules");
 const logContainer = document.getElementById("log-container");
 const messageElement = document.getElementById("message");
+const historyMetric = document.getElementById("history-metric");
+const historyRange = document.getElementById("history-range");
+const historyButton = document.getElementById("history-button");
+const historyChart = document.getElementById("history-chart");
+const historyInfo = document.getElementById("history-info");
+const traceEnabled = document.getElementById("trace-enabled");
+const traceChart = document.getElementById("trace-chart");
+const traceInfo = document.getElementById("trace-info");
 
 // Connect to WebSocket server
 function connect() {
   const serverUrl = `ws://${window.location.hostname}:3001`;
 
   socket = new WebSocket(serverUrl);
+  socket.binaryType = "arraybuffer";
 
   socket.onopen = () => {
     console.log("WebSocket connected");
@@ -50,6 +77,12 @@ function connect() {
         clientId: "web-client-" + Date.now().toString(36),
       })
     );
+
+    // The server forgets subscriptions when the connection drops
+    socket.send(
+      JSON.stringify({ eventType: "subscribe", topics: DASHBOARD_TOPICS })
+    );
+    if (traceEnabled.checked) setTraceSubscription(true);
   };
 
   socket.onclose = () => {
@@ -67,6 +100,11 @@ function connect() {
   };
 
   socket.onmessage = (event) => {
+    if (event.data instanceof ArrayBuffer) {
+      handleTraceFrame(event.data);
+      return;
+    }
+
     try {
       const message = JSON.parse(event.data);
       handleMessage(message);
@@ -83,11 +121,15 @@ function updateConnectionStatus() {
     statusIndicator.className = "connected";
     feedButton.disabled = false;
     waterButton.disabled = false;
+    calibrateButton.disabled = false;
+    refillButton.disabled = false;
   } else {
     statusIndicator.textContent = "Disconnected";
     statusIndicator.className = "disconnected";
     feedButton.disabled = true;
     waterButton.disabled = true;
+    calibrateButton.disabled = true;
+    refillButton.disabled = true;
   }
 }
 
@@ -131,6 +173,30 @@ function handleMessage(message) {
     case "command-simulated":
       showMessage("Command simulated (device not connected).");
       break;
+
+    case "history-data":
+      handleHistoryChunk(data);
+      break;
+
+    case "hatch-calibration":
+      showHatchCalibration(data);
+      break;
+
+    case "bowl-alert":
+      showBowlAlert(data);
+      break;
+
+    case "jam":
+      if (data.recovered) {
+        showMessage(`Food jam cleared after ${data.attempts} attempt(s)`);
+      } else {
+        showMessage(
+          `Food jammed: only ${data.dispensed.toFixed(1)}g of ` +
+            `${data.target.toFixed(1)}g dispensed, check the hopper`,
+          "error"
+        );
+      }
+      break;
   }
 }
 
@@ -159,6 +225,9 @@ function updateFeedingDataDisplay() {
     waterProgress.style.width = `${waterLevel}%`;
     waterPercentage.textContent = `${Math.round(waterLevel)}%`;
 
+    foodEmpty.textContent = formatEmptyIn(feedingData.hopper);
+    lastMeal.textContent = formatMeal(feedingData.lastMeal);
+
     // Update feeding times
     lastFeeding.textContent = formatDateTime(feedingData.lastFeed);
     nextFeeding.textContent = formatDateTime(feedingData.nextFeed);
@@ -168,6 +237,29 @@ function updateFeedingDataDisplay() {
   }
 }
 
+// Time until the hopper runs out, from the feeder's forecast
+function formatEmptyIn(hopper) {
+  if (!hopper || hopper.emptyInHours === undefined) return "Unknown";
+
+  const hours = hopper.emptyInHours;
+  const when =
+    hours < 48
+      ? `${Math.round(hours)} hours`
+      : `${Math.round(hours / 24)} days`;
+  return `in ${when} (${Math.round(hopper.gramsPerDay)}g/day)`;
+}
+
+// Last eating session the feeder saw in the bowl weight
+function formatMeal(meal) {
+  if (!meal) return "Unknown";
+
+  const minutes = Math.max(1, Math.round(meal.durationS / 60));
+  return (
+    `${meal.grams.toFixed(1)}g in ${minutes} min, ` +
+    `${formatDateTime(meal.receivedAt)}`
+  );
+}
+
 // Update system status display
 function updateSystemStatusDisplay() {
   if (systemStatus) {
@@ -279,6 +371,70 @@ function sendFeedCommand() {
   showMessage(`Sent feed command with ${size}g portion size`);
 }
 
+// Switch the kibble profile the feeder learns and doses with
+function selectFeedProfile() {
+  if (!isConnected) return;
+
+  socket.send(
+    JSON.stringify({
+      eventType: "feed-profile",
+      select: parseInt(feedProfile.value),
+    })
+  );
+
+  showMessage(`Feeder now uses ${feedProfile.selectedOptions[0].text}`);
+}
+
+// Measure the hatch's flow at each angle (food lands in the bowl)
+function sendCalibrateCommand() {
+  if (!isConnected) return;
+  if (!confirm("Calibration dispenses up to 200g into the bowl. Start?")) {
+    return;
+  }
+
+  socket.send(JSON.stringify({ eventType: "calibrate-hatch" }));
+  showMessage("Hatch calibration started");
+}
+
+// Tell the feeder the hopper was filled up
+function sendRefillCommand() {
+  if (!isConnected) return;
+  if (!confirm("Mark the hopper as full?")) return;
+
+  socket.send(JSON.stringify({ eventType: "hopper-refill" }));
+  showMessage("Hopper marked as full");
+}
+
+// Report calibration progress, and the table once it is measured
+function showHatchCalibration(data) {
+  const running = data.state === "settling" || data.state === "measuring";
+  calibrateButton.disabled = running || !isConnected;
+
+  if (running) {
+    showMessage(`Calibrating hatch: angle ${data.point} of ${data.points - 1}`);
+  } else if (data.state === "failed") {
+    showMessage(`Hatch calibration failed: ${data.error}`, "error");
+  } else if (data.state === "done") {
+    const table = (data.angle || [])
+      .map((angle, i) => `${angle}°: ${data.flow[i].toFixed(1)}g/s`)
+      .join(", ");
+    showMessage(`Hatch calibrated: ${table}`);
+  }
+}
+
+// Tell the user about something odd the feeder saw at the bowl
+function showBowlAlert(data) {
+  if (data.alert === "not-eating") {
+    showMessage(`Your pet has not eaten for ${data.hours} hours`, "error");
+  } else if (data.alert === "removed") {
+    showMessage("Bowl was lifted off the scale");
+  } else if (data.alert === "spilled") {
+    showMessage(`About ${data.grams.toFixed(0)}g spilled from the bowl`);
+  } else if (data.alert === "added") {
+    showMessage(`About ${data.grams.toFixed(0)}g of food added by hand`);
+  }
+}
+
 // Send water command
 function sendWaterCommand() {
   if (!isConnected) return;
@@ -362,6 +518,153 @@ function saveSchedules() {
   showMessage("Schedules saved successfully");
 }
 
+// Ask the feeder for min/max/avg history of one metric
+function requestHistory() {
+  if (!isConnected) return;
+
+  historyRequestId++;
+  historyBuckets = [];
+  historyInfo.textContent = "Loading...";
+
+  socket.send(
+    JSON.stringify({
+      eventType: "history",
+      requestId: historyRequestId,
+      metric: historyMetric.value,
+      range: parseInt(historyRange.value),
+      maxPoints: 200,
+    })
+  );
+}
+
+// Collect streamed history chunks, draw once the last one arrives
+function handleHistoryChunk(chunk) {
+  if (!chunk || chunk.requestId !== historyRequestId) return;
+
+  if (chunk.error) {
+    historyInfo.textContent = `History unavailable: ${chunk.error}`;
+    return;
+  }
+
+  // Device times are local epochs, shift them back to UTC
+  const offset = chunk.utcOffset || 0;
+  chunk.t.forEach((t, i) => {
+    historyBuckets.push({
+      time: (t - offset) * 1000,
+      min: chunk.min[i],
+      max: chunk.max[i],
+      avg: chunk.avg[i],
+    });
+  });
+
+  if (chunk.done) {
+    drawHistory();
+    historyInfo.textContent = historyBuckets.length
+      ? `${historyBuckets.length} points, ${chunk.tier} data, ` +
+        `${chunk.step}s buckets`
+      : "No history stored for this range yet";
+  }
+}
+
+// Plot the min/max band and the average line
+function drawHistory() {
+  const ctx = historyChart.getContext("2d");
+  const { width, height } = historyChart;
+  ctx.clearRect(0, 0, width, height);
+  if (!historyBuckets.length) return;
+
+  const first = historyBuckets[0].time;
+  const last = historyBuckets[historyBuckets.length - 1].time;
+  let low = Math.min(...historyBuckets.map((b) => b.min));
+  let high = Math.max(...historyBuckets.map((b) => b.max));
+  if (high === low) high = low + 1;
+
+  const x = (time) => ((time - first) / Math.max(1, last - first)) * width;
+  const y = (value) => height - ((value - low) / (high - low)) * height;
+
+  ctx.fillStyle = "rgba(52, 152, 219, 0.2)";
+  ctx.beginPath();
+  historyBuckets.forEach((b) => ctx.lineTo(x(b.time), y(b.max)));
+  for (let i = historyBuckets.length - 1; i >= 0; i--) {
+    ctx.lineTo(x(historyBuckets[i].time), y(historyBuckets[i].min));
+  }
+  ctx.fill();
+
+  ctx.strokeStyle = "#3498db";
+  ctx.beginPath();
+  historyBuckets.forEach((b) => ctx.lineTo(x(b.time), y(b.avg)));
+  ctx.stroke();
+
+  ctx.fillStyle = "#777";
+  ctx.fillText(high.toFixed(1), 2, 10);
+  ctx.fillText(low.toFixed(1), 2, height - 2);
+}
+
+// Start or stop the feeder's live trace for this dashboard
+function setTraceSubscription(enabled) {
+  if (!isConnected) return;
+
+  socket.send(
+    JSON.stringify(
+      enabled
+        ? { eventType: "subscribe", topics: { trace: TRACE_INTERVAL } }
+        : { eventType: "unsubscribe", topics: ["trace"] }
+    )
+  );
+  traceInfo.textContent = enabled ? "Waiting for the next feed..." : "";
+}
+
+// Decode a 12-byte little-endian frame: kind, hatch angle, sequence,
+// ms since start, then grams, g/s and target grams (all x10)
+function handleTraceFrame(buffer) {
+  if (buffer.byteLength < 12) return;
+  const view = new DataView(buffer);
+  const kind = view.getUint8(0);
+  const frame = {
+    hatch: view.getUint8(1),
+    seq: view.getUint16(2, true),
+    ms: view.getUint16(4, true),
+    dispensed: view.getInt16(6, true) / 10,
+    flow: view.getInt16(8, true) / 10,
+  };
+  traceTarget = view.getInt16(10, true) / 10;
+
+  // 1 = start, 2 = sample, 3 = end
+  if (kind === 1) tracePoints = [];
+  tracePoints.push(frame);
+  drawTrace();
+
+  traceInfo.textContent =
+    `${frame.dispensed.toFixed(1)}g of ${traceTarget.toFixed(1)}g, ` +
+    `${frame.flow.toFixed(1)}g/s, hatch ${frame.hatch}°` +
+    (kind === 3 ? " (done)" : "");
+}
+
+// Plot dispensed grams against the target line
+function drawTrace() {
+  const ctx = traceChart.getContext("2d");
+  const { width, height } = traceChart;
+  ctx.clearRect(0, 0, width, height);
+  if (!tracePoints.length) return;
+
+  const duration = Math.max(1000, tracePoints[tracePoints.length - 1].ms);
+  const high =
+    Math.max(traceTarget, ...tracePoints.map((p) => p.dispensed)) * 1.1 || 1;
+  const x = (ms) => (ms / duration) * width;
+  const y = (grams) => height - (grams / high) * height;
+
+  ctx.strokeStyle = "#e74c3c";
+  ctx.beginPath();
+  ctx.moveTo(0, y(traceTarget));
+  ctx.lineTo(width, y(traceTarget));
+  ctx.stroke();
+
+  ctx.strokeStyle = "#3498db";
+  ctx.beginPath();
+  tracePoints.forEach((p) => ctx.lineTo(x(p.ms), y(p.dispensed)));
+  ctx.stroke();
+}
+
 // Show message notification
 function showMessage(text, type = "info") {
   messageElement.textContent = text;
@@ -384,9 +687,16 @@ waterAmount.addEventListener("input", () => {
 // Event listeners for buttons
 feedButton.addEventListener("click", sendFeedCommand);
 waterButton.addEventListener("click", sendWaterCommand);
+feedProfile.addEventListener("change", selectFeedProfile);
+calibrateButton.addEventListener("click", sendCalibrateCommand);
+refillButton.addEventListener("click", sendRefillCommand);
 saveSettings.addEventListener("click", saveUserSettings);
 addScheduleButton.addEventListener("click", addNewSchedule);
 saveSchedulesButton.addEventListener("click", saveSchedules);
+historyButton.addEventListener("click", requestHistory);
+traceEnabled.addEventListener("change", () =>
+  setTraceSubscription(traceEnabled.checked)
+);
 
 // Initialize connection
 connect();
@@ -0,0 +1,118 @@
+const dgram = require("dgram");
+
+// Local NTP server for testing the feeder's SNTP client. Answers mode 3
+// requests like a stratum 2 server, with injected delay, jitter, loss and
+// clock offset so timeouts, backoff, server rotation and the re-resolve
+// path can be exercised on the bench.
+//
+// Point NTP_SERVER (config.h) at this machine's IP address, then e.g.:
+//
+//   NTP_LOSS=0.3 NTP_DELAY_MS=200 NTP_JITTER_MS=300 node ntp_standin.js
+//
+// Port 123 needs root on most systems. NTP_PORT moves the server, which is
+// useful with a port redirect or a host-side test client.
+
+// Configuration
+const PORT = parseInt(process.env.NTP_PORT || "123", 10);
+const DELAY_MS = parseInt(process.env.NTP_DELAY_MS || "0", 10);
+const JITTER_MS = parseInt(process.env.NTP_JITTER_MS || "0", 10);
+const LOSS = parseFloat(process.env.NTP_LOSS || "0");
+const OFFSET_MS = parseInt(process.env.NTP_OFFSET_MS || "0", 10);
+const HOLD_MS = parseInt(process.env.NTP_HOLD_MS || "0", 10);
+
+const NTP_UNIX_OFFSET = 2208988800; // 1900 -> 1970 (s)
+const PACKET_SIZE = 48;
+
+const stats = { requests: 0, dropped: 0, answered: 0, invalid: 0 };
+
+/**
+ * Write Unix ms as a 64-bit NTP timestamp
+ */
+function writeTimestamp(buffer, offset, unixMs) {
+  const seconds = Math.floor(unixMs / 1000) + NTP_UNIX_OFFSET;
+  const fraction = Math.floor(((unixMs % 1000) / 1000) * 0x100000000);
+  buffer.writeUInt32BE(seconds >>> 0, offset);
+  buffer.writeUInt32BE(fraction >>> 0, offset + 4);
+}
+
+/**
+ * Server clock, shifted by the injected offset
+ */
+function serverNow() {
+  return Date.now() + OFFSET_MS;
+}
+
+/**
+ * Build the reply to a client request
+ * @param request Client packet
+ * @param receivedAt Server time the request arrived (Unix ms)
+ */
+function buildReply(request, receivedAt) {
+  const reply = Buffer.alloc(PACKET_SIZE);
+  const version = (request[0] >> 3) & 0x07;
+
+  reply[0] = (0 << 6) | (version << 3) | 4; // LI 0, client's version, server
+  reply[1] = 2; // Stratum
+  reply[2] = request[2]; // Poll
+  reply[3] = 0xec; // Precision (~60 ns)
+  reply.write("LOCL", 12, "ascii"); // Reference id
+
+  writeTimestamp(reply, 16, receivedAt); // Reference
+  request.copy(reply, 24, 40, 48); // Originate = client's transmit
+  writeTimestamp(reply, 32, receivedAt); // Receive
+  writeTimestamp(reply, 40, receivedAt + HOLD_MS); // Transmit
+  return reply;
+}
+
+const socket = dgram.createSocket("udp4");
+
+socket.on("message", (request, remote) => {
+  const receivedAt = serverNow();
+  stats.requests++;
+
+  if (request.length < PACKET_SIZE || (request[0] & 0x07) !== 3) {
+    stats.invalid++;
+    return;
+  }
+
+  if (Math.random() < LOSS) {
+    stats.dropped++;
+    console.log(`${remote.address}:${remote.port} request dropped`);
+    return;
+  }
+
+  const delay = DELAY_MS + Math.floor(Math.random() * (JITTER_MS + 1));
+  const reply = buildReply(request, receivedAt);
+
+  setTimeout(() => {
+    socket.send(reply, remote.port, remote.address, (err) => {
+      if (err) {
+        console.error(`Reply to ${remote.address} failed: ${err.message}`);
+        return;
+      }
+      stats.answered++;
+      console.log(`${remote.address}:${remote.port} answered after ${delay}ms`);
+    });
+  }, delay);
+});
+
+socket.on("error", (err) => {
+  console.error(`NTP stand-in error: ${err.message}`);
+  socket.close();
+  process.exit(1);
+});
+
+socket.bind(PORT, () => {
+  console.log(
+    `NTP stand-in on udp/${PORT}: delay=${DELAY_MS}ms jitter=${JITTER_MS}ms ` +
+      `loss=${LOSS} offset=${OFFSET_MS}ms hold=${HOLD_MS}ms`
+  );
+});
+
+process.on("SIGINT", () => {
+  console.log(
+    `requests=${stats.requests} answered=${stats.answered} ` +
+      `dropped=${stats.dropped} invalid=${stats.invalid}`
+  );
+  process.exit(0);
+});
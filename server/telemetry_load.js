@@ -0,0 +1,170 @@
+const WebSocket = require("ws");
+
+// Load check for the feeding trace relay. Plays a feeder and a dashboard
+// against a running websocket_server.js: the dashboard subscribes to the
+// trace, the feeder waits to be told and floods binary frames, and the
+// dashboard counts what arrives, in order, and how long it took. When the
+// dashboard leaves, the feeder must be told the trace has no viewer.
+//
+//   node websocket_server.js &
+//   FRAMES=2000 node telemetry_load.js
+//
+// Exits non-zero if frames go missing or a step times out.
+
+// Configuration
+const URL = process.env.WS_URL || "ws://localhost:3001";
+const FRAMES = parseInt(process.env.FRAMES || "2000", 10);
+const TRACE_INTERVAL = parseInt(process.env.TRACE_INTERVAL || "50", 10);
+const TIMEOUT_MS = parseInt(process.env.TIMEOUT_MS || "10000", 10);
+
+const TELEMETRY_START = 1;
+const TELEMETRY_SAMPLE = 2;
+const TELEMETRY_END = 3;
+const FRAME_SIZE = 12;
+
+/**
+ * Frame as feed_telemetry.h packs it, little-endian
+ */
+function makeFrame(seq) {
+  const kind =
+    seq === 0
+      ? TELEMETRY_START
+      : seq === FRAMES - 1
+      ? TELEMETRY_END
+      : TELEMETRY_SAMPLE;
+  const frame = Buffer.alloc(FRAME_SIZE);
+  frame.writeUInt8(kind, 0);
+  frame.writeUInt8(90, 1); // Hatch angle
+  frame.writeUInt16LE(seq & 0xffff, 2);
+  frame.writeUInt16LE((seq * 100) & 0xffff, 4); // 100 ms per sample
+  frame.writeInt16LE(Math.min(seq, 500), 6); // Dispensed x10
+  frame.writeInt16LE(80, 8); // Flow x10
+  frame.writeInt16LE(500, 10); // Target x10
+  return frame;
+}
+
+/**
+ * Open a client and register it as the given device type
+ */
+function connect(deviceType) {
+  return new Promise((resolve, reject) => {
+    const ws = new WebSocket(URL);
+    ws.once("error", reject);
+    ws.once("open", () => {
+      ws.send(JSON.stringify({ eventType: "register", deviceType }));
+      resolve(ws);
+    });
+  });
+}
+
+/**
+ * Resolve with the first JSON message that passes the test
+ */
+function waitFor(ws, what, test) {
+  return new Promise((resolve, reject) => {
+    const timer = setTimeout(() => {
+      ws.off("message", onMessage);
+      reject(new Error(`timed out waiting for ${what}`));
+    }, TIMEOUT_MS);
+    function onMessage(data, isBinary) {
+      if (isBinary) return;
+      let message;
+      try {
+        message = JSON.parse(data);
+      } catch {
+        return;
+      }
+      if (!test(message)) return;
+      clearTimeout(timer);
+      ws.off("message", onMessage);
+      resolve(message);
+    }
+    ws.on("message", onMessage);
+  });
+}
+
+/**
+ * @return true if a subscriptions message lists the trace
+ */
+function traceWatched(message) {
+  return (
+    message.eventType === "subscriptions" &&
+    "trace" in (message.topics || {})
+  );
+}
+
+async function run() {
+  const feeder = await connect("feeder-device");
+  const dashboard = await connect("web-dashboard");
+
+  // The dashboard's frames, checked for order as they come in
+  const received = { frames: 0, outOfOrder: 0, bytes: 0, lastSeq: -1 };
+  let firstAt = 0;
+  let lastAt = 0;
+  const allReceived = new Promise((resolve) => {
+    dashboard.on("message", (data, isBinary) => {
+      if (!isBinary) return;
+      if (!firstAt) firstAt = Date.now();
+      received.frames++;
+      received.bytes += data.length;
+      const seq = data.readUInt16LE(2);
+      if (seq !== ((received.lastSeq + 1) & 0xffff)) received.outOfOrder++;
+      received.lastSeq = seq;
+      if (data[0] === TELEMETRY_END) {
+        lastAt = Date.now();
+        resolve();
+      }
+    });
+  });
+
+  const subscribed = waitFor(feeder, "the trace subscription", traceWatched);
+  dashboard.send(
+    JSON.stringify({
+      eventType: "subscribe",
+      topics: { trace: TRACE_INTERVAL },
+    })
+  );
+  await subscribed;
+
+  // Flood, as fast as the socket takes them
+  const sentAt = Date.now();
+  for (let seq = 0; seq < FRAMES; seq++) {
+    feeder.send(makeFrame(seq), { binary: true });
+  }
+
+  await Promise.race([
+    allReceived,
+    new Promise((resolve, reject) =>
+      setTimeout(
+        () => reject(new Error(`only ${received.frames} frames arrived`)),
+        TIMEOUT_MS
+      )
+    ),
+  ]);
+  const elapsed = lastAt - sentAt;
+  console.log(
+    `${received.frames}/${FRAMES} frames in ${elapsed} ms ` +
+      `(${Math.round((received.frames * 1000) / Math.max(elapsed, 1))}/s, ` +
+      `first after ${firstAt - sentAt} ms), ${received.outOfOrder} out of order`
+  );
+
+  // Leaving must stop the trace on the feeder
+  const released = waitFor(
+    feeder,
+    "the trace to be released",
+    (message) => message.eventType === "subscriptions" && !traceWatched(message)
+  );
+  dashboard.close();
+  await released;
+  console.log("Feeder told the trace has no viewer");
+  feeder.close();
+
+  return received.frames === FRAMES && received.outOfOrder === 0;
+}
+
+run()
+  .then((ok) => process.exit(ok ? 0 : 1))
+  .catch((err) => {
+    console.error(err.message);
+    process.exit(1);
+  });
@@ -123,6 +123,34 @@ const wss = new WebSocket.Server({ port: PORT });
 // Track connected clients
 const clients = new Map();
 
+// Last profiler report received from the feeder
+let latestMetrics = null;
+
+// Watchdog/exception traces uploaded by the feeder after a reset
+const MAX_CRASH_REPORTS = 20;
+const crashReports = [];
+
+// History queries relayed to the feeder, keyed by the id sent to it
+const historyRequests = new Map();
+let nextHistoryRequestId = 1;
+
+// Topics a dashboard watches until it subscribes itself, each with the
+// shortest interval between two messages (ms)
+const DEFAULT_DASHBOARD_TOPICS = { water: 5000, food: 5000, logs: 1000 };
+
+// Topics carried by broadcast events, events not listed go to everyone
+const EVENT_TOPICS = {
+  "feeding-data": ["food", "water"],
+  "system-status": ["food", "water"],
+  metrics: ["metrics"],
+  "log-entry": ["logs"],
+};
+
+// Skip a dashboard's trace frames while this much is still queued for it
+const TELEMETRY_MAX_BUFFERED = 16 * 1024;
+let telemetryRelayed = 0;
+let telemetryDropped = 0;
+
 // Generate a log entry
 function createLogEntry(action) {
   const now = new Date();
@@ -170,13 +198,19 @@ function saveDatabase() {
   }
 }
 
-// Broadcast to all connected clients
+// Broadcast to all connected clients watching the event's topics
 function broadcast(eventType, data) {
   const message = JSON.stringify({ eventType, data, timestamp: Date.now() });
+  const eventTopics = EVENT_TOPICS[eventType];
   wss.clients.forEach((client) => {
-    if (client.readyState === WebSocket.OPEN) {
-      client.send(message);
+    if (client.readyState !== WebSocket.OPEN) return;
+
+    // Clients that never subscribed (tools, older dashboards) get everything
+    const topics = clients.get(client)?.topics;
+    if (eventTopics && topics && !eventTopics.some((t) => t in topics)) {
+      return;
     }
+    client.send(message);
   });
 }
 
@@ -361,6 +395,55 @@ function triggerWater(type = "manual", waterAmount = null) {
   return true;
 }
 
+// Tell the feeder which topics the dashboards watch, each at the shortest
+// interval any of them asked for. Unlisted topics are not published.
+function sendSubscriptions(feederWs = null) {
+  const topics = {};
+  clients.forEach((clientInfo) => {
+    Object.entries(clientInfo.topics || {}).forEach(([topic, interval]) => {
+      topics[topic] =
+        topic in topics ? Math.min(topics[topic], interval) : interval;
+    });
+  });
+  const message = JSON.stringify({ eventType: "subscriptions", topics });
+
+  clients.forEach((clientInfo, clientWs) => {
+    if (
+      clientInfo.type === "feeder-device" &&
+      clientWs.readyState === WebSocket.OPEN &&
+      (!feederWs || clientWs === feederWs)
+    ) {
+      clientWs.send(message);
+    }
+  });
+}
+
+// Relay a binary telemetry frame from the feeder to its subscribers
+function relayTelemetry(frame) {
+  clients.forEach((clientInfo, subscriberWs) => {
+    if (!clientInfo.topics || !("trace" in clientInfo.topics)) return;
+    if (subscriberWs.readyState !== WebSocket.OPEN) return;
+
+    // A slow dashboard loses frames instead of queueing them without bound
+    if (subscriberWs.bufferedAmount > TELEMETRY_MAX_BUFFERED) {
+      telemetryDropped++;
+      return;
+    }
+    subscriberWs.send(frame, { binary: true });
+    telemetryRelayed++;
+  });
+
+  // Frame kind 3 closes the feed's trace
+  if (frame[0] === 3) {
+    logger.info("Feeding trace relayed", {
+      frames: telemetryRelayed,
+      dropped: telemetryDropped,
+    });
+    telemetryRelayed = 0;
+    telemetryDropped = 0;
+  }
+}
+
 // Add this function to handle feed requests with schedule information
 function handleFeedRequest(ws, message) {
   try {
@@ -530,7 +613,13 @@ wss.on("connection", (ws, req) => {
   ws.send(JSON.stringify({ eventType: "clients", data: db.clients }));
 
   // Handle incoming messages
-  ws.on("message", (message) => {
+  ws.on("message", (message, isBinary) => {
+    // Binary frames are the feeder's live feeding trace
+    if (isBinary) {
+      if (clients.get(ws)?.type === "feeder-device") relayTelemetry(message);
+      return;
+    }
+
     try {
       const msg = JSON.parse(message);
       const eventType = msg.eventType;
@@ -550,6 +639,12 @@ wss.on("connection", (ws, req) => {
           client.type = msg.deviceType || "unknown";
           client.version = msg.version || "1.0";
           logger.info(`Client ${client.id} registered as ${client.type}`);
+          if (client.type === "feeder-device") {
+            sendSubscriptions(ws);
+          } else if (client.type === "web-dashboard" && !client.topics) {
+            client.topics = { ...DEFAULT_DASHBOARD_TOPICS };
+            sendSubscriptions();
+          }
           break;
 
         case "get-settings":
@@ -608,6 +703,7 @@ wss.on("connection", (ws, req) => {
             `Log from ${client.id}: ${logEntry.type} - ${logEntry.details}`
           );
           saveDatabase();
+          broadcast("log-entry", logEntry);
           break;
 
         case "feeding-complete":
@@ -649,6 +745,324 @@ wss.on("connection", (ws, req) => {
           }
           break;
 
+        case "metrics":
+          // Profiler report from the feeder, relay it to the dashboards
+          if (client?.type === "feeder-device") {
+            latestMetrics = {
+              uptime: msg.uptime,
+              idlePercent: msg.idlePercent,
+              uiBlockedMsPerDay: msg.uiBlockedMsPerDay,
+              probes: msg.probes || [],
+              boot: msg.boot || null,
+              net: msg.net || null,
+              time: msg.time || null,
+              feedProfile: msg.feedProfile || null,
+              receivedAt: Date.now(),
+            };
+            broadcast("metrics", latestMetrics);
+          }
+          break;
+
+        case "crash-report":
+          // Breadcrumb trail from before a watchdog or exception reset
+          if (client?.type === "feeder-device") {
+            const report = {
+              reason: msg.reason,
+              exccause: msg.exccause,
+              epc1: msg.epc1,
+              excvaddr: msg.excvaddr,
+              bootCount: msg.bootCount,
+              subsystem: msg.subsystem,
+              state: msg.state,
+              stateSinceMs: msg.stateSinceMs,
+              trail: msg.trail || [],
+              receivedAt: Date.now(),
+            };
+            crashReports.push(report);
+            if (crashReports.length > MAX_CRASH_REPORTS) crashReports.shift();
+
+            logger.warn(
+              `Feeder reset (${report.reason}) in ${report.subsystem}/${report.state}`
+            );
+            broadcast("crash-report", report);
+          }
+          break;
+
+        case "get-crash-reports":
+          ws.send(
+            JSON.stringify({ eventType: "crash-reports", data: crashReports })
+          );
+          break;
+
+        case "history": {
+          // Dashboard asks for history, the feeder streams it in chunks
+          const requestId = nextHistoryRequestId++;
+          const request = {
+            eventType: "history",
+            requestId,
+            metric: msg.metric,
+            from: msg.from,
+            to: msg.to,
+            range: msg.range,
+            maxPoints: msg.maxPoints,
+          };
+
+          let sent = false;
+          clients.forEach((clientInfo, clientWs) => {
+            if (
+              !sent &&
+              clientInfo.type === "feeder-device" &&
+              clientWs.readyState === WebSocket.OPEN
+            ) {
+              clientWs.send(JSON.stringify(request));
+              sent = true;
+            }
+          });
+
+          if (sent) {
+            historyRequests.set(requestId, {
+              ws,
+              clientRequestId: msg.requestId,
+            });
+          } else {
+            ws.send(
+              JSON.stringify({
+                eventType: "history-data",
+                data: {
+                  requestId: msg.requestId,
+                  error: "feeder offline",
+                  done: true,
+                },
+              })
+            );
+          }
+          break;
+        }
+
+        case "history-data":
+          // Chunk of a history answer, only the asking dashboard gets it
+          if (client?.type === "feeder-device") {
+            const pending = historyRequests.get(msg.requestId);
+            if (!pending) break;
+
+            if (pending.ws.readyState === WebSocket.OPEN) {
+              pending.ws.send(
+                JSON.stringify({
+                  eventType: "history-data",
+                  data: {
+                    requestId: pending.clientRequestId,
+                    metric: msg.metric,
+                    tier: msg.tier,
+                    step: msg.step,
+                    utcOffset: msg.utcOffset,
+                    seq: msg.seq,
+                    t: msg.t || [],
+                    min: msg.min || [],
+                    max: msg.max || [],
+                    avg: msg.avg || [],
+                    error: msg.error,
+                    done: msg.done,
+                  },
+                })
+              );
+            }
+            if (msg.done) historyRequests.delete(msg.requestId);
+          }
+          break;
+
+        case "feed-profile":
+          // Dashboard selects, renames or resets the feeder's kibble profile
+          clients.forEach((clientInfo, clientWs) => {
+            if (
+              clientInfo.type === "feeder-device" &&
+              clientWs.readyState === WebSocket.OPEN
+            ) {
+              clientWs.send(
+                JSON.stringify({
+                  eventType: "feed-profile",
+                  select: msg.select,
+                  name: msg.name,
+                  reset: msg.reset,
+                })
+              );
+            }
+          });
+          break;
+
+        case "jam":
+          // Food bridged over the hatch during a feed
+          if (client?.type === "feeder-device") {
+            const report = {
+              attempts: msg.attempts,
+              recovered: msg.recovered,
+              detectMs: msg.detectMs,
+              recoverMs: msg.recoverMs,
+              dispensed: msg.dispensed,
+              target: msg.target,
+              receivedAt: Date.now(),
+            };
+            logger.warn(
+              `Hatch jammed, ${
+                report.recovered ? "cleared" : "not cleared"
+              } after ${report.attempts} attempt(s)`
+            );
+            broadcast("jam", report);
+          }
+          break;
+
+        case "hopper-refill":
+          // Dashboard reports that the hopper was refilled
+          clients.forEach((clientInfo, clientWs) => {
+            if (
+              clientInfo.type === "feeder-device" &&
+              clientWs.readyState === WebSocket.OPEN
+            ) {
+              clientWs.send(
+                JSON.stringify({
+                  eventType: "hopper-refill",
+                  grams: msg.grams,
+                  capacity: msg.capacity,
+                })
+              );
+            }
+          });
+          break;
+
+        case "hopper":
+          // Hopper inventory and time-to-empty forecast from the feeder
+          if (client?.type === "feeder-device") {
+            db.feedingData.foodLevel = msg.level;
+            db.feedingData.hopper = {
+              grams: msg.grams,
+              capacity: msg.capacity,
+              gramsPerDay: msg.gramsPerDay,
+              emptyInHours: msg.emptyInHours,
+              refills: msg.refills,
+              lastRefill: msg.lastRefill,
+              receivedAt: Date.now(),
+            };
+            broadcast("feeding-data", db.feedingData);
+            saveDatabase();
+          }
+          break;
+
+        case "eating":
+          // An eating session the feeder saw in the bowl weight
+          if (client?.type === "feeder-device") {
+            const meal = {
+              start: msg.start,
+              durationS: msg.durationS,
+              grams: msg.grams,
+              bites: msg.bites,
+              biteRate: msg.biteRate,
+              receivedAt: Date.now(),
+            };
+            db.feedingData.lastMeal = meal;
+            db.feedingData.logs.unshift({
+              time: new Date().toISOString(),
+              clientId: client.id,
+              type: "eating",
+              details: `Ate ${meal.grams.toFixed(1)}g in ${Math.round(
+                meal.durationS / 60
+              )} min (${meal.bites} bites)`,
+            });
+            broadcast("feeding-data", db.feedingData);
+            saveDatabase();
+          }
+          break;
+
+        case "bowl-alert":
+          // Something odd at the bowl: not eating, removed, spilled, added
+          if (client?.type === "feeder-device") {
+            const alert = {
+              alert: msg.alert,
+              grams: msg.grams,
+              hours: msg.hours,
+              receivedAt: Date.now(),
+            };
+            logger.warn(`Bowl alert: ${alert.alert}`, alert);
+            db.feedingData.logs.unshift({
+              time: new Date().toISOString(),
+              clientId: client.id,
+              type: `bowl_${alert.alert}`,
+              details:
+                alert.grams !== undefined
+                  ? `${alert.grams.toFixed(1)}g`
+                  : alert.hours !== undefined
+                  ? `No meal for ${alert.hours}h`
+                  : "Bowl alert",
+            });
+            broadcast("bowl-alert", alert);
+            broadcast("feeding-data", db.feedingData);
+            saveDatabase();
+          }
+          break;
+
+        case "calibrate-hatch":
+          // Dashboard starts (or aborts) the feeder's hatch calibration
+          clients.forEach((clientInfo, clientWs) => {
+            if (
+              clientInfo.type === "feeder-device" &&
+              clientWs.readyState === WebSocket.OPEN
+            ) {
+              clientWs.send(
+                JSON.stringify({
+                  eventType: "calibrate-hatch",
+                  abort: msg.abort,
+                })
+              );
+            }
+          });
+          break;
+
+        case "hatch-calibration":
+          // Calibration progress and result, every dashboard may show it
+          if (client?.type === "feeder-device") {
+            const calibration = {
+              state: msg.state,
+              point: msg.point,
+              points: msg.points,
+              error: msg.error,
+              angle: msg.angle || [],
+              flow: msg.flow || [],
+            };
+            if (msg.state === "done" || msg.state === "failed") {
+              logger.info(`Hatch calibration ${msg.state}`, calibration);
+            }
+            broadcast("hatch-calibration", calibration);
+          }
+          break;
+
+        case "get-metrics": {
+          // Ask the feeder for a fresh report, answer with the last one now
+          if (latestMetrics) {
+            ws.send(
+              JSON.stringify({ eventType: "metrics", data: latestMetrics })
+            );
+          }
+          clients.forEach((clientInfo, clientWs) => {
+            if (
+              clientInfo.type === "feeder-device" &&
+              clientWs.readyState === WebSocket.OPEN
+            ) {
+              clientWs.send(JSON.stringify({ eventType: "get-metrics" }));
+            }
+          });
+          break;
+        }
+
+        case "subscribe":
+          // { topics: { water: 5000, trace: 100, ... } }, intervals in ms
+          client.topics = { ...(client.topics || {}), ...(msg.topics || {}) };
+          sendSubscriptions();
+          break;
+
+        case "unsubscribe":
+          // { topics: ["trace", ...] }
+          (msg.topics || []).forEach((topic) => delete client.topics?.[topic]);
+          sendSubscriptions();
+          break;
+
         default:
           logger.warn(`Unknown event type: ${eventType}`, msg);
       }
@@ -665,6 +1079,14 @@ wss.on("connection", (ws, req) => {
     const client = clients.get(ws);
     logger.info(`Client disconnected: ${client ? client.id : "unknown"}`);
     clients.delete(ws);
+
+    // Let the feeder stop publishing what nobody watches any more
+    if (client?.topics) sendSubscriptions();
+
+    // Drop history answers nobody is waiting for any more
+    historyRequests.forEach((pending, requestId) => {
+      if (pending.ws === ws) historyRequests.delete(requestId);
+    });
   });
 });
 
@@ -30,6 +30,10 @@
 #define LCD_UPDATE_INTERVAL 500  // Update LCD display every 500ms
 #define LCD_BACKLIGHT_TIMEOUT 60000UL  // Turn off backlight after 1 minute
 
+// LCD message queue
+#define UI_QUEUE_SIZE 10       // Screens waiting to be shown
+#define UI_UPDATE_INTERVAL 50  // Queue servicing period in ms
+
 // LCD hardware settings
 #define LCD_ADDR 0x27                  // LCD I2C address
 #define LCD_X 16                       // LCD width in characters
@@ -41,12 +45,30 @@
 //==============================================================================
 #define MAX_RETRY_COUNT 5           // Maximum number of connection attempts
 #define CONNECTION_TIMEOUT 10000UL  // Timeout for each attempt (10 seconds)
-#define SETUP_STEP_TIMEOUT 30000UL  // Timeout for each setup step
+
+// Fast reconnect cache (last AP kept in RTC memory)
+#define WIFI_FAST_CONNECT_TIMEOUT 3000UL  // Stalled direct attempt, then scan
+#define WIFI_RECONNECT_INTERVAL 30000UL   // Wait between background retries
+#define WIFI_CHECK_INTERVAL 1000          // Connection supervision period (ms)
+// #define WIFI_CACHE_STATIC_IP  // Reuse the cached DHCP lease (skips DHCP)
 
 // NTP Configuration
 #define NTP_SERVER "asia.pool.ntp.org"
 #define NTP_OFFSET 25200UL            // Timezone offset (UTC +7:00)
 #define NTP_UPDATE_INTERVAL 360000UL  // Update interval (6 minutes)
+#define NTP_SERVER_2 "pool.ntp.org"     // Fallback servers, tried in turn
+#define NTP_SERVER_3 "time.google.com"
+#define NTP_MAX_SERVERS 3
+#define NTP_LOCAL_PORT 2390
+#define NTP_RESPONSE_TIMEOUT 1000     // Reply wait before the next server (ms)
+#define NTP_RESPONSE_POLL 20          // Reply polling period (ms)
+#define NTP_RERESOLVE_MISSES 3        // Timeouts in a row before a new lookup
+#define NTP_DNS_TIMEOUT 500           // DNS lookup limit, blocks the loop (ms)
+#define NTP_RETRY_MIN 2000UL          // First retry delay, doubles per failure
+#define NTP_RETRY_MAX 60000UL         // Retry delay cap
+#define NTP_MAX_RTT 500               // Discard replies slower than this (ms)
+#define NTP_DRIFT_MIN_SPAN 900000UL   // Shortest span for a drift sample (ms)
+#define NTP_DRIFT_MAX_PPM 500.0f      // Reject drift beyond a sane crystal
 
 //==============================================================================
 // Sensor Configuration
@@ -61,6 +83,15 @@
 #define DISTANCE_WATER_FULL 16.0    // Distance when tank is full
 #define WATER_CHECK_INTERVAL 10000  // Check water every 10 seconds
 
+// Adaptive water checks (see water_schedule.h)
+#define WATER_CHECK_MIN 10000UL     // Shortest period between checks (ms)
+#define WATER_CHECK_MAX 1800000UL   // Longest period between checks (ms)
+#define WATER_CHECK_FRACTION 0.5f   // Check before this much margin can go
+#define WATER_DROP_FLOOR 6.0f       // Assume at least this fall rate (cm/h)
+#define WATER_RATE_HEADROOM 2.0f    // ...or the observed rate times this
+#define WATER_RATE_TAU 2.0f         // Fall rate smoothing time (h)
+#define WATER_REFILL_RISE 0.5f      // A rise this large is a refill (cm)
+
 //==============================================================================
 // Water Management Settings
 //==============================================================================
@@ -73,6 +104,40 @@
 #define SERVO_OPEN_ANGLE 60
 #define SERVO_CLOSE_ANGLE 180
 #define SERVO_OPEN_INTERVAL 200  // Time to open the hatch in milliseconds
+#define SERVO_SLEW_RATE 400.0f   // Fastest hatch movement (deg/s)
+#define SERVO_MAX_RATE 600.0f    // Servo speed, for when a jump has arrived
+#define SERVO_TICK_INTERVAL 20   // Motion planner step (one PWM frame)
+#define SERVO_DETACH_DELAY 500   // Closed and still this long: PWM off
+
+// Flow control (proportional hatch, see flow_control.h)
+#define FLOW_CRACK_ANGLE 150        // Angle where food starts to trickle
+#define FLOW_APPROACH_TIME 0.8f     // Aim to finish the rest in this time (s)
+#define FLOW_MIN_FRACTION 0.2f      // Never ask for less than 20% of full flow
+#define FLOW_KP 0.3f                // Opening per unit of flow error
+#define FLOW_KI 0.5f                // Integral gain (1/s)
+#define FLOW_MEASURE_DELAY 1000     // Wide open this long before trusting flow
+#define FLOW_MEASURE_MIN_SAMPLES 5  // Steady samples to learn the full flow
+#define FLOW_ESTIMATE_ALPHA 0.3f    // Flow estimate smoothing (0-1)
+
+// Hatch calibration (angle -> flow table, see hatch_calibration.h)
+#define HATCH_CAL_POINTS 9          // Table points, closed to wide open
+#define HATCH_CAL_SETTLE_MS 1000    // Let the flow establish at each angle
+#define HATCH_CAL_MEASURE_MS 2000   // Longest flow fit per angle
+#define HATCH_CAL_STEP_GRAMS 15.0f  // Or stop the fit once this much fell
+#define HATCH_CAL_MIN_SAMPLES 5     // Fewest readings in a fit
+#define HATCH_CAL_MAX_GRAMS 200.0f  // Give up before the bowl overflows
+#define HATCH_CAL_SCALE_WAIT 1000   // Scale silent this long = failure
+
+// Jam detection (kibble bridging over the hatch, see jam_detector.h)
+#define JAM_PROGRESS_GRAMS 0.5f   // Reading rise that counts as flowing
+#define JAM_DETECT_MS 700         // No progress this long while open = jam
+#define JAM_EXPECTED_GRAMS 2.0f   // ...if at least this much was expected
+#define JAM_MIN_OPENING 0.5f      // Only judge a hatch at least half open
+#define JAM_GRACE_MS 500          // After (re)opening, on top of fall time
+#define JAM_PULSES 3              // Wiggles per recovery attempt
+#define JAM_PULSE_MS 150          // Half a wiggle
+#define JAM_WIGGLE_ANGLE 30       // Wiggle swing, grows with each attempt
+#define JAM_MAX_ATTEMPTS 3        // Then give up and end the feed
 
 //==============================================================================
 // Load Cell & Feeding Configuration
@@ -86,20 +151,74 @@
 #define CALIBRATION_FACTOR 374.13f  // Calibration factor for load cell
 
 // Feed Control Factors
-#define FEED_CALIBRATION_FACTOR 0.9f  // Close hatch at 85% of target
 #define FEED_COMPLETE_FACTOR 0.95f    // Accept 95% of target as complete
 
+// Feed Profiles (dispense model learned per kibble, see feed_profiles.h)
+#define FEED_PROFILE_COUNT 4          // Kibble profiles kept in flash
+#define FEED_PROFILE_NAME_LEN 12      // Profile name incl. terminator
+#define FEED_PROFILE_FORGET 0.9f      // RLS forgetting factor per opening
+#define FEED_PROFILE_FLOW 8.0f        // Prior flow of a new profile (g/s)
+#define FEED_PROFILE_FLOW_VAR 100.0f  // Prior flow variance ((g/s)^2)
+#define FEED_PROFILE_FALL_TIME 0.8f   // Prior fall time, ~10% of 65g (s)
+#define FEED_PROFILE_FALL_VAR 1.0f    // Prior fall time variance (s^2)
+#define FEED_PROFILE_SETTLE_VAR 1.0e6f  // Prior settle variance (ms^2)
+#define FEED_PROFILE_FLOW_MIN 0.5f    // Learned flow limits (g/s)
+#define FEED_PROFILE_FLOW_MAX 100.0f
+#define FEED_PROFILE_FALL_MAX 3.0f    // Longest believable fall time (s)
+#define FEED_PROFILE_SETTLE_MIN 300   // Learned settle time limits (ms)
+#define FEED_PROFILE_SETTLE_MAX 5000
+#define FEED_PROFILE_MIN_GRAMS 2.0f   // Smaller openings are not learned
+#define FEED_PROFILE_STILL_BAND 0.5f  // Reading change that counts as still
+#define FEED_PROFILE_STILL_READS 3    // Still readings in a row = settled
+
+// Hopper inventory (food left in the container, see hopper_inventory.h)
+#define HOPPER_RATE_WEIGHT 0.2f       // Weight of a feed in the rate averages
+#define HOPPER_RATE_MAX_GAP 259200UL  // Longer feed gaps count as 3 days (s)
+#define HOPPER_FLOW_WEIGHT 0.3f       // Weight of a feed in the flow baseline
+#define HOPPER_REFILL_FLOW_JUMP 1.3f  // Flow this far above baseline = refill
+#define HOPPER_REFILL_MAX_LEVEL 0.5f  // ...but only below half full
+#define HOPPER_OVERDRAW_GRAMS 20.0f   // Fed this much more than held = refill
+#define HOPPER_LOW_LEVEL 0.2f         // Warn below 20% of capacity
+
+// Bowl monitor (eating sessions between feeds, see bowl_monitor.h)
+#define BOWL_SAMPLE_INTERVAL 1000      // Weight sample period (ms)
+#define BOWL_TOUCH_GRAMS 3.0f          // Sample this far off the level = touch
+#define BOWL_STILL_BAND 0.5f           // Still = sample-to-sample change (g)
+#define BOWL_SETTLE_SAMPLES 3          // Still samples in a row = new level
+#define BOWL_LEVEL_SAMPLES 10          // Samples averaged into a level
+#define BOWL_CUSUM_DRIFT 0.25f         // CUSUM slack per sample (g)
+#define BOWL_CUSUM_LIMIT 3.0f          // CUSUM alarm for slow changes (g)
+#define BOWL_EAT_MIN_GRAMS 0.3f        // Smallest loss that opens a session
+#define BOWL_SESSION_GAP 90000UL       // No touch this long ends a session (ms)
+#define BOWL_SESSION_MIN_GRAMS 1.0f    // Smaller sessions are dropped
+#define BOWL_ADDED_GRAMS 3.0f          // Gain outside a feed = food added
+#define BOWL_SPILL_GRAMS 15.0f         // Loss this large...
+#define BOWL_SPILL_TOUCHES 2           // ...in this few touches = spilled
+#define BOWL_REMOVED_LEVEL -30.0f      // Below this the bowl is off the scale
+#define BOWL_NO_EATING_MS 86400000UL   // Alert after a day without a meal
+#define BOWL_SESSION_SLOTS 8           // Sessions kept until sent
+
 // Scale Stability Parameters
 #define WEIGHT_STABILITY_THRESHOLD 0.3f  // Maximum variance for stable readings
 #define WEIGHT_READ_INTERVAL 100         // Read weight every 100ms
 #define SCALE_TIMEOUT 3000               // Scale initialization timeout (ms)
-#define SETTLE_FINAL_TIME 2000           // Time to wait for final settling (ms)
+#define SETTLE_FINAL_TIME 2000           // Settle time of a new profile (ms)
+
+// Feeding Journal (power-fail record of the session in progress)
+#define FEED_JOURNAL_FLASH_STEP 5.0f        // Min grams between flash writes
+#define FEED_JOURNAL_FLASH_INTERVAL 2000UL  // Min time between flash writes
+#define FEED_JOURNAL_MAX_CHECKPOINTS 4     // Flash checkpoints per session
+#define FEED_JOURNAL_CREDIT_WINDOW 3600000UL  // Deduct lost grams within 1h
 
 //==============================================================================
 // Button Configuration
 //==============================================================================
-#define BUTTON_DEBOUNCE_TIME 50  // Button debounce time in ms
-#define BUTTON_RELEASE_TIME 10   // Button release check interval in ms
+#define BUTTON_DEBOUNCE_TIME 50      // Level must be stable this long (ms)
+#define BUTTON_LONG_PRESS_TIME 800   // Hold time for a long press (ms)
+#define BUTTON_DOUBLE_PRESS_GAP 300  // Max gap between double presses (ms)
+#define BUTTON_EDGE_QUEUE_SIZE 32    // Raw edges buffered by the interrupt
+#define BUTTON_EVENT_QUEUE_SIZE 4    // Gestures waiting to be handled
+#define MENU_TIMEOUT 15000UL         // Close the menu after inactivity (ms)
 
 //==============================================================================
 // Web Client Configuration
@@ -111,4 +230,116 @@
 #define WEB_RECONNECT_INTERVAL 10000    // Reconnect interval (10 seconds)
 #define WEB_UPDATE_INTERVAL 5000  // Update interval for status (5 seconds)
 
+// Live feeding trace (binary frames while a feed runs, only when watched)
+#define TELEMETRY_MAX_RATE 20        // Frame rate cap (Hz), scale permitting
+#define TELEMETRY_SEND_BUDGET 5000   // Send time that means backpressure (us)
+#define TELEMETRY_MAX_DECIMATION 8   // Slowest rate is 1/8 of the requested
+#define TELEMETRY_RECOVER_SENDS 10   // Fast sends before speeding up a step
+
+// Topic subscriptions (a topic is only published while a dashboard watches)
+#define TOPIC_DEFAULT_INTERVAL 1000  // Topic listed without an interval (ms)
+#define TOPIC_MIN_INTERVAL 50        // Fastest rate a dashboard can ask (ms)
+
+//==============================================================================
+// Boot Configuration
+//==============================================================================
+#define BOOT_MAX_STAGES 6          // Maximum number of boot stages
+#define BOOT_POLL_INTERVAL 20      // Boot stage polling period (ms)
+#define BOOT_STATUS_TIME 1000      // Display time of each boot status (ms)
+#define BOOT_SCALE_TIMEOUT 5000UL  // Scale detection and tare limit (ms)
+#define BOOT_NTP_TIMEOUT 8000UL    // First NTP synchronization limit (ms)
+#define SCALE_TARE_SAMPLES 5       // Raw readings averaged for the tare
+
+//==============================================================================
+// Task Scheduler Configuration
+//==============================================================================
+#define MAX_TASKS 16              // Maximum number of scheduled tasks
+#define SCHEDULER_MAX_IDLE 10000  // Longest single idle sleep (ms)
+#define BUTTON_POLL_INTERVAL 20   // Button polling period (ms)
+#define BACKLIGHT_CHECK_INTERVAL 1000  // Backlight timeout check period (ms)
+#define WEB_LOOP_INTERVAL 10      // WebSocket servicing period (ms)
+#define WEB_HEARTBEAT_INTERVAL 25000   // WebSocket ping period (ms)
+#define WEB_SCHEDULE_REFRESH 60000     // Schedule refresh from server (ms)
+#define SCHEDULER_STATS_INTERVAL 300000UL  // Print task statistics (5 min)
+
+//==============================================================================
+// Power Management
+//==============================================================================
+#define IDLE_MAX_WATCHES 4         // Event-driven tasks woken by the idle hook
+#define IDLE_PARK_INTERVAL 10000UL  // Fallback period of event-driven tasks
+#define IDLE_LIGHT_SLEEP_MIN 300   // Shortest gap worth light sleep (ms)
+#define IDLE_WAKE_CHECK 100        // Watch polling period while asleep (ms)
+#define IDLE_LISTEN_INTERVAL 3     // Beacons skipped in light sleep (DTIM)
+#define IDLE_CURRENT_ACTIVE 70.0f  // Module current running tasks (mA)
+#define IDLE_CURRENT_MODEM 15.0f   // Modem sleep, CPU on (mA)
+#define IDLE_CURRENT_LIGHT 1.5f    // Light sleep incl. beacon wake-ups (mA)
+
+#define CRUMB_RING_SIZE 16         // Breadcrumbs kept across a crash
+
+//==============================================================================
+// Profiler Configuration
+//==============================================================================
+#define PROFILING  // comment to compile out the profiling scopes
+#define PROFILER_MAX_PROBES 10            // Distinct PROFILE_SCOPE names
+#define METRICS_REPORT_INTERVAL 300000UL  // Send "metrics" frame (5 min)
+
+//==============================================================================
+// Feeding Schedule Configuration
+//==============================================================================
+#define MAX_SCHEDULES 10               // Maximum number of stored schedules
+#define SCHEDULE_CHECK_INTERVAL 1000   // Check schedule cursors every second
+#define SCHEDULE_DUE_WINDOW 300UL      // Slot counts as on time for 5 min (s)
+#define SCHEDULE_CATCHUP_MAX_AGE 14400UL  // Ignore slots missed > 4 hours (s)
+#define SCHEDULE_CATCHUP_MIN_PORTION 5.0f  // Skip catch-up portions below (g)
+
+// Missed-schedule policy: 0 = skip, 1 = feed once, 2 = feed proportionally
+#define SCHEDULE_CATCHUP_POLICY 1
+
+// Food already in the bowl at a scheduled feed: 0 = skip from
+// FEED_THRESHOLD, 1 = full portion anyway, 2 = top up to the portion
+#define FEED_TOPUP_POLICY 2
+
+// Scheduled feeds wait while the pet is at the bowl (see feed_gate.h)
+#define FEED_DEFER_FIRST 30UL          // First retry after (s), then doubling
+#define FEED_DEFER_STEP_MAX 300UL      // Longest wait between retries (s)
+#define FEED_DEFER_MAX 1800UL          // Feed anyway after this long (s)
+
+//==============================================================================
+// History Storage (time series on LittleFS)
+//==============================================================================
+#define TSDB_SAMPLE_INTERVAL 10000UL   // Bowl weight sampling period (ms)
+#define TSDB_SYNC_INTERVAL 600000UL    // Rewrite the open blocks (10 min)
+#define TSDB_BLOCK_SIZE 64             // Compressed block size (bytes)
+#define TSDB_WEIGHT_RESOLUTION 0.1f    // Stored weight precision (g)
+#define TSDB_WATER_RESOLUTION 0.1f     // Stored water height precision (cm)
+#define TSDB_PRUNE_BATCH 8             // Old segments deleted per window
+#define TSDB_CHUNK_POINTS 10           // Buckets per "history-data" frame
+#define TSDB_QUERY_MAX_POINTS 500      // Most buckets one query returns
+#define HISTORY_CHUNK_INTERVAL 20      // Gap between streamed chunks (ms)
+
+// Retention and segment file span of each tier (s)
+#define TSDB_RAW_RETENTION 3600UL         // Raw samples for 1 hour
+#define TSDB_RAW_WINDOW 900UL
+#define TSDB_MINUTE_RETENTION 86400UL     // 1-minute rollups for 1 day
+#define TSDB_MINUTE_WINDOW 21600UL
+#define TSDB_QUARTER_RETENTION 7776000UL  // 15-minute rollups for 90 days
+#define TSDB_QUARTER_WINDOW 604800UL
+
+//==============================================================================
+// Persistent Storage Layout
+//==============================================================================
+#define PERSIST_EEPROM_SIZE 1024   // Flash bytes reserved for EEPROM emulation
+#define EEPROM_SCHEDULE_ADDR 0     // Schedule cursors (92 bytes)
+#define EEPROM_JOURNAL_ADDR 128    // Feeding journal (32 bytes)
+#define EEPROM_PROFILES_ADDR 192   // Feed profiles (220 bytes)
+#define EEPROM_HATCH_CAL_ADDR 608  // Hatch calibration (56 bytes)
+#define EEPROM_HOPPER_ADDR 672     // Hopper inventory (40 bytes)
+
+// RTC user memory blocks (4 bytes each, 0-31 are used by the OTA loader)
+#define RTC_WIFI_CACHE_BLOCK 32  // WiFi fast-connect record (9 blocks)
+#define RTC_CRUMB_BLOCK 41       // Crash breadcrumb ring (4 + 2 per crumb)
+#define RTC_JOURNAL_BLOCK 77     // Feeding journal mirror (8 blocks)
+#define RTC_BOWL_BLOCK 85        // Eating session ring (27 blocks)
+#define RTC_FEED_GATE_BLOCK 112  // Deferred scheduled feed (4 blocks)
+
 #endif  // CONFIG_H
\ No newline at end of file
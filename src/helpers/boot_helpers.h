@@ -0,0 +1,206 @@
+#ifndef BOOT_HELPERS_H
+#define BOOT_HELPERS_H
+
+#include <Arduino.h>
+
+#include "../config.h"
+#include "breadcrumbs.h"
+
+// Boot orchestrator. Each setup step is a stage whose step function is polled
+// until it reports done or failed, so slow stages (WiFi association, NTP,
+// scale tare) run side by side from a scheduler task instead of one after the
+// other. Stages marked "required" gate readiness: once they have finished the
+// control loop may act while the rest keep going in the background.
+
+enum BootStatus {
+  BOOT_PENDING = 0,  // Not started (waiting on a dependency)
+  BOOT_RUNNING = 1,
+  BOOT_DONE = 2,
+  BOOT_FAILED = 3,
+  BOOT_SKIPPED = 4   // Dependency failed
+};
+
+// Polled step; starting is true on the first call
+typedef BootStatus (*BootStep)(bool starting);
+
+struct BootStage {
+  const char* name;
+  BootStep step;
+  uint32_t timeout;  // ms from start (0 = stage handles its own)
+  int8_t dependsOn;  // Stage that must be done first (-1 = none)
+  bool required;     // Needed before the system is ready
+  uint8_t status;
+  uint32_t startMs;
+  uint32_t endMs;
+};
+
+static BootStage bootStages[BOOT_MAX_STAGES];
+static uint8_t bootStageCount = 0;
+static uint32_t bootReadyMs = 0;     // millis() when required stages finished
+static uint32_t bootCompleteMs = 0;  // millis() when every stage finished
+
+/**
+ * Register a boot stage
+ * @param name Stage name, must be a string literal
+ * @param step Step function, polled until it returns done or failed
+ * @param required Whether readiness waits for this stage
+ * @param timeout Fail the stage after this many ms (0 = no limit)
+ * @param dependsOn Stage id that must succeed first (-1 = none)
+ * @return Stage id, or -1 if the table is full
+ */
+int8_t bootAddStage(const char* name, BootStep step, bool required,
+                    uint32_t timeout = 0, int8_t dependsOn = -1) {
+  if (bootStageCount >= BOOT_MAX_STAGES) {
+    DEBUG_PRINTLN(F("Boot stage table full!"));
+    return -1;
+  }
+
+  BootStage& stage = bootStages[bootStageCount];
+  memset(&stage, 0, sizeof(BootStage));
+  stage.name = name;
+  stage.step = step;
+  stage.required = required;
+  stage.timeout = timeout;
+  stage.dependsOn = dependsOn;
+  stage.status = BOOT_PENDING;
+  return bootStageCount++;
+}
+
+/**
+ * Short name of a boot status
+ */
+const char* bootStatusName(uint8_t status) {
+  switch (status) {
+    case BOOT_PENDING:
+      return "pending";
+    case BOOT_RUNNING:
+      return "running";
+    case BOOT_DONE:
+      return "done";
+    case BOOT_FAILED:
+      return "failed";
+    default:
+      return "skipped";
+  }
+}
+
+static bool bootFinished(const BootStage& stage) {
+  return stage.status >= BOOT_DONE;
+}
+
+static void bootFinish(BootStage& stage, uint8_t status) {
+  stage.status = status;
+  stage.endMs = millis();
+
+  DEBUG_PRINT(F("Boot stage "));
+  DEBUG_PRINT(stage.name);
+  DEBUG_PRINT(F(" "));
+  DEBUG_PRINT(bootStatusName(status));
+  DEBUG_PRINT(F(" after "));
+  DEBUG_PRINT(stage.endMs - stage.startMs);
+  DEBUG_PRINTLN(F("ms"));
+}
+
+/**
+ * Poll every running stage once and start those whose dependency is met
+ * @return true once every stage has finished
+ */
+bool bootRun() {
+  bool allFinished = true;
+  bool requiredFinished = true;
+
+  for (uint8_t i = 0; i < bootStageCount; i++) {
+    BootStage& stage = bootStages[i];
+
+    if (stage.status == BOOT_PENDING) {
+      if (stage.dependsOn >= 0) {
+        const BootStage& dependency = bootStages[stage.dependsOn];
+        if (dependency.status != BOOT_DONE) {
+          if (bootFinished(dependency)) {
+            stage.startMs = millis();
+            bootFinish(stage, BOOT_SKIPPED);
+          } else {
+            allFinished = false;
+            if (stage.required) requiredFinished = false;
+          }
+          continue;
+        }
+      }
+
+      stage.status = BOOT_RUNNING;
+      stage.startMs = millis();
+      crumbState(CRUMB_BOOT, i);
+      BootStatus status = stage.step(true);
+      if (status >= BOOT_DONE) bootFinish(stage, status);
+    } else if (stage.status == BOOT_RUNNING) {
+      if (stage.timeout > 0 && millis() - stage.startMs >= stage.timeout) {
+        bootFinish(stage, BOOT_FAILED);
+      } else {
+        BootStatus status = stage.step(false);
+        if (status >= BOOT_DONE) bootFinish(stage, status);
+      }
+    }
+
+    if (!bootFinished(stage)) {
+      allFinished = false;
+      if (stage.required) requiredFinished = false;
+    }
+  }
+
+  if (requiredFinished && bootReadyMs == 0) {
+    bootReadyMs = millis();
+    DEBUG_PRINT(F("System ready after "));
+    DEBUG_PRINT(bootReadyMs);
+    DEBUG_PRINTLN(F("ms"));
+  }
+  if (allFinished && bootCompleteMs == 0) {
+    bootCompleteMs = millis();
+    crumbState(CRUMB_NONE, 0);
+  }
+
+  return allFinished;
+}
+
+/**
+ * @return true once all required stages have finished (the feeder is usable)
+ */
+bool bootIsReady() { return bootReadyMs != 0; }
+
+/**
+ * @return true once every stage, including background ones, has finished
+ */
+bool bootIsComplete() { return bootCompleteMs != 0; }
+
+/**
+ * @return true if the stage finished successfully
+ */
+bool bootStageDone(int8_t id) {
+  return id >= 0 && id < bootStageCount && bootStages[id].status == BOOT_DONE;
+}
+
+/**
+ * Print when each stage started and how long it took
+ * @param out Output stream (e.g. Serial)
+ */
+void bootPrintReport(Print& out) {
+  out.print(F("Boot: ready="));
+  out.print(bootReadyMs);
+  out.print(F("ms complete="));
+  out.print(bootCompleteMs);
+  out.println(F("ms"));
+
+  for (uint8_t i = 0; i < bootStageCount; i++) {
+    const BootStage& stage = bootStages[i];
+    out.print(F("  "));
+    out.print(stage.name);
+    out.print(F(": "));
+    out.print(bootStatusName(stage.status));
+    out.print(F(" start="));
+    out.print(stage.startMs);
+    out.print(F(" took="));
+    out.print(bootFinished(stage) ? stage.endMs - stage.startMs : 0);
+    out.println(F("ms"));
+  }
+}
+
+#endif  // BOOT_HELPERS_H
@@ -0,0 +1,349 @@
+#ifndef BOWL_MONITOR_H
+#define BOWL_MONITOR_H
+
+#include <Arduino.h>
+
+#include "../config.h"
+#include "persist_helpers.h"
+
+// Background watch on the bowl between feeds. One scale sample every
+// BOWL_SAMPLE_INTERVAL is split into still segments and disturbances:
+//
+//   still      the reading stays near the segment level (the mean of its
+//              first BOWL_LEVEL_SAMPLES samples). A two-sided CUSUM on the
+//              offset from that level finds slow change points that no
+//              single sample shows.
+//   disturbed  a sample more than BOWL_TOUCH_GRAMS off the level (the pet
+//              pressing on the bowl, every new excursion counts as a bite)
+//              or a CUSUM alarm. It ends after BOWL_SETTLE_SAMPLES still
+//              samples in a row (BOWL_LEVEL_SAMPLES for a gain, a steady
+//              press is not food), whose mean is the new level.
+//
+// The step between two levels says what happened:
+//
+//   loss after a touch    eating. The first opens a session, later steps
+//                         add to it until BOWL_SESSION_GAP without a touch.
+//   large loss, 1-2 taps  spilled, eating that much takes dozens of bites
+//   gain                  food added outside a feed
+//   below REMOVED_LEVEL   bowl lifted off, quiet until it is back
+//   no touch              drift (creep, temperature), the level follows
+//
+// Grams of a session are the sum of its steps, which telescopes to the
+// level before the first bite minus the level after the last one, so noise
+// on single steps does not add up. Feeds and the hatch calibration pause
+// the monitor and restart it on a new baseline (bowlMonitorRebase).
+//
+// Finished sessions go to a ring in RTC memory (12 bytes each, survives a
+// reset) until they are sent. Alerts are pending bits, also for a day
+// without a meal. The per-sample work is a handful of float operations.
+
+enum BowlState {
+  BOWL_STILL = 0,
+  BOWL_DISTURBED = 1,
+  BOWL_REMOVED = 2
+};
+
+enum BowlAlert {
+  BOWL_ALERT_NOT_EATING = 0x01,  // No meal for BOWL_NO_EATING_MS
+  BOWL_ALERT_REMOVED = 0x02,     // Bowl lifted off the scale
+  BOWL_ALERT_SPILLED = 0x04,     // Food knocked out, not eaten
+  BOWL_ALERT_ADDED = 0x08        // Food added outside a feed
+};
+
+struct BowlSession {
+  uint32_t start;      // Local epoch (0 = time unknown)
+  uint16_t durationS;
+  uint16_t decigrams;  // Grams eaten x10
+  uint16_t bites;
+  uint16_t reserved;
+};
+
+struct BowlLog {
+  uint32_t magic;
+  uint8_t head;    // Next slot to write
+  uint8_t count;   // Sessions stored
+  uint8_t unsent;  // Newest sessions not sent yet
+  uint8_t reserved;
+  BowlSession sessions[BOWL_SESSION_SLOTS];
+  uint32_t crc;
+};
+
+struct BowlMonitor {
+  bool started;
+  BowlState state;
+  float level;          // Mean of the current still segment (g)
+  uint8_t levelCount;   // Samples in that mean
+  float cusumUp;
+  float cusumDown;
+  float prev;           // Previous sample
+
+  // Disturbance in progress
+  uint32_t disturbedAt;
+  float settleSum;      // Still samples in a row since the last move
+  uint8_t settleCount;
+  bool touched;         // A touch, not only a CUSUM alarm
+  bool above;           // Current sample is off by more than a touch
+  uint16_t dips;        // Touches in this disturbance
+  bool rebase;          // The next level is a new baseline
+
+  // Eating session in progress
+  bool eating;
+  uint32_t sessionStartMs;
+  uint32_t sessionStartEpoch;
+  uint32_t lastTouchMs;
+  float sessionGrams;
+  uint16_t sessionBites;
+
+  uint32_t lastMealMs;  // End of the last session (or the start)
+  uint8_t alerts;       // Pending BowlAlert bits
+  float alertGrams;     // Step of the last spilled/added alert
+};
+
+static const uint32_t BOWL_LOG_MAGIC = 0x424F574C;  // "BOWL"
+
+static BowlMonitor bowl;
+static BowlLog bowlLog;
+static bool bowlLogLoaded = false;
+
+/**
+ * Load the session ring kept across resets (safe to call repeatedly)
+ */
+void bowlLogBegin() {
+  if (bowlLogLoaded) return;
+  bowlLogLoaded = true;
+
+  if (!rtcLoad(RTC_BOWL_BLOCK, bowlLog) || bowlLog.magic != BOWL_LOG_MAGIC ||
+      bowlLog.head >= BOWL_SESSION_SLOTS) {
+    memset(&bowlLog, 0, sizeof(bowlLog));
+    bowlLog.magic = BOWL_LOG_MAGIC;
+  }
+}
+
+/**
+ * Close the session in progress, keeping it if enough was eaten
+ */
+static void bowlEndSession() {
+  if (!bowl.eating) return;
+  bowl.eating = false;
+  bowl.lastMealMs = bowl.lastTouchMs;
+  if (bowl.sessionGrams < BOWL_SESSION_MIN_GRAMS) return;
+
+  bowlLogBegin();
+  BowlSession& session = bowlLog.sessions[bowlLog.head];
+  session.start = bowl.sessionStartEpoch;
+  session.durationS = min((bowl.lastTouchMs - bowl.sessionStartMs) / 1000,
+                          (uint32_t)UINT16_MAX);
+  session.decigrams = min(bowl.sessionGrams * 10, (float)UINT16_MAX);
+  session.bites = bowl.sessionBites;
+  session.reserved = 0;
+
+  bowlLog.head = (bowlLog.head + 1) % BOWL_SESSION_SLOTS;
+  if (bowlLog.count < BOWL_SESSION_SLOTS) bowlLog.count++;
+  if (bowlLog.unsent < BOWL_SESSION_SLOTS) bowlLog.unsent++;
+  rtcSave(RTC_BOWL_BLOCK, bowlLog);
+}
+
+/**
+ * Start waiting for a new level
+ */
+static void bowlDisturb(float sample, uint32_t now, bool touched) {
+  bowl.state = BOWL_DISTURBED;
+  bowl.disturbedAt = now;
+  bowl.settleSum = sample;
+  bowl.settleCount = 1;
+  bowl.touched = touched;
+  bowl.above = touched;
+  bowl.dips = touched ? 1 : 0;
+  if (touched) bowl.lastTouchMs = now;
+}
+
+/**
+ * Restart on a new baseline, e.g. after a feed put food in the bowl. A
+ * session in progress ends.
+ */
+void bowlMonitorRebase() {
+  bowlEndSession();
+  bowl.rebase = true;
+  bowl.state = BOWL_DISTURBED;
+  bowl.settleCount = 0;
+  bowl.touched = false;
+  bowl.dips = 0;
+}
+
+/**
+ * Classify the step to a new level at the end of a disturbance
+ * @param level New level (g)
+ * @param now millis()
+ * @param epoch Local epoch (0 if time is not set)
+ */
+static void bowlSettled(float level, uint32_t now, uint32_t epoch) {
+  float step = level - bowl.level;
+
+  if (level < BOWL_REMOVED_LEVEL) {
+    bowlEndSession();
+    bowl.state = BOWL_REMOVED;
+    bowl.alerts |= BOWL_ALERT_REMOVED;
+    return;
+  }
+
+  if (bowl.rebase) {
+    // New baseline, nothing to classify
+  } else if (step > BOWL_ADDED_GRAMS) {
+    bowl.alerts |= BOWL_ALERT_ADDED;
+    bowl.alertGrams = step;
+  } else if (step < -BOWL_SPILL_GRAMS &&
+             bowl.dips <= BOWL_SPILL_TOUCHES) {
+    bowlEndSession();
+    bowl.alerts |= BOWL_ALERT_SPILLED;
+    bowl.alertGrams = -step;
+  } else if (bowl.eating) {
+    // Every step of a session counts, so they telescope
+    bowl.sessionGrams -= step;
+    bowl.sessionBites += bowl.dips;
+  } else if (bowl.touched && step <= -BOWL_EAT_MIN_GRAMS) {
+    bowl.eating = true;
+    bowl.sessionStartMs = bowl.disturbedAt;
+    bowl.sessionStartEpoch =
+        epoch > 0 ? epoch - (now - bowl.disturbedAt) / 1000 : 0;
+    bowl.sessionGrams = -step;
+    bowl.sessionBites = bowl.dips;
+  }
+
+  bowl.state = BOWL_STILL;
+  bowl.level = level;
+  bowl.levelCount = bowl.settleCount;
+  bowl.cusumUp = 0;
+  bowl.cusumDown = 0;
+  bowl.rebase = false;
+}
+
+/**
+ * Feed one weight sample to the monitor
+ * @param sample Bowl reading (g)
+ * @param now millis()
+ * @param epoch Local epoch (0 if time is not set)
+ */
+void bowlMonitorSample(float sample, uint32_t now, uint32_t epoch) {
+  if (!bowl.started) {
+    bowl.started = true;
+    bowl.lastMealMs = now;
+    bowl.prev = sample;
+    bowlMonitorRebase();
+  }
+
+  float offset = sample - bowl.level;
+  bool still = fabs(sample - bowl.prev) <= BOWL_STILL_BAND;
+  bowl.prev = sample;
+
+  if (bowl.state == BOWL_REMOVED) {
+    if (sample > BOWL_REMOVED_LEVEL) {
+      bowlMonitorRebase();
+      bowlDisturb(sample, now, false);
+    }
+    return;
+  }
+
+  if (bowl.state == BOWL_STILL) {
+    bowl.cusumUp = max(0.0f, bowl.cusumUp + offset - BOWL_CUSUM_DRIFT);
+    bowl.cusumDown = max(0.0f, bowl.cusumDown - offset - BOWL_CUSUM_DRIFT);
+
+    bool touched = fabs(offset) > BOWL_TOUCH_GRAMS;
+    if (touched || bowl.cusumUp > BOWL_CUSUM_LIMIT ||
+        bowl.cusumDown > BOWL_CUSUM_LIMIT) {
+      bowlDisturb(sample, now, touched);
+    } else if (bowl.levelCount < BOWL_LEVEL_SAMPLES) {
+      bowl.levelCount++;
+      bowl.level += offset / bowl.levelCount;
+    }
+  } else {
+    // Count every new excursion, the pet dipping into the bowl
+    bool above = !bowl.rebase && fabs(offset) > BOWL_TOUCH_GRAMS;
+    if (above && !bowl.above) {
+      bowl.dips++;
+      bowl.touched = true;
+    }
+    if (above) bowl.lastTouchMs = now;
+    bowl.above = above;
+
+    if (still && bowl.settleCount > 0) {
+      bowl.settleSum += sample;
+      bowl.settleCount++;
+    } else {
+      bowl.settleSum = sample;
+      bowl.settleCount = 1;
+    }
+    // A paw resting on the rim looks like a gain, so gains hold longer
+    float settled = bowl.settleSum / bowl.settleCount;
+    uint8_t needed = settled - bowl.level > BOWL_ADDED_GRAMS && !bowl.rebase
+                         ? BOWL_LEVEL_SAMPLES
+                         : BOWL_SETTLE_SAMPLES;
+    if (bowl.settleCount >= needed) bowlSettled(settled, now, epoch);
+  }
+
+  if (bowl.eating && bowl.state == BOWL_STILL &&
+      now - bowl.lastTouchMs >= BOWL_SESSION_GAP) {
+    bowlEndSession();
+  }
+  if (!bowl.eating && now - bowl.lastMealMs >= BOWL_NO_EATING_MS) {
+    bowl.alerts |= BOWL_ALERT_NOT_EATING;
+    bowl.lastMealMs = now;  // Again after another day
+  }
+}
+
+/**
+ * @return true while a session is in progress or the bowl is being touched
+ */
+bool bowlBusy() { return bowl.eating || bowl.state != BOWL_STILL; }
+
+/**
+ * Oldest session not sent yet
+ * @param session Filled in if there is one
+ * @return false if all sessions were sent
+ */
+bool bowlNextUnsent(BowlSession& session) {
+  bowlLogBegin();
+  if (bowlLog.unsent == 0) return false;
+  uint8_t index = (bowlLog.head + BOWL_SESSION_SLOTS - bowlLog.unsent) %
+                  BOWL_SESSION_SLOTS;
+  session = bowlLog.sessions[index];
+  return true;
+}
+
+/**
+ * Mark the oldest unsent session as sent
+ */
+void bowlMarkSent() {
+  if (bowlLog.unsent == 0) return;
+  bowlLog.unsent--;
+  rtcSave(RTC_BOWL_BLOCK, bowlLog);
+}
+
+/**
+ * Take the pending alerts
+ * @return BowlAlert bits raised since the last call
+ */
+uint8_t bowlTakeAlerts() {
+  uint8_t alerts = bowl.alerts;
+  bowl.alerts = 0;
+  return alerts;
+}
+
+/**
+ * @return Name of a BowlAlert bit, as sent to the server
+ */
+const char* bowlAlertName(uint8_t alert) {
+  switch (alert) {
+    case BOWL_ALERT_NOT_EATING:
+      return "not-eating";
+    case BOWL_ALERT_REMOVED:
+      return "removed";
+    case BOWL_ALERT_SPILLED:
+      return "spilled";
+    case BOWL_ALERT_ADDED:
+      return "added";
+    default:
+      return "unknown";
+  }
+}
+
+#endif  // BOWL_MONITOR_H
@@ -0,0 +1,258 @@
+#ifndef BREADCRUMBS_H
+#define BREADCRUMBS_H
+
+#include <Arduino.h>
+
+#include "../config.h"
+
+// Crash forensics. Every scheduler task start and every state change of the
+// long-running paths (feeding, water refill, WiFi connect, boot stages) drops
+// a breadcrumb into a ring in RTC user memory, which survives watchdog and
+// exception resets. After such a reset crumbBegin() keeps the previous ring
+// together with the reset reason so it can be printed and uploaded as a
+// "crash-report" frame.
+//
+// A crumb costs a handful of RTC word writes and no CRC: a reset in the
+// middle of a write tears at most the newest crumb.
+
+enum CrumbKind {
+  CRUMB_TASK = 1,  // Scheduler task started (code = task id)
+  CRUMB_STATE = 2  // Subsystem entered a state (code = subsystem)
+};
+
+enum CrumbSubsystem {
+  CRUMB_NONE = 0,
+  CRUMB_BOOT = 1,     // state = stage id
+  CRUMB_FEEDING = 2,  // state = feeding step
+  CRUMB_WATER = 3,    // state = water state machine
+  CRUMB_WIFI = 4      // state = WifiConnectMode
+};
+
+static const uint32_t CRUMB_MAGIC = 0x43524D31;  // "CRM1"
+
+struct CrumbHeader {
+  uint32_t magic;
+  uint16_t bootCount;
+  uint8_t subsystem;     // Subsystem active at the last state change
+  uint8_t head;          // Next ring slot
+  uint16_t state;
+  uint16_t count;        // Crumbs in the ring (up to CRUMB_RING_SIZE)
+  uint32_t stateSince;   // millis() of the last state change
+};
+
+struct Crumb {
+  uint8_t kind;   // CrumbKind
+  uint8_t code;   // Task id or subsystem
+  uint16_t arg;   // State for CRUMB_STATE
+  uint32_t ms;    // millis() when recorded
+};
+
+static const uint32_t CRUMB_HEADER_BLOCKS = sizeof(CrumbHeader) / 4;
+static const uint32_t CRUMB_BLOCKS = sizeof(Crumb) / 4;
+
+static CrumbHeader crumbHeader;
+static bool crumbStarted = false;
+
+// Previous boot, kept when it ended in a crash
+static CrumbHeader crumbPrevHeader;
+static Crumb crumbPrev[CRUMB_RING_SIZE];  // Oldest first
+static uint8_t crumbPrevCount = 0;
+static bool crumbPrevValid = false;
+static uint32_t crumbResetReason = 0;
+static uint32_t crumbExcCause = 0;
+static uint32_t crumbEpc1 = 0;
+static uint32_t crumbExcVaddr = 0;
+
+/**
+ * @return true if the last reset was a watchdog or an exception
+ */
+bool crumbLastResetWasCrash() {
+  return crumbResetReason == REASON_WDT_RST ||
+         crumbResetReason == REASON_EXCEPTION_RST ||
+         crumbResetReason == REASON_SOFT_WDT_RST;
+}
+
+/**
+ * Keep the previous boot's trail if it crashed, then start a fresh ring
+ * (call first thing in setup(), safe to call again)
+ */
+void crumbBegin() {
+  if (crumbStarted) return;
+  crumbStarted = true;
+
+  rst_info* info = ESP.getResetInfoPtr();
+  crumbResetReason = info->reason;
+  crumbExcCause = info->exccause;
+  crumbEpc1 = info->epc1;
+  crumbExcVaddr = info->excvaddr;
+
+  uint16_t bootCount = 0;
+  if (ESP.rtcUserMemoryRead(RTC_CRUMB_BLOCK, (uint32_t*)&crumbPrevHeader,
+                            sizeof(CrumbHeader)) &&
+      crumbPrevHeader.magic == CRUMB_MAGIC &&
+      crumbPrevHeader.head < CRUMB_RING_SIZE &&
+      crumbPrevHeader.count <= CRUMB_RING_SIZE) {
+    bootCount = crumbPrevHeader.bootCount + 1;
+
+    if (crumbLastResetWasCrash()) {
+      Crumb ring[CRUMB_RING_SIZE];
+      ESP.rtcUserMemoryRead(RTC_CRUMB_BLOCK + CRUMB_HEADER_BLOCKS,
+                            (uint32_t*)ring, sizeof(ring));
+
+      // Unroll so the oldest crumb comes first
+      crumbPrevCount = crumbPrevHeader.count;
+      uint8_t first = (crumbPrevHeader.head + CRUMB_RING_SIZE -
+                       crumbPrevCount) % CRUMB_RING_SIZE;
+      for (uint8_t i = 0; i < crumbPrevCount; i++) {
+        crumbPrev[i] = ring[(first + i) % CRUMB_RING_SIZE];
+      }
+      crumbPrevValid = true;
+    }
+  }
+
+  memset(&crumbHeader, 0, sizeof(crumbHeader));
+  crumbHeader.magic = CRUMB_MAGIC;
+  crumbHeader.bootCount = bootCount;
+  ESP.rtcUserMemoryWrite(RTC_CRUMB_BLOCK, (uint32_t*)&crumbHeader,
+                         sizeof(CrumbHeader));
+}
+
+/**
+ * Append a crumb and update the header words that changed
+ */
+static void crumbWrite(uint8_t kind, uint8_t code, uint16_t arg) {
+  if (!crumbStarted) return;
+
+  Crumb crumb = {kind, code, arg, (uint32_t)millis()};
+  ESP.rtcUserMemoryWrite(
+      RTC_CRUMB_BLOCK + CRUMB_HEADER_BLOCKS + crumbHeader.head * CRUMB_BLOCKS,
+      (uint32_t*)&crumb, sizeof(crumb));
+
+  crumbHeader.head = (crumbHeader.head + 1) % CRUMB_RING_SIZE;
+  if (crumbHeader.count < CRUMB_RING_SIZE) crumbHeader.count++;
+
+  if (kind == CRUMB_STATE) {
+    crumbHeader.subsystem = code;
+    crumbHeader.state = arg;
+    crumbHeader.stateSince = crumb.ms;
+    ESP.rtcUserMemoryWrite(RTC_CRUMB_BLOCK + 1, (uint32_t*)&crumbHeader + 1,
+                           sizeof(CrumbHeader) - 4);
+  } else {
+    // Only head and count (second and third words) changed
+    ESP.rtcUserMemoryWrite(RTC_CRUMB_BLOCK + 1, (uint32_t*)&crumbHeader + 1,
+                           8);
+  }
+}
+
+/**
+ * Record a scheduler task start
+ * @param taskId Scheduler task id
+ */
+void crumbTask(uint8_t taskId) { crumbWrite(CRUMB_TASK, taskId, 0); }
+
+/**
+ * Record that a subsystem entered a state
+ * @param subsystem One of CrumbSubsystem
+ * @param state Subsystem specific state or step
+ */
+void crumbState(uint8_t subsystem, uint16_t state) {
+  crumbWrite(CRUMB_STATE, subsystem, state);
+}
+
+// Marks a subsystem busy for the lifetime of a block, steps inside it call
+// crumbState() with the same subsystem
+class CrumbScope {
+ public:
+  explicit CrumbScope(uint8_t subsystem) { crumbState(subsystem, 0); }
+  ~CrumbScope() { crumbState(CRUMB_NONE, 0); }
+};
+
+/**
+ * @return true if a crash trail from the previous boot is waiting
+ */
+bool crumbHasReport() { return crumbPrevValid; }
+
+/**
+ * Forget the crash trail once it has been uploaded
+ */
+void crumbClearReport() { crumbPrevValid = false; }
+
+/**
+ * Short name of a subsystem
+ */
+const char* crumbSubsystemName(uint8_t subsystem) {
+  switch (subsystem) {
+    case CRUMB_BOOT:
+      return "boot";
+    case CRUMB_FEEDING:
+      return "feeding";
+    case CRUMB_WATER:
+      return "water";
+    case CRUMB_WIFI:
+      return "wifi";
+    default:
+      return "none";
+  }
+}
+
+/**
+ * Short name of a reset reason
+ */
+const char* crumbResetName(uint32_t reason) {
+  switch (reason) {
+    case REASON_WDT_RST:
+      return "hardware-wdt";
+    case REASON_EXCEPTION_RST:
+      return "exception";
+    case REASON_SOFT_WDT_RST:
+      return "software-wdt";
+    case REASON_SOFT_RESTART:
+      return "restart";
+    case REASON_DEEP_SLEEP_AWAKE:
+      return "deep-sleep";
+    case REASON_EXT_SYS_RST:
+      return "external";
+    default:
+      return "power-on";
+  }
+}
+
+/**
+ * Print the previous boot's crash trail
+ * @param out Output stream (e.g. Serial)
+ * @param taskName Maps a task id to its name (ids are stable across boots)
+ */
+void crumbPrintReport(Print& out, const char* (*taskName)(uint8_t)) {
+  out.print(F("Reset: "));
+  out.print(crumbResetName(crumbResetReason));
+  if (!crumbPrevValid) {
+    out.println();
+    return;
+  }
+
+  out.print(F(" exccause="));
+  out.print(crumbExcCause);
+  out.print(F(" epc1=0x"));
+  out.print(crumbEpc1, HEX);
+  out.print(F(" in "));
+  out.print(crumbSubsystemName(crumbPrevHeader.subsystem));
+  out.print(F("/"));
+  out.println(crumbPrevHeader.state);
+
+  for (uint8_t i = 0; i < crumbPrevCount; i++) {
+    const Crumb& crumb = crumbPrev[i];
+    out.print(F("  "));
+    out.print(crumb.ms);
+    out.print(F("ms "));
+    if (crumb.kind == CRUMB_TASK) {
+      out.print(F("task "));
+      out.println(taskName(crumb.code));
+    } else {
+      out.print(crumbSubsystemName(crumb.code));
+      out.print(F(" -> "));
+      out.println(crumb.arg);
+    }
+  }
+}
+
+#endif  // BREADCRUMBS_H
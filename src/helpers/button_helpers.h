@@ -0,0 +1,330 @@
+#ifndef BUTTON_HELPERS_H
+#define BUTTON_HELPERS_H
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <cstdint>
+#endif
+
+#include "../config.h"
+#include "../pins.h"
+
+// Interrupt-driven button driver. The GPIO interrupt only timestamps edges
+// into a ring; buttonUpdate() (a scheduler task) replays them through a
+// debounce state machine and turns clean presses into events:
+//
+//   BUTTON_PRESS        short press, sent once the double-press gap expires
+//   BUTTON_LONG_PRESS   held for BUTTON_LONG_PRESS_TIME (sent while held)
+//   BUTTON_DOUBLE_PRESS second short press within BUTTON_DOUBLE_PRESS_GAP
+//
+// Edges carry their own timestamps, so a late buttonUpdate() (e.g. during a
+// feeding) still measures press lengths correctly. The state machine does not
+// touch hardware and can be fed synthetic edges with buttonFeedEdge().
+
+#ifndef IRAM_ATTR
+#define IRAM_ATTR
+#endif
+
+enum ButtonEventType {
+  BUTTON_PRESS = 0,
+  BUTTON_LONG_PRESS = 1,
+  BUTTON_DOUBLE_PRESS = 2
+};
+
+struct ButtonEvent {
+  uint8_t type;   // One of ButtonEventType
+  uint32_t time;  // millis() when the gesture was recognised
+};
+
+// Raw edges written by the interrupt, read by buttonUpdate()
+static volatile uint32_t buttonEdgeTime[BUTTON_EDGE_QUEUE_SIZE];
+static volatile bool buttonEdgeLevel[BUTTON_EDGE_QUEUE_SIZE];
+static volatile uint8_t buttonEdgeHead = 0;
+static volatile uint8_t buttonEdgeTail = 0;
+static volatile bool buttonEdgeOverflow = false;
+
+// Debounce state (true = pressed)
+static bool buttonStable = false;
+static bool buttonCandidate = false;
+static uint32_t buttonCandidateSince = 0;
+static uint32_t buttonPressedAt = 0;
+static uint32_t buttonReleasedAt = 0;
+static uint32_t buttonLastChange = 0;
+static bool buttonLongSent = false;
+static bool buttonClickPending = false;
+
+// Recognised gestures
+static ButtonEvent buttonEvents[BUTTON_EVENT_QUEUE_SIZE];
+static uint8_t buttonEventHead = 0;
+static uint8_t buttonEventCount = 0;
+
+/**
+ * Store a raw edge (interrupt context)
+ * @param pressed Button level after the edge
+ * @param time millis() of the edge
+ */
+void IRAM_ATTR buttonFeedEdge(bool pressed, uint32_t time) {
+  uint8_t next = (buttonEdgeHead + 1) % BUTTON_EDGE_QUEUE_SIZE;
+  if (next == buttonEdgeTail) {
+    buttonEdgeOverflow = true;
+    return;
+  }
+
+  buttonEdgeTime[buttonEdgeHead] = time;
+  buttonEdgeLevel[buttonEdgeHead] = pressed;
+  buttonEdgeHead = next;
+}
+
+/**
+ * Add a gesture to the event queue, dropping the oldest if full
+ */
+static void buttonEmit(uint8_t type, uint32_t time) {
+  if (buttonEventCount >= BUTTON_EVENT_QUEUE_SIZE) {
+    buttonEventHead = (buttonEventHead + 1) % BUTTON_EVENT_QUEUE_SIZE;
+    buttonEventCount--;
+  }
+
+  uint8_t slot = (buttonEventHead + buttonEventCount) % BUTTON_EVENT_QUEUE_SIZE;
+  ButtonEvent& event = buttonEvents[slot];
+  event.type = type;
+  event.time = time;
+  buttonEventCount++;
+}
+
+/**
+ * Send a waiting single press once no second press can follow
+ */
+static void buttonExpireClick(uint32_t now) {
+  if (buttonClickPending &&
+      now - buttonReleasedAt > BUTTON_DOUBLE_PRESS_GAP) {
+    buttonClickPending = false;
+    buttonEmit(BUTTON_PRESS, buttonReleasedAt + BUTTON_DOUBLE_PRESS_GAP);
+  }
+}
+
+/**
+ * Send a long press while the button is still held
+ */
+static void buttonCheckLong(uint32_t now) {
+  if (!buttonStable || buttonLongSent ||
+      now - buttonPressedAt < BUTTON_LONG_PRESS_TIME) {
+    return;
+  }
+
+  // A short press just before a hold is its own gesture
+  if (buttonClickPending) {
+    buttonClickPending = false;
+    buttonEmit(BUTTON_PRESS, buttonPressedAt);
+  }
+
+  buttonLongSent = true;
+  buttonEmit(BUTTON_LONG_PRESS, buttonPressedAt + BUTTON_LONG_PRESS_TIME);
+}
+
+/**
+ * Apply a debounced level change
+ * @param pressed New stable level
+ * @param time When the level became stable (last edge of the bounce burst)
+ */
+static void buttonCommit(bool pressed, uint32_t time) {
+  buttonStable = pressed;
+  buttonLastChange = time;
+
+  if (pressed) {
+    // The double-press gap runs from the first release to this press
+    buttonExpireClick(time);
+    buttonPressedAt = time;
+    buttonLongSent = false;
+    return;
+  }
+
+  // Released - a hold that was only seen now still counts as long
+  buttonCheckLong(time);
+  if (buttonLongSent) return;
+
+  if (buttonClickPending) {
+    buttonClickPending = false;
+    buttonEmit(BUTTON_DOUBLE_PRESS, time);
+  } else {
+    buttonClickPending = true;
+    buttonReleasedAt = time;
+  }
+}
+
+/**
+ * Commit the candidate level if it has been stable long enough
+ * @param until Time up to which the candidate is known to hold
+ */
+static void buttonSettle(uint32_t until) {
+  if (buttonCandidate != buttonStable &&
+      until - buttonCandidateSince >= BUTTON_DEBOUNCE_TIME) {
+    buttonCommit(buttonCandidate, buttonCandidateSince);
+  }
+}
+
+/**
+ * Replay queued edges and advance the timers (no hardware access)
+ * @param now Current millis()
+ */
+void buttonService(uint32_t now) {
+  while (buttonEdgeTail != buttonEdgeHead) {
+    uint32_t time = buttonEdgeTime[buttonEdgeTail];
+    bool level = buttonEdgeLevel[buttonEdgeTail];
+    buttonEdgeTail = (buttonEdgeTail + 1) % BUTTON_EDGE_QUEUE_SIZE;
+
+    // The previous level lasted until this edge
+    buttonSettle(time);
+    buttonCheckLong(time);
+
+    // Every edge of a bounce burst restarts the stability timer
+    buttonCandidate = level;
+    buttonCandidateSince = time;
+  }
+
+  buttonSettle(now);
+  buttonCheckLong(now);
+
+  // A second press that is held or still settling decides the pending
+  // click when it commits, with its own edge time
+  if (!buttonStable && buttonCandidate == buttonStable) buttonExpireClick(now);
+}
+
+/**
+ * Take the oldest recognised gesture
+ * @param event Filled with the gesture
+ * @return true if an event was available
+ */
+bool buttonPollEvent(ButtonEvent& event) {
+  if (buttonEventCount == 0) return false;
+
+  event = buttonEvents[buttonEventHead];
+  buttonEventHead = (buttonEventHead + 1) % BUTTON_EVENT_QUEUE_SIZE;
+  buttonEventCount--;
+  return true;
+}
+
+/**
+ * Discard gestures that nobody has consumed yet
+ */
+void buttonClearEvents() {
+  buttonEventHead = 0;
+  buttonEventCount = 0;
+  buttonClickPending = false;
+}
+
+/**
+ * @return true while the button is held (debounced)
+ */
+bool buttonIsPressed() { return buttonStable; }
+
+/**
+ * @return millis() of the last debounced press or release (user activity)
+ */
+uint32_t buttonLastActivity() { return buttonLastChange; }
+
+/**
+ * @return true if edges are waiting for buttonUpdate()
+ */
+bool buttonEdgesPending() { return buttonEdgeTail != buttonEdgeHead; }
+
+/**
+ * @return true while a gesture is in progress and the timers need polling
+ * (bounce settling, button held, or a press waiting for a second one)
+ */
+bool buttonBusy() {
+  return buttonEdgesPending() || buttonCandidate != buttonStable ||
+         buttonStable || buttonClickPending;
+}
+
+#ifdef ARDUINO
+extern "C" {
+#include <user_interface.h>
+}
+
+static uint32_t buttonEdgesDropped = 0;  // Ring overflows (resynchronised)
+static volatile bool buttonWakeArmed = false;  // Pin is on a level interrupt
+
+/**
+ * Put the pin back on the edge interrupt (interrupt context)
+ */
+static inline void IRAM_ATTR buttonRestoreEdgeIrq() {
+  uint32_t config = GPC(MANUAL_FEED_BUTTON_PIN);
+  config &= ~((7UL << GPCI) | (1UL << GPCWE));
+  GPC(MANUAL_FEED_BUTTON_PIN) = config | ((uint32_t)CHANGE << GPCI);
+  buttonWakeArmed = false;
+}
+
+static void IRAM_ATTR buttonIsr() {
+  // The wake-up level interrupt fires for as long as the button is held
+  if (buttonWakeArmed) buttonRestoreEdgeIrq();
+
+  buttonFeedEdge(digitalRead(MANUAL_FEED_BUTTON_PIN) == LOW, millis());
+}
+
+/**
+ * Configure the button pin and attach the edge interrupt
+ */
+void buttonBegin() {
+  pinMode(MANUAL_FEED_BUTTON_PIN, INPUT_PULLUP);
+  buttonStable = buttonCandidate =
+      (digitalRead(MANUAL_FEED_BUTTON_PIN) == LOW);
+  attachInterrupt(digitalPinToInterrupt(MANUAL_FEED_BUTTON_PIN), buttonIsr,
+                  CHANGE);
+}
+
+/**
+ * Process pending edges. Call every BUTTON_POLL_INTERVAL and inside long
+ * blocking loops that wait for the button.
+ */
+void buttonUpdate() {
+  buttonService(millis());
+
+  // Edges were lost while the ring was full - resynchronise from the pin.
+  // buttonFeedEdge() also runs in the ISR, which must not move the head
+  // under us.
+  if (buttonEdgeOverflow) {
+    noInterrupts();
+    buttonEdgeOverflow = false;
+    buttonFeedEdge(digitalRead(MANUAL_FEED_BUTTON_PIN) == LOW, millis());
+    interrupts();
+
+    buttonEdgesDropped++;
+    buttonService(millis());
+  }
+}
+
+/**
+ * Let a press wake the CPU from light sleep. Only a level interrupt wakes
+ * the chip, so the pin waits for "low" until the first press (or
+ * buttonDisarmWake()) restores the edge interrupt.
+ */
+void buttonArmWake() {
+  if (buttonWakeArmed || digitalRead(MANUAL_FEED_BUTTON_PIN) == LOW) return;
+
+  buttonWakeArmed = true;
+  wifi_enable_gpio_wakeup(MANUAL_FEED_BUTTON_PIN, GPIO_PIN_INTR_LOLEVEL);
+}
+
+/**
+ * Back to edge interrupts after light sleep
+ */
+void buttonDisarmWake() {
+  wifi_disable_gpio_wakeup();
+
+  // An edge that raced the switch-over is picked up from the pin. The ISR
+  // writes the same ring, so the check and the push are one critical
+  // section.
+  noInterrupts();
+  if (buttonWakeArmed) buttonRestoreEdgeIrq();
+
+  uint8_t newest =
+      (buttonEdgeHead + BUTTON_EDGE_QUEUE_SIZE - 1) % BUTTON_EDGE_QUEUE_SIZE;
+  bool last = buttonEdgesPending() ? buttonEdgeLevel[newest] : buttonCandidate;
+  bool level = digitalRead(MANUAL_FEED_BUTTON_PIN) == LOW;
+  if (level != last) buttonFeedEdge(level, millis());
+  interrupts();
+}
+#endif
+
+#endif  // BUTTON_HELPERS_H
@@ -0,0 +1,151 @@
+#ifndef CONNECTIVITY_H
+#define CONNECTIVITY_H
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+
+#include "../config.h"
+
+// Connectivity state kept up to date by the WiFi event callbacks and the
+// WebSocket connect/disconnect events, so senders read a cached byte instead
+// of querying WiFi.status() before every message. The state and the
+// timestamps are single aligned words written from one context, so they can
+// be read at any time without locking.
+
+enum NetState {
+  NET_OFFLINE = 0,  // No WiFi
+  NET_WIFI = 1,     // WiFi up, server not connected
+  NET_ONLINE = 2    // WiFi and server connected
+};
+
+// Outage accounting for one link
+struct NetLinkStats {
+  bool up;
+  uint32_t changedAt;   // millis() of the last transition
+  uint32_t outages;     // Up -> down transitions
+  uint32_t lastOutageMs;
+  uint32_t maxOutageMs;
+  uint32_t totalOutageMs;
+};
+
+static volatile uint8_t netState = NET_OFFLINE;
+static NetLinkStats netWifi;
+static NetLinkStats netServer;
+
+// Handlers stay registered only while these objects live
+static WiFiEventHandler netGotIpHandler;
+static WiFiEventHandler netDisconnectedHandler;
+
+static void netUpdateState() {
+  netState = !netWifi.up     ? NET_OFFLINE
+             : netServer.up ? NET_ONLINE
+                            : NET_WIFI;
+}
+
+/**
+ * Record a link transition and the length of the outage it ends
+ */
+static void netSetLink(NetLinkStats& link, bool up) {
+  if (link.up == up) return;
+
+  uint32_t now = millis();
+  if (up && link.outages > 0) {
+    uint32_t outage = now - link.changedAt;
+    link.lastOutageMs = outage;
+    link.totalOutageMs += outage;
+    if (outage > link.maxOutageMs) link.maxOutageMs = outage;
+  } else if (!up) {
+    link.outages++;
+  }
+
+  link.up = up;
+  link.changedAt = now;
+  netUpdateState();
+}
+
+/**
+ * Update the WiFi link (from the station event callbacks)
+ */
+void netSetWifi(bool up) {
+  netSetLink(netWifi, up);
+
+  // The server connection cannot outlive the WiFi link
+  if (!up) netSetLink(netServer, false);
+}
+
+/**
+ * Update the server link (from the WebSocket event handler)
+ */
+void netSetServer(bool up) { netSetLink(netServer, up && netWifi.up); }
+
+/**
+ * Register the WiFi event callbacks (call once before connecting)
+ */
+void netBegin() {
+  if (netGotIpHandler) return;
+
+  netGotIpHandler = WiFi.onStationModeGotIP(
+      [](const WiFiEventStationModeGotIP&) { netSetWifi(true); });
+  netDisconnectedHandler = WiFi.onStationModeDisconnected(
+      [](const WiFiEventStationModeDisconnected&) { netSetWifi(false); });
+
+  netWifi.changedAt = netServer.changedAt = millis();
+  netSetWifi(WiFi.status() == WL_CONNECTED);
+}
+
+/**
+ * @return Current NetState
+ */
+uint8_t netGetState() { return netState; }
+
+/**
+ * @return true if WiFi has an IP address
+ */
+bool netWifiUp() { return netState != NET_OFFLINE; }
+
+/**
+ * @return true if WiFi and the server connection are both up
+ */
+bool netOnline() { return netState == NET_ONLINE; }
+
+/**
+ * @return Short name of the current state
+ */
+const char* netStateName() {
+  switch (netState) {
+    case NET_ONLINE:
+      return "online";
+    case NET_WIFI:
+      return "wifi";
+    default:
+      return "offline";
+  }
+}
+
+/**
+ * Print outage statistics for both links
+ * @param out Output stream (e.g. Serial)
+ */
+void netPrintReport(Print& out) {
+  const char* names[] = {"wifi", "server"};
+  const NetLinkStats* links[] = {&netWifi, &netServer};
+
+  out.print(F("Network: "));
+  out.println(netStateName());
+
+  for (uint8_t i = 0; i < 2; i++) {
+    out.print(F("  "));
+    out.print(names[i]);
+    out.print(F(": outages="));
+    out.print(links[i]->outages);
+    out.print(F(" last="));
+    out.print(links[i]->lastOutageMs);
+    out.print(F("ms max="));
+    out.print(links[i]->maxOutageMs);
+    out.print(F("ms total="));
+    out.print(links[i]->totalOutageMs);
+    out.println(F("ms"));
+  }
+}
+
+#endif  // CONNECTIVITY_H
@@ -4,16 +4,18 @@
 #include <Arduino.h>
 #include <ESP8266WiFi.h>  // Include ESP8266WiFi explicitly
 #include <LiquidCrystal_I2C.h>
-#include <NTPClient.h>
 
 #include "../config.h"
+#include "connectivity.h"
+#include "hopper_inventory.h"
+#include "profiler.h"
+#include "sntp_client.h"
+#include "ui_queue.h"
 
 // Forward declarations
 extern LiquidCrystal_I2C lcd;
-extern NTPClient timeClient;
+extern SntpClock timeClient;
 extern float getDistance();
-extern float getStableWeight(int numReadings, int samplesPerReading,
-                             float stabilityThreshold);
 extern bool hasSchedules();
 extern uint32_t getNextScheduledFeeding();
 extern void nonBlockingWait(uint32_t waitTime, uint32_t startDisplayTime = 0);
@@ -45,6 +47,11 @@ void showNextFeedingScreen();
  * Update the info display based on current display state
  */
 void updateInfoDisplay() {
+  PROFILE_SCOPE("display");
+
+  // Queued messages keep the screen until their display time is over
+  if (!uiScreenFree()) return;
+
   switch (currentDisplayState) {
     case DISPLAY_STATUS:
       showSystemStatusScreen();
@@ -73,9 +80,7 @@ void showSystemStatusScreen() {
     lcd.print(F("OFFLINE MODE"));
   } else if (isWebConnected()) {
     lcd.print(F("Connected"));
-  } else if (WiFi.status() ==
-             WL_CONNECTED) {  // Fixed: Using WiFi.status() == WL_CONNECTED
-                              // instead of WiFi.isConnected()
+  } else if (netWifiUp()) {
     lcd.print(F("WiFi Only"));
   } else {
     lcd.print(F("No Connection"));
@@ -101,18 +106,15 @@ void showSystemStatusScreen() {
 }
 
 /**
- * Show food and water levels screen
+ * Show food and water levels screen. Food is the hopper inventory with the
+ * time until it runs empty.
  */
 void showLevelsScreen() {
   lcd.clear();
 
-  // Get food level
-  float foodLevel = 0;
-  float currentWeight = getStableWeight(3, 2, 0.5);
-  if (currentWeight > 0) {
-    foodLevel = (currentWeight / FEED_TOTAL_WEIGHT) * 100.0;
-    foodLevel = constrain(foodLevel, 0, 100);
-  }
+  float foodLevel = hopperLevel();
+  char emptyIn[6];
+  hopperFormatEmptyIn(emptyIn, sizeof(emptyIn));
 
   // Get water level
   float waterLevel = 0;
@@ -124,17 +126,13 @@ void showLevelsScreen() {
     waterLevel = constrain(waterLevel, 0, 100);
   }
 
-  // Show food level on first line with visual indicator
+  // Show food level on first line, time to empty right-aligned
   lcd.setCursor(0, 0);
   lcd.print(F("Food: "));
   lcd.print((int)foodLevel);
-  lcd.print(F("% "));
-
-  // Simple visual indicator
-  int blocks = map(constrain(foodLevel, 0, 100), 0, 100, 0, 5);
-  for (int i = 0; i < 5; i++) {
-    lcd.write(i < blocks ? (byte)0xFF : ' ');
-  }
+  lcd.print(F("%"));
+  lcd.setCursor(LCD_X - strlen(emptyIn), 0);
+  lcd.print(emptyIn);
 
   // Show water level on second line with visual indicator
   lcd.setCursor(0, 1);
@@ -143,7 +141,7 @@ void showLevelsScreen() {
   lcd.print(F("% "));
 
   // Simple visual indicator
-  blocks = map(constrain(waterLevel, 0, 100), 0, 100, 0, 5);
+  int blocks = map(constrain(waterLevel, 0, 100), 0, 100, 0, 5);
   for (int i = 0; i < 5; i++) {
     lcd.write(i < blocks ? (byte)0xFF : ' ');
   }
@@ -0,0 +1,128 @@
+#ifndef FEED_GATE_H
+#define FEED_GATE_H
+
+#include <Arduino.h>
+
+#include "../config.h"
+#include "bowl_monitor.h"
+#include "persist_helpers.h"
+#include "ui_queue.h"
+
+// Pre-feed gate for scheduled feeds. A due portion is not dispensed while
+// the pet is at the bowl (an eating session is open or the bowl has not
+// been still for BOWL_LEVEL_SAMPLES samples): food dropping on its head
+// scares it off, and the bowl weight is useless for the top-up decision.
+// The feed is retried after FEED_DEFER_FIRST, doubling up to
+// FEED_DEFER_STEP_MAX, and goes out anyway after FEED_DEFER_MAX so a pet
+// that keeps hovering still gets its meal. Nothing blocks meanwhile.
+//
+// The portion waiting is mirrored in RTC memory: the schedule cursor was
+// already advanced, so a reset during a deferral must not lose the feed.
+// Without the bowl monitor running (no samples yet) the gate is open.
+
+extern void feeding(bool isScheduled, float targetAmount);
+extern bool sendLogEvent(const char* eventType, const char* details);
+
+struct FeedDeferral {
+  uint32_t magic;
+  float grams;     // Portion waiting (0 = none)
+  uint32_t since;  // Local epoch the portion became due
+  uint32_t crc;
+};
+
+static const uint32_t FEED_DEFERRAL_MAGIC = 0x44464552;  // "DFER"
+
+static FeedDeferral feedDeferral;
+static bool feedDeferralLoaded = false;
+static uint32_t feedGateNextAt = 0;  // Local epoch of the next attempt
+static uint8_t feedGateAttempts = 0;
+
+/**
+ * Load a portion left waiting before a reset (safe to call repeatedly)
+ */
+void feedGateBegin() {
+  if (feedDeferralLoaded) return;
+  feedDeferralLoaded = true;
+
+  if (!rtcLoad(RTC_FEED_GATE_BLOCK, feedDeferral) ||
+      feedDeferral.magic != FEED_DEFERRAL_MAGIC) {
+    memset(&feedDeferral, 0, sizeof(feedDeferral));
+    feedDeferral.magic = FEED_DEFERRAL_MAGIC;
+  }
+}
+
+/**
+ * @return true while a scheduled portion waits for the bowl
+ */
+bool feedGatePending() {
+  feedGateBegin();
+  return feedDeferral.grams > 0;
+}
+
+/**
+ * @return true if the bowl is quiet enough to feed
+ */
+bool feedGateOpen() {
+  if (!bowl.started) return true;
+  return !bowlBusy() && bowl.levelCount >= BOWL_LEVEL_SAMPLES;
+}
+
+/**
+ * Queue a scheduled portion, merging with one already waiting (an on-time
+ * slot covers the earlier one, as in the catch-up rules)
+ * @param grams Portion
+ * @param now Local epoch
+ */
+void feedGateRequest(float grams, uint32_t now) {
+  feedGateBegin();
+  if (feedDeferral.grams <= 0) {
+    feedDeferral.since = now;
+    feedGateNextAt = now;
+    feedGateAttempts = 0;
+  }
+  feedDeferral.grams = max(feedDeferral.grams, grams);
+  rtcSave(RTC_FEED_GATE_BLOCK, feedDeferral);
+}
+
+/**
+ * Dispense the waiting portion once the bowl is quiet, or back off
+ * @param now Local epoch
+ */
+void feedGateService(uint32_t now) {
+  if (!feedGatePending() || (int32_t)(now - feedGateNextAt) < 0) return;
+
+  uint32_t waited = now - feedDeferral.since;
+  if (!feedGateOpen() && waited < FEED_DEFER_MAX) {
+    uint8_t doublings = min(feedGateAttempts, (uint8_t)4);
+    uint32_t backoff = min(FEED_DEFER_FIRST << doublings, FEED_DEFER_STEP_MAX);
+    feedGateNextAt = now + backoff;
+
+    if (feedGateAttempts++ == 0) {
+      DEBUG_PRINTLN(F("Bowl busy, scheduled feed deferred"));
+      uiShow(F("Feed deferred"),
+             bowl.eating ? F("Pet is eating") : F("Bowl not still"),
+             INFO_DISPLAY_TIME);
+      char details[40];
+      snprintf(details, sizeof(details), "%s, retry in %us",
+               bowl.eating ? "Pet eating" : "Bowl moving", (unsigned)backoff);
+      sendLogEvent("feed_deferred", details);
+    }
+    return;
+  }
+
+  float grams = feedDeferral.grams;
+  feedDeferral.grams = 0;
+  rtcSave(RTC_FEED_GATE_BLOCK, feedDeferral);
+
+  if (feedGateAttempts > 0) {
+    char details[40];
+    snprintf(details, sizeof(details), "Fed after %u min%s",
+             (unsigned)(waited / 60), feedGateOpen() ? "" : " (timed out)");
+    sendLogEvent("feed_released", details);
+  }
+  feedGateAttempts = 0;
+
+  feeding(true, grams);
+}
+
+#endif  // FEED_GATE_H
@@ -0,0 +1,246 @@
+#ifndef FEED_JOURNAL_H
+#define FEED_JOURNAL_H
+
+#include <Arduino.h>
+
+#include "../config.h"
+#include "persist_helpers.h"
+
+// Write-ahead journal of the feeding session in progress. The session is
+// logged before the hatch opens, checkpointed while food goes out and closed
+// when the final weight is known. A reset or power cut in between leaves an
+// open session, which feedJournalReconcile() finds on the next boot.
+//
+// Every checkpoint goes to RTC memory (survives resets, not power loss).
+// Flash gets the start and end records plus at most
+// FEED_JOURNAL_MAX_CHECKPOINTS checkpoints per session, spaced by mass and
+// time, so a session costs at most MAX_CHECKPOINTS + 2 commits.
+//
+// The schedule cursors, feed profiles, hatch calibration and hopper share
+// the same 4 KB sector, and every commit erases and rewrites all of it. A
+// scheduled feed also commits its cursor, profile and hopper, so it costs
+// up to 9 erases: at four feeds a day the 100k-cycle sector lasts about
+// seven years, less with frequent schedule pushes. A power cut inside a
+// commit (after the erase) loses every record in the sector; their CRCs
+// fail and each falls back to its defaults, and an open session is then
+// only found if RTC memory survived.
+
+enum FeedJournalPhase {
+  JOURNAL_IDLE = 0,         // No session recorded yet
+  JOURNAL_STARTED = 1,      // Baseline taken, hatch not open yet
+  JOURNAL_DISPENSING = 2,   // Hatch open, dispensed holds the last checkpoint
+  JOURNAL_DONE = 3,         // Session finished normally
+  JOURNAL_INTERRUPTED = 4   // Open session closed by the boot reconcile
+};
+
+struct FeedJournalRecord {
+  uint32_t magic;
+  uint32_t sequence;   // Session number, increases across boots
+  uint8_t phase;       // FeedJournalPhase
+  uint8_t scheduled;   // Started by a schedule
+  uint16_t checkpoints;  // Flash checkpoints written this session
+  uint32_t startEpoch;   // Local epoch at start (0 = time unknown)
+  float target;        // Grams requested
+  float baseline;      // Bowl weight before the hatch opened
+  float dispensed;     // Grams at the last checkpoint
+  uint32_t crc;
+};
+
+static_assert(sizeof(FeedJournalRecord) <=
+                  EEPROM_PROFILES_ADDR - EEPROM_JOURNAL_ADDR,
+              "Feeding journal overlaps the feed profiles");
+
+static const uint32_t FEED_JOURNAL_MAGIC = 0x464A524E;  // "FJRN"
+
+static FeedJournalRecord feedJournal;
+static bool feedJournalLoaded = false;
+static uint32_t feedJournalFlashedAt = 0;   // millis() of the last flash write
+static float feedJournalFlashedGrams = 0;   // dispensed at that write
+static uint32_t feedJournalFlashWrites = 0;  // Since boot
+
+// Session that was open at boot
+static FeedJournalRecord feedJournalLost;
+static bool feedJournalLostPending = false;   // Not reported to the server yet
+static float feedJournalCredit = 0;  // Grams to deduct from the next feed
+
+/**
+ * @return true while a session is open
+ */
+bool feedJournalActive() {
+  return feedJournal.phase == JOURNAL_STARTED ||
+         feedJournal.phase == JOURNAL_DISPENSING;
+}
+
+/**
+ * Write the current record to flash
+ */
+static void feedJournalFlash() {
+  if (persistSave(EEPROM_JOURNAL_ADDR, feedJournal)) {
+    feedJournalFlashWrites++;
+  } else {
+    DEBUG_PRINTLN(F("Failed to commit feeding journal!"));
+  }
+  feedJournalFlashedAt = millis();
+  feedJournalFlashedGrams = feedJournal.dispensed;
+}
+
+/**
+ * Load the newest journal copy and close a session left open by a reset.
+ * Safe to call repeatedly, only the first call does the work.
+ * @return true if an interrupted session was found
+ */
+bool feedJournalReconcile() {
+  if (feedJournalLoaded) return feedJournalLostPending;
+  feedJournalLoaded = true;
+
+  FeedJournalRecord flash;
+  FeedJournalRecord rtc;
+  bool flashValid = persistLoad(EEPROM_JOURNAL_ADDR, flash) &&
+                    flash.magic == FEED_JOURNAL_MAGIC;
+  bool rtcValid = rtcLoad(RTC_JOURNAL_BLOCK, rtc) &&
+                  rtc.magic == FEED_JOURNAL_MAGIC;
+
+  // RTC holds every checkpoint but only survives resets; after a power cut
+  // it is garbage (CRC fails) or an older session
+  if (rtcValid && (!flashValid || rtc.sequence >= flash.sequence)) {
+    feedJournal = rtc;
+  } else if (flashValid) {
+    feedJournal = flash;
+  } else {
+    memset(&feedJournal, 0, sizeof(feedJournal));
+    feedJournal.magic = FEED_JOURNAL_MAGIC;
+    return false;
+  }
+
+  if (!feedJournalActive()) return false;
+
+  // Hatch is closed again by setupPins(); what went out is the last
+  // checkpoint (the tare at boot hides anything the bowl gained since)
+  feedJournalLost = feedJournal;
+  feedJournalLostPending = true;
+  if (feedJournal.scheduled) feedJournalCredit = feedJournal.dispensed;
+
+  DEBUG_PRINT(F("Feeding session "));
+  DEBUG_PRINT(feedJournal.sequence);
+  DEBUG_PRINT(F(" interrupted after "));
+  DEBUG_PRINT(feedJournal.dispensed);
+  DEBUG_PRINT(F("g of "));
+  DEBUG_PRINT(feedJournal.target);
+  DEBUG_PRINTLN(F("g"));
+
+  feedJournal.phase = JOURNAL_INTERRUPTED;
+  rtcSave(RTC_JOURNAL_BLOCK, feedJournal);
+  feedJournalFlash();
+  return true;
+}
+
+/**
+ * Log a new session before the hatch opens
+ * @param target Grams requested
+ * @param baseline Bowl weight before dispensing
+ * @param scheduled Whether a schedule started the feed
+ * @param epoch Local epoch (0 if time is not set)
+ */
+void feedJournalStart(float target, float baseline, bool scheduled,
+                      uint32_t epoch) {
+  feedJournalReconcile();
+
+  feedJournal.magic = FEED_JOURNAL_MAGIC;
+  feedJournal.sequence++;
+  feedJournal.phase = JOURNAL_STARTED;
+  feedJournal.scheduled = scheduled;
+  feedJournal.checkpoints = 0;
+  feedJournal.startEpoch = epoch;
+  feedJournal.target = target;
+  feedJournal.baseline = baseline;
+  feedJournal.dispensed = 0;
+
+  rtcSave(RTC_JOURNAL_BLOCK, feedJournal);
+  feedJournalFlash();
+}
+
+/**
+ * Record the mass dispensed so far. RTC is updated every call, flash only
+ * every target / (MAX_CHECKPOINTS + 1) grams (at least
+ * FEED_JOURNAL_FLASH_STEP) and FEED_JOURNAL_FLASH_INTERVAL ms.
+ * @param dispensed Grams out since the start
+ */
+void feedJournalCheckpoint(float dispensed) {
+  if (!feedJournalActive()) return;
+
+  feedJournal.phase = JOURNAL_DISPENSING;
+  feedJournal.dispensed = dispensed;
+  rtcSave(RTC_JOURNAL_BLOCK, feedJournal);
+
+  // Spread the flash checkpoints evenly over the portion
+  float step = feedJournal.target / (FEED_JOURNAL_MAX_CHECKPOINTS + 1);
+  if (step < FEED_JOURNAL_FLASH_STEP) step = FEED_JOURNAL_FLASH_STEP;
+
+  if (feedJournal.checkpoints < FEED_JOURNAL_MAX_CHECKPOINTS &&
+      dispensed - feedJournalFlashedGrams >= step &&
+      millis() - feedJournalFlashedAt >= FEED_JOURNAL_FLASH_INTERVAL) {
+    feedJournal.checkpoints++;
+    feedJournalFlash();
+  }
+}
+
+/**
+ * Close the session once the hatch is shut and the final weight is known
+ * @param dispensed Final grams dispensed
+ */
+void feedJournalEnd(float dispensed) {
+  if (!feedJournalActive()) return;
+
+  feedJournal.phase = JOURNAL_DONE;
+  feedJournal.dispensed = dispensed;
+  rtcSave(RTC_JOURNAL_BLOCK, feedJournal);
+  feedJournalFlash();
+}
+
+/**
+ * Food that an interrupted scheduled session already gave out, for the
+ * retry after a reset to deduct so it does not double-feed. The credit only
+ * applies within FEED_JOURNAL_CREDIT_WINDOW of boot.
+ * @return Grams to deduct from the next scheduled feed (0 if none)
+ */
+float feedJournalCreditGrams() {
+  feedJournalReconcile();
+  if (millis() > FEED_JOURNAL_CREDIT_WINDOW) feedJournalCredit = 0;
+  return feedJournalCredit;
+}
+
+/**
+ * Use up the credit, once a feed that deducted it commits to dispensing
+ */
+void feedJournalCreditUsed() {
+  if (feedJournalCredit <= 0) return;
+
+  DEBUG_PRINT(F("Deducted "));
+  DEBUG_PRINT(feedJournalCredit);
+  DEBUG_PRINTLN(F("g dispensed before the reset"));
+  feedJournalCredit = 0;
+}
+
+/**
+ * Print the journal state and any session interrupted before this boot
+ * @param out Output stream (e.g. Serial)
+ */
+void feedJournalPrintReport(Print& out) {
+  out.print(F("Feed journal: session="));
+  out.print(feedJournal.sequence);
+  out.print(F(" flash writes="));
+  out.println(feedJournalFlashWrites);
+
+  if (feedJournalLost.magic != FEED_JOURNAL_MAGIC) return;
+  out.print(F("  interrupted session "));
+  out.print(feedJournalLost.sequence);
+  out.print(feedJournalLost.phase == JOURNAL_DISPENSING
+                ? F(" while dispensing: ")
+                : F(" before dispensing: "));
+  out.print(feedJournalLost.dispensed, 1);
+  out.print(F("g of "));
+  out.print(feedJournalLost.target, 1);
+  out.println(F("g"));
+}
+
+#endif  // FEED_JOURNAL_H
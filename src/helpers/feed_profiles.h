@@ -0,0 +1,259 @@
+#ifndef FEED_PROFILES_H
+#define FEED_PROFILES_H
+
+#include <Arduino.h>
+
+#include "../config.h"
+#include "persist_helpers.h"
+
+// Dispense model learned per kibble. Every hatch opening of a feed is one
+// observation of three small linear models:
+//
+//   flow      = steady flow measured with the hatch wide open
+//   in flight = landed - reading at close = fallTime * flowAtClose
+//   settle    = time from close until the reading stops moving
+//
+// Each is fitted by recursive least squares with forgetting factor
+// FEED_PROFILE_FORGET, so a new kibble converges within a few feeds and a
+// profile follows slow drift (hopper level, humidity). The dispense loop
+// closes the hatch once the reading is within the predicted in-flight mass
+// of the target, and waits the learned settle time before re-weighing.
+//
+// FEED_PROFILE_COUNT profiles are kept in flash with one active. They are
+// saved once per feed, next to the schedule and journal records.
+
+struct FeedRls {
+  float theta;  // Parameter
+  float p;      // Variance
+  float pMax;   // Variance bound (the prior's), stops covariance windup
+};
+
+struct FeedProfile {
+  char name[FEED_PROFILE_NAME_LEN];
+  uint16_t feeds;     // Feeds learned from
+  uint16_t openings;  // Hatch openings learned from
+  FeedRls flow;       // theta = full flow (g/s)
+  FeedRls inFlight;   // theta = fall time (s)
+  FeedRls settle;     // theta = settle time (ms)
+};
+
+struct FeedProfileStore {
+  uint32_t magic;
+  uint8_t active;
+  uint8_t reserved[3];
+  FeedProfile profiles[FEED_PROFILE_COUNT];
+  uint32_t crc;
+};
+
+static_assert(sizeof(FeedProfileStore) <=
+                  EEPROM_HATCH_CAL_ADDR - EEPROM_PROFILES_ADDR,
+              "Feed profiles overlap the hatch calibration");
+
+static const uint32_t FEED_PROFILE_MAGIC = 0x46505232;  // "FPR2"
+
+static FeedProfileStore feedProfiles;
+static bool feedProfilesLoaded = false;
+static bool feedProfilesDirty = false;
+
+/**
+ * Start an RLS model from a prior
+ * @param theta Prior of the parameter
+ * @param var Prior variance
+ */
+static void feedRlsInit(FeedRls& rls, float theta, float var) {
+  rls.theta = theta;
+  rls.p = var;
+  rls.pMax = var;
+}
+
+/**
+ * One RLS step for y = theta * x
+ */
+static void feedRlsUpdate(FeedRls& rls, float x, float y) {
+  const float lambda = FEED_PROFILE_FORGET;
+
+  float px = rls.p * x;
+  float k = px / (lambda + x * px);
+  rls.theta += k * (y - rls.theta * x);
+
+  // P = (P - k x P) / lambda, bounded so a model the feeds stop exciting
+  // (e.g. no opening ever reaching full flow) cannot blow up
+  rls.p = min((rls.p - k * px) / lambda, rls.pMax);
+}
+
+/**
+ * Reset a profile to the compile-time priors
+ * @param index Profile slot
+ */
+void feedProfileReset(uint8_t index) {
+  if (index >= FEED_PROFILE_COUNT) return;
+  FeedProfile& profile = feedProfiles.profiles[index];
+
+  memset(&profile, 0, sizeof(profile));
+  snprintf(profile.name, sizeof(profile.name), "Food %u", index + 1);
+  feedRlsInit(profile.flow, FEED_PROFILE_FLOW, FEED_PROFILE_FLOW_VAR);
+  feedRlsInit(profile.inFlight, FEED_PROFILE_FALL_TIME, FEED_PROFILE_FALL_VAR);
+  feedRlsInit(profile.settle, SETTLE_FINAL_TIME, FEED_PROFILE_SETTLE_VAR);
+  feedProfilesDirty = true;
+}
+
+/**
+ * Load the profiles from flash (safe to call repeatedly)
+ */
+void feedProfilesBegin() {
+  if (feedProfilesLoaded) return;
+  feedProfilesLoaded = true;
+
+  if (persistLoad(EEPROM_PROFILES_ADDR, feedProfiles) &&
+      feedProfiles.magic == FEED_PROFILE_MAGIC &&
+      feedProfiles.active < FEED_PROFILE_COUNT) {
+    return;
+  }
+
+  DEBUG_PRINTLN(F("No feed profiles stored, starting from defaults"));
+  memset(&feedProfiles, 0, sizeof(feedProfiles));
+  feedProfiles.magic = FEED_PROFILE_MAGIC;
+  for (uint8_t i = 0; i < FEED_PROFILE_COUNT; i++) feedProfileReset(i);
+}
+
+/**
+ * Write the profiles to flash if they changed
+ * @return true if nothing was pending or the commit succeeded
+ */
+bool feedProfilesSave() {
+  if (!feedProfilesDirty) return true;
+  feedProfilesDirty = false;
+
+  if (!persistSave(EEPROM_PROFILES_ADDR, feedProfiles)) {
+    DEBUG_PRINTLN(F("Failed to commit feed profiles!"));
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @return The profile used by the next feed
+ */
+FeedProfile& feedProfileActive() {
+  feedProfilesBegin();
+  return feedProfiles.profiles[feedProfiles.active];
+}
+
+/**
+ * Switch the profile used by the next feed
+ * @param index Profile slot
+ * @return false if the slot does not exist
+ */
+bool feedProfileSelect(uint8_t index) {
+  feedProfilesBegin();
+  if (index >= FEED_PROFILE_COUNT) return false;
+
+  feedProfiles.active = index;
+  feedProfilesDirty = true;
+  return feedProfilesSave();
+}
+
+/**
+ * Rename the active profile (e.g. after the kibble it was learned from)
+ */
+void feedProfileRename(const char* name) {
+  if (!name) return;
+  FeedProfile& profile = feedProfileActive();
+  strncpy(profile.name, name, sizeof(profile.name) - 1);
+  profile.name[sizeof(profile.name) - 1] = '\0';
+  feedProfilesDirty = true;
+  feedProfilesSave();
+}
+
+/**
+ * @return Learned flow with the hatch open (g/s)
+ */
+float feedProfileFlow() {
+  return constrain(feedProfileActive().flow.theta, FEED_PROFILE_FLOW_MIN,
+                   FEED_PROFILE_FLOW_MAX);
+}
+
+/**
+ * @return true once a wide-open opening measured the flow; until then
+ *         feedProfileFlow() is the compile-time prior
+ */
+bool feedProfileFlowLearned() {
+  const FeedRls& flow = feedProfileActive().flow;
+  return flow.p < flow.pMax;
+}
+
+/**
+ * @return Learned time food takes from the hatch to the scale reading (s)
+ */
+float feedProfileFallTime() {
+  return constrain(feedProfileActive().inFlight.theta, 0.0f,
+                   FEED_PROFILE_FALL_MAX);
+}
+
+/**
+ * @return Learned time for the reading to settle after closing (ms)
+ */
+uint32_t feedProfileSettleMs() {
+  return constrain(feedProfileActive().settle.theta,
+                   (float)FEED_PROFILE_SETTLE_MIN,
+                   (float)FEED_PROFILE_SETTLE_MAX);
+}
+
+/**
+ * Reading at which to close the hatch so that the food still falling
+ * lands on the target
+ * @param target Grams wanted in total
+ * @param liveFlow Current flow estimate (g/s), 0 to use the learned flow
+ * @return Dispensed reading to close at
+ */
+float feedProfileCloseAt(float target, float liveFlow) {
+  float flow = liveFlow > 0 ? liveFlow : feedProfileFlow();
+  float closeAt = target - feedProfileFallTime() * flow;
+  return closeAt > 0 ? closeAt : 0;
+}
+
+/**
+ * Learn from one hatch opening once the food has settled
+ * @param fullFlow Steady flow measured wide open (g/s, 0 if never reached)
+ * @param reading Dispensed reading (this opening) when closing
+ * @param landed Settled grams (this opening)
+ * @param flowAtClose Flow estimate when closing (g/s, 0 if unknown)
+ */
+void feedProfileObserveOpening(float fullFlow, float reading, float landed,
+                               float flowAtClose) {
+  FeedProfile& profile = feedProfileActive();
+  if (fullFlow > 0) feedRlsUpdate(profile.flow, 1.0f, fullFlow);
+
+  // Too little to say anything about the food in the air
+  if (landed < FEED_PROFILE_MIN_GRAMS) {
+    if (fullFlow > 0) feedProfilesDirty = true;
+    return;
+  }
+
+  float flow = flowAtClose > 0 ? flowAtClose : feedProfileFlow();
+  feedRlsUpdate(profile.inFlight, flow, landed - reading);
+
+  profile.openings++;
+  feedProfilesDirty = true;
+}
+
+/**
+ * Learn how long the reading took to stop moving after a close
+ * @param settleMs Measured settle time
+ */
+void feedProfileObserveSettle(uint32_t settleMs) {
+  FeedProfile& profile = feedProfileActive();
+  feedRlsUpdate(profile.settle, 1.0f, settleMs);
+  feedProfilesDirty = true;
+}
+
+/**
+ * Count a completed feed and persist what it taught
+ */
+void feedProfileFinishFeed() {
+  feedProfileActive().feeds++;
+  feedProfilesDirty = true;
+  feedProfilesSave();
+}
+
+#endif  // FEED_PROFILES_H
@@ -0,0 +1,161 @@
+#ifndef FEED_TELEMETRY_H
+#define FEED_TELEMETRY_H
+
+#include <Arduino.h>
+#include <WebSocketsClient.h>
+
+#include "../config.h"
+#include "flow_control.h"
+
+// Live trace of a running feed for the dashboard. The dispense loop hands
+// every weight sample to telemetryFeedSample(), which sends it with the
+// flow estimate of flow_control.h as a 12-byte binary WebSocket frame, but
+// only while the server reports a subscriber.
+//
+// Frames go out at the subscriber's rate (capped at TELEMETRY_MAX_RATE and
+// by the scale's sample rate). A send that takes longer than
+// TELEMETRY_SEND_BUDGET to reach the TCP stack means the socket is backing
+// up: the rate is halved, then recovers one step per
+// TELEMETRY_RECOVER_SENDS fast sends. The feed never waits on a viewer.
+
+extern WebSocketsClient webSocket;
+extern bool webConnected;
+
+enum TelemetryKind {
+  TELEMETRY_START = 1,   // Feed started (target set)
+  TELEMETRY_SAMPLE = 2,  // Weight sample
+  TELEMETRY_END = 3      // Feed finished (final weight)
+};
+
+// Little-endian on the wire, decoded by the server and the dashboard
+struct __attribute__((packed)) TelemetryFrame {
+  uint8_t kind;       // TelemetryKind
+  uint8_t hatch;      // Hatch servo angle (degrees)
+  uint16_t seq;       // Frame number within the feed
+  uint16_t ms;        // Time since the feed started
+  int16_t dispensed;  // Grams x10
+  int16_t flow;       // Grams per second x10
+  int16_t target;     // Grams x10
+};
+
+static_assert(sizeof(TelemetryFrame) == 12, "Telemetry frame layout changed");
+
+// Subscription, set by the server's "telemetry" message
+static uint8_t telemetrySubscribers = 0;
+static uint8_t telemetryRate = TELEMETRY_MAX_RATE;  // Requested frames/s
+
+// Feed in progress
+static bool telemetryRunning = false;
+static uint32_t telemetryStart = 0;
+static uint32_t telemetryLastSent = 0;
+static float telemetryTarget = 0;
+static uint16_t telemetrySeq = 0;
+
+// Backpressure
+static uint8_t telemetryDecimation = 1;  // Send 1 in N rate slots
+static uint8_t telemetryFastSends = 0;
+
+// Statistics
+static uint32_t telemetrySent = 0;
+static uint32_t telemetrySkipped = 0;    // Samples thinned out
+static uint32_t telemetrySlowSends = 0;  // Sends over the budget
+static uint32_t telemetryMaxSendUs = 0;
+
+/**
+ * Apply the subscription reported by the server
+ * @param subscribers Dashboards watching the feeding trace (0 = stop)
+ * @param rate Highest frame rate any of them asked for (0 = default)
+ */
+void telemetrySetSubscribers(uint8_t subscribers, uint8_t rate) {
+  telemetrySubscribers = subscribers;
+  if (rate == 0 || rate > TELEMETRY_MAX_RATE) rate = TELEMETRY_MAX_RATE;
+  telemetryRate = rate;
+  telemetryDecimation = 1;
+}
+
+/**
+ * @return true if frames would be sent now
+ */
+bool telemetryWanted() { return webConnected && telemetrySubscribers > 0; }
+
+/**
+ * Send a frame and adapt the rate to how long the send blocked
+ */
+static void telemetrySend(uint8_t kind, float dispensed, uint8_t hatch) {
+  uint32_t sinceStart = millis() - telemetryStart;
+
+  TelemetryFrame frame;
+  frame.kind = kind;
+  frame.hatch = hatch;
+  frame.seq = telemetrySeq++;
+  frame.ms = sinceStart > 0xFFFF ? 0xFFFF : sinceStart;
+  frame.dispensed = constrain(dispensed * 10, -32768, 32767);
+  frame.flow = constrain(flowRate() * 10, -32768, 32767);
+  frame.target = constrain(telemetryTarget * 10, -32768, 32767);
+
+  uint32_t startUs = micros();
+  bool sent = webSocket.sendBIN((uint8_t*)&frame, sizeof(frame));
+  uint32_t elapsed = micros() - startUs;
+  if (elapsed > telemetryMaxSendUs) telemetryMaxSendUs = elapsed;
+
+  if (!sent || elapsed > TELEMETRY_SEND_BUDGET) {
+    telemetrySlowSends++;
+    telemetryFastSends = 0;
+    if (telemetryDecimation < TELEMETRY_MAX_DECIMATION) {
+      telemetryDecimation *= 2;
+    }
+  } else if (telemetryDecimation > 1 &&
+             ++telemetryFastSends >= TELEMETRY_RECOVER_SENDS) {
+    telemetryFastSends = 0;
+    telemetryDecimation--;
+  }
+
+  if (sent) telemetrySent++;
+  telemetryLastSent = millis();
+}
+
+/**
+ * Start the trace of a feed
+ * @param target Grams to dispense
+ */
+void telemetryFeedStart(float target) {
+  telemetryRunning = true;
+  telemetryStart = millis();
+  telemetryTarget = target;
+  telemetrySeq = 0;
+
+  if (telemetryWanted()) telemetrySend(TELEMETRY_START, 0, 0);
+}
+
+/**
+ * Stream a weight sample if watched
+ * @param dispensed Grams out since the start
+ * @param hatch Current hatch servo angle
+ */
+void telemetryFeedSample(float dispensed, uint8_t hatch) {
+  if (!telemetryRunning || !telemetryWanted()) return;
+
+  uint32_t now = millis();
+
+  // Half a sample of slack, so 10 Hz on a 10 Hz loop keeps every sample
+  uint32_t interval = 1000UL * telemetryDecimation / telemetryRate;
+  if (now - telemetryLastSent + WEIGHT_READ_INTERVAL / 2 < interval) {
+    telemetrySkipped++;
+    return;
+  }
+  telemetrySend(TELEMETRY_SAMPLE, dispensed, hatch);
+}
+
+/**
+ * Close the trace with the final weight
+ * @param dispensed Final grams dispensed
+ * @param hatch Hatch servo angle (closed)
+ */
+void telemetryFeedEnd(float dispensed, uint8_t hatch) {
+  if (!telemetryRunning) return;
+  telemetryRunning = false;
+
+  if (telemetryWanted()) telemetrySend(TELEMETRY_END, dispensed, hatch);
+}
+
+#endif  // FEED_TELEMETRY_H
@@ -9,11 +9,26 @@
 
 #include "../config.h"
 #include "../pins.h"
+#include "bowl_monitor.h"
+#include "button_helpers.h"
+#include "feed_journal.h"
+#include "feed_profiles.h"
+#include "feed_telemetry.h"
+#include "flow_control.h"
+#include "hatch_calibration.h"
+#include "hopper_inventory.h"
+#include "jam_detector.h"
+#include "lcd_helpers.h"
+#include "profiler.h"
+#include "schedule_helpers.h"
+#include "sntp_client.h"
+#include "ui_queue.h"
 
 // Forward declarations for external functions and objects
 extern LiquidCrystal_I2C lcd;
 extern Servo hatchServo;
 extern HX711 scale;
+extern SntpClock timeClient;
 extern StaticJsonDocument<512> jsonDoc;  // Reference the document from main.cpp
 extern void nonBlockingWait(uint32_t waitTime, uint32_t startDisplayTime);
 extern void progressBar(float percentage);
@@ -22,11 +37,10 @@ extern float getStableWeight(int numReadings, int samplesPerReading,
 extern bool isWebConnected();
 extern bool sendLogEvent(const char* eventType, const char* details);
 extern void updateFeedingToServer(float dispensedWeight, bool isScheduled);
-extern void lcdMessage(const char* line1, const char* line2, uint32_t waitTime,
-                       bool clearScreen);
 extern bool sendMessage(const char* eventType, JsonVariant data);
 extern bool sendFeedingComplete(bool isScheduled, const char* details,
                                 float foodLevel, float waterLevel);
+extern bool sendHopperStatus();
 
 /**
  * Check if scale is ready and responsive
@@ -90,6 +104,8 @@ void updateFeedingDisplay(float dispensedWeight, float targetWeight,
  * @return Average weight after settling
  */
 float measureSettledWeight(int numReadings = 5, int samplesPerReading = 2) {
+  PROFILE_SCOPE("scale");
+
   float settledWeight = 0;
   int validReadings = 0;
 
@@ -100,8 +116,10 @@ float measureSettledWeight(int numReadings = 5, int samplesPerReading = 2) {
       validReadings++;
 
       // Show progress indicator
-      lcd.setCursor(15, 1);
-      lcd.print(i + 1);
+      if (uiPendingCount() == 0) {
+        lcd.setCursor(15, 1);
+        lcd.print(i + 1);
+      }
       yield();
       delay(100);
     }
@@ -111,101 +129,71 @@ float measureSettledWeight(int numReadings = 5, int samplesPerReading = 2) {
 }
 
 /**
- * Check if bowl has enough food already
- * @param currentWeight Current weight in bowl (grams)
- * @param threshold Minimum threshold to consider "enough food"
- * @return True if user wants to continue feeding, false to cancel
+ * Wait after closing the hatch until the reading stops moving
+ * @param expectMs Settle time learned by the active feed profile
+ * @param settleMs Set to the time from the call until the reading was
+ *        still (ms, 0 if it never moved)
+ * @return false if it was still moving after twice the expected time
  */
-bool checkExistingFood(float currentWeight, float threshold) {
-  if (currentWeight >= threshold) {
-    // Food already present! Show notification
-    char weightText[16];
-    snprintf(weightText, sizeof(weightText), "Weight: %.1fg", currentWeight);
-
-    lcd.clear();
-    lcd.setCursor(0, 0);
-    lcd.print(F("Food detected!"));
-    lcd.setCursor(0, 1);
-    lcd.print(weightText);
-    nonBlockingWait(INFO_DISPLAY_TIME);
-
-    // Show options
-    lcd.clear();
-    lcd.setCursor(0, 0);
-    lcd.print(F("Food already >10g"));
-    lcd.setCursor(0, 1);
-    lcd.print(F("Btn:feed / Wait:20s"));
-
-    // Wait for button press or timeout
-    uint32_t notifyStartTime = millis();
-    const uint32_t NOTIFY_TIMEOUT = 20000;  // 20 second timeout
-    bool buttonPressed = false;
-
-    // Loop until button press or timeout
-    while (millis() - notifyStartTime < NOTIFY_TIMEOUT) {
-      // Check for button press with proper debouncing
-      if (digitalRead(MANUAL_FEED_BUTTON_PIN) == LOW) {
-        delay(BUTTON_DEBOUNCE_TIME);
-        if (digitalRead(MANUAL_FEED_BUTTON_PIN) == LOW) {
-          // Wait for release with yield
-          while (digitalRead(MANUAL_FEED_BUTTON_PIN) == LOW) {
-            delay(BUTTON_RELEASE_TIME);
-            yield();
-          }
-          buttonPressed = true;
-          break;
-        }
-      }
+bool waitForSettle(uint32_t expectMs, uint32_t& settleMs) {
+  PROFILE_SCOPE("settle");
 
-      // Update countdown timer every second
-      if ((millis() - notifyStartTime) / 1000 !=
-          ((millis() - notifyStartTime - 100) / 1000)) {
-        int secondsLeft =
-            (NOTIFY_TIMEOUT - (millis() - notifyStartTime)) / 1000;
-        lcd.setCursor(14, 1);
-        lcd.print(F("  "));  // Clear previous time
-        lcd.setCursor(14, 1);
-        lcd.print(secondsLeft);
-      }
+  uint32_t closedAt = millis();
+  uint32_t lastRead = closedAt;
+  uint32_t stillSince = closedAt;
+  uint8_t stillReads = 0;
+  float lastWeight = scale.get_units(1);
 
-      delay(100);
+  while (millis() - closedAt < expectMs * 2) {
+    if (millis() - lastRead < WEIGHT_READ_INTERVAL || !scale.is_ready()) {
       yield();
+      delay(10);
+      uiUpdate();
+      continue;
     }
 
-    // If no button press, cancel feeding
-    if (!buttonPressed) {
-      lcd.clear();
-      lcd.setCursor(0, 0);
-      lcd.print(F("Feeding canceled"));
-      lcd.setCursor(0, 1);
-      lcd.print(F("Bowl already has:"));
-      nonBlockingWait(QUICK_DISPLAY_TIME);
-
-      char foodText[16];
-      snprintf(foodText, sizeof(foodText), "%.1fg in bowl", currentWeight);
-      lcd.clear();
-      lcd.setCursor(0, 0);
-      lcd.print(F("Food weight:"));
-      lcd.setCursor(0, 1);
-      lcd.print(foodText);
-      nonBlockingWait(INFO_DISPLAY_TIME);
-      return false;
+    float weight = scale.get_units(1);
+    if (fabs(weight - lastWeight) <= FEED_PROFILE_STILL_BAND) {
+      if (stillReads++ == 0) stillSince = lastRead;
+    } else {
+      stillReads = 0;
     }
+    lastWeight = weight;
+    lastRead = millis();
 
-    // User confirmed continuation
-    lcd.clear();
-    lcd.setCursor(0, 0);
-    lcd.print(F("Continuing..."));
-    lcd.setCursor(0, 1);
-    lcd.print(F("Adding more food"));
-    nonBlockingWait(QUICK_DISPLAY_TIME);
+    // Not before half the learned time, food may still be in the air
+    if (stillReads >= FEED_PROFILE_STILL_READS &&
+        lastRead - closedAt >= expectMs / 2) {
+      settleMs = stillSince - closedAt;
+      return true;
+    }
   }
+  return false;
+}
 
-  return true;  // Continue with feeding
+/**
+ * Report a jam to the server: how long the flow had stopped when it was
+ * noticed, and whether wiggling the hatch got it going again
+ * @param dispensed Grams dispensed so far
+ * @param target Grams wanted
+ */
+static void sendJamReport(float dispensed, float target) {
+  jsonDoc.clear();
+  jsonDoc["attempts"] = jam.attempts;
+  jsonDoc["recovered"] = jam.recoverMs > 0;
+  jsonDoc["detectMs"] = jam.detectMs;
+  jsonDoc["recoverMs"] = jam.recoverMs;
+  jsonDoc["dispensed"] = dispensed;
+  jsonDoc["target"] = target;
+  sendMessage("jam", jsonDoc);
+  jamReported();
 }
 
 /**
- * Handle the food dispensing process
+ * Handle the food dispensing process. The hatch closes once the food still
+ * in the air (predicted by the active feed profile) would make up the rest
+ * of the target; every opening then teaches the profile. A jammed hatch is
+ * wiggled free, or the feed ends early.
  */
 float dispenseFoodWithFeedback(float initialWeight, float targetAmount) {
   // Setup moving average for stable readings
@@ -226,13 +214,26 @@ float dispenseFoodWithFeedback(float initialWeight, float targetAmount) {
   int retryCount = 0;
   int stabilityCounter = 0;
 
-  // Open servo to begin dispensing
-  hatchServo.write(SERVO_OPEN_ANGLE);
-  delay(500);  // Give servo time to open
+  // Dispensed reading when the current hatch opening started
+  float openingStart = 0;
+
+  // Start opening the hatch, the flow controller takes it from here
+  hatchCalAbort("feeding started");
+  flowEstimateStart();
+  telemetryFeedStart(targetAmount);
+  flowControlStart(feedProfileFlow(), targetAmount);
+  jamStart();
 
   // Main feeding loop
   while (!targetReached && (millis() - startTime < FEED_TIMEOUT)) {
     uint32_t now = millis();
+    hatchTick();
+
+    // A jam recovery drives the hatch until its wiggle is done
+    if (jamRecoveryUpdate()) {
+      flowControlStart(feedProfileFlow(), targetAmount - dispensedWeight);
+      jamRearm(dispensedWeight);
+    }
 
     // Read weight at regular intervals
     if (now - lastWeightRead >= WEIGHT_READ_INTERVAL) {
@@ -253,14 +254,18 @@ float dispenseFoodWithFeedback(float initialWeight, float targetAmount) {
 
         if (!recovered) {
           lcdMessage("Scale error!", "Closing hatch", LCD_TIMEOUT);
-          hatchServo.write(SERVO_CLOSE_ANGLE);
-          nonBlockingWait(LCD_TIMEOUT);
+          hatchJump(SERVO_CLOSE_ANGLE);
+          jamStop();
+          telemetryFeedEnd(dispensedWeight, SERVO_CLOSE_ANGLE);
           return dispensedWeight;
         }
       }
 
       // Update moving average
-      weightReadings[readingIndex] = scale.get_units(1);  // Fast read
+      {
+        PROFILE_SCOPE("scale-fast");
+        weightReadings[readingIndex] = scale.get_units(1);  // Fast read
+      }
       readingIndex = (readingIndex + 1) % movingAvgSize;
 
       // Calculate current weight and dispensed amount
@@ -272,30 +277,60 @@ float dispenseFoodWithFeedback(float initialWeight, float targetAmount) {
 
       dispensedWeight = currentWeight - initialWeight;
       if (dispensedWeight < 0) dispensedWeight = 0;
+      feedJournalCheckpoint(dispensedWeight);
+      flowObserve(dispensedWeight);
+      telemetryFeedSample(dispensedWeight, hatchServo.read());
+
+      // Taper the flow towards the close point, then pre-close once the
+      // food in the air makes up the rest. Until the first flow estimate
+      // the calibrated flow at the hatch angle stands in.
+      float measuredFlow = flowRate();
+      float flowAtClose =
+          measuredFlow > 0 ? measuredFlow : flowControlExpected();
+      float closeAt = feedProfileCloseAt(targetAmount, flowAtClose);
+      if (!preCloseExecuted && !jamRecovering()) {
+        flowControlUpdate(closeAt - dispensedWeight, measuredFlow);
+
+        if (jamCheck(dispensedWeight) && !jamGaveUp()) {
+          char attemptText[LCD_X + 1];
+          snprintf(attemptText, sizeof(attemptText), "Shaking #%d",
+                   jam.attempts);
+          uiShow(F("Food stuck"), attemptText, 0);
+        }
+      }
+      if (jamReportDue()) sendJamReport(dispensedWeight, targetAmount);
+      if (jamGaveUp()) {
+        char jamText[LCD_X + 1];
+        snprintf(jamText, sizeof(jamText), "%.1fg dispensed",
+                 dispensedWeight);
+        uiShow(F("Food jammed!"), jamText, INFO_DISPLAY_TIME);
+        break;
+      }
 
-      // Pre-close logic when approaching target
-      if (!preCloseExecuted &&
-          dispensedWeight >= targetAmount * FEED_CALIBRATION_FACTOR) {
+      if (!preCloseExecuted && dispensedWeight >= closeAt) {
         // Pre-close when we reach threshold
-        hatchServo.write(SERVO_CLOSE_ANGLE);
+        float fullFlow = flowControlStop();
+        hopperObserveFlow(fullFlow);
+        jamStop();
         preCloseExecuted = true;
+        float readingAtClose = dispensedWeight - openingStart;
 
         // Show pre-close message
-        lcd.clear();
-        lcd.setCursor(0, 0);
-        lcd.print(F("Almost there..."));
-        lcd.setCursor(0, 1);
-        lcd.print(F("Food settling"));
+        uiShow(F("Almost there..."), F("Food settling"), 0);
 
         // Give food time to fall and settle
-        delay(SETTLE_FINAL_TIME);  // Using value from config.h
-        yield();
+        uint32_t settleMs = 0;
+        bool settled = waitForSettle(feedProfileSettleMs(), settleMs);
 
         // Re-measure after settling
         float settledWeight = measureSettledWeight(5, 2);
         dispensedWeight = settledWeight - initialWeight;
         if (dispensedWeight < 0) dispensedWeight = 0;
 
+        feedProfileObserveOpening(fullFlow, readingAtClose,
+                                  dispensedWeight - openingStart, flowAtClose);
+        if (settled) feedProfileObserveSettle(settleMs);
+
         // Update current weight and readings array
         currentWeight = settledWeight;
         for (int i = 0; i < movingAvgSize; i++) {
@@ -306,42 +341,29 @@ float dispenseFoodWithFeedback(float initialWeight, float targetAmount) {
         if (dispensedWeight < targetAmount * FEED_COMPLETE_FACTOR &&
             retryCount < FEED_RETRY_TIMEOUT) {
           retryCount++;
-          char retryText[16];
+          char retryText[LCD_X + 1];
           snprintf(retryText, sizeof(retryText), "Retry #%d", retryCount);
-          lcd.clear();
-          lcd.setCursor(0, 0);
-          lcd.print(F("Need more food"));
-          lcd.setCursor(0, 1);
-          lcd.print(retryText);
-
-          hatchServo.write(SERVO_OPEN_ANGLE);
-          delay(300);
+          uiShow(F("Need more food"), retryText, 0);
+
+          openingStart = dispensedWeight;
+          flowControlStart(feedProfileFlow(), targetAmount - dispensedWeight);
+          jamRearm(dispensedWeight);
           preCloseExecuted = false;
         }
         // Handle successful dispense
         else if (dispensedWeight >= targetAmount * FEED_COMPLETE_FACTOR) {
           targetReached = true;
-          char dispensedText[16];
+          char dispensedText[LCD_X + 1];
           snprintf(dispensedText, sizeof(dispensedText), "Dispensed: %.1fg",
                    dispensedWeight);
-          lcd.clear();
-          lcd.setCursor(0, 0);
-          lcd.print(F("Target reached!"));
-          lcd.setCursor(0, 1);
-          lcd.print(dispensedText);
-          nonBlockingWait(QUICK_DISPLAY_TIME);
+          uiShow(F("Target reached!"), dispensedText, QUICK_DISPLAY_TIME);
         }
         // Handle case where we can't reach target despite retries
         else if (retryCount >= FEED_RETRY_TIMEOUT) {
-          char warningText[16];
+          char warningText[LCD_X + 1];
           snprintf(warningText, sizeof(warningText), "%.1fg dispensed",
                    dispensedWeight);
-          lcd.clear();
-          lcd.setCursor(0, 0);
-          lcd.print(F("Warning: Only"));
-          lcd.setCursor(0, 1);
-          lcd.print(warningText);
-          nonBlockingWait(INFO_DISPLAY_TIME);
+          uiShow(F("Warning: Only"), warningText, INFO_DISPLAY_TIME);
           targetReached = true;
         }
       }
@@ -349,7 +371,8 @@ float dispenseFoodWithFeedback(float initialWeight, float targetAmount) {
       // Standard target check for when pre-close isn't active
       if (!preCloseExecuted) {
         if (dispensedWeight >= targetAmount) {
-          hatchServo.write(SERVO_CLOSE_ANGLE);
+          hatchJump(SERVO_CLOSE_ANGLE);
+          jamStop();
           preCloseExecuted = true;
 
           // Confirm with stable readings
@@ -362,30 +385,31 @@ float dispenseFoodWithFeedback(float initialWeight, float targetAmount) {
 
         // Emergency stop if way too much food dispensed (use 125% threshold)
         if (dispensedWeight >= targetAmount * 1.25f) {
-          hatchServo.write(SERVO_CLOSE_ANGLE);
-          lcd.clear();
-          lcd.setCursor(0, 0);
-          lcd.print(F("Warning!"));
-          lcd.setCursor(0, 1);
-          lcd.print(F("Excess food!"));
-          nonBlockingWait(QUICK_DISPLAY_TIME);
+          hatchJump(SERVO_CLOSE_ANGLE);
+          jamStop();
+          uiShow(F("Warning!"), F("Excess food!"), QUICK_DISPLAY_TIME);
           targetReached = true;
         }
       }
     }
 
-    // Update display periodically
-    if (now - lastDisplayUpdate >= LCD_UPDATE_INTERVAL) {
+    // Update display periodically, unless a message is still showing
+    if (now - lastDisplayUpdate >= LCD_UPDATE_INTERVAL && uiScreenFree()) {
       lastDisplayUpdate = now;
       updateFeedingDisplay(dispensedWeight, targetAmount);
     }
 
     yield();
     delay(10);
+    uiUpdate();
   }
 
   // Ensure servo is closed
-  hatchServo.write(SERVO_CLOSE_ANGLE);
+  hatchJump(SERVO_CLOSE_ANGLE);
+  jamStop();
+  if (jam.open) sendJamReport(dispensedWeight, targetAmount);
+  telemetryFeedEnd(dispensedWeight, SERVO_CLOSE_ANGLE);
+  feedProfileFinishFeed();
 
   return dispensedWeight;
 }
@@ -428,7 +452,6 @@ void showFeedingResults(float initialWeight, float finalWeight,
 
   // Fixed: Use lcdMessage since both strings are now char*
   lcdMessage(accuracyText, qualityMsg, INFO_DISPLAY_TIME);
-  nonBlockingWait(INFO_DISPLAY_TIME);
 
   // Show total food in bowl
   char totalText[16];
@@ -440,13 +463,15 @@ void showFeedingResults(float initialWeight, float finalWeight,
  * Main feeding function that orchestrates the entire feeding process
  * @param isScheduled Whether this is a scheduled feeding (true) or manual
  * (false)
+ * @param targetAmount Grams to dispense (catch-up feeds may be smaller)
  */
-void feeding(bool isScheduled = false) {
+void feeding(bool isScheduled = false, float targetAmount = FEED_WEIGHT) {
+  PROFILE_SCOPE("feeding");
+
   DEBUG_PRINTLN(F("Start feeding sequence..."));
 
   // Notify server that feeding is starting
-  if (WiFi.status() == WL_CONNECTED &&
-      isWebConnected()) {  // Fixed: Using WiFi.status() == WL_CONNECTED
+  if (isWebConnected()) {
     if (isScheduled) {
       sendLogEvent("feeding_start", "Scheduled feeding initiated");
     } else {
@@ -455,71 +480,73 @@ void feeding(bool isScheduled = false) {
   }
 
   // Step 1: Initialize and check scale
-  lcd.clear();
-  lcd.setCursor(0, 0);
-  lcd.print(F("Feeding time"));
-  lcd.setCursor(0, 1);
-  lcd.print(F("Checking scale"));
-  nonBlockingWait(QUICK_DISPLAY_TIME);
+  uiShow(F("Feeding time"), F("Checking scale"), QUICK_DISPLAY_TIME);
 
   // Check if scale is responsive
   if (!checkScaleReady(SCALE_TIMEOUT)) {
-    lcd.clear();
-    lcd.setCursor(0, 0);
-    lcd.print(F("Error"));
-    lcd.setCursor(0, 1);
-    lcd.print(F("Scale not ready!"));
-    nonBlockingWait(INFO_DISPLAY_TIME);
+    uiShow(F("Error"), F("Scale not ready!"), INFO_DISPLAY_TIME);
     return;
   }
 
   // Step 2: Check if there's already food on the scale
-  lcd.setCursor(0, 1);
-  lcd.print(F("Checking bowl..."));
-  nonBlockingWait(QUICK_DISPLAY_TIME);
+  uiShowLine(1, F("Checking bowl..."), QUICK_DISPLAY_TIME);
 
   // Get stable initial weight
   float currentFoodWeight = getStableWeight(5, 2, WEIGHT_STABILITY_THRESHOLD);
   if (currentFoodWeight < 0) currentFoodWeight = 0;
 
-  // Check if there's already food in the bowl
-  if (!checkExistingFood(currentFoodWeight, FEED_THRESHOLD)) {
-    return;  // User canceled feeding
+  // A scheduled feed follows the top-up policy, a manual one gives what was
+  // asked for. A retry after a reset only tops up what the cut-short
+  // session did not give out.
+  if (isScheduled) {
+    float credit = feedJournalCreditGrams();
+    targetAmount = scheduledPortion(targetAmount, currentFoodWeight, credit);
+    if (targetAmount < SCHEDULE_CATCHUP_MIN_PORTION && credit > 0 &&
+        currentFoodWeight < FEED_THRESHOLD) {
+      uiShow(F("Already fed"), F("before restart"), INFO_DISPLAY_TIME);
+      feedJournalCreditUsed();
+      return;
+    }
+    if (targetAmount < SCHEDULE_CATCHUP_MIN_PORTION) {
+      char weightText[LCD_X + 1];
+      snprintf(weightText, sizeof(weightText), "%.1fg in bowl",
+               currentFoodWeight);
+      uiShow(F("Bowl is full"), weightText, INFO_DISPLAY_TIME);
+      if (isWebConnected()) sendLogEvent("feed_skipped", weightText);
+      return;
+    }
   }
 
   // Step 3: Start feeding process
+  if (isScheduled) feedJournalCreditUsed();
   float initialWeight = currentFoodWeight;
-  lcd.clear();
-  lcd.setCursor(0, 0);
-  lcd.print(F("Starting feed"));
-  lcd.setCursor(0, 1);
-  lcd.print(F("Opening hatch..."));
-  nonBlockingWait(QUICK_DISPLAY_TIME);
+  uiShow(F("Starting feed"), F("Opening hatch..."), QUICK_DISPLAY_TIME);
+  feedJournalStart(targetAmount, initialWeight, isScheduled,
+                   timeClient.isTimeSet() ? timeClient.getEpochTime() : 0);
 
   // Step 4: Perform the feeding
-  float dispensedAmount = dispenseFoodWithFeedback(initialWeight, FEED_WEIGHT);
+  float dispensedAmount = dispenseFoodWithFeedback(initialWeight, targetAmount);
 
   // Step 5: Wait for food to settle and take final measurement
-  lcd.clear();
-  lcd.setCursor(0, 0);
-  lcd.print(F("Measuring final"));
-  lcd.setCursor(0, 1);
-  lcd.print(F("weight..."));
-  nonBlockingWait(SETTLE_FINAL_TIME);  // Wait for food to settle
+  uiShow(F("Measuring final"), F("weight..."), 0);
+  nonBlockingWait(feedProfileSettleMs());  // Wait for food to settle
 
   // Get final stable weight
   float finalWeight = measureSettledWeight(5, 5);
+  feedJournalEnd(max(finalWeight - initialWeight, 0.0f));
+  bowlMonitorRebase();  // The portion is not food added by hand
 
   // Step 6: Show feeding results
-  showFeedingResults(initialWeight, finalWeight, FEED_WEIGHT);
+  showFeedingResults(initialWeight, finalWeight, targetAmount);
 
   // Get current levels for server update
   float dispensedWeight = finalWeight - initialWeight;
   if (dispensedWeight < 0) dispensedWeight = 0;
 
-  float foodLevel =
-      (FEED_TOTAL_WEIGHT - dispensedWeight) / FEED_TOTAL_WEIGHT * 100.0;
-  foodLevel = constrain(foodLevel, 0, 100);
+  // Take the feed out of the hopper inventory
+  HopperRefill refill = hopperFeedEnd(
+      dispensedWeight, timeClient.isTimeSet() ? timeClient.getEpochTime() : 0);
+  float foodLevel = hopperLevel();
 
   // Get water level
   float waterLevel = 50.0;  // Default if not available
@@ -532,8 +559,7 @@ void feeding(bool isScheduled = false) {
   }
 
   // Update server with feeding results at the end
-  if (WiFi.status() == WL_CONNECTED &&
-      isWebConnected()) {  // Fixed: Using WiFi.status() == WL_CONNECTED
+  if (isWebConnected()) {
     // Format detailed completion message
     char details[48];
     snprintf(details, sizeof(details),
@@ -542,6 +568,18 @@ void feeding(bool isScheduled = false) {
 
     // Send the feeding complete notification
     sendFeedingComplete(isScheduled, details, foodLevel, waterLevel);
+    sendHopperStatus();
+
+    if (refill != HOPPER_REFILL_NONE) {
+      sendLogEvent("hopper_refilled", hopperRefillName(refill));
+    }
+    if (hopperLowPending()) {
+      char emptyIn[6];
+      hopperFormatEmptyIn(emptyIn, sizeof(emptyIn));
+      snprintf(details, sizeof(details), "%.0fg left, empty in %s",
+               hopperGrams(), emptyIn);
+      if (sendLogEvent("hopper_low", details)) hopperLowReported();
+    }
   }
 }
 
@@ -0,0 +1,187 @@
+#ifndef FLOW_CONTROL_H
+#define FLOW_CONTROL_H
+
+#include <Arduino.h>
+
+#include "../config.h"
+#include "servo_planner.h"
+
+// Proportional hatch. Instead of slamming between SERVO_OPEN_ANGLE and
+// SERVO_CLOSE_ANGLE, the dispense loop asks for a mass flow that starts at
+// the full rate and tapers as the close point approaches:
+//
+//   setpoint = remaining / FLOW_APPROACH_TIME, within
+//              [FLOW_MIN_FRACTION, 1] x full flow
+//
+// While the setpoint is the full flow the hatch is simply wide open, and
+// the steady flow measured then is what the feed profile learns as its full
+// flow. Once the setpoint tapers, a PI controller on the measured flow trims
+// the feed-forward opening (setpoint / full flow) for the hatch's
+// non-linear response. The integrator only runs while the output is not
+// pushing against a limit (conditional integration), so it cannot wind up.
+//
+// The servo follows the controller in rate-limited moves of the motion
+// planner (SERVO_SLEW_RATE), never by waiting. Closing the hatch jumps.
+//
+// The measured flow is an exponential average (FLOW_ESTIMATE_ALPHA) of the
+// flow between weight samples, fed by flowObserve(). The dispense loop
+// controls and pre-closes on it, and the live trace reports it.
+
+// Measured angle -> flow table, see hatch_calibration.h
+bool hatchCalAvailable();
+float hatchCalFraction(float angle);
+float hatchCalAngleFor(float fraction);
+
+struct FlowController {
+  float fullFlow;      // Flow with the hatch wide open (g/s)
+  float setpoint;      // Wanted flow (g/s)
+  float integral;      // PI integrator (opening fraction)
+  float opening;       // Last output (0 = crack angle, 1 = fully open)
+  uint32_t lastMs;
+  uint32_t wideSince;  // Hatch wide open since (0 = not wide open)
+  float wideFlowSum;   // Flow samples taken wide open, once steady
+  uint16_t wideFlowCount;
+};
+
+static FlowController flowControl;
+
+// Flow estimate of the running feed
+static float flowEstimate = 0;  // Smoothed g/s
+static float flowLastDispensed = 0;
+static uint32_t flowLastSampleMs = 0;
+
+/**
+ * Start a new flow estimate, at the start of a feed
+ */
+void flowEstimateStart() {
+  flowEstimate = 0;
+  flowLastDispensed = 0;
+  flowLastSampleMs = millis();
+}
+
+/**
+ * Update the flow estimate from a weight sample
+ * @param dispensed Grams out since the start of the feed
+ */
+void flowObserve(float dispensed) {
+  uint32_t now = millis();
+  uint32_t elapsed = now - flowLastSampleMs;
+  if (elapsed == 0) return;
+
+  float flow = (dispensed - flowLastDispensed) * 1000.0f / elapsed;
+  flowEstimate += FLOW_ESTIMATE_ALPHA * (flow - flowEstimate);
+  flowLastSampleMs = now;
+  flowLastDispensed = dispensed;
+}
+
+/**
+ * @return Smoothed flow of the running feed (g/s)
+ */
+float flowRate() { return flowEstimate; }
+
+/**
+ * @param opening Fraction of the wide-open flow. Without a hatch
+ *        calibration flow is taken as linear from FLOW_CRACK_ANGLE.
+ * @return Servo angle
+ */
+float flowOpeningToAngle(float opening) {
+  if (hatchCalAvailable()) return hatchCalAngleFor(opening);
+  return FLOW_CRACK_ANGLE + opening * (SERVO_OPEN_ANGLE - FLOW_CRACK_ANGLE);
+}
+
+/**
+ * @param remaining Grams still to dispense
+ * @return Flow to aim for (g/s)
+ */
+float flowSetpoint(float remaining) {
+  float setpoint = remaining / FLOW_APPROACH_TIME;
+  float low = flowControl.fullFlow * FLOW_MIN_FRACTION;
+  return constrain(setpoint, low, flowControl.fullFlow);
+}
+
+/**
+ * Start (or restart, on a retry) dispensing under flow control
+ * @param fullFlow Flow with the hatch wide open (g/s), from the feed profile
+ * @param remaining Grams still to dispense
+ */
+void flowControlStart(float fullFlow, float remaining) {
+  flowControl.fullFlow = fullFlow;
+  flowControl.setpoint = flowSetpoint(remaining);
+  flowControl.integral = 0;
+  flowControl.opening = flowControl.setpoint / fullFlow;
+  flowControl.lastMs = millis();
+  flowControl.wideSince = 0;
+  flowControl.wideFlowSum = 0;
+  flowControl.wideFlowCount = 0;
+
+  hatchMoveAt(flowOpeningToAngle(flowControl.opening), SERVO_SLEW_RATE);
+}
+
+/**
+ * One controller step, at every weight sample
+ * @param remaining Grams still to dispense
+ * @param measuredFlow Current flow estimate (g/s)
+ */
+void flowControlUpdate(float remaining, float measuredFlow) {
+  uint32_t now = millis();
+  float dt = (now - flowControl.lastMs) / 1000.0f;
+  flowControl.lastMs = now;
+
+  float setpoint = flowSetpoint(remaining);
+  flowControl.setpoint = setpoint;
+
+  // Far from the target: wide open, and measure the full flow once the
+  // food has had FLOW_MEASURE_DELAY to reach the reading
+  if (setpoint >= flowControl.fullFlow) {
+    flowControl.opening = 1.0f;
+    hatchMoveAt(SERVO_OPEN_ANGLE, SERVO_SLEW_RATE);
+    if (hatchMotion.angle != SERVO_OPEN_ANGLE) return;
+
+    if (flowControl.wideSince == 0) {
+      flowControl.wideSince = now;
+    } else if (now - flowControl.wideSince >= FLOW_MEASURE_DELAY) {
+      flowControl.wideFlowSum += measuredFlow;
+      flowControl.wideFlowCount++;
+    }
+    return;
+  }
+  flowControl.wideSince = 0;
+
+  float error = (setpoint - measuredFlow) / flowControl.fullFlow;
+
+  float feedForward = setpoint / flowControl.fullFlow;
+  float output = feedForward + FLOW_KP * error + flowControl.integral;
+
+  // Integrate only when it would not push further into a limit
+  bool high = output >= 1.0f && error > 0;
+  bool low = output <= 0.0f && error < 0;
+  if (!high && !low) {
+    flowControl.integral += FLOW_KI * error * dt;
+    flowControl.integral = constrain(flowControl.integral, -1.0f, 1.0f);
+  }
+
+  flowControl.opening = constrain(output, 0.0f, 1.0f);
+  hatchMoveAt(flowOpeningToAngle(flowControl.opening), SERVO_SLEW_RATE);
+}
+
+/**
+ * @return Flow expected at the hatch's current angle (g/s), 0 without a
+ *         hatch calibration
+ */
+float flowControlExpected() {
+  if (!hatchCalAvailable()) return 0;
+  return flowControl.fullFlow * hatchCalFraction(hatchMotion.angle);
+}
+
+/**
+ * Close the hatch at once
+ * @return Mean steady flow measured wide open (g/s), 0 if it never was
+ */
+float flowControlStop() {
+  hatchJump(SERVO_CLOSE_ANGLE);
+
+  if (flowControl.wideFlowCount < FLOW_MEASURE_MIN_SAMPLES) return 0;
+  return flowControl.wideFlowSum / flowControl.wideFlowCount;
+}
+
+#endif  // FLOW_CONTROL_H
@@ -0,0 +1,327 @@
+#ifndef HATCH_CALIBRATION_H
+#define HATCH_CALIBRATION_H
+
+#include <Arduino.h>
+#include <HX711.h>
+
+#include "../config.h"
+#include "feed_profiles.h"
+#include "flow_control.h"
+#include "persist_helpers.h"
+
+// Hatch characterisation. A one-shot routine steps the hatch from closed to
+// wide open in HATCH_CAL_POINTS equal angle steps. At each step it waits
+// HATCH_CAL_SETTLE_MS for the flow to establish, then fits the slope of the
+// scale readings (least squares) as the steady flow at that angle. The
+// result is forced monotone (pool adjacent violators) and kept in flash as
+// an angle -> g/s table.
+//
+// The routine is a state machine advanced by hatchCalStep() from a
+// scheduler task, so the rest of the device keeps running. A feed aborts
+// it. Once a table exists, the flow controller maps its opening (fraction
+// of full flow) through it instead of assuming flow is linear above
+// FLOW_CRACK_ANGLE, and the dispense loop predicts the flow at the
+// commanded angle for the pre-close.
+
+extern HX711 scale;
+
+enum HatchCalState {
+  HATCH_CAL_IDLE = 0,
+  HATCH_CAL_SETTLING = 1,   // Moving to the step's angle, flow establishing
+  HATCH_CAL_MEASURING = 2,  // Fitting the flow at the step's angle
+  HATCH_CAL_DONE = 3,       // Table measured and saved
+  HATCH_CAL_FAILED = 4
+};
+
+struct HatchCalStore {
+  uint32_t magic;
+  uint8_t angle[HATCH_CAL_POINTS];  // Closed first
+  uint8_t reserved[3];
+  float flow[HATCH_CAL_POINTS];  // Steady flow at each angle (g/s)
+  uint32_t crc;
+};
+
+static_assert(sizeof(HatchCalStore) <=
+                  EEPROM_HOPPER_ADDR - EEPROM_HATCH_CAL_ADDR,
+              "Hatch calibration overlaps the hopper record");
+
+// Least-squares fit of weight over time for one step
+struct HatchCalFit {
+  uint16_t count;
+  float sumT, sumW, sumTT, sumTW;
+};
+
+static const uint32_t HATCH_CAL_MAGIC = 0x48434C42;  // "HCLB"
+
+static HatchCalStore hatchCal;
+static bool hatchCalLoaded = false;
+static bool hatchCalValid = false;
+
+static HatchCalState hatchCalState = HATCH_CAL_IDLE;
+static const char* hatchCalError = NULL;
+static uint8_t hatchCalPoint = 0;
+static uint32_t hatchCalSince = 0;  // millis() the current phase started
+static uint32_t hatchCalLastRead = 0;
+static float hatchCalStartWeight = 0;
+static float hatchCalStepWeight = 0;  // Reading when measuring started
+static float hatchCalNewFlow[HATCH_CAL_POINTS];
+static HatchCalFit hatchCalFit;
+
+/**
+ * @return Angle of a table point (0 = closed)
+ */
+static uint8_t hatchCalPointAngle(uint8_t point) {
+  return SERVO_CLOSE_ANGLE - (int)(SERVO_CLOSE_ANGLE - SERVO_OPEN_ANGLE) *
+                                 point / (HATCH_CAL_POINTS - 1);
+}
+
+/**
+ * Load the table from flash (safe to call repeatedly). A table measured
+ * with other hatch angles than the current config is ignored.
+ */
+void hatchCalBegin() {
+  if (hatchCalLoaded) return;
+  hatchCalLoaded = true;
+
+  hatchCalValid = persistLoad(EEPROM_HATCH_CAL_ADDR, hatchCal) &&
+                  hatchCal.magic == HATCH_CAL_MAGIC;
+  for (uint8_t i = 0; hatchCalValid && i < HATCH_CAL_POINTS; i++) {
+    if (hatchCal.angle[i] != hatchCalPointAngle(i)) hatchCalValid = false;
+  }
+  if (hatchCalValid && hatchCal.flow[HATCH_CAL_POINTS - 1] <= 0) {
+    hatchCalValid = false;
+  }
+
+  if (!hatchCalValid) {
+    DEBUG_PRINTLN(F("No hatch calibration, assuming linear flow"));
+  }
+}
+
+/**
+ * @return true if a measured table is in use
+ */
+bool hatchCalAvailable() {
+  hatchCalBegin();
+  return hatchCalValid;
+}
+
+/**
+ * @return Calibrated flow at an angle as a fraction of the wide-open flow,
+ *         interpolated between table points
+ */
+float hatchCalFraction(float angle) {
+  const float* flow = hatchCal.flow;
+  float full = flow[HATCH_CAL_POINTS - 1];
+
+  if (angle >= hatchCal.angle[0]) return flow[0] / full;
+  for (uint8_t i = 1; i < HATCH_CAL_POINTS; i++) {
+    if (angle < hatchCal.angle[i]) continue;
+    float span = hatchCal.angle[i - 1] - hatchCal.angle[i];
+    float t = (hatchCal.angle[i - 1] - angle) / span;
+    return (flow[i - 1] + t * (flow[i] - flow[i - 1])) / full;
+  }
+  return 1.0f;
+}
+
+/**
+ * Invert the table
+ * @param fraction Flow wanted, as a fraction of the wide-open flow
+ * @return Smallest opening angle expected to give it
+ */
+float hatchCalAngleFor(float fraction) {
+  const float* flow = hatchCal.flow;
+  float wanted = fraction * flow[HATCH_CAL_POINTS - 1];
+
+  if (wanted <= flow[0]) return hatchCal.angle[0];
+  for (uint8_t i = 1; i < HATCH_CAL_POINTS; i++) {
+    if (flow[i] < wanted) continue;
+    float t = (wanted - flow[i - 1]) / (flow[i] - flow[i - 1]);
+    return hatchCal.angle[i - 1] -
+           t * (hatchCal.angle[i - 1] - hatchCal.angle[i]);
+  }
+  return hatchCal.angle[HATCH_CAL_POINTS - 1];
+}
+
+/**
+ * Make a measured flow curve non-decreasing with the opening (pool
+ * adjacent violators: a drop is replaced by the mean of the points
+ * involved, which is the closest monotone curve in least squares)
+ */
+static void hatchCalMakeMonotone(float* flow) {
+  float mean[HATCH_CAL_POINTS];
+  uint8_t size[HATCH_CAL_POINTS];
+  uint8_t blocks = 0;
+
+  for (uint8_t i = 0; i < HATCH_CAL_POINTS; i++) {
+    mean[blocks] = flow[i];
+    size[blocks] = 1;
+    blocks++;
+    while (blocks > 1 && mean[blocks - 2] > mean[blocks - 1]) {
+      uint8_t merged = size[blocks - 2] + size[blocks - 1];
+      mean[blocks - 2] = (mean[blocks - 2] * size[blocks - 2] +
+                          mean[blocks - 1] * size[blocks - 1]) /
+                         merged;
+      size[blocks - 2] = merged;
+      blocks--;
+    }
+  }
+
+  uint8_t i = 0;
+  for (uint8_t b = 0; b < blocks; b++) {
+    for (uint8_t j = 0; j < size[b]; j++) flow[i++] = mean[b];
+  }
+}
+
+/**
+ * End the routine with the hatch closed
+ * @param error NULL on success, otherwise why it stopped
+ */
+static void hatchCalFinish(const char* error) {
+  hatchJump(SERVO_CLOSE_ANGLE);
+  hatchCalError = error;
+  hatchCalState = error ? HATCH_CAL_FAILED : HATCH_CAL_DONE;
+
+  if (error) {
+    DEBUG_PRINT(F("Hatch calibration failed: "));
+    DEBUG_PRINTLN(error);
+    return;
+  }
+
+  hatchCalMakeMonotone(hatchCalNewFlow);
+  if (hatchCalNewFlow[HATCH_CAL_POINTS - 1] <= 0) {
+    hatchCalFinish("no flow measured");
+    return;
+  }
+
+  hatchCal.magic = HATCH_CAL_MAGIC;
+  memset(hatchCal.reserved, 0, sizeof(hatchCal.reserved));
+  for (uint8_t i = 0; i < HATCH_CAL_POINTS; i++) {
+    hatchCal.angle[i] = hatchCalPointAngle(i);
+    hatchCal.flow[i] = hatchCalNewFlow[i];
+  }
+  hatchCalLoaded = true;
+  hatchCalValid = true;
+  if (!persistSave(EEPROM_HATCH_CAL_ADDR, hatchCal)) {
+    DEBUG_PRINTLN(F("Failed to commit hatch calibration!"));
+  }
+
+  // The wide-open flow is also a steady full-flow measurement of the
+  // kibble in the hopper
+  feedProfileObserveOpening(hatchCal.flow[HATCH_CAL_POINTS - 1], 0, 0, 0);
+  feedProfilesSave();
+
+  DEBUG_PRINTLN(F("Hatch calibration saved"));
+}
+
+/**
+ * Move on to a table point (0 = closed, flow 0 without measuring)
+ */
+static void hatchCalStartPoint(uint8_t point) {
+  hatchCalPoint = point;
+  hatchCalState = HATCH_CAL_SETTLING;
+  hatchCalSince = millis();
+  hatchMoveAt(hatchCalPointAngle(point), SERVO_SLEW_RATE);
+}
+
+/**
+ * @return true while the routine owns the hatch
+ */
+bool hatchCalRunning() {
+  return hatchCalState == HATCH_CAL_SETTLING ||
+         hatchCalState == HATCH_CAL_MEASURING;
+}
+
+/**
+ * Start the routine. The bowl should be able to take HATCH_CAL_MAX_GRAMS.
+ * @return false if it is already running or the scale is not responding
+ */
+bool hatchCalStart() {
+  if (hatchCalRunning()) return false;
+  if (!scale.is_ready()) {
+    hatchCalError = "scale not ready";
+    hatchCalState = HATCH_CAL_FAILED;
+    return false;
+  }
+
+  hatchCalBegin();
+  hatchCalError = NULL;
+  hatchCalStartWeight = scale.get_units(1);
+  hatchCalLastRead = millis();
+  hatchCalNewFlow[0] = 0;
+
+  hatchJump(SERVO_CLOSE_ANGLE);
+  hatchCalStartPoint(1);
+  DEBUG_PRINTLN(F("Hatch calibration started"));
+  return true;
+}
+
+/**
+ * Stop the routine, keeping the previous table
+ * @param reason Reported as the failure
+ */
+void hatchCalAbort(const char* reason) {
+  if (hatchCalRunning()) hatchCalFinish(reason);
+}
+
+/**
+ * Advance the routine, call every WEIGHT_READ_INTERVAL while running
+ * @return true when a step finished (a point was measured or the routine
+ *         ended), i.e. there is progress to report
+ */
+bool hatchCalStep() {
+  if (!hatchCalRunning()) return false;
+
+  uint32_t now = millis();
+  if (!scale.is_ready()) {
+    if (now - hatchCalLastRead > HATCH_CAL_SCALE_WAIT) {
+      hatchCalFinish("scale stopped responding");
+      return true;
+    }
+    return false;
+  }
+  hatchCalLastRead = now;
+  float weight = scale.get_units(1);
+
+  if (weight - hatchCalStartWeight > HATCH_CAL_MAX_GRAMS) {
+    hatchCalFinish("bowl full");
+    return true;
+  }
+
+  if (hatchCalState == HATCH_CAL_SETTLING) {
+    if (hatchMoving()) hatchCalSince = now;
+    if (now - hatchCalSince < HATCH_CAL_SETTLE_MS) return false;
+
+    memset(&hatchCalFit, 0, sizeof(hatchCalFit));
+    hatchCalStepWeight = weight;
+    hatchCalSince = now;
+    hatchCalState = HATCH_CAL_MEASURING;
+  }
+
+  float t = (now - hatchCalSince) / 1000.0f;
+  HatchCalFit& fit = hatchCalFit;
+  fit.count++;
+  fit.sumT += t;
+  fit.sumW += weight;
+  fit.sumTT += t * t;
+  fit.sumTW += t * weight;
+
+  // Measure for HATCH_CAL_MEASURE_MS, or less once enough food fell
+  bool enough = fit.count >= HATCH_CAL_MIN_SAMPLES &&
+                weight - hatchCalStepWeight >= HATCH_CAL_STEP_GRAMS;
+  if (now - hatchCalSince < HATCH_CAL_MEASURE_MS && !enough) return false;
+  if (fit.count < HATCH_CAL_MIN_SAMPLES) return false;
+
+  float denom = fit.count * fit.sumTT - fit.sumT * fit.sumT;
+  float slope =
+      denom > 0 ? (fit.count * fit.sumTW - fit.sumT * fit.sumW) / denom : 0;
+  hatchCalNewFlow[hatchCalPoint] = slope > 0 ? slope : 0;
+
+  if (hatchCalPoint + 1 < HATCH_CAL_POINTS) {
+    hatchCalStartPoint(hatchCalPoint + 1);
+  } else {
+    hatchCalFinish(NULL);
+  }
+  return true;
+}
+
+#endif  // HATCH_CALIBRATION_H
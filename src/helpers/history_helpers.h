@@ -0,0 +1,34 @@
+#ifndef HISTORY_HELPERS_H
+#define HISTORY_HELPERS_H
+
+#include <Arduino.h>
+#include <HX711.h>
+
+#include "../config.h"
+#include "sntp_client.h"
+#include "tsdb_helpers.h"
+
+// The bowl weight history task, shared by both firmwares. Each registers
+// it with the scheduler at TSDB_SAMPLE_INTERVAL once the scale is tared.
+
+extern HX711 scale;
+extern SntpClock timeClient;
+
+/**
+ * Sample the bowl weight into the history and sync its open blocks
+ */
+void historyTask() {
+  static uint32_t lastSync = 0;
+
+  // Readings before the clock is set would have no place in the history
+  if (timeClient.isTimeSet() && scale.is_ready()) {
+    tsdbAppend(TSDB_WEIGHT, timeClient.getEpochTime(), scale.get_units(1));
+  }
+
+  if (millis() - lastSync >= TSDB_SYNC_INTERVAL) {
+    lastSync = millis();
+    tsdbSync();
+  }
+}
+
+#endif  // HISTORY_HELPERS_H
@@ -0,0 +1,274 @@
+#ifndef HOPPER_INVENTORY_H
+#define HOPPER_INVENTORY_H
+
+#include <Arduino.h>
+
+#include "../config.h"
+#include "feed_journal.h"
+#include "persist_helpers.h"
+
+// Food left in the hopper. Every feed subtracts the grams that reached the
+// bowl, including a feed cut short by a reset (from the journal), so the
+// level follows the hopper instead of the last portion. A refill puts the
+// hopper back to its capacity. It is either reported (dashboard command)
+// or detected at the end of a feed:
+//
+//   flow   the wide-open flow jumped HOPPER_REFILL_FLOW_JUMP above its
+//          baseline while the hopper was below HOPPER_REFILL_MAX_LEVEL.
+//          A nearly empty hopper feeds the hatch slower, fresh food (or a
+//          new kibble, which also means a refill) changes the flow.
+//   overdrawn  the feed took HOPPER_OVERDRAW_GRAMS more than the hopper
+//          was thought to hold, so someone must have topped it up.
+//
+// The consumption rate is the ratio of two running averages, grams per
+// feed over seconds between feeds. It follows a changed schedule within a
+// few feeds and does not jump when a manual feed comes right after a
+// scheduled one. Time to empty is the level divided by that rate.
+//
+// All of it is O(1) per feed: one record, saved once per feed.
+
+enum HopperRefill {
+  HOPPER_REFILL_NONE = 0,
+  HOPPER_REFILL_COMMAND = 1,   // Reported by the user
+  HOPPER_REFILL_FLOW = 2,      // Wide-open flow jumped
+  HOPPER_REFILL_OVERDRAWN = 3  // Fed more than the hopper held
+};
+
+struct HopperStore {
+  uint32_t magic;
+  float grams;           // Food estimated in the hopper
+  float capacity;        // Grams in a full hopper
+  float feedGrams;       // Running average of grams per feed
+  float feedGapS;        // Running average of seconds between feeds
+  float flowBaseline;    // Running average of the wide-open flow (g/s)
+  uint32_t lastFeedAt;   // Local epoch of the last feed (0 = unknown)
+  uint32_t refilledAt;   // Local epoch of the last refill (0 = unknown)
+  uint16_t refills;
+  uint8_t lastRefill;    // HopperRefill
+  uint8_t lowReported;   // Low warning sent since the last refill
+  uint32_t crc;
+};
+
+static_assert(sizeof(HopperStore) <= PERSIST_EEPROM_SIZE - EEPROM_HOPPER_ADDR,
+              "Hopper record runs past the EEPROM area");
+
+static const uint32_t HOPPER_MAGIC = 0x48505052;  // "HPPR"
+
+static HopperStore hopper;
+static bool hopperLoaded = false;
+static float hopperFeedFlow = 0;  // Wide-open flow of the feed running
+
+void hopperConsume(float grams, uint32_t epoch);
+static void hopperSave();
+
+/**
+ * Load the inventory from flash (safe to call repeatedly). Grams of a feed
+ * that a reset interrupted are taken out once.
+ */
+void hopperBegin() {
+  if (hopperLoaded) return;
+  hopperLoaded = true;
+
+  if (!persistLoad(EEPROM_HOPPER_ADDR, hopper) ||
+      hopper.magic != HOPPER_MAGIC) {
+    DEBUG_PRINTLN(F("No hopper inventory, assuming a full hopper"));
+    memset(&hopper, 0, sizeof(hopper));
+    hopper.magic = HOPPER_MAGIC;
+    hopper.capacity = FEED_TOTAL_WEIGHT;
+    hopper.grams = FEED_TOTAL_WEIGHT;
+  }
+
+  if (feedJournalReconcile() && feedJournalLost.dispensed > 0) {
+    hopperConsume(feedJournalLost.dispensed, feedJournalLost.startEpoch);
+    hopperSave();
+  }
+}
+
+/**
+ * Write the inventory to flash
+ */
+static void hopperSave() {
+  if (!persistSave(EEPROM_HOPPER_ADDR, hopper)) {
+    DEBUG_PRINTLN(F("Failed to commit hopper inventory!"));
+  }
+}
+
+/**
+ * @return Grams estimated in the hopper
+ */
+float hopperGrams() {
+  hopperBegin();
+  return hopper.grams;
+}
+
+/**
+ * @return Hopper level in percent of its capacity
+ */
+float hopperLevel() {
+  hopperBegin();
+  return constrain(hopper.grams / hopper.capacity * 100.0f, 0.0f, 100.0f);
+}
+
+/**
+ * @return Consumption in grams per day, 0 before two timed feeds
+ */
+float hopperGramsPerDay() {
+  hopperBegin();
+  if (hopper.feedGapS <= 0) return 0;
+  return hopper.feedGrams / hopper.feedGapS * 86400.0f;
+}
+
+/**
+ * @return Hours until the hopper is empty at the current rate, -1 if the
+ *         rate is not known yet
+ */
+float hopperHoursToEmpty() {
+  float perDay = hopperGramsPerDay();
+  if (perDay <= 0) return -1;
+  return hopperGrams() / perDay * 24.0f;
+}
+
+/**
+ * Put the hopper back to full
+ * @param reason HopperRefill
+ * @param epoch Local epoch (0 if time is not set)
+ */
+static void hopperMarkRefill(HopperRefill reason, uint32_t epoch) {
+  hopper.grams = hopper.capacity;
+  hopper.refills++;
+  hopper.lastRefill = reason;
+  hopper.refilledAt = epoch;
+  hopper.lowReported = false;
+  hopper.flowBaseline = 0;
+}
+
+/**
+ * Record a refill reported by the user
+ * @param grams Food now in the hopper (0 = filled to capacity)
+ * @param capacity New capacity (0 = unchanged)
+ * @param epoch Local epoch (0 if time is not set)
+ */
+void hopperRefill(float grams, float capacity, uint32_t epoch) {
+  hopperBegin();
+  if (capacity > 0) hopper.capacity = capacity;
+  if (grams > hopper.capacity) hopper.capacity = grams;
+
+  hopperMarkRefill(HOPPER_REFILL_COMMAND, epoch);
+  if (grams > 0) hopper.grams = grams;
+  hopperSave();
+}
+
+/**
+ * Note the steady wide-open flow of a hatch opening in the running feed
+ * @param fullFlow Flow (g/s), 0 if the hatch never ran wide open
+ */
+void hopperObserveFlow(float fullFlow) {
+  if (fullFlow > 0) hopperFeedFlow = fullFlow;
+}
+
+/**
+ * Take one feed out of the inventory and update the consumption rate
+ * @param grams Grams that reached the bowl
+ * @param epoch Local epoch of the feed (0 if time is not set)
+ */
+void hopperConsume(float grams, uint32_t epoch) {
+  if (grams < 0) grams = 0;
+
+  if (epoch > 0 && hopper.lastFeedAt > 0 && epoch > hopper.lastFeedAt) {
+    uint32_t gap = min(epoch - hopper.lastFeedAt,
+                       (uint32_t)HOPPER_RATE_MAX_GAP);
+    if (hopper.feedGapS <= 0) {
+      hopper.feedGrams = grams;
+      hopper.feedGapS = gap;
+    } else {
+      hopper.feedGrams += HOPPER_RATE_WEIGHT * (grams - hopper.feedGrams);
+      hopper.feedGapS += HOPPER_RATE_WEIGHT * (gap - hopper.feedGapS);
+    }
+  }
+  if (epoch > 0) hopper.lastFeedAt = epoch;
+
+  hopper.grams -= grams;
+  if (hopper.grams < 0) hopper.grams = 0;
+}
+
+/**
+ * Account for a finished feed, detecting an unreported refill
+ * @param grams Grams that reached the bowl
+ * @param epoch Local epoch of the feed (0 if time is not set)
+ * @return How the hopper was found refilled, HOPPER_REFILL_NONE if not
+ */
+HopperRefill hopperFeedEnd(float grams, uint32_t epoch) {
+  hopperBegin();
+  HopperRefill refill = HOPPER_REFILL_NONE;
+  float flow = hopperFeedFlow;
+  hopperFeedFlow = 0;
+
+  if (grams > hopper.grams + HOPPER_OVERDRAW_GRAMS) {
+    refill = HOPPER_REFILL_OVERDRAWN;
+  } else if (flow > 0 && hopper.flowBaseline > 0 &&
+             flow > hopper.flowBaseline * HOPPER_REFILL_FLOW_JUMP &&
+             hopper.grams < hopper.capacity * HOPPER_REFILL_MAX_LEVEL) {
+    refill = HOPPER_REFILL_FLOW;
+  }
+  if (refill != HOPPER_REFILL_NONE) {
+    DEBUG_PRINTLN(F("Hopper was refilled"));
+    hopperMarkRefill(refill, epoch);
+  }
+
+  if (flow > 0) {
+    hopper.flowBaseline =
+        hopper.flowBaseline > 0
+            ? hopper.flowBaseline +
+                  HOPPER_FLOW_WEIGHT * (flow - hopper.flowBaseline)
+            : flow;
+  }
+
+  hopperConsume(grams, epoch);
+  hopperSave();
+  return refill;
+}
+
+/**
+ * @return true once the hopper fell below HOPPER_LOW_LEVEL and no warning
+ *         went out since the last refill
+ */
+bool hopperLowPending() {
+  hopperBegin();
+  return !hopper.lowReported &&
+         hopper.grams < hopper.capacity * HOPPER_LOW_LEVEL;
+}
+
+/**
+ * Mark the low warning as sent
+ */
+void hopperLowReported() {
+  hopper.lowReported = true;
+  hopperSave();
+}
+
+/**
+ * @return Name of a HopperRefill, as sent to the server
+ */
+const char* hopperRefillName(uint8_t refill) {
+  static const char* const names[] = {"none", "command", "flow",
+                                      "overdrawn"};
+  return refill <= HOPPER_REFILL_OVERDRAWN ? names[refill] : "none";
+}
+
+/**
+ * Format the time to empty for the LCD, e.g. "36h" or "12d"
+ * @param buffer Output, at least 6 bytes
+ * @param size Size of the buffer
+ */
+void hopperFormatEmptyIn(char* buffer, size_t size) {
+  float hours = hopperHoursToEmpty();
+  if (hours < 0) {
+    snprintf(buffer, size, "--");
+  } else if (hours < 48) {
+    snprintf(buffer, size, "%uh", (unsigned)hours);
+  } else {
+    snprintf(buffer, size, "%ud", (unsigned)min(hours / 24, 999.0f));
+  }
+}
+
+#endif  // HOPPER_INVENTORY_H
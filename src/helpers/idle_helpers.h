@@ -0,0 +1,206 @@
+#ifndef IDLE_HELPERS_H
+#define IDLE_HELPERS_H
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+
+#include "../config.h"
+#include "button_helpers.h"
+#include "connectivity.h"
+#include "task_scheduler.h"
+
+// Idle manager, installed as the scheduler's idle hook. The scheduler knows
+// the next deadline (water check, NTP, stats); event-driven tasks park
+// themselves far out and register a watch that pulls them forward when work
+// shows up between deadlines (button edges, a queued LCD message).
+//
+// Gaps shorter than IDLE_LIGHT_SLEEP_MIN, or with WiFi down, are spent in
+// modem sleep (radio off between beacons, CPU clocked). Longer gaps with the
+// station connected switch to automatic light sleep, which also suspends the
+// CPU between DTIM beacons; the button wakes it through a GPIO level
+// interrupt. Time in each mode is kept to estimate the supply current.
+
+enum IdleMode {
+  IDLE_ACTIVE = 0,  // Running tasks
+  IDLE_MODEM = 1,
+  IDLE_LIGHT = 2
+};
+
+static const uint32_t IDLE_NEVER = 0xFFFFFFFFUL;
+
+// Milliseconds until the watched task has work (IDLE_NEVER = nothing)
+typedef uint32_t (*IdleDue)();
+
+struct IdleWatch {
+  int8_t taskId;
+  IdleDue due;
+};
+
+static IdleWatch idleWatches[IDLE_MAX_WATCHES];
+static uint8_t idleWatchCount = 0;
+
+// Statistics
+static uint32_t idleStatsStart = 0;
+static uint32_t idleSleepMs[3] = {0, 0, 0};  // Indexed by IdleMode
+static uint32_t idleWakes = 0;       // Sleeps ended by a deadline
+static uint32_t idleEarlyWakes = 0;  // Sleeps cut short by a watch
+
+/**
+ * Run a task as soon as its due function reports work
+ * @param taskId Scheduler task id
+ * @param due Returns ms until the task has work, IDLE_NEVER if none
+ */
+void idleWatch(int8_t taskId, IdleDue due) {
+  if (taskId < 0 || idleWatchCount >= IDLE_MAX_WATCHES) return;
+
+  idleWatches[idleWatchCount].taskId = taskId;
+  idleWatches[idleWatchCount].due = due;
+  idleWatchCount++;
+}
+
+/**
+ * Earliest watch
+ * @param taskId Set to the watched task
+ * @return ms until it has work (IDLE_NEVER if none)
+ */
+static uint32_t idleNextWatch(int8_t& taskId) {
+  uint32_t next = IDLE_NEVER;
+  taskId = -1;
+
+  for (uint8_t i = 0; i < idleWatchCount; i++) {
+    uint32_t due = idleWatches[i].due();
+    if (due < next) {
+      next = due;
+      taskId = idleWatches[i].taskId;
+    }
+  }
+  return next;
+}
+
+/**
+ * Idle hook: sleep until the next deadline or until a watch has work
+ * @param idleMs Time until the scheduler's next deadline
+ */
+void idleSleep(uint32_t idleMs) {
+  uint32_t start = millis();
+  if (idleStatsStart == 0) idleStatsStart = start;
+
+  uint8_t mode = (netWifiUp() && idleMs >= IDLE_LIGHT_SLEEP_MIN) ? IDLE_LIGHT
+                                                                 : IDLE_MODEM;
+  if (mode == IDLE_LIGHT) {
+    Serial.flush();  // The UART stops with the CPU
+    WiFi.setSleepMode(WIFI_LIGHT_SLEEP, IDLE_LISTEN_INTERVAL);
+    buttonArmWake();
+  }
+
+  // Sleep in slices so a wake-up (button) is served within IDLE_WAKE_CHECK
+  bool early = false;
+  while (true) {
+    uint32_t elapsed = millis() - start;
+    if (elapsed >= idleMs) break;
+
+    int8_t taskId;
+    uint32_t due = idleNextWatch(taskId);
+    if (due == 0) {
+      schedulerRunIn(taskId, 0);
+      early = true;
+      break;
+    }
+
+    uint32_t slice = idleMs - elapsed;
+    if (slice > IDLE_WAKE_CHECK) slice = IDLE_WAKE_CHECK;
+    if (slice > due) slice = due;
+    delay(slice);
+  }
+
+  if (mode == IDLE_LIGHT) {
+    buttonDisarmWake();
+    WiFi.setSleepMode(WIFI_MODEM_SLEEP);
+  }
+
+  idleSleepMs[mode] += millis() - start;
+  if (early) {
+    idleEarlyWakes++;
+  } else {
+    idleWakes++;
+  }
+}
+
+/**
+ * Install the idle hook
+ */
+void idleBegin() {
+  WiFi.setSleepMode(WIFI_MODEM_SLEEP);
+  idleStatsStart = millis();
+  schedulerSetIdleHook(idleSleep);
+}
+
+/**
+ * @return Share of time spent in a mode since idleBegin(), in percent
+ */
+float idlePercent(uint8_t mode) {
+  uint32_t elapsed = millis() - idleStatsStart;
+  if (elapsed == 0) return 0.0f;
+
+  uint32_t ms = idleSleepMs[mode];
+  if (mode == IDLE_ACTIVE) {
+    uint32_t asleep = idleSleepMs[IDLE_MODEM] + idleSleepMs[IDLE_LIGHT];
+    ms = elapsed > asleep ? elapsed - asleep : 0;
+  }
+  return 100.0f * ms / elapsed;
+}
+
+/**
+ * @return Loop wake-ups per hour since idleBegin()
+ */
+uint32_t idleWakesPerHour() {
+  uint32_t elapsed = millis() - idleStatsStart;
+  if (elapsed == 0) return 0;
+  return (uint64_t)(idleWakes + idleEarlyWakes) * 3600000ULL / elapsed;
+}
+
+/**
+ * Estimated average module current from the time in each mode (mA),
+ * excluding the LCD, sensors and actuators
+ */
+float idleAverageCurrent() {
+  return (idlePercent(IDLE_ACTIVE) * IDLE_CURRENT_ACTIVE +
+          idlePercent(IDLE_MODEM) * IDLE_CURRENT_MODEM +
+          idlePercent(IDLE_LIGHT) * IDLE_CURRENT_LIGHT) /
+         100.0f;
+}
+
+/**
+ * Same estimate for the old delay(10) loop, which never left modem sleep
+ */
+float idleBusyLoopCurrent() {
+  return (idlePercent(IDLE_ACTIVE) * IDLE_CURRENT_ACTIVE +
+          (100.0f - idlePercent(IDLE_ACTIVE)) * IDLE_CURRENT_MODEM) /
+         100.0f;
+}
+
+/**
+ * Print time per mode, wake-ups and the current estimate
+ * @param out Output stream (e.g. Serial)
+ */
+void idlePrintReport(Print& out) {
+  out.print(F("Idle: active="));
+  out.print(idlePercent(IDLE_ACTIVE), 1);
+  out.print(F("% modem="));
+  out.print(idlePercent(IDLE_MODEM), 1);
+  out.print(F("% light="));
+  out.print(idlePercent(IDLE_LIGHT), 1);
+  out.print(F("% wakes/h="));
+  out.print(idleWakesPerHour());
+  out.print(F(" (early "));
+  out.print(idleEarlyWakes);
+  out.println(F(")"));
+
+  out.print(F("  current: "));
+  out.print(idleAverageCurrent(), 1);
+  out.print(F("mA avg, busy loop "));
+  out.print(idleBusyLoopCurrent(), 1);
+  out.println(F("mA"));
+}
+
+#endif  // IDLE_HELPERS_H
@@ -0,0 +1,195 @@
+#ifndef JAM_DETECTOR_H
+#define JAM_DETECTOR_H
+
+#include <Arduino.h>
+
+#include "../config.h"
+#include "feed_profiles.h"
+#include "flow_control.h"
+
+// Jam (bridging) detection for the dispense loop. Kibble that bridges over
+// the hatch stops the flow while the hatch stands open. The detector
+// watches the dispensed reading: it must rise by JAM_PROGRESS_GRAMS every
+// so often. If it has not for JAM_DETECT_MS, and at least
+// JAM_EXPECTED_GRAMS should have fallen in that time (at the hatch's
+// opening, but no more than the flow the controller asks for), the hatch
+// is jammed. A hatch opened less than JAM_MIN_OPENING is left alone: while
+// the flow tapers a trickle is expected, and the flow controller opens up
+// if it stops. After every (re)opening the check waits the learned fall
+// time plus JAM_GRACE_MS, until food can have reached the scale.
+//
+// Recovery wiggles the hatch towards closed and back JAM_PULSES times, as
+// JAM_PULSE_MS planner moves, each started when the last completes. Each
+// further attempt in the same feed wiggles JAM_WIGGLE_ANGLE further. After
+// JAM_MAX_ATTEMPTS the feed gives up instead of waiting for FEED_TIMEOUT.
+// Every jam ends in one report: recovered (flow resumed) or not.
+
+enum JamState {
+  JAM_IDLE = 0,        // Not dispensing
+  JAM_WATCHING = 1,    // Hatch open, checking for progress
+  JAM_RECOVERING = 2,  // Wiggling the hatch
+  JAM_GAVE_UP = 3      // Out of attempts, the feed should end
+};
+
+struct JamDetector {
+  JamState state;
+  float progressMark;   // Reading at the last progress
+  uint32_t progressAt;  // When it was made (ahead of now during a grace)
+  uint8_t attempts;     // Recoveries in this feed
+  uint8_t pulse;        // Half-wiggles done in this recovery
+  float baseAngle;      // Hatch angle the wiggle returns to
+
+  // Current jam, reported once flow resumes or the feed gives up
+  bool open;            // A jam has not been reported yet
+  uint32_t detectedAt;  // millis() of the first detection
+  uint32_t detectMs;    // No-progress time when it was detected
+  uint32_t recoverMs;   // Detection to resumed flow (0 = not recovered)
+};
+
+static JamDetector jam;
+
+/**
+ * Wait for progress from the current reading, after the fall time
+ */
+static void jamArm(float dispensed) {
+  jam.state = JAM_WATCHING;
+  jam.progressMark = dispensed;
+  jam.progressAt =
+      millis() + JAM_GRACE_MS + (uint32_t)(feedProfileFallTime() * 1000);
+}
+
+/**
+ * Start watching a new feed
+ */
+void jamStart() {
+  memset(&jam, 0, sizeof(jam));
+  jamArm(0);
+}
+
+/**
+ * Re-arm after the hatch (re)opened, e.g. on a retry
+ */
+void jamRearm(float dispensed) {
+  if (jam.state != JAM_GAVE_UP) jamArm(dispensed);
+}
+
+/**
+ * Stop watching (hatch closing or the feed ended)
+ */
+void jamStop() {
+  if (jam.state != JAM_GAVE_UP) jam.state = JAM_IDLE;
+}
+
+/**
+ * @return true while the detector drives the hatch
+ */
+bool jamRecovering() { return jam.state == JAM_RECOVERING; }
+
+/**
+ * @return true once recovery failed JAM_MAX_ATTEMPTS times
+ */
+bool jamGaveUp() { return jam.state == JAM_GAVE_UP; }
+
+/**
+ * @param stalledMs Time without progress
+ * @return Grams the open hatch should have passed in that time
+ */
+static float jamExpectedGrams(uint32_t stalledMs) {
+  // A new profile only knows the prior flow, which a slow kibble may not
+  // reach by far; until it measured one, only a long stall counts
+  if (!feedProfileFlowLearned()) {
+    return FEED_PROFILE_FLOW_MIN * stalledMs / 1000.0f;
+  }
+
+  // While tapering, the opening of an uncalibrated hatch overstates the
+  // flow; the setpoint is what the controller is after
+  float flow = min(flowControl.fullFlow * flowControl.opening,
+                   flowControl.setpoint);
+  return flow * stalledMs / 1000.0f;
+}
+
+/**
+ * Check one weight sample while the flow controller holds the hatch open
+ * @param dispensed Grams out since the feed started
+ * @return true if a jam was just detected (recovery started, or gave up)
+ */
+bool jamCheck(float dispensed) {
+  if (jam.state != JAM_WATCHING) return false;
+  uint32_t now = millis();
+
+  if (dispensed >= jam.progressMark + JAM_PROGRESS_GRAMS) {
+    jam.progressMark = dispensed;
+    jam.progressAt = now;
+    if (jam.open && jam.recoverMs == 0) jam.recoverMs = now - jam.detectedAt;
+    return false;
+  }
+
+  // A hatch the controller throttled below JAM_MIN_OPENING counts as
+  // reopened once it opens up again: the reading trails it by the fall
+  if (flowControl.opening < JAM_MIN_OPENING) {
+    jamArm(dispensed);
+    return false;
+  }
+
+  // Still in the grace after (re)opening
+  if ((int32_t)(now - jam.progressAt) < 0) return false;
+
+  uint32_t stalled = now - jam.progressAt;
+  if (stalled < JAM_DETECT_MS) return false;
+  if (jamExpectedGrams(stalled) < JAM_EXPECTED_GRAMS) return false;
+
+  if (!jam.open) {
+    jam.open = true;
+    jam.detectedAt = now;
+    jam.detectMs = stalled;
+    jam.recoverMs = 0;
+  }
+
+  if (jam.attempts >= JAM_MAX_ATTEMPTS) {
+    jam.state = JAM_GAVE_UP;
+    return true;
+  }
+
+  jam.attempts++;
+  jam.state = JAM_RECOVERING;
+  jam.pulse = 0;
+  jam.baseAngle = hatchMotion.target;
+  return true;
+}
+
+/**
+ * Advance the wiggle, call every loop pass while recovering
+ * @return true when the pattern finished and the hatch is back open
+ */
+bool jamRecoveryUpdate() {
+  if (jam.state != JAM_RECOVERING) return false;
+  if (jam.pulse > 0 && hatchMoving()) return false;
+  if (jam.pulse >= 2 * JAM_PULSES) return true;
+
+  // The first half of each wiggle swings towards closed, the second back
+  float swing = JAM_WIGGLE_ANGLE * jam.attempts;
+  float closed = jam.baseAngle + (SERVO_CLOSE_ANGLE > SERVO_OPEN_ANGLE
+                                      ? swing
+                                      : -swing);
+  float angle = jam.pulse % 2 == 0 ? closed : jam.baseAngle;
+  hatchMoveTo(constrain(angle, min(SERVO_OPEN_ANGLE, SERVO_CLOSE_ANGLE),
+                        max(SERVO_OPEN_ANGLE, SERVO_CLOSE_ANGLE)),
+              JAM_PULSE_MS);
+  jam.pulse++;
+  return false;
+}
+
+/**
+ * @return true if a jam is waiting to be reported: it recovered (flow
+ *         resumed) or the feed gave up on it
+ */
+bool jamReportDue() {
+  return jam.open && (jam.recoverMs > 0 || jam.state == JAM_GAVE_UP);
+}
+
+/**
+ * Mark the pending jam as reported
+ */
+void jamReported() { jam.open = false; }
+
+#endif  // JAM_DETECTOR_H
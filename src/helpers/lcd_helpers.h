@@ -5,38 +5,24 @@
 #include <LiquidCrystal_I2C.h>
 
 #include "../config.h"
+#include "button_helpers.h"
+#include "profiler.h"
+#include "ui_queue.h"
 
 // Forward declarations for external functions used
 extern void nonBlockingWait(uint32_t waitTime, uint32_t startDisplayTime = 0);
 extern LiquidCrystal_I2C lcd;
 
 /**
- * Display message on LCD with non-blocking delay
- * Use F() in call site for string literals to save RAM
+ * Queue a message on the LCD, returns immediately
  * @param line1 First line text (NULL to leave unchanged)
  * @param line2 Second line text (NULL to leave unchanged)
- * @param waitTime Time to display message in ms (0 for no wait)
+ * @param waitTime Minimum time on screen in ms (0 to allow replacing at once)
  * @param clearScreen Whether to clear the screen first
  */
 void lcdMessage(const char* line1, const char* line2 = NULL,
                 uint32_t waitTime = LCD_TIMEOUT, bool clearScreen = true) {
-  if (clearScreen) {
-    lcd.clear();
-  }
-
-  if (line1) {
-    lcd.setCursor(0, 0);
-    lcd.print(line1);
-  }
-
-  if (line2) {
-    lcd.setCursor(0, 1);
-    lcd.print(line2);
-  }
-
-  if (waitTime > 0) {
-    nonBlockingWait(waitTime);
-  }
+  uiShow(line1, line2, waitTime, clearScreen);
 }
 
 /**
@@ -51,21 +37,10 @@ void lcdMessage(const char* line1, const char* line2 = NULL,
 void lcdMessageWithValue(const char* line1, const char* prefix, float value,
                          int precision, const char* suffix = NULL,
                          uint32_t waitTime = LCD_TIMEOUT) {
-  lcd.clear();
-  lcd.setCursor(0, 0);
-  lcd.print(line1);
-
-  lcd.setCursor(0, 1);
-  lcd.print(prefix);
-  lcd.print(value, precision);
-
-  if (suffix) {
-    lcd.print(suffix);
-  }
-
-  if (waitTime > 0) {
-    nonBlockingWait(waitTime);
-  }
+  char valueText[LCD_X + 1];
+  snprintf(valueText, sizeof(valueText), "%s%.*f%s", prefix, precision, value,
+           suffix ? suffix : "");
+  uiShow(line1, valueText, waitTime);
 }
 
 /**
@@ -99,6 +74,8 @@ void clearLineLCD(uint8_t col, uint8_t row, uint8_t length = 0) {
  * @param percentage Value from 0-100 to display
  */
 void progressBar(float percentage) {
+  PROFILE_SCOPE("lcd");
+
   // Define the width of the progress bar in characters
   uint8_t partialBlock[8] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
 
@@ -156,24 +133,25 @@ void progressBar(float percentage) {
 }
 
 /**
- * Wait for button press with timeout and update countdown on LCD
- * @param buttonPin Pin to check (using INPUT_PULLUP)
+ * Wait for a button gesture with timeout and update countdown on LCD
  * @param timeout Timeout in milliseconds
  * @param position Position to show countdown [column, row]
  * @return true if button pressed, false if timeout
  */
-bool waitForButtonWithTimeout(uint8_t buttonPin, uint32_t timeout,
-                              uint8_t posCol = 14, uint8_t posRow = 1) {
+bool waitForButtonWithTimeout(uint32_t timeout, uint8_t posCol = 14,
+                              uint8_t posRow = 1) {
   uint32_t startTime = millis();
-  uint32_t lastUpdate = 0;
   int lastSecond = -1;
 
+  // Only gestures made from now on count
+  buttonClearEvents();
+
   while (millis() - startTime < timeout) {
     // Calculate seconds left
     int secondsLeft = (timeout - (millis() - startTime)) / 1000;
 
     // Update display once per second
-    if (secondsLeft != lastSecond) {
+    if (secondsLeft != lastSecond && uiPendingCount() == 0) {
       lastSecond = secondsLeft;
       lcd.setCursor(posCol, posRow);
       lcd.print(F("  "));  // Clear previous time
@@ -181,19 +159,12 @@ bool waitForButtonWithTimeout(uint8_t buttonPin, uint32_t timeout,
       lcd.print(secondsLeft);
     }
 
-    // Check for button press with debounce
-    if (digitalRead(buttonPin) == LOW) {
-      delay(BUTTON_DEBOUNCE_TIME);  // Debounce
-      if (digitalRead(buttonPin) == LOW) {
-        // Wait for release
-        while (digitalRead(buttonPin) == LOW) {
-          delay(BUTTON_RELEASE_TIME);
-          yield();
-        }
-        return true;
-      }
-    }
+    // Edges are debounced from their interrupt timestamps
+    ButtonEvent event;
+    buttonUpdate();
+    if (buttonPollEvent(event)) return true;
 
+    uiUpdate();
     yield();
     delay(10);
   }
@@ -0,0 +1,117 @@
+#ifndef PERSIST_HELPERS_H
+#define PERSIST_HELPERS_H
+
+#include <Arduino.h>
+#include <EEPROM.h>
+
+#include "../config.h"
+
+// Records stored through these helpers must end with a uint32_t crc field.
+// The CRC covers every byte before it, so a torn write is always detected.
+
+static bool persistStarted = false;
+
+/**
+ * CRC-32 (IEEE, reflected) over a byte buffer
+ * @param data Buffer to checksum
+ * @param length Number of bytes
+ * @return CRC-32 value
+ */
+uint32_t persistCrc32(const void* data, size_t length) {
+  const uint8_t* bytes = (const uint8_t*)data;
+  uint32_t crc = 0xFFFFFFFF;
+
+  for (size_t i = 0; i < length; i++) {
+    crc ^= bytes[i];
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+  }
+
+  return ~crc;
+}
+
+/**
+ * Start the emulated EEPROM once (safe to call repeatedly)
+ */
+void persistBegin() {
+  if (!persistStarted) {
+    EEPROM.begin(PERSIST_EEPROM_SIZE);
+    persistStarted = true;
+  }
+}
+
+/**
+ * Load a CRC-protected record from flash (EEPROM emulation)
+ * @param address Byte offset in the EEPROM area
+ * @param record Record to fill
+ * @return true if the stored record is intact
+ */
+template <typename T>
+bool persistLoad(int address, T& record) {
+  persistBegin();
+  EEPROM.get(address, record);
+
+  uint32_t storedCrc;
+  memcpy(&storedCrc, (uint8_t*)&record + sizeof(T) - sizeof(uint32_t),
+         sizeof(uint32_t));
+  return storedCrc == persistCrc32(&record, sizeof(T) - sizeof(uint32_t));
+}
+
+/**
+ * Store a CRC-protected record in flash and commit it
+ * @param address Byte offset in the EEPROM area
+ * @param record Record to write (its crc field is updated)
+ * @return true if the commit succeeded
+ */
+template <typename T>
+bool persistSave(int address, T& record) {
+  persistBegin();
+
+  uint32_t crc = persistCrc32(&record, sizeof(T) - sizeof(uint32_t));
+  memcpy((uint8_t*)&record + sizeof(T) - sizeof(uint32_t), &crc,
+         sizeof(uint32_t));
+
+  EEPROM.put(address, record);
+  return EEPROM.commit();
+}
+
+/**
+ * Load a CRC-protected record from RTC user memory (survives resets and
+ * watchdog reboots, lost on power loss)
+ * @param block RTC user memory block (4 bytes per block)
+ * @param record Record to fill
+ * @return true if the stored record is intact
+ */
+template <typename T>
+bool rtcLoad(uint32_t block, T& record) {
+  static_assert(sizeof(T) % 4 == 0, "RTC records must be 4-byte aligned");
+
+  if (!ESP.rtcUserMemoryRead(block, (uint32_t*)&record, sizeof(T))) {
+    return false;
+  }
+
+  uint32_t storedCrc;
+  memcpy(&storedCrc, (uint8_t*)&record + sizeof(T) - sizeof(uint32_t),
+         sizeof(uint32_t));
+  return storedCrc == persistCrc32(&record, sizeof(T) - sizeof(uint32_t));
+}
+
+/**
+ * Store a CRC-protected record in RTC user memory
+ * @param block RTC user memory block (4 bytes per block)
+ * @param record Record to write (its crc field is updated)
+ * @return true if the write succeeded
+ */
+template <typename T>
+bool rtcSave(uint32_t block, T& record) {
+  static_assert(sizeof(T) % 4 == 0, "RTC records must be 4-byte aligned");
+
+  uint32_t crc = persistCrc32(&record, sizeof(T) - sizeof(uint32_t));
+  memcpy((uint8_t*)&record + sizeof(T) - sizeof(uint32_t), &crc,
+         sizeof(uint32_t));
+
+  return ESP.rtcUserMemoryWrite(block, (uint32_t*)&record, sizeof(T));
+}
+
+#endif  // PERSIST_HELPERS_H
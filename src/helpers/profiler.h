@@ -0,0 +1,231 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#endif
+
+#include "../config.h"
+
+// Lightweight execution-time profiler. PROFILE_SCOPE("name") at the top of a
+// block records how long the block took into a per-name histogram.
+//
+// Histograms are log-linear (HDR style): values below 4 us are exact, above
+// that every power of two is split into 4 buckets, so any percentile is
+// within 25% of the true value. 96 buckets of 16-bit counters cover up to
+// ~33 s in under 200 bytes per probe.
+
+static const uint8_t PROFILER_SUB_BITS = 2;
+static const uint8_t PROFILER_SUB_BUCKETS = 1 << PROFILER_SUB_BITS;
+static const uint8_t PROFILER_BUCKETS = 96;
+static const uint32_t PROFILER_CYCLE_SAFE_MS = 10000;  // Cycle counter wraps
+                                                       // after ~26 s @160MHz
+
+struct ProfileProbe {
+  const char* name;
+  uint32_t count;
+  uint32_t maxUs;
+  uint16_t buckets[PROFILER_BUCKETS];  // Saturating counters
+};
+
+static ProfileProbe profileProbes[PROFILER_MAX_PROBES];
+static uint8_t profileProbeCount = 0;
+
+//------------------------------------------------------------------------------
+// Time source: CPU cycle counter on target, steady_clock on the host
+//------------------------------------------------------------------------------
+#ifdef ARDUINO
+struct ProfileStamp {
+  uint32_t cycles;
+  uint32_t ms;
+};
+
+static inline ProfileStamp profilerStamp() {
+  ProfileStamp stamp = {ESP.getCycleCount(), (uint32_t)millis()};
+  return stamp;
+}
+
+static inline uint32_t profilerElapsedUs(const ProfileStamp& start) {
+  uint32_t ms = millis() - start.ms;
+
+  // Long scopes (feeding) would wrap the 32-bit cycle counter
+  if (ms > PROFILER_CYCLE_SAFE_MS) return ms * 1000UL;
+  return (ESP.getCycleCount() - start.cycles) / ESP.getCpuFreqMHz();
+}
+#else
+typedef std::chrono::steady_clock::time_point ProfileStamp;
+
+static inline ProfileStamp profilerStamp() {
+  return std::chrono::steady_clock::now();
+}
+
+static inline uint32_t profilerElapsedUs(const ProfileStamp& start) {
+  return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+#endif
+
+//------------------------------------------------------------------------------
+// Histogram
+//------------------------------------------------------------------------------
+
+/**
+ * Map a duration to its histogram bucket
+ * @param us Duration in microseconds
+ * @return Bucket index
+ */
+static uint8_t profilerBucket(uint32_t us) {
+  if (us < PROFILER_SUB_BUCKETS) return us;
+
+  uint8_t msb = 31 - __builtin_clz(us);
+  uint8_t shift = msb - PROFILER_SUB_BITS;
+  uint32_t bucket = (shift + 1) * PROFILER_SUB_BUCKETS +
+                    ((us >> shift) - PROFILER_SUB_BUCKETS);
+
+  return (bucket < PROFILER_BUCKETS) ? bucket : PROFILER_BUCKETS - 1;
+}
+
+/**
+ * Highest duration that falls into a bucket
+ * @param bucket Bucket index
+ * @return Upper bound in microseconds
+ */
+static uint32_t profilerBucketLimit(uint8_t bucket) {
+  if (bucket < PROFILER_SUB_BUCKETS) return bucket;
+
+  uint8_t shift = bucket / PROFILER_SUB_BUCKETS - 1;
+  uint32_t sub = bucket % PROFILER_SUB_BUCKETS;
+  return ((PROFILER_SUB_BUCKETS + sub + 1) << shift) - 1;
+}
+
+/**
+ * Find or create the probe for a name (call once per scope site)
+ * @param name Probe name, must be a string literal
+ * @return Probe id, or -1 if the probe table is full
+ */
+int8_t profilerProbe(const char* name) {
+  for (uint8_t i = 0; i < profileProbeCount; i++) {
+    if (strcmp(profileProbes[i].name, name) == 0) return i;
+  }
+  if (profileProbeCount >= PROFILER_MAX_PROBES) return -1;
+
+  uint8_t id = profileProbeCount++;
+  memset(&profileProbes[id], 0, sizeof(ProfileProbe));
+  profileProbes[id].name = name;
+  return id;
+}
+
+/**
+ * Add one sample to a probe
+ * @param probe Probe id
+ * @param us Duration in microseconds
+ */
+void profilerRecord(int8_t probe, uint32_t us) {
+  if (probe < 0 || probe >= profileProbeCount) return;
+
+  ProfileProbe& p = profileProbes[probe];
+  uint16_t& bucket = p.buckets[profilerBucket(us)];
+  if (bucket < 0xFFFF) bucket++;
+  p.count++;
+  if (us > p.maxUs) p.maxUs = us;
+}
+
+/**
+ * Duration below which a share of the samples fall
+ * @param probe Probe id
+ * @param quantile Share between 0 and 1 (0.5 = median)
+ * @return Duration in microseconds (0 if no samples)
+ */
+uint32_t profilerPercentile(int8_t probe, float quantile) {
+  if (probe < 0 || probe >= profileProbeCount) return 0;
+  const ProfileProbe& p = profileProbes[probe];
+
+  // Counters saturate, so rank against what the buckets actually hold
+  uint32_t total = 0;
+  for (uint8_t i = 0; i < PROFILER_BUCKETS; i++) total += p.buckets[i];
+  if (total == 0) return 0;
+
+  uint32_t rank = (uint32_t)(quantile * total + 0.5f);
+  if (rank < 1) rank = 1;
+
+  uint32_t seen = 0;
+  for (uint8_t i = 0; i < PROFILER_BUCKETS; i++) {
+    seen += p.buckets[i];
+    if (seen >= rank) {
+      uint32_t limit = profilerBucketLimit(i);
+      return (limit < p.maxUs) ? limit : p.maxUs;
+    }
+  }
+
+  return p.maxUs;
+}
+
+/**
+ * Clear all samples (probe names are kept)
+ */
+void profilerReset() {
+  for (uint8_t i = 0; i < profileProbeCount; i++) {
+    profileProbes[i].count = 0;
+    profileProbes[i].maxUs = 0;
+    memset(profileProbes[i].buckets, 0, sizeof(profileProbes[i].buckets));
+  }
+}
+
+#ifdef ARDUINO
+/**
+ * Print p50/p99/max of every probe
+ * @param out Output stream (e.g. Serial)
+ */
+void profilerPrintReport(Print& out) {
+  out.println(F("Profile (us):"));
+
+  for (uint8_t i = 0; i < profileProbeCount; i++) {
+    out.print(F("  "));
+    out.print(profileProbes[i].name);
+    out.print(F(": n="));
+    out.print(profileProbes[i].count);
+    out.print(F(" p50="));
+    out.print(profilerPercentile(i, 0.50f));
+    out.print(F(" p99="));
+    out.print(profilerPercentile(i, 0.99f));
+    out.print(F(" max="));
+    out.println(profileProbes[i].maxUs);
+  }
+}
+#endif
+
+//------------------------------------------------------------------------------
+// Scope instrumentation
+//------------------------------------------------------------------------------
+
+// Records the lifetime of a block into a probe
+class ProfileScope {
+ public:
+  explicit ProfileScope(int8_t probe)
+      : probe_(probe), start_(profilerStamp()) {}
+  ~ProfileScope() { profilerRecord(probe_, profilerElapsedUs(start_)); }
+
+ private:
+  int8_t probe_;
+  ProfileStamp start_;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+#ifdef PROFILING
+#define PROFILE_SCOPE(name)                                 \
+  static int8_t PROFILE_CONCAT(profileProbe_, __LINE__) =   \
+      profilerProbe(name);                                  \
+  ProfileScope PROFILE_CONCAT(profileScope_, __LINE__)(     \
+      PROFILE_CONCAT(profileProbe_, __LINE__))
+#else
+#define PROFILE_SCOPE(name)
+#endif
+
+#endif  // PROFILER_H
@@ -0,0 +1,324 @@
+#ifndef SCHEDULE_HELPERS_H
+#define SCHEDULE_HELPERS_H
+
+#include <Arduino.h>
+
+#include "../config.h"
+#include "feed_gate.h"
+#include "persist_helpers.h"
+
+// Forward declarations for external functions
+extern bool sendLogEvent(const char* eventType, const char* details);
+
+// Missed-schedule policies
+enum CatchUpPolicy {
+  CATCHUP_SKIP = 0,          // Drop missed slots, wait for the next one
+  CATCHUP_FEED_ONCE = 1,     // One normal portion for any missed slot
+  CATCHUP_PROPORTIONAL = 2,  // Portion scaled by time left until next slot
+};
+
+// What a scheduled feed does about food still in the bowl
+enum TopUpPolicy {
+  TOPUP_THRESHOLD = 0,   // Skip if the bowl holds FEED_THRESHOLD or more
+  TOPUP_FULL = 1,        // Full portion regardless
+  TOPUP_DIFFERENCE = 2,  // Only what is missing up to the portion
+};
+
+// One feeding slot with its persisted "last fired" cursor
+struct ScheduleSlot {
+  uint16_t minutes;    // Minutes since local midnight
+  uint16_t reserved;   // Padding, keeps the record 4-byte aligned
+  uint32_t lastFired;  // Local epoch of the last occurrence handled (0 = new)
+};
+
+// Flash record holding all slots
+struct ScheduleStore {
+  uint32_t magic;
+  uint8_t count;
+  uint8_t policy;
+  uint8_t topUp;  // TopUpPolicy + 1, 0 = FEED_TOPUP_POLICY (also what
+                  // records from before it existed hold)
+  uint8_t reserved;
+  ScheduleSlot slots[MAX_SCHEDULES];
+  uint32_t crc;
+};
+
+static_assert(sizeof(ScheduleStore) <=
+                  EEPROM_JOURNAL_ADDR - EEPROM_SCHEDULE_ADDR,
+              "Schedule record overlaps the feeding journal");
+
+static const uint32_t SCHEDULE_STORE_MAGIC = 0x53434844;  // "SCHD"
+static const uint32_t SECONDS_PER_DAY = 86400UL;
+
+static ScheduleStore scheduleStore;
+static bool scheduleStoreLoaded = false;
+
+/**
+ * Load schedule cursors from flash, starting empty if the record is missing
+ * or corrupted. A corrupted record never causes a feed: new slots start with
+ * their cursor on the most recent occurrence.
+ */
+void loadSchedules() {
+  if (scheduleStoreLoaded) return;
+  scheduleStoreLoaded = true;
+
+  if (persistLoad(EEPROM_SCHEDULE_ADDR, scheduleStore) &&
+      scheduleStore.magic == SCHEDULE_STORE_MAGIC &&
+      scheduleStore.count <= MAX_SCHEDULES) {
+    DEBUG_PRINT(F("Loaded "));
+    DEBUG_PRINT(scheduleStore.count);
+    DEBUG_PRINTLN(F(" schedule cursor(s) from flash"));
+    return;
+  }
+
+  DEBUG_PRINTLN(F("No valid schedule store, starting empty"));
+  memset(&scheduleStore, 0, sizeof(scheduleStore));
+  scheduleStore.magic = SCHEDULE_STORE_MAGIC;
+  scheduleStore.policy = SCHEDULE_CATCHUP_POLICY;
+}
+
+/**
+ * Write schedule cursors to flash
+ * @return true if the record was committed
+ */
+bool saveSchedules() {
+  bool saved = persistSave(EEPROM_SCHEDULE_ADDR, scheduleStore);
+  if (!saved) {
+    DEBUG_PRINTLN(F("Failed to commit schedule cursors!"));
+  }
+  return saved;
+}
+
+/**
+ * Most recent occurrence of a daily slot at or before now
+ * @param minutes Minutes since local midnight
+ * @param now Current local epoch
+ * @return Local epoch of the occurrence
+ */
+uint32_t lastScheduleOccurrence(uint16_t minutes, uint32_t now) {
+  uint32_t occurrence = now - (now % SECONDS_PER_DAY) + minutes * 60UL;
+  if (occurrence > now) occurrence -= SECONDS_PER_DAY;
+  return occurrence;
+}
+
+/**
+ * Replace the schedule list, keeping cursors of slots that still exist
+ * @param minutes Slot times in minutes since local midnight
+ * @param count Number of slots
+ * @param now Current local epoch (0 if time is not known yet)
+ */
+void setSchedules(const uint16_t* minutes, uint8_t count, uint32_t now) {
+  loadSchedules();
+  if (count > MAX_SCHEDULES) count = MAX_SCHEDULES;
+
+  ScheduleSlot updated[MAX_SCHEDULES];
+  bool changed = (count != scheduleStore.count);
+
+  for (uint8_t i = 0; i < count; i++) {
+    updated[i].minutes = minutes[i];
+    updated[i].reserved = 0;
+
+    // A newly added slot must not look "missed", so its cursor starts at the
+    // most recent occurrence (or is resolved once time becomes valid)
+    updated[i].lastFired =
+        (now > 0) ? lastScheduleOccurrence(minutes[i], now) : 0;
+
+    for (uint8_t j = 0; j < scheduleStore.count; j++) {
+      if (scheduleStore.slots[j].minutes == minutes[i]) {
+        updated[i].lastFired = scheduleStore.slots[j].lastFired;
+        break;
+      }
+    }
+
+    if (i >= scheduleStore.count ||
+        scheduleStore.slots[i].minutes != updated[i].minutes ||
+        scheduleStore.slots[i].lastFired != updated[i].lastFired) {
+      changed = true;
+    }
+  }
+
+  if (!changed) return;
+
+  memcpy(scheduleStore.slots, updated, count * sizeof(ScheduleSlot));
+  scheduleStore.count = count;
+  saveSchedules();
+}
+
+/**
+ * Change the missed-schedule policy
+ * @param policy One of CatchUpPolicy
+ */
+void setCatchUpPolicy(uint8_t policy) {
+  loadSchedules();
+  if (policy > CATCHUP_PROPORTIONAL || policy == scheduleStore.policy) return;
+
+  scheduleStore.policy = policy;
+  saveSchedules();
+}
+
+/**
+ * Change what scheduled feeds do about food left in the bowl
+ * @param policy One of TopUpPolicy
+ */
+void setTopUpPolicy(uint8_t policy) {
+  loadSchedules();
+  if (policy > TOPUP_DIFFERENCE || policy + 1 == scheduleStore.topUp) return;
+
+  scheduleStore.topUp = policy + 1;
+  saveSchedules();
+}
+
+/**
+ * @return Top-up policy in effect, one of TopUpPolicy
+ */
+uint8_t topUpPolicy() {
+  loadSchedules();
+  return scheduleStore.topUp > 0 ? scheduleStore.topUp - 1
+                                 : FEED_TOPUP_POLICY;
+}
+
+/**
+ * Portion of a scheduled feed after the top-up policy
+ * @param portion Scheduled portion (g)
+ * @param inBowl Food already in the bowl (g)
+ * @param credit Grams a session cut short by a reset already gave out for
+ *        this slot. Topping up to the portion counts them with the bowl,
+ *        the other policies deduct them.
+ * @return Grams to dispense, 0 to skip the feed
+ */
+float scheduledPortion(float portion, float inBowl, float credit = 0) {
+  switch (topUpPolicy()) {
+    case TOPUP_FULL:
+      return max(portion - credit, 0.0f);
+
+    case TOPUP_DIFFERENCE:
+      return max(portion - inBowl, 0.0f);
+
+    case TOPUP_THRESHOLD:
+    default:
+      return inBowl >= FEED_THRESHOLD ? 0 : max(portion - credit, 0.0f);
+  }
+}
+
+/**
+ * @return true if at least one schedule is stored
+ */
+bool hasStoredSchedules() {
+  loadSchedules();
+  return scheduleStore.count > 0;
+}
+
+/**
+ * Next upcoming slot after now
+ * @param now Current local epoch
+ * @return Local epoch of the next slot, or 0 if there are no schedules
+ */
+uint32_t nextScheduleTime(uint32_t now) {
+  loadSchedules();
+  uint32_t next = 0;
+
+  for (uint8_t i = 0; i < scheduleStore.count; i++) {
+    uint32_t occurrence =
+        lastScheduleOccurrence(scheduleStore.slots[i].minutes, now) +
+        SECONDS_PER_DAY;
+    if (next == 0 || occurrence < next) next = occurrence;
+  }
+
+  return next;
+}
+
+/**
+ * Advance all cursors up to now and decide how much food is owed.
+ * Cursors are committed to flash BEFORE the caller feeds, so a power cut at
+ * any point can lose a feed but never repeat one.
+ * @param now Current local epoch
+ * @return Grams to dispense now (0 if nothing is due)
+ */
+float collectScheduledFeeding(uint32_t now) {
+  loadSchedules();
+
+  bool changed = false;
+  bool due = false;
+  uint32_t newestMissed = 0;
+
+  for (uint8_t i = 0; i < scheduleStore.count; i++) {
+    ScheduleSlot& slot = scheduleStore.slots[i];
+    uint32_t occurrence = lastScheduleOccurrence(slot.minutes, now);
+
+    // Slot added before time was known - start tracking from here
+    if (slot.lastFired == 0) {
+      slot.lastFired = occurrence;
+      changed = true;
+      continue;
+    }
+
+    if (occurrence <= slot.lastFired) continue;
+
+    slot.lastFired = occurrence;
+    changed = true;
+
+    uint32_t age = now - occurrence;
+    if (age <= SCHEDULE_DUE_WINDOW) {
+      due = true;
+    } else if (age <= SCHEDULE_CATCHUP_MAX_AGE && occurrence > newestMissed) {
+      newestMissed = occurrence;
+    }
+  }
+
+  if (!changed) return 0;
+
+  float grams = 0;
+  if (due) {
+    // An on-time slot also covers anything missed before it
+    grams = FEED_WEIGHT;
+  } else if (newestMissed > 0) {
+    switch (scheduleStore.policy) {
+      case CATCHUP_FEED_ONCE:
+        grams = FEED_WEIGHT;
+        break;
+
+      case CATCHUP_PROPORTIONAL: {
+        // Scale by how much of the gap to the next slot is still ahead
+        uint32_t next = nextScheduleTime(now);
+        float fraction =
+            (float)(next - now) / (float)(next - newestMissed);
+        grams = FEED_WEIGHT * constrain(fraction, 0.0f, 1.0f);
+        if (grams < SCHEDULE_CATCHUP_MIN_PORTION) grams = 0;
+        break;
+      }
+
+      case CATCHUP_SKIP:
+      default:
+        grams = 0;
+        break;
+    }
+
+    DEBUG_PRINT(F("Missed schedule detected, catch-up portion: "));
+    DEBUG_PRINT(grams);
+    DEBUG_PRINTLN(F("g"));
+  }
+
+  // Never feed on a cursor that is not durable - that is what could repeat
+  if (!saveSchedules()) return 0;
+
+  return grams;
+}
+
+/**
+ * Fire any due or missed schedule through the pre-feed gate. Call every
+ * SCHEDULE_CHECK_INTERVAL once time is valid.
+ * @param now Current local epoch
+ */
+void serviceSchedules(uint32_t now) {
+  float grams = collectScheduledFeeding(now);
+  if (grams > 0) {
+    char details[40];
+    snprintf(details, sizeof(details), "Scheduled feeding: %.1fg", grams);
+    sendLogEvent("scheduled_feed", details);
+    feedGateRequest(grams, now);
+  }
+
+  feedGateService(now);
+}
+
+#endif  // SCHEDULE_HELPERS_H
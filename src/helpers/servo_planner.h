@@ -0,0 +1,203 @@
+#ifndef SERVO_PLANNER_H
+#define SERVO_PLANNER_H
+
+#include <Arduino.h>
+#include <Servo.h>
+
+#include "../config.h"
+#include "../pins.h"
+#include "task_scheduler.h"
+
+// Non-blocking hatch motion. A move is a target angle plus either a
+// duration (linear interpolation) or a slew rate (the flow controller
+// retargets those while they run). hatchTick() advances the move and only
+// writes the PWM when the whole-degree angle changes. A jump writes the
+// target at once but still counts as moving for as long as the servo takes
+// at SERVO_MAX_RATE, so a completion event means the hatch has arrived.
+//
+// Once the hatch rests closed for SERVO_DETACH_DELAY the PWM is detached:
+// no jitter and no holding current while idle. The next move re-attaches.
+// An open hatch is always held.
+//
+// hatchTick() runs as the "servo" scheduler task, enabled only while a
+// move runs or the PWM is attached. Loops that block the scheduler (the
+// dispense loop) call it themselves.
+
+extern Servo hatchServo;
+
+struct ServoMotion {
+  float angle;          // Angle commanded now
+  float from;           // Start of a timed move
+  float target;
+  float rate;           // Slew rate of a rate move (deg/s), 0 = timed
+  uint32_t startMs;     // Timed move start
+  uint32_t durationMs;  // Timed move length
+  uint32_t lastMs;      // Previous tick
+  uint32_t doneAt;      // millis() the last move finished
+  int16_t written;      // Last angle sent to the servo (-1 = none)
+  bool moving;
+  bool attached;
+  bool completed;  // Motion-complete event not taken yet
+};
+
+static ServoMotion hatchMotion = {
+    SERVO_CLOSE_ANGLE, SERVO_CLOSE_ANGLE, SERVO_CLOSE_ANGLE, 0, 0, 0, 0, 0,
+    -1, false, false, false};
+static int8_t hatchTaskId = -1;
+
+void hatchTick();
+
+/**
+ * Register the servo task (safe to call repeatedly). Without it moves
+ * still work, advanced by whoever calls hatchTick(). A servo the sketch
+ * attached itself is taken as resting closed and detached in time.
+ */
+void hatchPlannerBegin() {
+  if (hatchTaskId >= 0) return;
+  if (!hatchMotion.attached && hatchServo.attached()) {
+    hatchMotion.attached = true;
+    hatchMotion.doneAt = millis();
+  }
+  hatchTaskId = schedulerAddTask("servo", hatchTick, SERVO_TICK_INTERVAL,
+                                 TASK_PRIORITY_HIGH);
+  schedulerEnable(hatchTaskId, hatchMotion.moving || hatchMotion.attached);
+}
+
+/**
+ * Send an angle to the servo, attaching the PWM if needed
+ */
+static void hatchWrite(float angle) {
+  int16_t degrees = (int16_t)(angle + 0.5f);
+  if (!hatchMotion.attached) {
+    hatchServo.attach(SERVO_PIN);
+    hatchMotion.attached = true;
+    hatchMotion.written = -1;
+  }
+  if (degrees == hatchMotion.written) return;
+  hatchServo.write(degrees);
+  hatchMotion.written = degrees;
+}
+
+/**
+ * Common start of every move
+ */
+static void hatchBeginMove(float target) {
+  uint32_t now = millis();
+  if (!hatchMotion.moving) hatchMotion.lastMs = now;
+  hatchMotion.from = hatchMotion.angle;
+  hatchMotion.target = target;
+  hatchMotion.startMs = now;
+  hatchMotion.moving = true;
+  hatchMotion.completed = false;
+  schedulerEnable(hatchTaskId, true);
+}
+
+/**
+ * Move to an angle in a given time
+ * @param angle Target angle
+ * @param durationMs Time for the move (0 = jump)
+ */
+void hatchMoveTo(float angle, uint32_t durationMs) {
+  hatchBeginMove(angle);
+  hatchMotion.rate = 0;
+  hatchMotion.durationMs = durationMs;
+  if (durationMs == 0) {
+    hatchMotion.angle = angle;
+    hatchWrite(angle);
+  }
+}
+
+/**
+ * Move to an angle at a given rate. Calling it again while the move runs
+ * just changes the target.
+ * @param angle Target angle
+ * @param rate Slew rate (deg/s)
+ */
+void hatchMoveAt(float angle, float rate) {
+  if (hatchMotion.moving && hatchMotion.rate > 0) {
+    hatchMotion.target = angle;
+    hatchMotion.rate = rate;
+    return;
+  }
+  if (!hatchMotion.moving && angle == hatchMotion.angle) return;
+
+  hatchBeginMove(angle);
+  hatchMotion.rate = rate;
+}
+
+/**
+ * Command an angle at once (e.g. to close the hatch). The move completes
+ * when the servo can have got there.
+ */
+void hatchJump(float angle) {
+  float travel = fabs(angle - hatchMotion.angle);
+  hatchBeginMove(angle);
+  hatchMotion.rate = 0;
+  hatchMotion.durationMs = (uint32_t)(travel * 1000 / SERVO_MAX_RATE);
+  hatchMotion.from = angle;
+  hatchMotion.angle = angle;
+  hatchWrite(angle);
+}
+
+/**
+ * @return true while a move runs
+ */
+bool hatchMoving() { return hatchMotion.moving; }
+
+/**
+ * Take the motion-complete event
+ * @return true once after each finished move
+ */
+bool hatchMotionDone() {
+  if (!hatchMotion.completed) return false;
+  hatchMotion.completed = false;
+  return true;
+}
+
+/**
+ * Advance the current move, and detach the PWM of an idle closed hatch
+ */
+void hatchTick() {
+  uint32_t now = millis();
+  float dt = (now - hatchMotion.lastMs) / 1000.0f;
+  hatchMotion.lastMs = now;
+
+  if (hatchMotion.moving) {
+    bool arrived;
+    if (hatchMotion.rate > 0) {
+      float error = hatchMotion.target - hatchMotion.angle;
+      float step = hatchMotion.rate * dt;
+      arrived = fabs(error) <= step;
+      if (arrived) {
+        hatchMotion.angle = hatchMotion.target;
+      } else {
+        hatchMotion.angle += error > 0 ? step : -step;
+      }
+    } else {
+      uint32_t elapsed = now - hatchMotion.startMs;
+      arrived = elapsed >= hatchMotion.durationMs;
+      float t = arrived ? 1.0f : (float)elapsed / hatchMotion.durationMs;
+      hatchMotion.angle =
+          hatchMotion.from + t * (hatchMotion.target - hatchMotion.from);
+    }
+    hatchWrite(hatchMotion.angle);
+
+    if (arrived) {
+      hatchMotion.moving = false;
+      hatchMotion.completed = true;
+      hatchMotion.doneAt = now;
+    }
+    return;
+  }
+
+  if (hatchMotion.attached && hatchMotion.angle == SERVO_CLOSE_ANGLE &&
+      now - hatchMotion.doneAt >= SERVO_DETACH_DELAY) {
+    hatchServo.detach();
+    hatchMotion.attached = false;
+  }
+  if (!hatchMotion.attached || hatchMotion.angle != SERVO_CLOSE_ANGLE) {
+    schedulerEnable(hatchTaskId, false);
+  }
+}
+
+#endif  // SERVO_PLANNER_H
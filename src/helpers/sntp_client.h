@@ -0,0 +1,335 @@
+#ifndef SNTP_CLIENT_H
+#define SNTP_CLIENT_H
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <WiFiUdp.h>
+
+#include "../config.h"
+#include "connectivity.h"
+
+// Non-blocking SNTP clock, a drop-in for the NTPClient calls used here.
+// update() never waits: one call sends the request, later calls pick up the
+// reply when it has arrived. Lost or slow replies move on to the next
+// server with exponential backoff.
+//
+// Between syncs time is extrapolated from millis() corrected by the measured
+// oscillator drift. Drift is estimated from the clock error accumulated over
+// spans of at least NTP_DRIFT_MIN_SPAN and smoothed, so long gaps between
+// syncs (or a dead network) stay accurate to a few ppm instead of the
+// crystal's tens of ppm.
+
+static const uint32_t NTP_UNIX_OFFSET = 2208988800UL;  // 1900 -> 1970 (s)
+static const uint16_t NTP_PORT = 123;
+static const uint8_t NTP_PACKET_SIZE = 48;
+static const uint32_t NTP_REBASE_INTERVAL = 86400000UL;  // Keeps millis()
+                                                          // spans short
+static const float NTP_DRIFT_SMOOTHING = 0.3f;
+
+class SntpClock {
+ public:
+  SntpClock(WiFiUDP& udp, const char* const* servers, uint8_t serverCount,
+            long offsetSeconds, uint32_t syncIntervalMs)
+      : udp_(udp),
+        servers_(servers),
+        serverCount_(serverCount < NTP_MAX_SERVERS ? serverCount
+                                                   : NTP_MAX_SERVERS),
+        offsetSeconds_(offsetSeconds),
+        syncIntervalMs_(syncIntervalMs) {}
+
+  /**
+   * Open the UDP socket (sync starts on the next update())
+   */
+  void begin() {
+    if (started_) return;
+    started_ = true;
+    udp_.begin(NTP_LOCAL_PORT);
+    nextAttemptMs_ = millis();
+  }
+
+  /**
+   * Advance the request/reply state machine, never blocks on the network
+   * @return true if the time is set
+   */
+  bool update() {
+    if (!started_) begin();
+
+    uint32_t now = millis();
+
+    // Keep the extrapolation span well inside millis() wrap-around
+    if (timeSet_ && now - anchorMillis_ >= NTP_REBASE_INTERVAL) {
+      anchorUnixMs_ = unixMsAt(now);
+      anchorMillis_ = now;
+    }
+
+    if (waiting_) {
+      if (receive(now)) return true;
+
+      if (waiting_ && now - sentAt_ >= NTP_RESPONSE_TIMEOUT) {
+        DEBUG_PRINT(F("NTP: no reply from "));
+        DEBUG_PRINTLN(servers_[server_]);
+
+        // The pool may have rotated the address, but a lookup stalls the
+        // loop, so only look again after NTP_RERESOLVE_MISSES in a row
+        if (++misses_[server_] >= NTP_RERESOLVE_MISSES) {
+          resolved_[server_] = false;
+          misses_[server_] = 0;
+        }
+        fail(now);
+      }
+    } else if ((int32_t)(now - nextAttemptMs_) >= 0 && netWifiUp()) {
+      send(now);
+    }
+
+    return timeSet_;
+  }
+
+  /**
+   * @return Milliseconds until update() has something to do
+   */
+  uint32_t pollDelay() const {
+    if (waiting_) return NTP_RESPONSE_POLL;
+
+    // Overdue but offline: nothing to send until WiFi is back
+    int32_t remaining = (int32_t)(nextAttemptMs_ - millis());
+    if (remaining <= 0) return netWifiUp() ? NTP_RESPONSE_POLL : NTP_RETRY_MIN;
+    return (uint32_t)remaining;
+  }
+
+  bool isTimeSet() const { return timeSet_; }
+
+  /**
+   * @return Local epoch in seconds (timezone offset applied)
+   */
+  unsigned long getEpochTime() const {
+    return (unsigned long)(unixMsAt(millis()) / 1000ULL) + offsetSeconds_;
+  }
+
+  int getDay() const { return ((getEpochTime() / 86400L) + 4) % 7; }
+  int getHours() const { return (getEpochTime() % 86400L) / 3600; }
+  int getMinutes() const { return (getEpochTime() % 3600) / 60; }
+  int getSeconds() const { return getEpochTime() % 60; }
+
+  /**
+   * @return Local time as HH:MM:SS
+   */
+  String getFormattedTime() const {
+    char text[9];
+    snprintf(text, sizeof(text), "%02d:%02d:%02d", getHours(), getMinutes(),
+             getSeconds());
+    return String(text);
+  }
+
+  float driftPpm() const { return driftPpm_; }
+  int32_t lastOffsetMs() const { return lastOffsetMs_; }
+  uint32_t lastRttMs() const { return lastRttMs_; }
+  uint32_t syncCount() const { return syncs_; }
+  uint32_t failureCount() const { return failures_; }
+
+  /**
+   * Print sync statistics
+   * @param out Output stream (e.g. Serial)
+   */
+  void printReport(Print& out) const {
+    out.print(F("NTP: syncs="));
+    out.print(syncs_);
+    out.print(F(" failures="));
+    out.print(failures_);
+    out.print(F(" rtt="));
+    out.print(lastRttMs_);
+    out.print(F("ms offset="));
+    out.print(lastOffsetMs_);
+    out.print(F("ms drift="));
+    out.print(driftPpm_);
+    out.println(F("ppm"));
+  }
+
+ private:
+  /**
+   * Estimated Unix time in ms at a millis() reading
+   */
+  uint64_t unixMsAt(uint32_t ms) const {
+    if (!timeSet_) return 0;
+
+    int32_t elapsed = (int32_t)(ms - anchorMillis_);
+    return anchorUnixMs_ + elapsed + (int64_t)(elapsed * driftPpm_ / 1e6f);
+  }
+
+  static uint32_t readWord(const uint8_t* bytes) {
+    return ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16) |
+           ((uint32_t)bytes[2] << 8) | bytes[3];
+  }
+
+  /**
+   * NTP timestamp (seconds since 1900 + 32-bit fraction) to Unix ms
+   */
+  static uint64_t ntpToUnixMs(const uint8_t* bytes) {
+    uint32_t seconds = readWord(bytes) - NTP_UNIX_OFFSET;
+    uint32_t fraction = readWord(bytes + 4);
+    return (uint64_t)seconds * 1000ULL + (((uint64_t)fraction * 1000) >> 32);
+  }
+
+  void send(uint32_t now) {
+    // DNS lookups block (up to NTP_DNS_TIMEOUT), so resolve once and reuse
+    // the address
+    if (!resolved_[server_]) {
+      if (!WiFi.hostByName(servers_[server_], serverIp_[server_],
+                           NTP_DNS_TIMEOUT)) {
+        DEBUG_PRINT(F("NTP: cannot resolve "));
+        DEBUG_PRINTLN(servers_[server_]);
+        fail(now);
+        return;
+      }
+      resolved_[server_] = true;
+    }
+
+    uint8_t packet[NTP_PACKET_SIZE];
+    memset(packet, 0, sizeof(packet));
+    packet[0] = 0x23;  // LI 0, version 4, client mode
+
+    // Random transmit stamp, the server echoes it back as "originate"
+    nonce_[0] = micros() ^ (syncs_ << 16);
+    nonce_[1] = ESP.getCycleCount();
+    for (uint8_t i = 0; i < 4; i++) {
+      packet[40 + i] = nonce_[0] >> (24 - 8 * i);
+      packet[44 + i] = nonce_[1] >> (24 - 8 * i);
+    }
+
+    // Drop stale replies from an earlier request
+    while (udp_.parsePacket() > 0) udp_.flush();
+
+    udp_.beginPacket(serverIp_[server_], NTP_PORT);
+    udp_.write(packet, sizeof(packet));
+    if (!udp_.endPacket()) {
+      fail(now);
+      return;
+    }
+
+    waiting_ = true;
+    sentAt_ = millis();
+  }
+
+  bool receive(uint32_t now) {
+    if (udp_.parsePacket() < NTP_PACKET_SIZE) return false;
+
+    uint8_t packet[NTP_PACKET_SIZE];
+    udp_.read(packet, sizeof(packet));
+    uint32_t receivedAt = millis();
+
+    // Reply must answer our request, come from a synchronised server mode
+    // and carry a sane stratum
+    uint8_t leap = packet[0] >> 6;
+    uint8_t mode = packet[0] & 0x07;
+    uint8_t stratum = packet[1];
+    if (readWord(packet + 24) != nonce_[0] ||
+        readWord(packet + 28) != nonce_[1] || mode != 4 || leap == 3 ||
+        stratum == 0 || stratum > 15) {
+      return false;  // Keep waiting for the right reply until the timeout
+    }
+
+    uint64_t serverReceive = ntpToUnixMs(packet + 32);
+    uint64_t serverTransmit = ntpToUnixMs(packet + 40);
+
+    // Round trip minus the time the server held the request
+    int32_t rtt = (int32_t)(receivedAt - sentAt_) -
+                  (int32_t)(serverTransmit - serverReceive);
+    if (rtt < 0) rtt = 0;
+    if (rtt > NTP_MAX_RTT) {
+      DEBUG_PRINTLN(F("NTP: reply too slow, discarded"));
+      fail(now);
+      return false;
+    }
+
+    applySample(serverTransmit + rtt / 2, receivedAt);
+    lastRttMs_ = rtt;
+    waiting_ = false;
+    attempt_ = 0;
+    misses_[server_] = 0;
+    syncs_++;
+    nextAttemptMs_ = receivedAt + syncIntervalMs_;
+    return true;
+  }
+
+  /**
+   * Re-anchor the clock on a measurement and refine the drift estimate
+   * @param unixMs Server time at receivedAt
+   * @param receivedAt millis() of the measurement
+   */
+  void applySample(uint64_t unixMs, uint32_t receivedAt) {
+    if (timeSet_) {
+      lastOffsetMs_ = (int32_t)(int64_t)(unixMs - unixMsAt(receivedAt));
+
+      // Only spans long enough for the error to dominate the RTT noise
+      uint32_t span = receivedAt - driftRefMillis_;
+      if (span >= NTP_DRIFT_MIN_SPAN) {
+        int64_t error = (int64_t)(unixMs - driftRefUnixMs_) - span;
+        float measured = error * 1e6f / span;
+        measured = constrain(measured, -NTP_DRIFT_MAX_PPM, NTP_DRIFT_MAX_PPM);
+        driftPpm_ = driftSamples_ == 0
+                        ? measured
+                        : driftPpm_ + NTP_DRIFT_SMOOTHING *
+                                          (measured - driftPpm_);
+        driftSamples_++;
+        driftRefUnixMs_ = unixMs;
+        driftRefMillis_ = receivedAt;
+      }
+    } else {
+      driftRefUnixMs_ = unixMs;
+      driftRefMillis_ = receivedAt;
+      DEBUG_PRINT(F("NTP: time set from "));
+      DEBUG_PRINTLN(servers_[server_]);
+    }
+
+    anchorUnixMs_ = unixMs;
+    anchorMillis_ = receivedAt;
+    timeSet_ = true;
+  }
+
+  /**
+   * Give up on this request, try the next server after a backoff
+   */
+  void fail(uint32_t now) {
+    waiting_ = false;
+    failures_++;
+    attempt_++;
+    server_ = (server_ + 1) % serverCount_;
+
+    uint32_t backoff = NTP_RETRY_MIN << (attempt_ < 6 ? attempt_ - 1 : 5);
+    nextAttemptMs_ = now + (backoff < NTP_RETRY_MAX ? backoff : NTP_RETRY_MAX);
+  }
+
+  WiFiUDP& udp_;
+  const char* const* servers_;
+  uint8_t serverCount_;
+  long offsetSeconds_;
+  uint32_t syncIntervalMs_;
+
+  IPAddress serverIp_[NTP_MAX_SERVERS];
+  bool resolved_[NTP_MAX_SERVERS] = {};
+  uint8_t misses_[NTP_MAX_SERVERS] = {};  // Reply timeouts in a row
+  uint8_t server_ = 0;
+
+  bool started_ = false;
+  bool waiting_ = false;
+  uint32_t sentAt_ = 0;
+  uint32_t nextAttemptMs_ = 0;
+  uint8_t attempt_ = 0;
+  uint32_t nonce_[2] = {0, 0};
+
+  // Clock model: unix = anchor + elapsed * (1 + drift)
+  bool timeSet_ = false;
+  uint64_t anchorUnixMs_ = 0;
+  uint32_t anchorMillis_ = 0;
+  float driftPpm_ = 0;
+  uint64_t driftRefUnixMs_ = 0;
+  uint32_t driftRefMillis_ = 0;
+  uint16_t driftSamples_ = 0;
+
+  // Statistics
+  int32_t lastOffsetMs_ = 0;
+  uint32_t lastRttMs_ = 0;
+  uint32_t syncs_ = 0;
+  uint32_t failures_ = 0;
+};
+
+#endif  // SNTP_CLIENT_H
@@ -0,0 +1,360 @@
+#ifndef TASK_SCHEDULER_H
+#define TASK_SCHEDULER_H
+
+#include <Arduino.h>
+
+#include "../config.h"
+#include "breadcrumbs.h"
+#include "profiler.h"
+
+// Cooperative scheduler: periodic tasks live in a min-heap ordered by their
+// next deadline, so loop() runs only what is due and then sleeps until the
+// next deadline instead of spinning on delay(10).
+
+typedef void (*TaskCallback)();
+typedef void (*IdleHook)(uint32_t idleMs);
+
+// Lower value runs first when several tasks are due together
+enum TaskPriority {
+  TASK_PRIORITY_HIGH = 0,
+  TASK_PRIORITY_NORMAL = 1,
+  TASK_PRIORITY_LOW = 2
+};
+
+struct Task {
+  const char* name;
+  TaskCallback callback;
+  uint32_t interval;  // Period in ms (0 = one-shot)
+  uint32_t nextRun;   // millis() deadline
+  uint32_t budgetUs;  // Expected worst-case run time (0 = unchecked)
+  uint8_t priority;
+  bool enabled;
+
+  // Statistics
+  uint32_t runs;
+  uint32_t overruns;        // Runs that exceeded budgetUs
+  uint32_t maxLatenessMs;   // Worst start delay after the deadline
+  uint32_t totalLatenessMs;
+  uint32_t maxRunUs;
+};
+
+static Task tasks[MAX_TASKS];
+static uint8_t taskCount = 0;
+
+// Min-heap of task ids keyed by nextRun
+static uint8_t taskHeap[MAX_TASKS];
+static uint8_t taskHeapSize = 0;
+
+static void defaultIdleHook(uint32_t idleMs) { delay(idleMs); }
+static IdleHook schedulerIdleHook = defaultIdleHook;
+
+// Loop accounting for idle percentage
+static uint32_t schedulerStatsStart = 0;
+static uint32_t schedulerIdleMs = 0;
+
+// Wrap-safe deadline comparison
+static inline bool deadlineBefore(uint32_t a, uint32_t b) {
+  return (int32_t)(a - b) < 0;
+}
+
+static void heapSwap(uint8_t i, uint8_t j) {
+  uint8_t temp = taskHeap[i];
+  taskHeap[i] = taskHeap[j];
+  taskHeap[j] = temp;
+}
+
+static void heapPush(uint8_t id) {
+  uint8_t i = taskHeapSize++;
+  taskHeap[i] = id;
+
+  // Sift up
+  while (i > 0) {
+    uint8_t parent = (i - 1) / 2;
+    if (!deadlineBefore(tasks[taskHeap[i]].nextRun,
+                        tasks[taskHeap[parent]].nextRun)) {
+      break;
+    }
+    heapSwap(i, parent);
+    i = parent;
+  }
+}
+
+static uint8_t heapPop() {
+  uint8_t top = taskHeap[0];
+  taskHeap[0] = taskHeap[--taskHeapSize];
+
+  // Sift down
+  uint8_t i = 0;
+  while (true) {
+    uint8_t left = 2 * i + 1;
+    uint8_t right = left + 1;
+    uint8_t smallest = i;
+
+    if (left < taskHeapSize &&
+        deadlineBefore(tasks[taskHeap[left]].nextRun,
+                       tasks[taskHeap[smallest]].nextRun)) {
+      smallest = left;
+    }
+    if (right < taskHeapSize &&
+        deadlineBefore(tasks[taskHeap[right]].nextRun,
+                       tasks[taskHeap[smallest]].nextRun)) {
+      smallest = right;
+    }
+    if (smallest == i) break;
+
+    heapSwap(i, smallest);
+    i = smallest;
+  }
+
+  return top;
+}
+
+static void heapRemove(uint8_t id) {
+  for (uint8_t i = 0; i < taskHeapSize; i++) {
+    if (taskHeap[i] == id) {
+      // Rebuild from the remaining entries (heap is tiny)
+      uint8_t remaining[MAX_TASKS];
+      uint8_t count = 0;
+      for (uint8_t j = 0; j < taskHeapSize; j++) {
+        if (j != i) remaining[count++] = taskHeap[j];
+      }
+      taskHeapSize = 0;
+      for (uint8_t j = 0; j < count; j++) heapPush(remaining[j]);
+      return;
+    }
+  }
+}
+
+/**
+ * Register a periodic task
+ * @param name Short name used in statistics
+ * @param callback Function to run
+ * @param interval Period in ms (0 for a one-shot task)
+ * @param priority Order among tasks due at the same time
+ * @param budgetUs Expected worst-case run time, overruns are counted
+ * @param firstDelay Delay before the first run in ms
+ * @return Task id, or -1 if the table is full
+ */
+int8_t schedulerAddTask(const char* name, TaskCallback callback,
+                        uint32_t interval,
+                        uint8_t priority = TASK_PRIORITY_NORMAL,
+                        uint32_t budgetUs = 0, uint32_t firstDelay = 0) {
+  if (taskCount >= MAX_TASKS) {
+    DEBUG_PRINTLN(F("Task table full!"));
+    return -1;
+  }
+
+  uint8_t id = taskCount++;
+  memset(&tasks[id], 0, sizeof(Task));
+  tasks[id].name = name;
+  tasks[id].callback = callback;
+  tasks[id].interval = interval;
+  tasks[id].priority = priority;
+  tasks[id].budgetUs = budgetUs;
+  tasks[id].nextRun = millis() + firstDelay;
+  tasks[id].enabled = true;
+
+  heapPush(id);
+  return id;
+}
+
+/**
+ * Move a task's next deadline
+ * @param id Task id
+ * @param delayMs Run after this many ms from now
+ */
+void schedulerRunIn(int8_t id, uint32_t delayMs) {
+  if (id < 0 || id >= taskCount) return;
+
+  heapRemove(id);
+  tasks[id].nextRun = millis() + delayMs;
+  tasks[id].enabled = true;
+  heapPush(id);
+}
+
+/**
+ * Change a task's period (applies from its next run)
+ * @param id Task id
+ * @param interval New period in ms
+ */
+void schedulerSetInterval(int8_t id, uint32_t interval) {
+  if (id < 0 || id >= taskCount) return;
+  tasks[id].interval = interval;
+}
+
+/**
+ * Enable or disable a task without removing it
+ * @param id Task id
+ * @param enabled Whether the task should run
+ */
+void schedulerEnable(int8_t id, bool enabled) {
+  if (id < 0 || id >= taskCount) return;
+
+  if (enabled && !tasks[id].enabled) {
+    schedulerRunIn(id, 0);
+  } else if (!enabled && tasks[id].enabled) {
+    tasks[id].enabled = false;
+    heapRemove(id);
+  }
+}
+
+/**
+ * @return Milliseconds until the earliest deadline (0 if one is due)
+ */
+uint32_t schedulerTimeToNext() {
+  if (taskHeapSize == 0) return SCHEDULER_MAX_IDLE;
+
+  int32_t remaining = (int32_t)(tasks[taskHeap[0]].nextRun - millis());
+  if (remaining <= 0) return 0;
+  return (remaining < SCHEDULER_MAX_IDLE) ? remaining : SCHEDULER_MAX_IDLE;
+}
+
+/**
+ * Run every task whose deadline has passed, highest priority first
+ */
+void schedulerRun() {
+  uint32_t now = millis();
+  if (schedulerStatsStart == 0) schedulerStatsStart = now;
+
+  // Pull every due task off the heap
+  uint8_t due[MAX_TASKS];
+  uint8_t dueCount = 0;
+  while (taskHeapSize > 0 &&
+         !deadlineBefore(now, tasks[taskHeap[0]].nextRun)) {
+    due[dueCount++] = heapPop();
+  }
+
+  // Order by priority, then by deadline (insertion sort, few entries)
+  for (uint8_t i = 1; i < dueCount; i++) {
+    uint8_t key = due[i];
+    int8_t j = i - 1;
+    while (j >= 0 && (tasks[due[j]].priority > tasks[key].priority ||
+                      (tasks[due[j]].priority == tasks[key].priority &&
+                       deadlineBefore(tasks[key].nextRun,
+                                      tasks[due[j]].nextRun)))) {
+      due[j + 1] = due[j];
+      j--;
+    }
+    due[j + 1] = key;
+  }
+
+  for (uint8_t i = 0; i < dueCount; i++) {
+    Task& task = tasks[due[i]];
+
+    // Lateness is the loop jitter seen by this task
+    uint32_t start = millis();
+    uint32_t lateness = start - task.nextRun;
+    if (lateness > task.maxLatenessMs) task.maxLatenessMs = lateness;
+    task.totalLatenessMs += lateness;
+#ifdef PROFILING
+    static int8_t latencyProbe = profilerProbe("loop-latency");
+    profilerRecord(latencyProbe, lateness * 1000UL);
+#endif
+
+    crumbTask(due[i]);
+    uint32_t startUs = micros();
+    task.callback();
+    uint32_t runUs = micros() - startUs;
+
+    task.runs++;
+    if (runUs > task.maxRunUs) task.maxRunUs = runUs;
+    if (task.budgetUs > 0 && runUs > task.budgetUs) {
+      task.overruns++;
+      DEBUG_PRINT(F("Task over budget: "));
+      DEBUG_PRINT(task.name);
+      DEBUG_PRINT(F(" "));
+      DEBUG_PRINT(runUs);
+      DEBUG_PRINTLN(F("us"));
+    }
+
+    // The callback may have rescheduled or disabled itself
+    if (!task.enabled) continue;
+    bool queued = false;
+    for (uint8_t j = 0; j < taskHeapSize; j++) {
+      if (taskHeap[j] == due[i]) queued = true;
+    }
+    if (queued) continue;
+
+    if (task.interval == 0) {
+      task.enabled = false;
+      continue;
+    }
+
+    // Keep the cadence, but do not burst to catch up after a long stall:
+    // skip the missed runs and stay on the grid, so tasks whose periods
+    // divide each other keep waking together
+    task.nextRun += task.interval;
+    uint32_t finished = millis();
+    if (deadlineBefore(task.nextRun, finished)) {
+      uint32_t missed = (finished - task.nextRun) / task.interval + 1;
+      task.nextRun += missed * task.interval;
+    }
+    heapPush(due[i]);
+  }
+
+  yield();
+}
+
+/**
+ * Sleep until the next deadline through the idle hook
+ */
+void schedulerIdle() {
+  uint32_t idleMs = schedulerTimeToNext();
+  if (idleMs == 0) return;
+
+  uint32_t start = millis();
+  schedulerIdleHook(idleMs);
+  schedulerIdleMs += millis() - start;
+}
+
+/**
+ * Replace the idle hook (default: delay(), which still services WiFi)
+ * @param hook Function called with the time until the next deadline
+ */
+void schedulerSetIdleHook(IdleHook hook) {
+  schedulerIdleHook = hook ? hook : defaultIdleHook;
+}
+
+/**
+ * @return Share of time spent idle since start, in percent
+ */
+float schedulerIdlePercent() {
+  uint32_t elapsed = millis() - schedulerStatsStart;
+  if (schedulerStatsStart == 0 || elapsed == 0) return 100.0f;
+  return 100.0f * schedulerIdleMs / elapsed;
+}
+
+/**
+ * @return Name of a task ("?" for an unknown id)
+ */
+const char* schedulerTaskName(uint8_t id) {
+  return id < taskCount ? tasks[id].name : "?";
+}
+
+/**
+ * Print per-task jitter and run time plus the CPU idle percentage
+ * @param out Output stream (e.g. Serial)
+ */
+void schedulerPrintStats(Print& out) {
+  out.print(F("Scheduler idle: "));
+  out.print(schedulerIdlePercent(), 1);
+  out.println(F("%"));
+
+  for (uint8_t i = 0; i < taskCount; i++) {
+    const Task& task = tasks[i];
+    out.print(F("  "));
+    out.print(task.name);
+    out.print(F(": runs="));
+    out.print(task.runs);
+    out.print(F(" jitter avg/max="));
+    out.print(task.runs ? task.totalLatenessMs / task.runs : 0);
+    out.print(F("/"));
+    out.print(task.maxLatenessMs);
+    out.print(F("ms run max="));
+    out.print(task.maxRunUs);
+    out.print(F("us overruns="));
+    out.println(task.overruns);
+  }
+}
+
+#endif  // TASK_SCHEDULER_H
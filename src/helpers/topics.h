@@ -0,0 +1,117 @@
+#ifndef TOPICS_H
+#define TOPICS_H
+
+#include <Arduino.h>
+
+#include "../config.h"
+
+// Outbound topics the dashboards can subscribe to. The server sends the
+// union of what its dashboards watch as a "subscriptions" message, each
+// topic with the shortest interval any of them asked for. A topic that is
+// not listed is not published at all, so with no viewers the device is
+// down to heartbeat pings and the records the server keeps (feeding
+// reports, log events, crash reports, history answers), which bypass the
+// topics.
+//
+// Status topics (water, food) coalesce: an update inside the interval
+// replaces the pending one and the newest value goes out once the interval
+// has passed. Log events are always sent and the server filters the live
+// relay to dashboards by the "logs" topic; sendLogEvent() only fails while
+// offline, callers that must not lose an event check it and retry.
+
+enum Topic {
+  TOPIC_WATER = 0,   // Water level and pump status
+  TOPIC_FOOD = 1,    // Food level and feeding status
+  TOPIC_TRACE = 2,   // Live feeding trace (binary frames)
+  TOPIC_METRICS = 3, // Periodic profiler report
+  TOPIC_LOGS = 4,    // Log events
+  TOPIC_COUNT
+};
+
+struct TopicState {
+  const char* name;
+  bool wanted;
+  uint32_t interval;  // Shortest gap between two messages (ms)
+  uint32_t lastSent;  // millis() of the last message
+  uint32_t sent;
+  uint32_t dropped;   // Suppressed or replaced by a newer value
+};
+
+static TopicState topics[TOPIC_COUNT] = {
+    {"water", false, 0, 0, 0, 0},   {"food", false, 0, 0, 0, 0},
+    {"trace", false, 0, 0, 0, 0},   {"metrics", false, 0, 0, 0, 0},
+    {"logs", false, 0, 0, 0, 0},
+};
+
+/**
+ * @param name Topic name as used by the server
+ * @return Topic index, -1 if unknown
+ */
+int8_t topicByName(const char* name) {
+  if (!name) return -1;
+  for (uint8_t i = 0; i < TOPIC_COUNT; i++) {
+    if (strcmp(name, topics[i].name) == 0) return i;
+  }
+  return -1;
+}
+
+/**
+ * Forget all subscriptions (disconnect, or before applying a new set)
+ */
+void topicsClear() {
+  for (uint8_t i = 0; i < TOPIC_COUNT; i++) topics[i].wanted = false;
+}
+
+/**
+ * Mark a topic as watched
+ * @param topic Topic index
+ * @param interval Shortest gap between messages (ms), clamped to
+ *        TOPIC_MIN_INTERVAL (0 = TOPIC_DEFAULT_INTERVAL)
+ */
+void topicSubscribe(uint8_t topic, uint32_t interval) {
+  if (topic >= TOPIC_COUNT) return;
+  if (interval == 0) interval = TOPIC_DEFAULT_INTERVAL;
+  if (interval < TOPIC_MIN_INTERVAL) interval = TOPIC_MIN_INTERVAL;
+  topics[topic].wanted = true;
+  topics[topic].interval = interval;
+}
+
+/**
+ * @return true if some dashboard watches the topic
+ */
+bool topicWanted(uint8_t topic) {
+  return topic < TOPIC_COUNT && topics[topic].wanted;
+}
+
+/**
+ * @return true if no topic is watched (heartbeat-only traffic)
+ */
+bool topicsIdle() {
+  for (uint8_t i = 0; i < TOPIC_COUNT; i++) {
+    if (topics[i].wanted) return false;
+  }
+  return true;
+}
+
+/**
+ * @return true if a message on the topic may go out now
+ */
+bool topicDue(uint8_t topic) {
+  const TopicState& state = topics[topic];
+  return state.wanted && millis() - state.lastSent >= state.interval;
+}
+
+/**
+ * Record a message sent on the topic
+ */
+void topicSent(uint8_t topic) {
+  topics[topic].lastSent = millis();
+  topics[topic].sent++;
+}
+
+/**
+ * Record a message that was suppressed or replaced
+ */
+void topicDropped(uint8_t topic) { topics[topic].dropped++; }
+
+#endif  // TOPICS_H
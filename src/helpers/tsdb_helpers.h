@@ -0,0 +1,823 @@
+#ifndef TSDB_HELPERS_H
+#define TSDB_HELPERS_H
+
+#include <Arduino.h>
+#include <LittleFS.h>
+
+#include "../config.h"
+#include "persist_helpers.h"
+
+// Append-only time-series store for the bowl weight and the water height on
+// LittleFS. Points are packed Gorilla-style into fixed-size blocks: the
+// timestamp as a delta-of-delta, each float XORed with the previous one so
+// unchanged readings cost a single bit. Values are rounded to the sensor
+// resolution first, which keeps the XOR of noisy readings short.
+//
+// Every series has three tiers: raw points for an hour, 1-minute rollups
+// (min, max, avg) for a day and 15-minute rollups for 90 days. Each tier
+// writes one segment file per time window ("/ts/<metric><tier>/<window>")
+// and deletes windows past its retention when a new one opens, so old data
+// goes in whole files and LittleFS spreads the rewritten blocks over the
+// whole partition.
+//
+// A block is written when it fills up, and the open blocks are rewritten in
+// place every TSDB_SYNC_INTERVAL; a power cut loses at most that much.
+// Each block carries a CRC, so a torn write drops one block, not the file.
+
+enum TsdbMetric {
+  TSDB_WEIGHT = 0,  // Bowl weight (g)
+  TSDB_WATER = 1,   // Water height above the tank bottom (cm)
+  TSDB_METRICS = 2
+};
+
+enum TsdbTier {
+  TSDB_RAW = 0,      // Samples as taken
+  TSDB_MINUTE = 1,   // 1-minute min/max/avg
+  TSDB_QUARTER = 2,  // 15-minute min/max/avg
+  TSDB_TIERS = 3
+};
+
+static const uint8_t TSDB_MAX_VALUES = 3;  // Rollup points: min, max, avg
+
+struct TsdbTierInfo {
+  uint32_t step;       // Rollup bucket (s), 0 for raw points
+  uint32_t window;     // Span of one segment file (s)
+  uint32_t retention;  // Windows older than this are deleted (s)
+  uint8_t values;      // Floats per point
+};
+
+static const TsdbTierInfo tsdbTiers[TSDB_TIERS] = {
+    {0, TSDB_RAW_WINDOW, TSDB_RAW_RETENTION, 1},
+    {60, TSDB_MINUTE_WINDOW, TSDB_MINUTE_RETENTION, 3},
+    {900, TSDB_QUARTER_WINDOW, TSDB_QUARTER_RETENTION, 3}};
+
+static const char tsdbMetricCodes[TSDB_METRICS] = {'w', 'l'};
+static const float tsdbResolution[TSDB_METRICS] = {TSDB_WEIGHT_RESOLUTION,
+                                                    TSDB_WATER_RESOLUTION};
+
+struct TsdbBlock {
+  uint32_t start;  // Epoch of the first point
+  uint16_t count;  // Points in the block
+  uint16_t bits;   // Bits of data in use
+  uint8_t data[TSDB_BLOCK_SIZE - 12];
+  uint32_t crc;
+};
+
+static_assert(sizeof(TsdbBlock) == TSDB_BLOCK_SIZE,
+              "TSDB_BLOCK_SIZE must be a multiple of 4");
+
+static const uint16_t TSDB_BLOCK_BITS = sizeof(TsdbBlock::data) * 8;
+
+// Encoder (or decoder) position within a block
+struct TsdbCursor {
+  uint16_t bits;
+  uint32_t time;
+  int32_t delta;
+  uint32_t value[TSDB_MAX_VALUES];
+  uint8_t lead[TSDB_MAX_VALUES];   // Zero bits above the last XOR window
+  uint8_t trail[TSDB_MAX_VALUES];  // Zero bits below it (lead > 31 = none)
+};
+
+struct TsdbSeries {
+  TsdbBlock block;    // Open block
+  TsdbCursor cursor;  // Encoder state after its last point
+  uint32_t window;    // Window index of the open segment
+  uint16_t slot;      // Block slot of the open block in that segment
+  bool open;          // A segment has been opened since boot
+  bool dirty;         // Open block changed since it was last written
+  uint32_t last;      // Epoch of the newest point
+};
+
+struct TsdbBucket {
+  uint32_t index;  // Bucket number (epoch / step)
+  uint32_t count;  // Raw samples in the bucket
+  float min;
+  float max;
+  float sum;
+};
+
+// Called for every point of a range read, oldest first
+typedef void (*TsdbVisitor)(uint32_t time, const float* values,
+                            uint8_t count, void* context);
+
+static TsdbSeries tsdbSeries[TSDB_METRICS][TSDB_TIERS];
+static TsdbBucket tsdbBuckets[TSDB_METRICS][TSDB_TIERS];  // Rollup tiers
+static bool tsdbStarted = false;
+
+// Statistics
+static uint32_t tsdbPoints[TSDB_TIERS] = {0, 0, 0};
+static uint32_t tsdbSealedPoints[TSDB_TIERS] = {0, 0, 0};
+static uint32_t tsdbSealedBlocks[TSDB_TIERS] = {0, 0, 0};
+static uint32_t tsdbFlashWrites = 0;
+static uint32_t tsdbAppends = 0;
+static uint32_t tsdbAppendUs = 0;     // Total time in tsdbAppend()
+static uint32_t tsdbAppendMaxUs = 0;  // Slowest append (a block write)
+
+/**
+ * Mount LittleFS (formatted on first use). Safe to call repeatedly.
+ * @return true if the store is usable
+ */
+bool tsdbBegin() {
+  if (tsdbStarted) return true;
+
+  if (!LittleFS.begin()) {
+    DEBUG_PRINTLN(F("LittleFS mount failed, history disabled"));
+    return false;
+  }
+  tsdbStarted = true;
+  return true;
+}
+
+/**
+ * Segment file of a tier window
+ */
+static void tsdbPath(char* path, size_t size, uint8_t metric, uint8_t tier,
+                     uint32_t window) {
+  snprintf(path, size, "/ts/%c%u/%lu", tsdbMetricCodes[metric], tier,
+           (unsigned long)window);
+}
+
+/**
+ * Append bits to a block. Running out of room pushes the cursor past the
+ * end, which the caller checks once the whole point is written.
+ */
+static void tsdbPut(TsdbBlock& block, TsdbCursor& cursor, uint32_t value,
+                    uint8_t count) {
+  if (cursor.bits + count > TSDB_BLOCK_BITS) {
+    cursor.bits = TSDB_BLOCK_BITS + 1;
+    return;
+  }
+
+  for (int8_t i = count - 1; i >= 0; i--) {
+    uint8_t mask = 0x80 >> (cursor.bits & 7);
+    if ((value >> i) & 1) {
+      block.data[cursor.bits >> 3] |= mask;
+    } else {
+      block.data[cursor.bits >> 3] &= ~mask;
+    }
+    cursor.bits++;
+  }
+}
+
+/**
+ * Read bits from a block
+ */
+static uint32_t tsdbGet(const TsdbBlock& block, TsdbCursor& cursor,
+                        uint8_t count) {
+  uint32_t value = 0;
+  for (uint8_t i = 0; i < count && cursor.bits < TSDB_BLOCK_BITS; i++) {
+    uint8_t bit = (block.data[cursor.bits >> 3] >> (7 - (cursor.bits & 7)));
+    value = (value << 1) | (bit & 1);
+    cursor.bits++;
+  }
+  return value;
+}
+
+/**
+ * Encode one point at the cursor
+ * @return false if it did not fit (block and cursor must be restored)
+ */
+static bool tsdbEncode(TsdbBlock& block, TsdbCursor& cursor, uint8_t values,
+                       uint32_t time, const uint32_t* raw) {
+  if (block.count == 0) {
+    // First point: timestamp in the header, values verbatim
+    block.start = time;
+    cursor.time = time;
+    cursor.delta = 0;
+    for (uint8_t i = 0; i < values; i++) {
+      tsdbPut(block, cursor, raw[i], 32);
+      cursor.value[i] = raw[i];
+      cursor.lead[i] = 0xFF;
+    }
+    block.count = 1;
+    block.bits = cursor.bits;
+    return true;
+  }
+
+  int32_t delta = (int32_t)(time - cursor.time);
+  int32_t dod = delta - cursor.delta;
+  if (dod == 0) {
+    tsdbPut(block, cursor, 0, 1);
+  } else if (dod >= -63 && dod <= 64) {
+    tsdbPut(block, cursor, 0x2, 2);
+    tsdbPut(block, cursor, dod + 63, 7);
+  } else if (dod >= -255 && dod <= 256) {
+    tsdbPut(block, cursor, 0x6, 3);
+    tsdbPut(block, cursor, dod + 255, 9);
+  } else if (dod >= -2047 && dod <= 2048) {
+    tsdbPut(block, cursor, 0xE, 4);
+    tsdbPut(block, cursor, dod + 2047, 12);
+  } else {
+    tsdbPut(block, cursor, 0xF, 4);
+    tsdbPut(block, cursor, (uint32_t)dod, 32);
+  }
+  cursor.time = time;
+  cursor.delta = delta;
+
+  for (uint8_t i = 0; i < values; i++) {
+    uint32_t x = raw[i] ^ cursor.value[i];
+    cursor.value[i] = raw[i];
+    if (x == 0) {
+      tsdbPut(block, cursor, 0, 1);
+      continue;
+    }
+
+    uint8_t lead = __builtin_clz(x);
+    uint8_t trail = __builtin_ctz(x);
+    if (cursor.lead[i] <= 31 && lead >= cursor.lead[i] &&
+        trail >= cursor.trail[i]) {
+      // Fits the previous window: only the meaningful bits
+      tsdbPut(block, cursor, 0x2, 2);
+      tsdbPut(block, cursor, x >> cursor.trail[i],
+              32 - cursor.lead[i] - cursor.trail[i]);
+    } else {
+      uint8_t length = 32 - lead - trail;
+      tsdbPut(block, cursor, 0x3, 2);
+      tsdbPut(block, cursor, lead, 5);
+      tsdbPut(block, cursor, length - 1, 5);
+      tsdbPut(block, cursor, x >> trail, length);
+      cursor.lead[i] = lead;
+      cursor.trail[i] = trail;
+    }
+  }
+
+  if (cursor.bits > TSDB_BLOCK_BITS) return false;
+  block.count++;
+  block.bits = cursor.bits;
+  return true;
+}
+
+/**
+ * Decode the next point at the cursor (mirror of tsdbEncode)
+ * @param index Position of the point in the block
+ */
+static void tsdbDecode(const TsdbBlock& block, TsdbCursor& cursor,
+                       uint16_t index, uint8_t values, uint32_t& time,
+                       float* out) {
+  if (index == 0) {
+    cursor.bits = 0;
+    cursor.time = block.start;
+    cursor.delta = 0;
+    for (uint8_t i = 0; i < values; i++) {
+      cursor.value[i] = tsdbGet(block, cursor, 32);
+      cursor.lead[i] = 0xFF;
+    }
+  } else {
+    int32_t dod = 0;
+    if (tsdbGet(block, cursor, 1)) {
+      if (!tsdbGet(block, cursor, 1)) {
+        dod = (int32_t)tsdbGet(block, cursor, 7) - 63;
+      } else if (!tsdbGet(block, cursor, 1)) {
+        dod = (int32_t)tsdbGet(block, cursor, 9) - 255;
+      } else if (!tsdbGet(block, cursor, 1)) {
+        dod = (int32_t)tsdbGet(block, cursor, 12) - 2047;
+      } else {
+        dod = (int32_t)tsdbGet(block, cursor, 32);
+      }
+    }
+    cursor.delta += dod;
+    cursor.time += cursor.delta;
+
+    for (uint8_t i = 0; i < values; i++) {
+      if (!tsdbGet(block, cursor, 1)) continue;
+
+      if (!tsdbGet(block, cursor, 1)) {
+        uint8_t length = 32 - cursor.lead[i] - cursor.trail[i];
+        cursor.value[i] ^= tsdbGet(block, cursor, length) << cursor.trail[i];
+      } else {
+        cursor.lead[i] = tsdbGet(block, cursor, 5);
+        uint8_t length = tsdbGet(block, cursor, 5) + 1;
+        cursor.trail[i] = 32 - cursor.lead[i] - length;
+        cursor.value[i] ^= tsdbGet(block, cursor, length) << cursor.trail[i];
+      }
+    }
+  }
+
+  time = cursor.time;
+  for (uint8_t i = 0; i < values; i++) {
+    memcpy(&out[i], &cursor.value[i], sizeof(float));
+  }
+}
+
+/**
+ * Write the open block into its slot of the segment file
+ */
+static void tsdbWriteBlock(uint8_t metric, uint8_t tier) {
+  TsdbSeries& series = tsdbSeries[metric][tier];
+  if (series.block.count == 0) return;
+
+  char path[24];
+  tsdbPath(path, sizeof(path), metric, tier, series.window);
+  File file = LittleFS.open(path, LittleFS.exists(path) ? "r+" : "w");
+  if (!file) {
+    DEBUG_PRINT(F("Cannot write "));
+    DEBUG_PRINTLN(path);
+    return;
+  }
+
+  series.block.crc =
+      persistCrc32(&series.block, sizeof(TsdbBlock) - sizeof(uint32_t));
+  file.seek(series.slot * sizeof(TsdbBlock));
+  file.write((const uint8_t*)&series.block, sizeof(TsdbBlock));
+  file.close();
+
+  series.dirty = false;
+  tsdbFlashWrites++;
+}
+
+/**
+ * Write the open block for good and start an empty one in the next slot
+ */
+static void tsdbSeal(uint8_t metric, uint8_t tier) {
+  TsdbSeries& series = tsdbSeries[metric][tier];
+  if (series.block.count == 0) return;
+
+  tsdbWriteBlock(metric, tier);
+  tsdbSealedPoints[tier] += series.block.count;
+  tsdbSealedBlocks[tier]++;
+
+  memset(&series.block, 0, sizeof(series.block));
+  memset(&series.cursor, 0, sizeof(series.cursor));
+  series.slot++;
+}
+
+/**
+ * Delete the segments of a tier that fell out of its retention
+ * @param window Window being opened
+ */
+static void tsdbPrune(uint8_t metric, uint8_t tier, uint32_t window) {
+  // The oldest window kept must still hold points a full retention old
+  const TsdbTierInfo& info = tsdbTiers[tier];
+  uint32_t keep = (info.retention + info.window - 1) / info.window + 1;
+  if (window < keep) return;
+
+  char dirPath[8];
+  snprintf(dirPath, sizeof(dirPath), "/ts/%c%u", tsdbMetricCodes[metric],
+           tier);
+
+  // Collect first, removing while the directory is listed skips entries
+  uint32_t stale[TSDB_PRUNE_BATCH];
+  uint8_t staleCount = 0;
+  Dir dir = LittleFS.openDir(dirPath);
+  while (dir.next() && staleCount < TSDB_PRUNE_BATCH) {
+    uint32_t old = strtoul(dir.fileName().c_str(), nullptr, 10);
+    if (old + keep <= window) stale[staleCount++] = old;
+  }
+
+  char path[24];
+  for (uint8_t i = 0; i < staleCount; i++) {
+    tsdbPath(path, sizeof(path), metric, tier, stale[i]);
+    LittleFS.remove(path);
+  }
+}
+
+/**
+ * Switch a tier to another window, appending after any blocks already in
+ * that segment (written before a reset)
+ */
+static void tsdbOpenWindow(uint8_t metric, uint8_t tier, uint32_t window) {
+  TsdbSeries& series = tsdbSeries[metric][tier];
+  if (series.open) tsdbSeal(metric, tier);
+
+  memset(&series.block, 0, sizeof(series.block));
+  memset(&series.cursor, 0, sizeof(series.cursor));
+  series.window = window;
+  series.slot = 0;
+  series.open = true;
+  series.dirty = false;
+
+  char path[24];
+  tsdbPath(path, sizeof(path), metric, tier, window);
+  if (LittleFS.exists(path)) {
+    File file = LittleFS.open(path, "r");
+    if (file) {
+      series.slot = file.size() / sizeof(TsdbBlock);
+      file.close();
+    }
+  } else {
+    tsdbPrune(metric, tier, window);
+  }
+}
+
+/**
+ * Add a point to one tier
+ * @param values tsdbTiers[tier].values floats
+ */
+static void tsdbAppendPoint(uint8_t metric, uint8_t tier, uint32_t time,
+                            const float* values) {
+  TsdbSeries& series = tsdbSeries[metric][tier];
+  const TsdbTierInfo& info = tsdbTiers[tier];
+
+  // The store is append-only, a clock step backwards waits until it catches
+  // up again
+  if (series.open && time < series.last) return;
+
+  uint32_t window = time / info.window;
+  if (!series.open || window != series.window) {
+    tsdbOpenWindow(metric, tier, window);
+  }
+
+  // Round to the sensor resolution so repeated readings XOR to zero
+  uint32_t raw[TSDB_MAX_VALUES];
+  float resolution = tsdbResolution[metric];
+  for (uint8_t i = 0; i < info.values; i++) {
+    float rounded = roundf(values[i] / resolution) * resolution;
+    memcpy(&raw[i], &rounded, sizeof(float));
+  }
+
+  TsdbCursor saved = series.cursor;
+  if (!tsdbEncode(series.block, series.cursor, info.values, time, raw)) {
+    series.cursor = saved;
+    tsdbSeal(metric, tier);
+    tsdbEncode(series.block, series.cursor, info.values, time, raw);
+  }
+
+  series.last = time;
+  series.dirty = true;
+  tsdbPoints[tier]++;
+}
+
+/**
+ * Fold samples into a rollup tier, emitting the bucket once time moves
+ * past it. Finished buckets cascade into the next coarser tier.
+ * @param count Raw samples behind min/max/sum
+ */
+static void tsdbRollup(uint8_t metric, uint8_t tier, uint32_t time, float min,
+                       float max, float sum, uint32_t count) {
+  TsdbBucket& bucket = tsdbBuckets[metric][tier];
+  uint32_t step = tsdbTiers[tier].step;
+  uint32_t index = time / step;
+
+  if (bucket.count > 0 && index != bucket.index) {
+    float values[3] = {bucket.min, bucket.max, bucket.sum / bucket.count};
+    uint32_t start = bucket.index * step;
+    tsdbAppendPoint(metric, tier, start, values);
+    if (tier + 1 < TSDB_TIERS) {
+      tsdbRollup(metric, tier + 1, start, bucket.min, bucket.max, bucket.sum,
+                 bucket.count);
+    }
+    bucket.count = 0;
+  }
+
+  if (bucket.count == 0) {
+    bucket.index = index;
+    bucket.min = min;
+    bucket.max = max;
+    bucket.sum = 0;
+  }
+  if (min < bucket.min) bucket.min = min;
+  if (max > bucket.max) bucket.max = max;
+  bucket.sum += sum;
+  bucket.count += count;
+}
+
+/**
+ * Record a sample
+ * @param metric One of TsdbMetric
+ * @param epoch Local epoch of the sample (0 = time unknown, dropped)
+ * @param value Reading
+ */
+void tsdbAppend(uint8_t metric, uint32_t epoch, float value) {
+  if (!tsdbStarted || metric >= TSDB_METRICS || epoch == 0) return;
+  if (isnan(value)) return;
+
+  uint32_t startUs = micros();
+  tsdbAppendPoint(metric, TSDB_RAW, epoch, &value);
+  tsdbRollup(metric, TSDB_MINUTE, epoch, value, value, value, 1);
+
+  uint32_t elapsed = micros() - startUs;
+  tsdbAppends++;
+  tsdbAppendUs += elapsed;
+  if (elapsed > tsdbAppendMaxUs) tsdbAppendMaxUs = elapsed;
+}
+
+/**
+ * Rewrite the open blocks that gained points since the last sync
+ */
+void tsdbSync() {
+  if (!tsdbStarted) return;
+
+  for (uint8_t metric = 0; metric < TSDB_METRICS; metric++) {
+    for (uint8_t tier = 0; tier < TSDB_TIERS; tier++) {
+      if (tsdbSeries[metric][tier].dirty) tsdbWriteBlock(metric, tier);
+    }
+  }
+}
+
+/**
+ * Decode every point of a block inside [from, to]
+ * @return Points visited
+ */
+static uint32_t tsdbVisitBlock(const TsdbBlock& block, uint8_t values,
+                               uint32_t from, uint32_t to, TsdbVisitor visit,
+                               void* context) {
+  TsdbCursor cursor;
+  float point[TSDB_MAX_VALUES];
+  uint32_t time;
+  uint32_t visited = 0;
+
+  for (uint16_t i = 0; i < block.count; i++) {
+    tsdbDecode(block, cursor, i, values, time, point);
+    if (time > to) break;
+    if (time < from) continue;
+    visit(time, point, values, context);
+    visited++;
+  }
+  return visited;
+}
+
+/**
+ * Binary search a segment for the last block starting at or before from,
+ * so a read late in a window skips the blocks before it
+ * @param slots Blocks in the file
+ * @return Slot to read from (0 if a torn block cut the search short)
+ */
+static uint16_t tsdbFirstSlot(File& file, uint16_t slots, uint32_t from) {
+  TsdbBlock block;
+  uint16_t low = 0;
+  uint16_t high = slots;
+  while (high - low > 1) {
+    uint16_t middle = low + (high - low) / 2;
+    file.seek((uint32_t)middle * sizeof(TsdbBlock));
+    if (file.read((uint8_t*)&block, sizeof(block)) != sizeof(block) ||
+        block.crc !=
+            persistCrc32(&block, sizeof(TsdbBlock) - sizeof(uint32_t))) {
+      return 0;
+    }
+    if (block.start <= from) {
+      low = middle;
+    } else {
+      high = middle;
+    }
+  }
+  return low;
+}
+
+/**
+ * Read the points of one tier between two epochs, oldest first. The open
+ * blocks are read from RAM, so the result includes unsynced points.
+ * @param metric One of TsdbMetric
+ * @param tier One of TsdbTier
+ * @param from First epoch (inclusive)
+ * @param to Last epoch (inclusive)
+ * @param visit Called for each point
+ * @param context Passed through to visit
+ * @return Points visited
+ */
+uint32_t tsdbRead(uint8_t metric, uint8_t tier, uint32_t from, uint32_t to,
+                  TsdbVisitor visit, void* context) {
+  if (!tsdbStarted || metric >= TSDB_METRICS || tier >= TSDB_TIERS) return 0;
+
+  const TsdbTierInfo& info = tsdbTiers[tier];
+  const TsdbSeries& series = tsdbSeries[metric][tier];
+
+  // No segment older than the retention survives, don't look for one
+  uint32_t oldest = to > info.retention + info.window
+                        ? to - info.retention - info.window
+                        : 0;
+  if (from < oldest) from = oldest;
+  if (from > to) return 0;
+
+  uint32_t visited = 0;
+  TsdbBlock block;
+  char path[24];
+
+  for (uint32_t window = from / info.window; window <= to / info.window;
+       window++) {
+    bool current = series.open && window == series.window;
+    uint16_t slots = current ? series.slot : 0xFFFF;
+
+    tsdbPath(path, sizeof(path), metric, tier, window);
+    if (LittleFS.exists(path)) {
+      File file = LittleFS.open(path, "r");
+      uint16_t slot = 0;
+      if (file) {
+        uint32_t stored = file.size() / sizeof(TsdbBlock);
+        if (stored < slots) slots = stored;
+        slot = tsdbFirstSlot(file, slots, from);
+        file.seek((uint32_t)slot * sizeof(TsdbBlock));
+      }
+      for (; file && slot < slots; slot++) {
+        if (file.read((uint8_t*)&block, sizeof(block)) != sizeof(block)) {
+          break;
+        }
+        // A torn block only costs its own points
+        if (block.crc !=
+            persistCrc32(&block, sizeof(TsdbBlock) - sizeof(uint32_t))) {
+          continue;
+        }
+        if (block.start > to) break;  // Blocks are in time order
+        visited += tsdbVisitBlock(block, info.values, from, to, visit,
+                                  context);
+        yield();
+      }
+      if (file) file.close();
+    }
+
+    if (current) {
+      visited += tsdbVisitBlock(series.block, info.values, from, to, visit,
+                                context);
+    }
+  }
+
+  return visited;
+}
+
+// Range query reduced to at most maxPoints min/max/avg buckets. The range
+// is read one chunk of TSDB_CHUNK_POINTS buckets at a time, so callers can
+// stream the result without ever holding the whole series.
+struct TsdbQuery {
+  uint8_t metric;
+  uint8_t tier;   // Finest tier still holding the start of the range
+  uint32_t from;  // First bucket start
+  uint32_t to;    // Last epoch (inclusive)
+  uint32_t step;  // Bucket width (s)
+  uint32_t next;  // Start of the next chunk
+  bool done;      // The chunk ending at to has been read
+};
+
+struct TsdbChunk {
+  uint8_t count;  // Non-empty buckets
+  uint32_t time[TSDB_CHUNK_POINTS];  // Bucket start
+  float min[TSDB_CHUNK_POINTS];
+  float max[TSDB_CHUNK_POINTS];
+  float sum[TSDB_CHUNK_POINTS];        // Of the point averages
+  uint16_t points[TSDB_CHUNK_POINTS];  // Stored points in the bucket
+};
+
+/**
+ * Metric id from its protocol name ("weight" or "water")
+ * @return TsdbMetric, or -1 if unknown
+ */
+int8_t tsdbMetricByName(const char* name) {
+  if (!name) return -1;
+  if (strcmp(name, "weight") == 0) return TSDB_WEIGHT;
+  if (strcmp(name, "water") == 0) return TSDB_WATER;
+  return -1;
+}
+
+/**
+ * Short name of a tier
+ */
+const char* tsdbTierName(uint8_t tier) {
+  static const char* const names[TSDB_TIERS] = {"raw", "1m", "15m"};
+  return tier < TSDB_TIERS ? names[tier] : "?";
+}
+
+/**
+ * Smallest multiple of unit not below value
+ */
+static uint64_t tsdbRoundUp(uint64_t value, uint64_t unit) {
+  return (value + unit - 1) / unit * unit;
+}
+
+/**
+ * Plan a range query
+ * @param query Filled in
+ * @param from First epoch
+ * @param to Last epoch (inclusive)
+ * @param maxPoints Most buckets wanted (capped at TSDB_QUERY_MAX_POINTS)
+ * @param now Current epoch, picks the tier by the age of from
+ * @return false if the range is empty or the metric unknown
+ */
+bool tsdbQueryBegin(TsdbQuery& query, uint8_t metric, uint32_t from,
+                    uint32_t to, uint16_t maxPoints, uint32_t now) {
+  if (metric >= TSDB_METRICS || from > to || maxPoints == 0) return false;
+  if (maxPoints > TSDB_QUERY_MAX_POINTS) maxPoints = TSDB_QUERY_MAX_POINTS;
+
+  // Coarser tiers only if the finer one has already dropped the start
+  uint8_t tier = TSDB_RAW;
+  while (tier + 1 < TSDB_TIERS && now > from &&
+         now - from > tsdbTiers[tier].retention) {
+    tier++;
+  }
+
+  // Whole multiples of the tier step, aligned so buckets never split a
+  // rollup point. Aligning from down can add a bucket; if it does, size
+  // for one bucket less. 64-bit, to - from + 1 overflows on the full
+  // epoch range.
+  uint64_t unit = tsdbTiers[tier].step ? tsdbTiers[tier].step : 1;
+  uint64_t step = tsdbRoundUp((to - from) / maxPoints + 1ULL, unit);
+  if ((to - from + from % step) / step + 1 > maxPoints) {
+    step = maxPoints > 1 ? (to - from) / (maxPoints - 1) + 1ULL
+                         : to + 1ULL;
+    step = tsdbRoundUp(step, unit);
+  }
+  if (step > UINT32_MAX) step = UINT32_MAX - UINT32_MAX % unit;
+
+  query.metric = metric;
+  query.tier = tier;
+  query.from = from - from % step;
+  query.to = to;
+  query.step = step;
+  query.next = query.from;
+  query.done = false;
+  return true;
+}
+
+/**
+ * @return true once every chunk has been read
+ */
+bool tsdbQueryDone(const TsdbQuery& query) { return query.done; }
+
+struct TsdbChunkFill {
+  TsdbChunk* chunk;
+  uint32_t step;
+};
+
+/**
+ * Fold one point into the chunk's bucket for its time
+ */
+static void tsdbChunkVisit(uint32_t time, const float* values, uint8_t count,
+                           void* context) {
+  TsdbChunkFill& fill = *(TsdbChunkFill*)context;
+  TsdbChunk& chunk = *fill.chunk;
+  uint32_t start = time - time % fill.step;
+
+  // Rollup points carry min/max/avg, raw points a single value
+  float low = values[0];
+  float high = count > 1 ? values[1] : values[0];
+  float avg = count > 2 ? values[2] : values[0];
+
+  uint8_t i = chunk.count;
+  if (i == 0 || chunk.time[i - 1] != start) {
+    if (i == TSDB_CHUNK_POINTS) return;
+    chunk.time[i] = start;
+    chunk.min[i] = low;
+    chunk.max[i] = high;
+    chunk.sum[i] = 0;
+    chunk.points[i] = 0;
+    chunk.count = ++i;
+  }
+
+  i--;
+  if (low < chunk.min[i]) chunk.min[i] = low;
+  if (high > chunk.max[i]) chunk.max[i] = high;
+  chunk.sum[i] += avg;
+  chunk.points[i]++;
+}
+
+/**
+ * Read the next chunk of buckets (empty buckets are left out, so a chunk
+ * may hold fewer than TSDB_CHUNK_POINTS, or none)
+ * @param query Query started by tsdbQueryBegin()
+ * @param chunk Filled with the buckets
+ */
+void tsdbQueryNext(TsdbQuery& query, TsdbChunk& chunk) {
+  chunk.count = 0;
+  if (tsdbQueryDone(query)) return;
+
+  // 64-bit, a chunk of wide steps runs past the end of the epoch
+  uint64_t last =
+      (uint64_t)query.next + (uint64_t)query.step * TSDB_CHUNK_POINTS - 1;
+  if (last >= query.to) {
+    last = query.to;
+    query.done = true;
+  }
+
+  TsdbChunkFill fill = {&chunk, query.step};
+  tsdbRead(query.metric, query.tier, query.next, last, tsdbChunkVisit, &fill);
+
+  query.next = last + 1;
+}
+
+/**
+ * Print points, bytes per point and append cost per tier, and flash usage
+ * @param out Output stream (e.g. Serial)
+ */
+void tsdbPrintReport(Print& out) {
+  out.print(F("History: appends="));
+  out.print(tsdbAppends);
+  out.print(F(" avg="));
+  out.print(tsdbAppends ? tsdbAppendUs / tsdbAppends : 0);
+  out.print(F("us max="));
+  out.print(tsdbAppendMaxUs);
+  out.print(F("us flash writes="));
+  out.println(tsdbFlashWrites);
+
+  for (uint8_t tier = 0; tier < TSDB_TIERS; tier++) {
+    out.print(F("  "));
+    out.print(tsdbTierName(tier));
+    out.print(F(": points="));
+    out.print(tsdbPoints[tier]);
+    out.print(F(" bytes/point="));
+    if (tsdbSealedPoints[tier] > 0) {
+      out.println((float)tsdbSealedBlocks[tier] * sizeof(TsdbBlock) /
+                      tsdbSealedPoints[tier],
+                  2);
+    } else {
+      out.println(F("-"));
+    }
+  }
+
+  FSInfo info;
+  if (tsdbStarted && LittleFS.info(info)) {
+    out.print(F("  flash: "));
+    out.print(info.usedBytes / 1024);
+    out.print(F("KB of "));
+    out.print(info.totalBytes / 1024);
+    out.println(F("KB"));
+  }
+}
+
+#endif  // TSDB_HELPERS_H
@@ -0,0 +1,190 @@
+#ifndef UI_QUEUE_H
+#define UI_QUEUE_H
+
+#include <Arduino.h>
+#include <LiquidCrystal_I2C.h>
+
+#include "../config.h"
+
+// Timed LCD message queue. Callers post a screen with a minimum display time
+// and return at once; uiUpdate() (a scheduler task) shows the next screen when
+// the current one has been up long enough. Nothing blocks so a human can read.
+
+extern LiquidCrystal_I2C lcd;
+
+struct UiMessage {
+  char lines[LCD_Y][LCD_X + 1];
+  bool keepLine[LCD_Y];  // Line left as is (NULL passed)
+  bool clearScreen;
+  uint16_t holdMs;  // Minimum time on screen
+};
+
+static UiMessage uiQueue[UI_QUEUE_SIZE];
+static uint8_t uiHead = 0;
+static uint8_t uiCount = 0;
+
+// Screen currently shown
+static uint32_t uiShownAt = 0;
+static uint32_t uiHoldMs = 0;
+
+// Statistics
+static uint32_t uiDropped = 0;    // Messages lost to a full queue
+static uint32_t uiBlockedMs = 0;  // Time spent in busy waits
+
+/**
+ * Copy a RAM string into a message line
+ * @return false if text is NULL (line is kept)
+ */
+static inline bool uiCopyText(char* line, const char* text) {
+  if (!text) return false;
+  strncpy(line, text, LCD_X);
+  line[LCD_X] = '\0';
+  return true;
+}
+
+/**
+ * Copy a flash (F()) string into a message line
+ * @return false if text is NULL (line is kept)
+ */
+static inline bool uiCopyText(char* line, const __FlashStringHelper* text) {
+  if (!text) return false;
+  strncpy_P(line, (PGM_P)text, LCD_X);
+  line[LCD_X] = '\0';
+  return true;
+}
+
+/**
+ * Draw a message on the LCD
+ */
+static void uiDraw(const UiMessage& message) {
+  if (message.clearScreen) lcd.clear();
+
+  for (uint8_t row = 0; row < LCD_Y; row++) {
+    if (message.keepLine[row]) continue;
+
+    lcd.setCursor(0, row);
+    lcd.print(message.lines[row]);
+
+    // Without a clear, pad so the old text does not show through
+    if (!message.clearScreen) {
+      for (uint8_t col = strlen(message.lines[row]); col < LCD_X; col++) {
+        lcd.print(' ');
+      }
+    }
+  }
+}
+
+/**
+ * Show the next queued message once the current one has been up long enough
+ */
+void uiUpdate() {
+  while (uiCount > 0 && millis() - uiShownAt >= uiHoldMs) {
+    const UiMessage& message = uiQueue[uiHead];
+    uiDraw(message);
+    uiShownAt = millis();
+    uiHoldMs = message.holdMs;
+
+    uiHead = (uiHead + 1) % UI_QUEUE_SIZE;
+    uiCount--;
+  }
+}
+
+/**
+ * Reserve the next queue slot, dropping the oldest pending message if full
+ */
+static UiMessage& uiReserve() {
+  if (uiCount >= UI_QUEUE_SIZE) {
+    uiHead = (uiHead + 1) % UI_QUEUE_SIZE;
+    uiCount--;
+    uiDropped++;
+    DEBUG_PRINTLN(F("UI queue full, dropped oldest message"));
+  }
+
+  UiMessage& message = uiQueue[(uiHead + uiCount) % UI_QUEUE_SIZE];
+  uiCount++;
+  return message;
+}
+
+/**
+ * Queue a two-line screen (RAM or F() strings, NULL keeps a line)
+ * @param line1 First line text
+ * @param line2 Second line text
+ * @param holdMs Minimum time on screen before the next message
+ * @param clearScreen Whether to clear the screen first
+ */
+template <typename Line1, typename Line2>
+void uiShow(Line1 line1, Line2 line2, uint32_t holdMs = LCD_TIMEOUT,
+            bool clearScreen = true) {
+  UiMessage& message = uiReserve();
+  message.keepLine[0] = !uiCopyText(message.lines[0], line1);
+  message.keepLine[1] = !uiCopyText(message.lines[1], line2);
+  message.clearScreen = clearScreen;
+  message.holdMs = holdMs;
+
+  // Draw right away if the screen is free
+  uiUpdate();
+}
+
+/**
+ * Queue an update of a single line, keeping the other one
+ * @param row Line to replace (0 or 1)
+ * @param text Line text (RAM or F() string)
+ * @param holdMs Minimum time on screen before the next message
+ */
+template <typename Text>
+void uiShowLine(uint8_t row, Text text, uint32_t holdMs = LCD_TIMEOUT) {
+  UiMessage& message = uiReserve();
+  for (uint8_t i = 0; i < LCD_Y; i++) message.keepLine[i] = (i != row);
+  uiCopyText(message.lines[row], text);
+  message.clearScreen = false;
+  message.holdMs = holdMs;
+
+  uiUpdate();
+}
+
+/**
+ * @return Number of messages waiting to be shown
+ */
+uint8_t uiPendingCount() { return uiCount; }
+
+/**
+ * @return true when no message is waiting or still inside its display time,
+ * so live screens (progress, levels) may draw
+ */
+bool uiScreenFree() {
+  return uiCount == 0 && millis() - uiShownAt >= uiHoldMs;
+}
+
+/**
+ * @return Milliseconds until uiUpdate() can show the next message
+ * (0xFFFFFFFF when the queue is empty)
+ */
+uint32_t uiNextUpdateIn() {
+  if (uiCount == 0) return 0xFFFFFFFFUL;
+
+  uint32_t shown = millis() - uiShownAt;
+  return shown >= uiHoldMs ? 0 : uiHoldMs - shown;
+}
+
+/**
+ * End the display time of the current screen so the next one shows at once
+ * (used by interactive screens that replace themselves)
+ */
+void uiEndHold() { uiHoldMs = 0; }
+
+/**
+ * Add time spent in a busy wait to the blocked counter
+ * @param ms Milliseconds spent waiting
+ */
+void uiRecordBlocked(uint32_t ms) { uiBlockedMs += ms; }
+
+/**
+ * @return Blocked time scaled to one day of uptime (ms per day)
+ */
+uint32_t uiBlockedMsPerDay() {
+  uint32_t uptime = millis();
+  if (uptime == 0) return 0;
+  return (uint32_t)((uint64_t)uiBlockedMs * 86400000ULL / uptime);
+}
+
+#endif  // UI_QUEUE_H
@@ -7,9 +7,15 @@
 
 #include "../config.h"
 #include "../pins.h"
+#include "profiler.h"
+#include "sntp_client.h"
+#include "tsdb_helpers.h"
+#include "ui_queue.h"
+#include "water_schedule.h"
 
 // Forward declarations
 extern NewPing sonar;
+extern SntpClock timeClient;
 extern LiquidCrystal_I2C lcd;
 extern void lcdMessage(const char* line1, const char* line2, uint32_t waitTime,
                        bool clearScreen);
@@ -93,7 +99,9 @@ unsigned int nonBlockingMedianPing(NewPing& sonar, uint8_t iterations = 5,
  * @return Average distance in centimeters, or 0 if all readings failed
  */
 float getDistance() {
-  uint32_t totalDistance = 0;  // Use 32-bit to accumulate distance
+  PROFILE_SCOPE("ping");
+
+  uint32_t totalUs = 0;  // Echo times, converted once for mm resolution
   uint8_t validReadings = 0;
 
   // Take readings with minimal memory usage
@@ -104,7 +112,7 @@ float getDistance() {
 
     // Process valid readings only (non-zero response)
     if (uS > 0) {
-      totalDistance += sonar.convert_cm(uS);
+      totalUs += uS;
       validReadings++;
     }
 
@@ -116,14 +124,17 @@ float getDistance() {
     return 0;
   }
 
-  // Calculate and return average
-  return totalDistance / validReadings;
+  // Average echo time to cm, without rounding each ping to whole cm (the
+  // water trend needs the sub-cm changes)
+  return (float)totalUs / validReadings / US_ROUNDTRIP_CM;
 }
 
 /**
  * Check water level and manage pump activation
  */
 void checkWaterLevel() {
+  PROFILE_SCOPE("water");
+
   // Static variables for state machine
   static enum WaterState {
     CHECK_WATER,     // Normal water level checking
@@ -140,6 +151,8 @@ void checkWaterLevel() {
   // State machine for water level management using switch
   switch (state) {
     case CHECK_WATER: {
+      // Polled often, but only pings when the water trend says so
+      if (!waterCheckDue(currentMillis)) return;
       DEBUG_PRINTLN(F("Checking Water Level"));
       yield();
 
@@ -149,12 +162,7 @@ void checkWaterLevel() {
 
       // If readings failed completely, show error
       if (distanceCm <= 0 || distanceCm > 400) {
-        lcd.clear();
-        lcd.setCursor(0, 0);
-        lcd.print(F("Sensor Error"));
-        lcd.setCursor(0, 1);
-        lcd.print(F("Check ultrasonic"));
-        nonBlockingWait(INFO_DISPLAY_TIME);
+        uiShow(F("Sensor Error"), F("Check ultrasonic"), INFO_DISPLAY_TIME);
         return;
       }
 
@@ -162,14 +170,17 @@ void checkWaterLevel() {
       float waterHeight = DISTANCE_WATER_EMPTY - distanceCm;
       waterHeight =
           constrain(waterHeight, 0, DISTANCE_WATER_EMPTY - DISTANCE_WATER_FULL);
+      if (timeClient.isTimeSet()) {
+        tsdbAppend(TSDB_WATER, timeClient.getEpochTime(), waterHeight);
+      }
+      waterTrendUpdate(waterHeight, currentMillis);
 
       float waterPercentage =
           (waterHeight / (DISTANCE_WATER_EMPTY - DISTANCE_WATER_FULL)) * 100;
       waterPercentage = constrain(waterPercentage, 0, 100);
 
       // Update server with water level if connected
-      if (WiFi.status() == WL_CONNECTED &&
-          isWebConnected()) {  // Fixed: Using WiFi.status() == WL_CONNECTED
+      if (isWebConnected()) {
         const char* status =
             (waterHeight <= WATER_CRITICAL_HEIGHT) ? "low" : "ok";
         updateWaterStatus(status, waterPercentage);
@@ -187,28 +198,20 @@ void checkWaterLevel() {
       DEBUG_PRINT(distanceCm);
       DEBUG_PRINTLN(F("cm"));
 
-      // Display on LCD
-      lcd.clear();
-      lcd.setCursor(0, 0);
-      lcd.print(F("Water Level:"));
-
       // Check if water level is critically low
       if (waterHeight <= WATER_CRITICAL_HEIGHT) {
-        ;
         DEBUG_PRINTLN(F("Water level critically low! Activating relay."));
 
         // Display low water information
-        char waterInfo[16];
+        char waterInfo[LCD_X + 1];
         snprintf(waterInfo, sizeof(waterInfo), "LOW! %.1fcm (%d%%)",
                  waterHeight, (int)waterPercentage);
-        lcd.setCursor(0, 1);
-        lcd.print(waterInfo);
+        uiShow(F("Water Level:"), waterInfo, QUICK_DISPLAY_TIME);
         yield();
 
         // If water level is low, update server before activating pump
         if (waterHeight <= WATER_CRITICAL_HEIGHT &&
-            WiFi.status() == WL_CONNECTED &&
-            isWebConnected()) {  // Fixed: Using WiFi.status() == WL_CONNECTED
+            isWebConnected()) {
           updateWaterStatus("refilling", waterPercentage);
           addLogEntry("water_low", "Water level critically low, refilling");
         }
@@ -217,22 +220,20 @@ void checkWaterLevel() {
         // digitalWrite(WATER_PUMP_RELAY_PIN, HIGH);
 
         // Show activation message
-        lcd.clear();
-        lcd.setCursor(0, 0);
-        lcd.print(F("Water low!"));
-        ;
-        lcd.setCursor(0, 1);
-        lcd.print(F("Refilling..."));
+        uiShow(F("Water low!"), F("Refilling..."));
 
         // Change state and record start time
         state = REFILL_RUNNING;
         stateStartTime = currentMillis;
         lastDisplayUpdate = currentMillis;
-      } else {
-        // Water level OK - display info and progress bar
-        char waterInfo[16];
+      } else if (uiScreenFree()) {
+        // Water level OK - live screen, only when no message is showing
+        char waterInfo[LCD_X + 1];
         snprintf(waterInfo, sizeof(waterInfo), "OK %.1fcm (%d%%)", waterHeight,
                  (int)waterPercentage);
+        lcd.clear();
+        lcd.setCursor(0, 0);
+        lcd.print(F("Water Level:"));
         lcd.setCursor(0, 1);
         lcd.print(waterInfo);
 
@@ -243,8 +244,8 @@ void checkWaterLevel() {
     }
 
     case REFILL_RUNNING: {
-      // Update display periodically
-      if (currentMillis - lastDisplayUpdate >= 200) {
+      // Update display periodically (refill message on screen)
+      if (currentMillis - lastDisplayUpdate >= 200 && uiPendingCount() == 0) {
         lastDisplayUpdate = currentMillis;
         yield();
 
@@ -282,11 +283,7 @@ void checkWaterLevel() {
         }
 
         // Show completion message
-        lcd.clear();
-        lcd.setCursor(0, 0);
-        lcd.print(F("Refill complete"));
-        lcd.setCursor(0, 1);
-        lcd.print(F("Cooldown: 5 min"));
+        uiShow(F("Refill complete"), F("Cooldown: 5 min"));
 
         // Change state to cooldown
         state = COOLDOWN;
@@ -300,7 +297,8 @@ void checkWaterLevel() {
 
     case COOLDOWN: {
       // Update display periodically
-      if (currentMillis - lastDisplayUpdate >= DISPLAY_UPDATE_INTERVAL) {
+      if (currentMillis - lastDisplayUpdate >= DISPLAY_UPDATE_INTERVAL &&
+          uiPendingCount() == 0) {
         lastDisplayUpdate = currentMillis;
         yield();
 
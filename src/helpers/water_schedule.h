@@ -0,0 +1,75 @@
+#ifndef WATER_SCHEDULE_H
+#define WATER_SCHEDULE_H
+
+#include <Arduino.h>
+
+#include "../config.h"
+
+// Adaptive water-check interval. The tank drops slowly overnight and fast
+// while the pet drinks, so a fixed period either wastes pings on a full,
+// still tank or reacts late near critical. Every reading updates a
+// smoothed drop rate (time weighted over WATER_RATE_TAU, so one noisy
+// reading moves it by at most noise / tau). A rise of WATER_REFILL_RISE
+// means the tank was refilled and the rate starts over.
+//
+// The next check comes once the level could have covered
+// WATER_CHECK_FRACTION of its margin to WATER_CRITICAL_HEIGHT, assuming
+// the faster of the observed rate (with WATER_RATE_HEADROOM) and
+// WATER_DROP_FLOOR. A drinking pet takes up to 0.1 cm in 30 s (12 cm/h);
+// with WATER_CHECK_FRACTION at a half, a 6 cm/h floor still lets no drink
+// carry the level past critical between two checks. A full tank (1 cm of
+// margin) is checked every 5 minutes; near critical the period shrinks to
+// WATER_CHECK_MIN. As long as the level does not fall faster than twice
+// the assumed rate, low water is seen within WATER_CHECK_MIN of crossing.
+
+struct WaterTrend {
+  float height;     // Last reading (cm above empty)
+  float dropRate;   // Smoothed fall rate (cm/h, negative = rising)
+  uint32_t at;      // millis() of the last reading
+  bool valid;
+};
+
+static WaterTrend waterTrend = {0, 0, 0, false};
+static uint32_t waterNextCheckMs = 0;  // Delay chosen after the last reading
+static uint32_t waterCheckedAt = 0;    // millis() of the last reading
+
+/**
+ * Take a water reading into the trend
+ * @param height Water height (cm above empty)
+ * @param now millis()
+ * @return Delay until the next check (ms)
+ */
+uint32_t waterTrendUpdate(float height, uint32_t now) {
+  if (!waterTrend.valid || height - waterTrend.height > WATER_REFILL_RISE) {
+    // First reading or a refill, nothing to learn from the step
+    waterTrend.dropRate = 0;
+  } else if (now != waterTrend.at) {
+    float hours = (now - waterTrend.at) / 3600000.0f;
+    float rate = (waterTrend.height - height) / hours;
+    float weight = min(hours / WATER_RATE_TAU, 1.0f);
+    waterTrend.dropRate += weight * (rate - waterTrend.dropRate);
+  }
+  waterTrend.height = height;
+  waterTrend.at = now;
+  waterTrend.valid = true;
+
+  float margin = height - WATER_CRITICAL_HEIGHT;
+  float assumed = max(waterTrend.dropRate * WATER_RATE_HEADROOM,
+                      (float)WATER_DROP_FLOOR);
+  float delayMs = margin / assumed * WATER_CHECK_FRACTION * 3600000.0f;
+
+  waterNextCheckMs = constrain(delayMs, (float)WATER_CHECK_MIN,
+                               (float)WATER_CHECK_MAX);
+  waterCheckedAt = now;
+  return waterNextCheckMs;
+}
+
+/**
+ * @return true once the delay chosen after the last reading has passed
+ *         (always before the first reading)
+ */
+bool waterCheckDue(uint32_t now) {
+  return !waterTrend.valid || now - waterCheckedAt >= waterNextCheckMs;
+}
+
+#endif  // WATER_SCHEDULE_H
@@ -4,12 +4,32 @@
 #include <Arduino.h>
 #include <ArduinoJson.h>
 #include <ESP8266WiFi.h>
+#include <HX711.h>
 #include <WebSocketsClient.h>
 
 #include "../config.h"
+#include "boot_helpers.h"
+#include "bowl_monitor.h"
+#include "breadcrumbs.h"
+#include "connectivity.h"
+#include "feed_journal.h"
+#include "feed_profiles.h"
+#include "feed_telemetry.h"
+#include "hatch_calibration.h"
+#include "history_helpers.h"
+#include "hopper_inventory.h"
+#include "profiler.h"
+#include "schedule_helpers.h"
+#include "servo_planner.h"
+#include "sntp_client.h"
+#include "task_scheduler.h"
+#include "topics.h"
+#include "tsdb_helpers.h"
+#include "ui_queue.h"
 
 // Forward declaration of externally defined objects
-extern NTPClient timeClient;
+extern SntpClock timeClient;
+extern HX711 scale;
 extern StaticJsonDocument<512> jsonDoc;  // Reference the document from main.cpp
 extern void handleWebSocketCommand(
     const char* command,
@@ -22,8 +42,27 @@ extern bool webConnected;
 
 // Static variables for this file only
 static uint32_t lastReconnectAttempt = 0;
-static uint32_t lastHeartbeat = 0;
-static uint32_t lastScheduleCheck = 0;
+static bool webTasksRegistered = false;
+
+// History query being streamed, one chunk per "hist-query" task run
+static TsdbQuery historyQuery;
+static uint32_t historyRequestId = 0;
+static uint16_t historySeq = 0;
+static bool historyActive = false;
+static int8_t historyTaskId = -1;
+
+// Hatch calibration, advanced by the "hatch-cal" task while it runs
+static int8_t hatchCalTaskId = -1;
+
+// Newest water/food status not sent yet, indexed by TOPIC_WATER/TOPIC_FOOD.
+// Held back by the topic interval, or kept for the next viewer.
+struct PendingStatus {
+  const char* status;  // String literal
+  float level;         // Percent
+  float weight;        // Grams of the last feed (food only, 0 = none)
+  bool pending;
+};
+static PendingStatus pendingStatus[TOPIC_FOOD + 1];
 
 // Simple min function to replace std::min
 template <typename T>
@@ -31,18 +70,29 @@ T minVal(T a, T b) {
   return (a < b) ? a : b;
 }
 
-// Add a global variable to track the next scheduled feeding
+// Next scheduled feeding, derived from the persisted schedule cursors
 uint32_t nextScheduledFeeding = 0;  // Unix timestamp of next feeding
-bool hasActiveSchedule = false;
 
 // Function declarations
 bool webInit(const char* url, const char* id);
 bool webConnect();
 void webUpdate();
+void registerWebTasks();
 bool sendMessage(const char* eventType, JsonVariant data);
 void processWebSocketMessage(uint8_t* payload, size_t length);
 bool sendFeedingComplete(bool isScheduled, const char* details, float foodLevel,
                          float waterLevel);
+bool sendMetrics();
+bool sendCrashReport();
+void startHistoryQuery(JsonVariant request);
+void applySubscriptions(JsonObject requested);
+void startHatchCalibration(JsonVariant request);
+bool sendHatchCalibration();
+void applyFeedProfile(JsonVariant request);
+void applyHopperRefill(JsonVariant request);
+bool sendHopperStatus();
+bool sendEatingSession(const BowlSession& session);
+bool sendBowlAlert(uint8_t alert);
 void checkSchedules();
 bool isWebConnected();
 uint32_t getNextScheduledFeeding();
@@ -51,6 +101,43 @@ bool hasSchedules();
 // Declare webSocketEvent as an extern function that's implemented in main.cpp
 extern void webSocketEvent(WStype_t type, uint8_t* payload, size_t length);
 
+/**
+ * Track server connect/disconnect, then hand the event to webSocketEvent
+ */
+static void webEventHook(WStype_t type, uint8_t* payload, size_t length) {
+  if (type == WStype_CONNECTED) {
+    netSetServer(true);
+  } else if (type == WStype_DISCONNECTED) {
+    netSetServer(false);
+    // Quiet until the server resends the subscriptions on register
+    topicsClear();
+    telemetrySetSubscribers(0, 0);
+  }
+
+  webSocketEvent(type, payload, length);
+
+  // Upload the trail of a watchdog or exception reset once registered
+  if (type == WStype_CONNECTED && crumbHasReport() && sendCrashReport()) {
+    crumbClearReport();
+  }
+}
+
+/**
+ * Report a feed that a reset or power cut interrupted, once the server has
+ * sent its subscriptions after connecting
+ */
+static void reportInterruptedFeed() {
+  if (!feedJournalLostPending) return;
+
+  char details[48];
+  snprintf(details, sizeof(details), "Session %lu stopped at %.1fg of %.1fg",
+           (unsigned long)feedJournalLost.sequence, feedJournalLost.dispensed,
+           feedJournalLost.target);
+  if (sendLogEvent("feeding_interrupted", details)) {
+    feedJournalLostPending = false;
+  }
+}
+
 /**
  * Initialize WebSocket connection with server
  * @param url Server URL (from config.h: WEB_SERVER_URL)
@@ -67,9 +154,16 @@ bool webInit(const char* url, const char* id) {
   DEBUG_PRINTLN(id);
 
   // Initialize WebSocket client
+  crumbBegin();
+  feedJournalReconcile();
+  feedProfilesBegin();
+  hopperBegin();
+  tsdbBegin();
+  netBegin();
   webSocket.begin(url, WEB_SERVER_PORT, "/");
   webSocket.setReconnectInterval(WEB_RECONNECT_INTERVAL);
-  webSocket.onEvent(webSocketEvent);
+  webSocket.onEvent(webEventHook);
+  registerWebTasks();
 
   // Try to connect right away
   return webConnect();
@@ -81,9 +175,7 @@ bool webInit(const char* url, const char* id) {
  */
 bool webConnect() {
   // First check if WiFi is connected
-  if (WiFi.status() !=
-      WL_CONNECTED) {  // Fixed: Using WiFi.status() != WL_CONNECTED instead of
-                       // !WiFi.isConnected()
+  if (!netWifiUp()) {
     DEBUG_PRINTLN(F("Cannot connect to server: WiFi not connected"));
     webConnected = false;
     return false;
@@ -94,36 +186,223 @@ bool webConnect() {
 
   // Remember when we tried to connect
   lastReconnectAttempt = millis();
-  lastHeartbeat = millis();
 
   // Connection attempt in progress
   return true;
 }
 
+/**
+ * Send the pending status of a topic and mark it sent
+ * @param topic TOPIC_WATER or TOPIC_FOOD
+ * @return true if sent successfully
+ */
+static bool sendStatus(uint8_t topic) {
+  PendingStatus& status = pendingStatus[topic];
+  status.pending = false;
+  topicSent(topic);
+
+  jsonDoc.clear();
+  if (topic == TOPIC_WATER) {
+    jsonDoc["waterLevel"] = status.level;
+  } else {
+    jsonDoc["foodLevel"] = status.level;
+    if (status.weight > 0) jsonDoc["lastFeedWeight"] = status.weight;
+  }
+  sendMessage("updateFeedingData", jsonDoc);
+
+  jsonDoc.clear();
+  jsonDoc[topic == TOPIC_WATER ? "watering" : "feeding"] = status.status;
+  return sendMessage("updateSystemStatus", jsonDoc);
+}
+
+/**
+ * Publish a status update, or hold it until the topic is due
+ * @return true if sent now
+ */
+static bool publishStatus(uint8_t topic, const char* state, float level,
+                          float weight) {
+  PendingStatus& status = pendingStatus[topic];
+  if (status.pending) topicDropped(topic);  // Replaced before it went out
+
+  status.status = state;
+  status.level = level;
+  status.weight = weight;
+  status.pending = true;
+
+  if (!webConnected || !topicDue(topic)) return false;
+  return sendStatus(topic);
+}
+
+/**
+ * Send held back status updates whose topic interval has passed
+ */
+static void flushStatus() {
+  if (!webConnected) return;
+  for (uint8_t topic = TOPIC_WATER; topic <= TOPIC_FOOD; topic++) {
+    if (pendingStatus[topic].pending && topicDue(topic)) sendStatus(topic);
+  }
+}
+
 /**
  * Process WebSocket messages and maintain connection
- * Call this function regularly in loop()
+ * Runs as a scheduler task (or call it regularly in loop())
  */
 void webUpdate() {
+  PROFILE_SCOPE("web");
+
   // Loop to process WebSocket events
   webSocket.loop();
+  flushStatus();
+}
 
-  // Send heartbeat every 25 seconds to keep connection alive
-  if (webConnected && millis() - lastHeartbeat > 25000) {
-    // Send ping using WebSocket ping frame
-    webSocket.sendPing();
-    lastHeartbeat = millis();
-    DEBUG_PRINTLN(F("Sent WebSocket ping"));
-  }
+/**
+ * Send heartbeat to keep connection alive
+ */
+void webHeartbeatTask() {
+  if (!webConnected) return;
+
+  // Send ping using WebSocket ping frame
+  webSocket.sendPing();
+  DEBUG_PRINTLN(F("Sent WebSocket ping"));
+}
 
-  // Check feeding schedules periodically
-  if (webConnected && millis() - lastScheduleCheck > 60000 &&
-      timeClient.isTimeSet()) {
-    lastScheduleCheck = millis();
+/**
+ * Refresh feeding schedules from the server
+ */
+void webScheduleTask() {
+  if (webConnected && timeClient.isTimeSet()) {
     checkSchedules();
   }
 }
 
+/**
+ * Fire due or missed feedings from the stored cursors, even when offline
+ */
+void scheduleCursorTask() {
+  if (timeClient.isTimeSet()) {
+    serviceSchedules(timeClient.getEpochTime());
+  }
+}
+
+/**
+ * Report profiler histograms to the server while a dashboard watches them
+ */
+void webMetricsTask() {
+  if (!topicDue(TOPIC_METRICS)) return;
+  if (sendMetrics()) topicSent(TOPIC_METRICS);
+}
+
+/**
+ * Stream the next chunk of the active history query, then sleep until the
+ * next request
+ */
+void historyQueryTask() {
+  if (!historyActive || !webConnected) {
+    historyActive = false;
+    schedulerEnable(historyTaskId, false);
+    return;
+  }
+
+  // Chunks without data are skipped, the last frame always goes out
+  TsdbChunk chunk;
+  tsdbQueryNext(historyQuery, chunk);
+  bool done = tsdbQueryDone(historyQuery);
+  if (chunk.count == 0 && !done) return;
+
+  jsonDoc.clear();
+  jsonDoc["requestId"] = historyRequestId;
+  jsonDoc["metric"] = historyQuery.metric == TSDB_WEIGHT ? "weight" : "water";
+  jsonDoc["tier"] = tsdbTierName(historyQuery.tier);
+  jsonDoc["step"] = historyQuery.step;
+  jsonDoc["utcOffset"] = NTP_OFFSET;
+  jsonDoc["seq"] = historySeq++;
+  jsonDoc["done"] = done;
+
+  JsonArray times = jsonDoc["t"].to<JsonArray>();
+  JsonArray mins = jsonDoc["min"].to<JsonArray>();
+  JsonArray maxs = jsonDoc["max"].to<JsonArray>();
+  JsonArray avgs = jsonDoc["avg"].to<JsonArray>();
+  for (uint8_t i = 0; i < chunk.count; i++) {
+    times.add(chunk.time[i]);
+    mins.add(chunk.min[i]);
+    maxs.add(chunk.max[i]);
+    avgs.add(chunk.sum[i] / chunk.points[i]);
+  }
+
+  sendMessage("history-data", jsonDoc);
+
+  if (done) {
+    historyActive = false;
+    schedulerEnable(historyTaskId, false);
+  }
+}
+
+/**
+ * Advance a running hatch calibration and report each measured angle, and
+ * how it ended (also when a feed aborted it)
+ */
+void hatchCalTask() {
+  bool progress = hatchCalStep();
+  if (!hatchCalRunning()) {
+    schedulerEnable(hatchCalTaskId, false);
+    progress = true;
+  }
+  if (progress) sendHatchCalibration();
+}
+
+/**
+ * Watch the bowl between feeds (restarting it after a feed or while the
+ * hatch calibration drops food), then send finished eating sessions and
+ * bowl alerts
+ */
+void bowlTask() {
+  if (feedJournalActive() || hatchCalRunning()) {
+    bowlMonitorRebase();
+  } else if (scale.is_ready()) {
+    bowlMonitorSample(scale.get_units(1), millis(),
+                      timeClient.isTimeSet() ? timeClient.getEpochTime() : 0);
+  }
+
+  if (!webConnected) return;
+  BowlSession session;
+  if (bowlNextUnsent(session) && sendEatingSession(session)) bowlMarkSent();
+  uint8_t alerts = bowlTakeAlerts();
+  for (uint8_t bit = 1; alerts; bit <<= 1) {
+    if (alerts & bit) sendBowlAlert(bit);
+    alerts &= ~bit;
+  }
+}
+
+/**
+ * Register the periodic WebSocket and schedule work with the task scheduler
+ */
+void registerWebTasks() {
+  if (webTasksRegistered) return;
+  webTasksRegistered = true;
+
+  schedulerAddTask("web", webUpdate, WEB_LOOP_INTERVAL, TASK_PRIORITY_HIGH);
+  schedulerAddTask("ws-ping", webHeartbeatTask, WEB_HEARTBEAT_INTERVAL,
+                   TASK_PRIORITY_LOW, 0, WEB_HEARTBEAT_INTERVAL);
+  schedulerAddTask("schedules", webScheduleTask, WEB_SCHEDULE_REFRESH,
+                   TASK_PRIORITY_LOW, 0, WEB_SCHEDULE_REFRESH);
+  schedulerAddTask("feed-sched", scheduleCursorTask, SCHEDULE_CHECK_INTERVAL,
+                   TASK_PRIORITY_NORMAL);
+  schedulerAddTask("history", historyTask, TSDB_SAMPLE_INTERVAL,
+                   TASK_PRIORITY_LOW);
+  schedulerAddTask("bowl", bowlTask, BOWL_SAMPLE_INTERVAL, TASK_PRIORITY_LOW);
+  historyTaskId = schedulerAddTask("hist-query", historyQueryTask,
+                                   HISTORY_CHUNK_INTERVAL, TASK_PRIORITY_LOW);
+  schedulerEnable(historyTaskId, false);
+  hatchCalTaskId = schedulerAddTask("hatch-cal", hatchCalTask,
+                                    WEIGHT_READ_INTERVAL, TASK_PRIORITY_NORMAL);
+  schedulerEnable(hatchCalTaskId, false);
+  hatchPlannerBegin();
+#ifdef PROFILING
+  schedulerAddTask("metrics", webMetricsTask, METRICS_REPORT_INTERVAL,
+                   TASK_PRIORITY_LOW, 0, METRICS_REPORT_INTERVAL);
+#endif
+}
+
 /**
  * Send message using WebSocket
  * @param eventType Type of event (like "get-settings", "feed-now", etc.)
@@ -133,8 +412,10 @@ void webUpdate() {
 bool sendMessage(const char* eventType, JsonVariant data) {
   if (!webConnected) return false;
 
-  // Create complete message with event type
-  JsonObject root = jsonDoc.to<JsonObject>();
+  // Create complete message with event type. Callers usually pass jsonDoc
+  // itself as data, so build the frame in its own document.
+  JsonDocument message;
+  JsonObject root = message.to<JsonObject>();
   root["eventType"] = eventType;
   root["clientId"] = clientId;
 
@@ -149,7 +430,7 @@ bool sendMessage(const char* eventType, JsonVariant data) {
   }
 
   String output;
-  serializeJson(jsonDoc, output);
+  serializeJson(message, output);
 
   DEBUG_PRINT(F("Sending: "));
   DEBUG_PRINTLN(output);
@@ -217,6 +498,39 @@ void processWebSocketMessage(uint8_t* payload, size_t length) {
     } else {
       processSystemStatus(jsonDoc);
     }
+  } else if (strcmp(eventType, "get-metrics") == 0) {
+    sendMetrics();
+  } else if (strcmp(eventType, "subscriptions") == 0) {
+    // Topics the dashboards watch, with the shortest interval of each
+    if (jsonDoc.containsKey("data")) {
+      applySubscriptions(jsonDoc["data"]["topics"]);
+    } else {
+      applySubscriptions(jsonDoc["topics"]);
+    }
+  } else if (strcmp(eventType, "feed-profile") == 0) {
+    if (jsonDoc.containsKey("data")) {
+      applyFeedProfile(jsonDoc["data"]);
+    } else {
+      applyFeedProfile(jsonDoc.as<JsonVariant>());
+    }
+  } else if (strcmp(eventType, "calibrate-hatch") == 0) {
+    if (jsonDoc.containsKey("data")) {
+      startHatchCalibration(jsonDoc["data"]);
+    } else {
+      startHatchCalibration(jsonDoc.as<JsonVariant>());
+    }
+  } else if (strcmp(eventType, "hopper-refill") == 0) {
+    if (jsonDoc.containsKey("data")) {
+      applyHopperRefill(jsonDoc["data"]);
+    } else {
+      applyHopperRefill(jsonDoc.as<JsonVariant>());
+    }
+  } else if (strcmp(eventType, "history") == 0) {
+    if (jsonDoc.containsKey("data")) {
+      startHistoryQuery(jsonDoc["data"]);
+    } else {
+      startHistoryQuery(jsonDoc.as<JsonVariant>());
+    }
   } else if (strcmp(eventType, "command") == 0) {
     // Process command requests
     const char* command = NULL;
@@ -244,6 +558,174 @@ void processWebSocketMessage(uint8_t* payload, size_t length) {
   }
 }
 
+/**
+ * Replace the subscriptions with the set sent by the server
+ * @param requested Topic name -> shortest interval between messages (ms).
+ *        Topics that are not listed are not published.
+ */
+void applySubscriptions(JsonObject requested) {
+  topicsClear();
+  for (JsonPair kv : requested) {
+    int8_t topic = topicByName(kv.key().c_str());
+    if (topic >= 0) topicSubscribe(topic, kv.value().as<uint32_t>());
+  }
+
+  // The feeding trace paces itself in frames per second
+  if (topicWanted(TOPIC_TRACE)) {
+    telemetrySetSubscribers(1, 1000 / topics[TOPIC_TRACE].interval);
+  } else {
+    telemetrySetSubscribers(0, 0);
+  }
+
+  DEBUG_PRINT(F("Subscribed topics: "));
+  for (uint8_t i = 0; i < TOPIC_COUNT; i++) {
+    if (!topicWanted(i)) continue;
+    DEBUG_PRINT(topics[i].name);
+    DEBUG_PRINT(F(" "));
+  }
+  DEBUG_PRINTLN(topicsIdle() ? F("none (heartbeat only)") : F(""));
+
+  reportInterruptedFeed();
+}
+
+/**
+ * Select, rename or reset a feed profile, then report the active one
+ * @param request select (slot index), name (for the active profile) and/or
+ *        reset (true to forget what the active profile learned)
+ */
+void applyFeedProfile(JsonVariant request) {
+  if (request.containsKey("select")) {
+    uint8_t select = request["select"];
+    feedProfileSelect(select);
+  }
+  if (request.containsKey("name")) {
+    const char* name = request["name"];
+    feedProfileRename(name);
+  }
+  if (request["reset"].as<bool>()) {
+    feedProfileReset(feedProfiles.active);
+    feedProfilesSave();
+  }
+
+  FeedProfile& profile = feedProfileActive();
+  DEBUG_PRINT(F("Feed profile: "));
+  DEBUG_PRINTLN(profile.name);
+  sendMetrics();
+}
+
+/**
+ * Record a hopper refill reported from the dashboard, then report the
+ * inventory
+ * @param request grams (food now in the hopper, default full) and/or
+ *        capacity (grams a full hopper holds)
+ */
+void applyHopperRefill(JsonVariant request) {
+  float grams = request["grams"];
+  float capacity = request["capacity"];
+  hopperRefill(grams, capacity,
+               timeClient.isTimeSet() ? timeClient.getEpochTime() : 0);
+  sendHopperStatus();
+}
+
+/**
+ * Send the hopper inventory and its time-to-empty forecast
+ * @return true if sent successfully
+ */
+bool sendHopperStatus() {
+  hopperBegin();
+
+  jsonDoc.clear();
+  jsonDoc["grams"] = hopper.grams;
+  jsonDoc["capacity"] = hopper.capacity;
+  jsonDoc["level"] = hopperLevel();
+  jsonDoc["gramsPerDay"] = hopperGramsPerDay();
+  float hours = hopperHoursToEmpty();
+  if (hours >= 0) jsonDoc["emptyInHours"] = hours;
+  jsonDoc["refills"] = hopper.refills;
+  jsonDoc["lastRefill"] = hopperRefillName(hopper.lastRefill);
+  if (hopper.refilledAt > 0) jsonDoc["refilledAt"] = hopper.refilledAt;
+
+  return sendMessage("hopper", jsonDoc);
+}
+
+/**
+ * Send a finished eating session
+ * @param session Session from the bowl monitor
+ * @return true if sent successfully
+ */
+bool sendEatingSession(const BowlSession& session) {
+  jsonDoc.clear();
+  if (session.start > 0) jsonDoc["start"] = session.start;
+  jsonDoc["durationS"] = session.durationS;
+  jsonDoc["grams"] = session.decigrams / 10.0f;
+  jsonDoc["bites"] = session.bites;
+  if (session.durationS > 0) {
+    jsonDoc["biteRate"] = session.bites * 60.0f / session.durationS;
+  }
+
+  return sendMessage("eating", jsonDoc);
+}
+
+/**
+ * Send one bowl alert
+ * @param alert BowlAlert bit
+ * @return true if sent successfully
+ */
+bool sendBowlAlert(uint8_t alert) {
+  jsonDoc.clear();
+  jsonDoc["alert"] = bowlAlertName(alert);
+  if (alert == BOWL_ALERT_SPILLED || alert == BOWL_ALERT_ADDED) {
+    jsonDoc["grams"] = bowl.alertGrams;
+  }
+  if (alert == BOWL_ALERT_NOT_EATING) {
+    jsonDoc["hours"] = BOWL_NO_EATING_MS / 3600000UL;
+  }
+
+  return sendMessage("bowl-alert", jsonDoc);
+}
+
+/**
+ * Start or abort the hatch calibration, then report its state
+ * @param request abort (true to stop a running calibration)
+ */
+void startHatchCalibration(JsonVariant request) {
+  if (request["abort"].as<bool>()) {
+    hatchCalAbort("aborted");
+  } else if (hatchCalStart()) {
+    schedulerEnable(hatchCalTaskId, true);
+  }
+  sendHatchCalibration();
+}
+
+/**
+ * Send the calibration state with the table measured so far, or the stored
+ * table once the routine is not running
+ * @return true if sent successfully
+ */
+bool sendHatchCalibration() {
+  static const char* const stateNames[] = {"idle", "settling", "measuring",
+                                           "done", "failed"};
+
+  jsonDoc.clear();
+  jsonDoc["state"] = stateNames[hatchCalState];
+  jsonDoc["point"] = hatchCalPoint;
+  jsonDoc["points"] = HATCH_CAL_POINTS;
+  if (hatchCalError) jsonDoc["error"] = hatchCalError;
+
+  bool running = hatchCalRunning();
+  uint8_t count = running ? hatchCalPoint : HATCH_CAL_POINTS;
+  if (running || hatchCalAvailable()) {
+    JsonArray angles = jsonDoc["angle"].to<JsonArray>();
+    JsonArray flows = jsonDoc["flow"].to<JsonArray>();
+    for (uint8_t i = 0; i < count; i++) {
+      angles.add(hatchCalPointAngle(i));
+      flows.add(running ? hatchCalNewFlow[i] : hatchCal.flow[i]);
+    }
+  }
+
+  return sendMessage("hatch-calibration", jsonDoc);
+}
+
 /**
  * Register the device with the server
  */
@@ -255,6 +737,7 @@ void registerDevice() {
 
   DEBUG_PRINTLN(F("Registering device with server..."));
   sendMessage("register", jsonDoc);
+  sendHopperStatus();
 }
 
 /**
@@ -299,6 +782,34 @@ void processSettings(JsonDocument& doc) {
     DEBUG_PRINT(F("Water amount: "));
     DEBUG_PRINTLN(waterAmount);
   }
+
+  // Extract missed-schedule policy ("skip", "once" or "proportional")
+  if (data.containsKey("catchUpPolicy")) {
+    const char* policy = data["catchUpPolicy"];
+    if (policy && strcmp(policy, "skip") == 0) {
+      setCatchUpPolicy(CATCHUP_SKIP);
+    } else if (policy && strcmp(policy, "once") == 0) {
+      setCatchUpPolicy(CATCHUP_FEED_ONCE);
+    } else if (policy && strcmp(policy, "proportional") == 0) {
+      setCatchUpPolicy(CATCHUP_PROPORTIONAL);
+    }
+    DEBUG_PRINT(F("Catch-up policy: "));
+    DEBUG_PRINTLN(policy);
+  }
+
+  // Extract top-up policy ("threshold", "full" or "top-up")
+  if (data.containsKey("topUpPolicy")) {
+    const char* policy = data["topUpPolicy"];
+    if (policy && strcmp(policy, "threshold") == 0) {
+      setTopUpPolicy(TOPUP_THRESHOLD);
+    } else if (policy && strcmp(policy, "full") == 0) {
+      setTopUpPolicy(TOPUP_FULL);
+    } else if (policy && strcmp(policy, "top-up") == 0) {
+      setTopUpPolicy(TOPUP_DIFFERENCE);
+    }
+    DEBUG_PRINT(F("Top-up policy: "));
+    DEBUG_PRINTLN(policy);
+  }
 }
 
 /**
@@ -315,123 +826,64 @@ void processSchedules(JsonDocument& doc) {
   DEBUG_PRINT(schedules.size());
   DEBUG_PRINTLN(F(" schedule(s)"));
 
-  // Get current time
-  if (!timeClient.isTimeSet()) {
-    DEBUG_PRINTLN(F("Cannot process schedules - time not set"));
-    return;
-  }
-
-  uint32_t currentEpoch = timeClient.getEpochTime();
-  int currentHour = timeClient.getHours();
-  int currentMinute = timeClient.getMinutes();
-  int currentTimeMinutes = currentHour * 60 + currentMinute;
-
-  // Reset next scheduled feeding
-  nextScheduledFeeding = 0;
-  hasActiveSchedule = false;
-
-  int activeCount = 0;
+  // Get current time (0 if unknown - cursors are then resolved later)
+  uint32_t currentEpoch =
+      timeClient.isTimeSet() ? timeClient.getEpochTime() : 0;
 
-  // Temporary array to store all enabled schedules
-  const int MAX_SCHEDULES = 10;
-  struct ScheduleTime {
-    int minutes;       // Minutes since midnight
-    const char* time;  // Original time string
-  };
-  ScheduleTime enabledSchedules[MAX_SCHEDULES];
-  int enabledCount = 0;
+  uint16_t enabledSchedules[MAX_SCHEDULES];
+  uint8_t enabledCount = 0;
 
-  // First loop: count active schedules and store their times
+  // Collect enabled schedules as minutes since midnight
   for (JsonObject schedule : schedules) {
     if (schedule["enabled"].as<bool>()) {
-      activeCount++;
       String timeStr = schedule["time"].as<String>();
 
       // Parse HH:MM format
       int hour = timeStr.substring(0, 2).toInt();
       int minute = timeStr.substring(3, 5).toInt();
-      int scheduleMinutes = hour * 60 + minute;
 
       DEBUG_PRINT(F("Schedule #"));
-      DEBUG_PRINT(activeCount);
+      DEBUG_PRINT(enabledCount + 1);
       DEBUG_PRINT(F(": "));
       DEBUG_PRINTLN(timeStr);
 
       if (enabledCount < MAX_SCHEDULES) {
-        enabledSchedules[enabledCount].minutes = scheduleMinutes;
-        enabledSchedules[enabledCount].time = timeStr.c_str();
-        enabledCount++;
+        enabledSchedules[enabledCount++] = hour * 60 + minute;
       }
     }
   }
 
-  // If we have active schedules, find the next one
-  if (enabledCount > 0) {
-    hasActiveSchedule = true;
-
-    // Find the next schedule (first one later today)
-    int nextScheduleIndex = -1;
-    int minTimeDiff = 24 * 60 + 1;  // More than a day's minutes
-
-    for (int i = 0; i < enabledCount; i++) {
-      int scheduleMinutes = enabledSchedules[i].minutes;
-
-      // Calculate time difference in minutes, handling wrap-around at midnight
-      int timeDiff;
-      if (scheduleMinutes > currentTimeMinutes) {
-        // Schedule is later today
-        timeDiff = scheduleMinutes - currentTimeMinutes;
-      } else {
-        // Schedule is tomorrow
-        timeDiff = scheduleMinutes + (24 * 60 - currentTimeMinutes);
-      }
-
-      if (timeDiff < minTimeDiff) {
-        minTimeDiff = timeDiff;
-        nextScheduleIndex = i;
-      }
-    }
-
-    if (nextScheduleIndex >= 0) {
-      // Calculate next feeding timestamp
-      struct tm timeinfo;
-      time_t now = currentEpoch;
-      gmtime_r(&now, &timeinfo);
-
-      int nextHour = enabledSchedules[nextScheduleIndex].minutes / 60;
-      int nextMinute = enabledSchedules[nextScheduleIndex].minutes % 60;
-
-      // If next schedule is earlier today, it must be for tomorrow
-      if (enabledSchedules[nextScheduleIndex].minutes <= currentTimeMinutes) {
-        // Add a day
-        timeinfo.tm_mday++;
-      }
-
-      timeinfo.tm_hour = nextHour;
-      timeinfo.tm_min = nextMinute;
-      timeinfo.tm_sec = 0;
-
-      // Convert to timestamp and store
-      nextScheduledFeeding = mktime(&timeinfo);
+  // Persist the list; cursors of unchanged slots are kept so a restart or an
+  // outage can tell which feedings already happened
+  setSchedules(enabledSchedules, enabledCount, currentEpoch);
+  if (currentEpoch == 0) {
+    DEBUG_PRINTLN(F("Time not set - schedules stored for later"));
+    return;
+  }
+  nextScheduledFeeding = nextScheduleTime(currentEpoch);
 
-      DEBUG_PRINT(F("Next feeding scheduled at: "));
-      DEBUG_PRINTLN(enabledSchedules[nextScheduleIndex].time);
-      DEBUG_PRINT(F("Countdown: "));
-      DEBUG_PRINT(minTimeDiff / 60);
-      DEBUG_PRINT(F("h "));
-      DEBUG_PRINT(minTimeDiff % 60);
-      DEBUG_PRINTLN(F("m"));
-    }
+  if (enabledCount > 0) {
+    uint32_t countdown = (nextScheduledFeeding - currentEpoch) / 60;
+    DEBUG_PRINT(F("Next feeding in: "));
+    DEBUG_PRINT(countdown / 60);
+    DEBUG_PRINT(F("h "));
+    DEBUG_PRINT(countdown % 60);
+    DEBUG_PRINTLN(F("m"));
   } else {
     DEBUG_PRINTLN(F("No active schedules found"));
   }
 }
 
 // Getter for next scheduled feeding time
-uint32_t getNextScheduledFeeding() { return nextScheduledFeeding; }
+uint32_t getNextScheduledFeeding() {
+  if (timeClient.isTimeSet()) {
+    nextScheduledFeeding = nextScheduleTime(timeClient.getEpochTime());
+  }
+  return nextScheduledFeeding;
+}
 
 // Getter to check if we have any active schedules
-bool hasSchedules() { return hasActiveSchedule; }
+bool hasSchedules() { return hasStoredSchedules(); }
 
 /**
  * Process feeding data received from server
@@ -529,6 +981,180 @@ bool sendFeedingComplete(bool isScheduled, const char* details, float foodLevel,
   return sendMessage("feeding-complete", jsonDoc);
 }
 
+/**
+ * Send profiler percentiles as a "metrics" frame
+ * @return true if sent successfully
+ */
+bool sendMetrics() {
+  if (!webConnected) return false;
+
+  jsonDoc.clear();
+  jsonDoc["uptime"] = millis() / 1000;
+  jsonDoc["idlePercent"] = schedulerIdlePercent();
+  jsonDoc["uiBlockedMsPerDay"] = uiBlockedMsPerDay();
+
+  // One entry per probe, durations in microseconds
+  JsonArray probes = jsonDoc["probes"].to<JsonArray>();
+  for (uint8_t i = 0; i < profileProbeCount; i++) {
+    JsonObject probe = probes.add<JsonObject>();
+    probe["name"] = profileProbes[i].name;
+    probe["count"] = profileProbes[i].count;
+    probe["p50"] = profilerPercentile(i, 0.50f);
+    probe["p99"] = profilerPercentile(i, 0.99f);
+    probe["max"] = profileProbes[i].maxUs;
+  }
+
+  // Link outages since boot
+  JsonObject net = jsonDoc["net"].to<JsonObject>();
+  net["state"] = netStateName();
+  net["wifiOutages"] = netWifi.outages;
+  net["wifiMaxOutageMs"] = netWifi.maxOutageMs;
+  net["wifiTotalOutageMs"] = netWifi.totalOutageMs;
+  net["serverOutages"] = netServer.outages;
+  net["serverMaxOutageMs"] = netServer.maxOutageMs;
+  net["serverTotalOutageMs"] = netServer.totalOutageMs;
+
+  // Clock discipline
+  JsonObject time = jsonDoc["time"].to<JsonObject>();
+  time["set"] = timeClient.isTimeSet();
+  time["driftPpm"] = timeClient.driftPpm();
+  time["offsetMs"] = timeClient.lastOffsetMs();
+  time["rttMs"] = timeClient.lastRttMs();
+  time["syncs"] = timeClient.syncCount();
+  time["failures"] = timeClient.failureCount();
+
+  // Live feeding trace
+  JsonObject telemetry = jsonDoc["telemetry"].to<JsonObject>();
+  telemetry["subscribers"] = telemetrySubscribers;
+  telemetry["sent"] = telemetrySent;
+  telemetry["skipped"] = telemetrySkipped;
+  telemetry["slowSends"] = telemetrySlowSends;
+  telemetry["maxSendUs"] = telemetryMaxSendUs;
+
+  // Dispense model of the active feed profile
+  FeedProfile& profile = feedProfileActive();
+  JsonObject feedProfile = jsonDoc["feedProfile"].to<JsonObject>();
+  feedProfile["active"] = feedProfiles.active;
+  feedProfile["name"] = profile.name;
+  feedProfile["feeds"] = profile.feeds;
+  feedProfile["openings"] = profile.openings;
+  feedProfile["flow"] = feedProfileFlow();
+  feedProfile["fallTime"] = feedProfileFallTime();
+  feedProfile["settleMs"] = feedProfileSettleMs();
+
+  // Outbound topics, interval 0 = nobody watching
+  JsonObject topicStats = jsonDoc["topics"].to<JsonObject>();
+  for (uint8_t i = 0; i < TOPIC_COUNT; i++) {
+    JsonObject topic = topicStats[topics[i].name].to<JsonObject>();
+    topic["interval"] = topics[i].wanted ? topics[i].interval : 0;
+    topic["sent"] = topics[i].sent;
+    topic["dropped"] = topics[i].dropped;
+  }
+
+  // Boot stage timings in ms since power-on
+  JsonObject boot = jsonDoc["boot"].to<JsonObject>();
+  boot["readyMs"] = bootReadyMs;
+  boot["completeMs"] = bootCompleteMs;
+  JsonArray stages = boot["stages"].to<JsonArray>();
+  for (uint8_t i = 0; i < bootStageCount; i++) {
+    JsonObject stage = stages.add<JsonObject>();
+    stage["name"] = bootStages[i].name;
+    stage["status"] = bootStatusName(bootStages[i].status);
+    stage["startMs"] = bootStages[i].startMs;
+    stage["endMs"] = bootStages[i].endMs;
+  }
+
+  return sendMessage("metrics", jsonDoc);
+}
+
+/**
+ * Answer a "history" request that cannot be served
+ */
+static bool sendHistoryError(uint32_t requestId, const char* error) {
+  jsonDoc.clear();
+  jsonDoc["requestId"] = requestId;
+  jsonDoc["error"] = error;
+  jsonDoc["done"] = true;
+  return sendMessage("history-data", jsonDoc);
+}
+
+/**
+ * Start streaming a "history" request as "history-data" chunks of at most
+ * TSDB_CHUNK_POINTS min/max/avg buckets
+ * @param request metric ("weight" or "water"), maxPoints, requestId and
+ *        either from/to (device epochs) or range (seconds back from now)
+ */
+void startHistoryQuery(JsonVariant request) {
+  // Copy everything out, the replies reuse jsonDoc
+  uint32_t requestId = request["requestId"];
+  int8_t metric = tsdbMetricByName(request["metric"]);
+  uint16_t maxPoints = request["maxPoints"];
+  uint32_t range = request["range"];
+  uint32_t from = request["from"];
+  uint32_t to = request["to"];
+
+  if (historyActive) {
+    sendHistoryError(requestId, "busy");
+    return;
+  }
+  if (!timeClient.isTimeSet()) {
+    sendHistoryError(requestId, "time not set");
+    return;
+  }
+
+  uint32_t now = timeClient.getEpochTime();
+  if (maxPoints == 0) maxPoints = 100;
+  if (to == 0 || to > now) to = now;
+  if (range > 0) from = range < to ? to - range : 0;
+
+  if (metric < 0 ||
+      !tsdbQueryBegin(historyQuery, metric, from, to, maxPoints, now)) {
+    sendHistoryError(requestId, "bad request");
+    return;
+  }
+
+  DEBUG_PRINT(F("History query from "));
+  DEBUG_PRINT(tsdbTierName(historyQuery.tier));
+  DEBUG_PRINT(F(", step "));
+  DEBUG_PRINTLN(historyQuery.step);
+
+  historyRequestId = requestId;
+  historySeq = 0;
+  historyActive = true;
+  schedulerEnable(historyTaskId, true);
+}
+
+/**
+ * Send the breadcrumb trail of the previous boot as a "crash-report" frame
+ * @return true if sent successfully
+ */
+bool sendCrashReport() {
+  jsonDoc.clear();
+  jsonDoc["reason"] = crumbResetName(crumbResetReason);
+  jsonDoc["exccause"] = crumbExcCause;
+  jsonDoc["epc1"] = crumbEpc1;
+  jsonDoc["excvaddr"] = crumbExcVaddr;
+  jsonDoc["bootCount"] = crumbPrevHeader.bootCount;
+  jsonDoc["subsystem"] = crumbSubsystemName(crumbPrevHeader.subsystem);
+  jsonDoc["state"] = crumbPrevHeader.state;
+  jsonDoc["stateSinceMs"] = crumbPrevHeader.stateSince;
+
+  JsonArray trail = jsonDoc["trail"].to<JsonArray>();
+  for (uint8_t i = 0; i < crumbPrevCount; i++) {
+    const Crumb& crumb = crumbPrev[i];
+    JsonObject entry = trail.add<JsonObject>();
+    entry["ms"] = crumb.ms;
+    if (crumb.kind == CRUMB_TASK) {
+      entry["task"] = schedulerTaskName(crumb.code);
+    } else {
+      entry["subsystem"] = crumbSubsystemName(crumb.code);
+      entry["state"] = crumb.arg;
+    }
+  }
+
+  return sendMessage("crash-report", jsonDoc);
+}
+
 /**
  * Check for scheduled feedings and calculate next feeding time
  */
@@ -555,12 +1181,8 @@ void checkSchedules() {
   jsonDoc.clear();
   sendMessage("getSchedules", jsonDoc);
 
-  // Reset next scheduled feeding
-  nextScheduledFeeding = 0;
-  hasActiveSchedule = false;
-
-  // Calculate next feeding time based on received schedules
-  // This will be updated when schedules are received from server
+  // Keep the stored schedules until the server answers
+  nextScheduledFeeding = nextScheduleTime(currentEpoch);
 }
 
 /**
@@ -604,6 +1226,10 @@ bool sendWaterNow(int waterAmount = 0) {
 bool sendLogEvent(const char* eventType, const char* details) {
   if (!webConnected) return false;
 
+  // The server keeps every event, so logs go out with or without viewers;
+  // it relays them to the dashboards watching the "logs" topic
+  topicSent(TOPIC_LOGS);
+
   jsonDoc.clear();
   jsonDoc["type"] = eventType;
   jsonDoc["details"] = details;
@@ -620,23 +1246,7 @@ bool sendLogEvent(const char* eventType, const char* details) {
  */
 bool updateFeedingStatus(const char* status, float foodLevel,
                          float foodWeight = 0.0f) {
-  if (!webConnected) return false;
-
-  // Update feeding data
-  jsonDoc.clear();
-  jsonDoc["foodLevel"] = foodLevel;
-
-  if (foodWeight > 0) {
-    jsonDoc["lastFeedWeight"] = foodWeight;
-  }
-
-  sendMessage("updateFeedingData", jsonDoc);
-
-  // Update system status
-  jsonDoc.clear();
-  jsonDoc["feeding"] = status;
-
-  return sendMessage("updateSystemStatus", jsonDoc);
+  return publishStatus(TOPIC_FOOD, status, foodLevel, foodWeight);
 }
 
 /**
@@ -646,29 +1256,14 @@ bool updateFeedingStatus(const char* status, float foodLevel,
  * @return true if successful
  */
 bool updateWaterStatus(const char* status, float waterLevel) {
-  if (!webConnected) return false;
-
-  // Update water level data
-  jsonDoc.clear();
-  jsonDoc["waterLevel"] = waterLevel;
-
-  sendMessage("updateFeedingData", jsonDoc);
-
-  // Update system status
-  jsonDoc.clear();
-  jsonDoc["watering"] = status;
-
-  return sendMessage("updateSystemStatus", jsonDoc);
+  return publishStatus(TOPIC_WATER, status, waterLevel, 0);
 }
 
 /**
- * Check if connected to web server
+ * Check if connected to web server (cached, updated by WiFi and WebSocket
+ * events)
  * @return true if connected
  */
-bool isWebConnected() {
-  return webConnected &&
-         (WiFi.status() ==
-          WL_CONNECTED);  // Fixed: Using WiFi.status() == WL_CONNECTED
-}
+bool isWebConnected() { return netOnline(); }
 
 #endif  // WEB_HELPERS_H
@@ -0,0 +1,205 @@
+#ifndef WIFI_CACHE_H
+#define WIFI_CACHE_H
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+
+#include "../config.h"
+#include "breadcrumbs.h"
+#include "persist_helpers.h"
+#include "profiler.h"
+
+// WiFi fast-reconnect cache. After every successful association the access
+// point's BSSID and channel (and optionally the DHCP lease) are kept in RTC
+// user memory. The next connect - after a reset or a dropped link - goes
+// straight to that AP on that channel, skipping the ~2 s all-channel scan.
+// If the AP is not found there, the SDK says so after probing that one
+// channel, and a normal scan follows at once. A miss thus costs one
+// channel dwell on top of the scan. WIFI_FAST_CONNECT_TIMEOUT only catches
+// a direct attempt that stalls after finding the AP.
+
+static const uint32_t WIFI_CACHE_MAGIC = 0x57464331;  // "WFC1"
+
+struct WifiCacheRecord {
+  uint32_t magic;
+  uint32_t ssidHash;  // Record belongs to this SSID only
+  uint8_t bssid[6];
+  uint8_t channel;
+  uint8_t hasLease;   // ip/gateway/subnet/dns are set
+  uint32_t ip;
+  uint32_t gateway;
+  uint32_t subnet;
+  uint32_t dns;
+  uint32_t crc;
+};
+
+enum WifiConnectMode {
+  WIFI_CONNECT_IDLE = 0,
+  WIFI_CONNECT_FAST = 1,  // Direct to cached BSSID/channel
+  WIFI_CONNECT_SCAN = 2   // Full scan by SSID
+};
+
+static WifiCacheRecord wifiCache;
+static bool wifiCacheValid = false;
+
+static const char* wifiSsid = NULL;
+static const char* wifiPassword = NULL;
+static uint8_t wifiConnectMode = WIFI_CONNECT_IDLE;
+static uint32_t wifiConnectStartMs = 0;
+
+// Statistics
+static uint32_t wifiFastConnects = 0;
+static uint32_t wifiFastFallbacks = 0;  // Direct attempts that needed a scan
+static uint32_t wifiScanConnects = 0;
+
+/**
+ * Load the cached AP from RTC memory
+ * @param ssid Network the cache must belong to
+ * @return true if a usable record was found
+ */
+bool wifiCacheLoad(const char* ssid) {
+  wifiCacheValid = rtcLoad(RTC_WIFI_CACHE_BLOCK, wifiCache) &&
+                   wifiCache.magic == WIFI_CACHE_MAGIC &&
+                   wifiCache.ssidHash == persistCrc32(ssid, strlen(ssid)) &&
+                   wifiCache.channel >= 1 && wifiCache.channel <= 14;
+  return wifiCacheValid;
+}
+
+/**
+ * Remember the AP we are associated with
+ */
+void wifiCacheStore() {
+  memset(&wifiCache, 0, sizeof(wifiCache));
+  wifiCache.magic = WIFI_CACHE_MAGIC;
+  wifiCache.ssidHash = persistCrc32(wifiSsid, strlen(wifiSsid));
+  memcpy(wifiCache.bssid, WiFi.BSSID(), sizeof(wifiCache.bssid));
+  wifiCache.channel = WiFi.channel();
+
+  wifiCache.hasLease = 1;
+  wifiCache.ip = (uint32_t)WiFi.localIP();
+  wifiCache.gateway = (uint32_t)WiFi.gatewayIP();
+  wifiCache.subnet = (uint32_t)WiFi.subnetMask();
+  wifiCache.dns = (uint32_t)WiFi.dnsIP();
+
+  wifiCacheValid = rtcSave(RTC_WIFI_CACHE_BLOCK, wifiCache);
+}
+
+/**
+ * Forget the cached AP (it did not answer on the cached channel)
+ */
+void wifiCacheInvalidate() {
+  wifiCacheValid = false;
+  wifiCache.magic = 0;
+  rtcSave(RTC_WIFI_CACHE_BLOCK, wifiCache);
+}
+
+/**
+ * Start a connection: direct to the cached AP if there is one, else a scan
+ * @param ssid Network name
+ * @param password Network password
+ */
+void wifiConnectBegin(const char* ssid, const char* password) {
+  wifiSsid = ssid;
+  wifiPassword = password;
+  wifiConnectStartMs = millis();
+
+  // The RTC cache replaces the SDK's flash copy, no flash write per connect
+  WiFi.persistent(false);
+  WiFi.mode(WIFI_STA);
+
+  if (wifiCacheValid || wifiCacheLoad(ssid)) {
+#ifdef WIFI_CACHE_STATIC_IP
+    if (wifiCache.hasLease) {
+      WiFi.config(IPAddress(wifiCache.ip), IPAddress(wifiCache.gateway),
+                  IPAddress(wifiCache.subnet), IPAddress(wifiCache.dns));
+    }
+#endif
+    DEBUG_PRINT(F("WiFi: direct connect on channel "));
+    DEBUG_PRINTLN(wifiCache.channel);
+
+    wifiConnectMode = WIFI_CONNECT_FAST;
+    crumbState(CRUMB_WIFI, wifiConnectMode);
+    WiFi.begin(ssid, password, wifiCache.channel, wifiCache.bssid, true);
+  } else {
+    DEBUG_PRINTLN(F("WiFi: no cached AP, scanning"));
+
+    wifiConnectMode = WIFI_CONNECT_SCAN;
+    crumbState(CRUMB_WIFI, wifiConnectMode);
+    WiFi.begin(ssid, password);
+  }
+}
+
+/**
+ * Drive a connection started with wifiConnectBegin()
+ * @return true once associated with an IP address
+ */
+bool wifiConnectPoll() {
+  if (wifiConnectMode == WIFI_CONNECT_IDLE) {
+    return WiFi.status() == WL_CONNECTED;
+  }
+
+  uint32_t elapsed = millis() - wifiConnectStartMs;
+  wl_status_t status = WiFi.status();
+
+  if (status == WL_CONNECTED) {
+    // Association time per path, reported with the profiler probes
+    bool fast = (wifiConnectMode == WIFI_CONNECT_FAST);
+    static int8_t fastProbe = profilerProbe("wifi-fast");
+    static int8_t scanProbe = profilerProbe("wifi-scan");
+    profilerRecord(fast ? fastProbe : scanProbe, elapsed * 1000UL);
+    if (fast) {
+      wifiFastConnects++;
+    } else {
+      wifiScanConnects++;
+    }
+
+    DEBUG_PRINT(fast ? F("WiFi: direct connect in ")
+                     : F("WiFi: scan connect in "));
+    DEBUG_PRINT(elapsed);
+    DEBUG_PRINTLN(F("ms"));
+
+    wifiConnectMode = WIFI_CONNECT_IDLE;
+    crumbState(CRUMB_NONE, 0);
+    wifiCacheStore();
+    return true;
+  }
+
+  // Cached AP is gone or moved - fall back to a full scan
+  if (wifiConnectMode == WIFI_CONNECT_FAST &&
+      (status == WL_NO_SSID_AVAIL || elapsed >= WIFI_FAST_CONNECT_TIMEOUT)) {
+    DEBUG_PRINTLN(F("WiFi: direct connect failed, scanning"));
+    wifiFastFallbacks++;
+    wifiCacheInvalidate();
+
+#ifdef WIFI_CACHE_STATIC_IP
+    // Back to DHCP, the lease may belong to another network
+    WiFi.config(IPAddress(0U), IPAddress(0U), IPAddress(0U));
+#endif
+    wifiConnectMode = WIFI_CONNECT_SCAN;
+    crumbState(CRUMB_WIFI, wifiConnectMode);
+    wifiConnectStartMs = millis();
+    WiFi.begin(wifiSsid, wifiPassword);
+  }
+
+  return false;
+}
+
+/**
+ * @return true while a direct or scan attempt is in progress
+ */
+bool wifiConnecting() { return wifiConnectMode != WIFI_CONNECT_IDLE; }
+
+/**
+ * Time spent in the current attempt (a fallback scan restarts it)
+ */
+uint32_t wifiConnectElapsed() { return millis() - wifiConnectStartMs; }
+
+/**
+ * Stop tracking the current attempt (caller gives up or retries later)
+ */
+void wifiConnectAbort() {
+  wifiConnectMode = WIFI_CONNECT_IDLE;
+  crumbState(CRUMB_NONE, 0);
+}
+
+#endif  // WIFI_CACHE_H
@@ -2,7 +2,6 @@
 #include <ESP8266WiFi.h>
 #include <HX711.h>
 #include <LiquidCrystal_I2C.h>
-#include <NTPClient.h>
 #include <NewPing.h>
 #include <Servo.h>
 #include <WiFiUdp.h>
@@ -10,6 +9,29 @@
 
 #include "config.h"
 #include "globals.h"
+#include "helpers/profiler.h"
+#include "helpers/task_scheduler.h"
+#include "helpers/boot_helpers.h"
+#include "helpers/bowl_monitor.h"
+#include "helpers/breadcrumbs.h"
+#include "helpers/button_helpers.h"
+#include "helpers/connectivity.h"
+#include "helpers/feed_journal.h"
+#include "helpers/feed_profiles.h"
+#include "helpers/flow_control.h"
+#include "helpers/hatch_calibration.h"
+#include "helpers/history_helpers.h"
+#include "helpers/hopper_inventory.h"
+#include "helpers/idle_helpers.h"
+#include "helpers/jam_detector.h"
+#include "helpers/schedule_helpers.h"
+#include "helpers/servo_planner.h"
+#include "helpers/sntp_client.h"
+#include "helpers/tsdb_helpers.h"
+#include "helpers/ui_queue.h"
+#include "helpers/water_schedule.h"
+#include "helpers/wifi_cache.h"
+#include "menu.h"
 #include "pins.h"
 #include "secret.h"
 
@@ -18,30 +40,46 @@ NewPing sonar(TRIG_PIN, ECHO_PIN, MAX_DISTANCE);
 Servo hatchServo;
 HX711 scale;
 
-// Define NTP Client to get time
+// Non-blocking SNTP clock, servers are tried in turn
+static const char* const ntpServers[] = {NTP_SERVER, NTP_SERVER_2,
+                                         NTP_SERVER_3};
 WiFiUDP ntpUDP;
-NTPClient timeClient(ntpUDP, NTP_SERVER, NTP_OFFSET, NTP_UPDATE_INTERVAL);
+SntpClock timeClient(ntpUDP, ntpServers, 3, NTP_OFFSET, NTP_UPDATE_INTERVAL);
 
 // Function prototypes
-// Setup functions
-static bool setupLCD();
-static bool setupPins();
-static bool setupScale();
-static bool setupWiFi();
-static bool setupNTPTimer();
+// Setup functions (boot stages, polled until done)
+static BootStatus setupLCD(bool starting);
+static BootStatus setupPins(bool starting);
+static BootStatus setupScale(bool starting);
+static BootStatus setupWiFi(bool starting);
+static BootStatus setupNTPTimer(bool starting);
 // Helper functions
 static unsigned int nonBlockingMedianPing(NewPing& sonar, uint8_t iterations,
                                           unsigned int maxDistance,
                                           unsigned int maxDuration);
 static float getDistance();
 static void checkWaterLevel();
-static void feeding();
-static bool checkAnyButtonPressed();
+void feeding(bool isScheduled = false, float targetAmount = FEED_WEIGHT);
+static void feedConfirm();
+static bool feedActive();
+static void handleButtonEvent(const ButtonEvent& event);
+static void runMenuAction(unsigned int id);
+// Periodic tasks
+static void setupTasks();
+static void bootTask();
+static void buttonTask();
+static void backlightTask();
+static void ntpTask();
+static void waterTask();
+static void bowlTask();
+static void scheduleTask();
+static void feedTask();
+static void hatchCalTask();
+static void wifiTask();
+static void uiTask();
+static void statsTask();
 // Utility functions
 static float calculateFilteredWeight(float* buffer, uint8_t size);
-static void nonBlockingWait(uint32_t waitTime, uint32_t startDisplayTime = 0);
-static void showSetupStep(const char* setupName, bool (*setupFunction)(),
-                          uint32_t timeout);
 static void clearLineLCD(uint8_t col, uint8_t row, uint8_t length = 0);
 static void progressBar(float percentage);
 static void scrollTextContinuous(const char* message, uint8_t col, uint8_t row,
@@ -51,6 +89,9 @@ static void scrollTextContinuous(const char* message, uint8_t col, uint8_t row,
                                  uint16_t pauseAfterMs = 300);
 
 void setup() {
+  // Keep the previous boot's trail before the first crumb overwrites it
+  crumbBegin();
+
 #ifdef DEBUG
   Serial.begin(115200);
   // while (Serial.available() <= 0);  // Wait for serial to connect
@@ -59,187 +100,462 @@ void setup() {
   DEBUG_PRINTLN("IoT Pet Feeder Initializing");
 #endif
 
-  // Step 1: Setting up the LCD display
-  setupLCD();
-  // Step 2: Setting up GPIO pins
-  showSetupStep("Setting up GPIOs", setupPins, 5000);
-  // Step 3: Setting up the HX711 load cell amplifier
-  showSetupStep("Setting up scale", setupScale, 15000);
-  // Step 4: Setting up WiFi connection
-  showSetupStep("Connect to WiFi", setupWiFi, 20000);
-  // Step 5: Setting up NTP time synchronization
-  showSetupStep("Setting up NTP", setupNTPTimer, 8000);
-
-  // Show overall status but ALWAYS continue to loop()
-  lcd.clear();
-  lcd.print(F("Setup completed!"));
-  lcd.setCursor(0, 1);
-  lcd.print(WiFi.status() == WL_CONNECTED ? F("System ready!")
-                                          : F("Offline Mode"));
-  nonBlockingWait(LCD_TIMEOUT);
+  // Local hardware gates readiness; network stages finish in the background
+  bootAddStage("lcd", setupLCD, true);
+  bootAddStage("pins", setupPins, true);
+  bootAddStage("scale", setupScale, true, BOOT_SCALE_TIMEOUT);
+  int8_t wifiStage = bootAddStage("wifi", setupWiFi, false);
+  bootAddStage("ntp", setupNTPTimer, false, BOOT_NTP_TIMEOUT, wifiStage);
+
+  // Start every stage now, the "boot" task polls them from here on
+  bootRun();
+
+  // A feed cut short by a reset or power loss is reported, not repeated
+  if (feedJournalReconcile()) {
+    char lostText[LCD_X + 1];
+    snprintf(lostText, sizeof(lostText), "%.1fg of %.0fg",
+             feedJournalLost.dispensed, feedJournalLost.target);
+    uiShow(F("Feed interrupted"), lostText, INFO_DISPLAY_TIME);
+  }
+
+  // Weight and water history on LittleFS (formats the partition once)
+  tsdbBegin();
+
+  // Dispense model learned per kibble, and the food left in the hopper
+  // (less what the interrupted feed above gave out)
+  feedProfilesBegin();
+  hopperBegin();
+
+  // Hand periodic work over to the task scheduler
+  setupTasks();
+
+#ifdef DEBUG
+  // Task ids are stable across boots, so the trail can name them
+  crumbPrintReport(Serial, schedulerTaskName);
+#endif
 }
 
 void loop() {
-  static uint32_t lastUserActivityTime = millis();  // Initialize on first run
+  // Run whatever is due, then sleep until the next deadline
+  schedulerRun();
+  schedulerIdle();
+}
 
-  // Static variables for interval management
-  static uint32_t lastWaterCheckTime = 0;
-  static uint32_t lastNtpUpdateTime = 0;
-  // static const uint32_t WATER_CHECK_INTERVAL =
-  //     10000;  // Check water every 10 seconds instead of 1 second
+/* ----- Tasks ------ */
+
+// Time of the last button press, drives the backlight timeout
+static uint32_t lastUserActivityTime = 0;
+
+// Disabled once every boot stage has finished
+static int8_t bootTaskId = -1;
+static int8_t ntpTaskId = -1;
+static int8_t historyTaskId = -1;  // Enabled once the scale is tared
+
+// Event-driven tasks park themselves and are woken by idle watches
+static int8_t buttonTaskId = -1;
+static int8_t uiTaskId = -1;
+static int8_t backlightTaskId = -1;
+static int8_t wifiTaskId = -1;
+static int8_t waterTaskId = -1;
+static int8_t feedTaskId = -1;  // Enabled only while a feed runs
+static int8_t hatchCalTaskId = -1;  // Enabled while a calibration runs
+static int8_t scheduleTaskId = -1;  // Parked until the next slot
+static bool wifiSeenUp = false;  // Link state at the last wifi task run
+
+// Register the periodic work that used to be polled from loop()
+static void setupTasks() {
+  lastUserActivityTime = millis();
+
+  bootTaskId = schedulerAddTask("boot", bootTask, BOOT_POLL_INTERVAL,
+                                TASK_PRIORITY_HIGH);
+  buttonTaskId = schedulerAddTask("button", buttonTask, BUTTON_POLL_INTERVAL,
+                                  TASK_PRIORITY_HIGH, 2000);
+  uiTaskId = schedulerAddTask("ui", uiTask, UI_UPDATE_INTERVAL,
+                              TASK_PRIORITY_NORMAL);
+  backlightTaskId = schedulerAddTask("backlight", backlightTask,
+                                     BACKLIGHT_CHECK_INTERVAL,
+                                     TASK_PRIORITY_LOW);
+  // The reply is timestamped when polled, a late poll skews the offset by
+  // half its lateness. Cheap, and parked between exchanges.
+  ntpTaskId = schedulerAddTask("ntp", ntpTask, NTP_RESPONSE_POLL,
+                               TASK_PRIORITY_HIGH);
+  waterTaskId = schedulerAddTask("water", waterTask, WATER_CHECK_INTERVAL,
+                                 TASK_PRIORITY_NORMAL);
+  wifiTaskId = schedulerAddTask("wifi", wifiTask, WIFI_CHECK_INTERVAL,
+                                TASK_PRIORITY_LOW);
+  historyTaskId = schedulerAddTask("history", historyTask,
+                                   TSDB_SAMPLE_INTERVAL, TASK_PRIORITY_LOW);
+  schedulerEnable(historyTaskId, false);
+  schedulerAddTask("bowl", bowlTask, BOWL_SAMPLE_INTERVAL, TASK_PRIORITY_LOW);
+  scheduleTaskId = schedulerAddTask("feed-sched", scheduleTask,
+                                    SCHEDULE_CHECK_INTERVAL,
+                                    TASK_PRIORITY_NORMAL);
+  feedTaskId = schedulerAddTask("feed", feedTask, WEIGHT_READ_INTERVAL,
+                                TASK_PRIORITY_NORMAL);
+  schedulerEnable(feedTaskId, false);
+  hatchCalTaskId = schedulerAddTask("hatch-cal", hatchCalTask,
+                                    WEIGHT_READ_INTERVAL, TASK_PRIORITY_NORMAL);
+  schedulerEnable(hatchCalTaskId, false);
+  hatchPlannerBegin();
+#ifdef DEBUG
+  schedulerAddTask("stats", statsTask, SCHEDULER_STATS_INTERVAL,
+                   TASK_PRIORITY_LOW, 0, SCHEDULER_STATS_INTERVAL);
+#endif
 
-  // Allow background tasks to run
-  yield();
+  // Sleep between deadlines, waking parked tasks when their work arrives
+  idleWatch(buttonTaskId, []() -> uint32_t {
+    return buttonEdgesPending() ? 0 : IDLE_NEVER;
+  });
+  idleWatch(uiTaskId, uiNextUpdateIn);
+  idleWatch(wifiTaskId, []() -> uint32_t {
+    return netWifiUp() != wifiSeenUp ? 0 : IDLE_NEVER;
+  });
+  idleBegin();
+}
 
-  // Get current time once per loop iteration
-  uint32_t currentMillis = millis();
+// Advance the boot stages until all of them have finished
+void bootTask() {
+  static bool readyShown = false;
+
+  bool complete = bootRun();
+
+  if (bootIsReady() && !readyShown) {
+    readyShown = true;
+    uiShow(F("IoT Pet Feeder"), F("Ready"), BOOT_STATUS_TIME);
+    schedulerEnable(historyTaskId, true);
+  }
+
+  if (complete) {
+    uiShow(F("Setup completed!"),
+           netWifiUp() ? F("System ready!") : F("Offline Mode"));
+#ifdef DEBUG
+    bootPrintReport(Serial);
+#endif
+    schedulerEnable(bootTaskId, false);
+  }
+}
+
+// Debounce button edges and dispatch the resulting gestures
+void buttonTask() {
+  static uint32_t lastButtonActivity = 0;
+
+  buttonUpdate();
 
-  // Check for any button press - this happens on every loop for responsiveness
-  if (checkAnyButtonPressed()) {
-    // Button press detected - turn on lcd backlight
+  // Any press or release wakes the backlight
+  if (buttonLastActivity() != lastButtonActivity) {
+    lastButtonActivity = buttonLastActivity();
+    lastUserActivityTime = millis();
     lcd.backlight();
+    schedulerRunIn(backlightTaskId, LCD_BACKLIGHT_TIMEOUT);
+  }
 
-    // Always update activity timestamp on button press
-    lastUserActivityTime = currentMillis;
+  ButtonEvent event;
+  while (buttonPollEvent(event)) {
+    handleButtonEvent(event);
+  }
 
-    // Handle manual feeding button specifically
-    if (digitalRead(MANUAL_FEED_BUTTON_PIN) == LOW) {
-      feeding();  // Pass false to indicate this is a manual feeding
-    }
+  menuCheckTimeout();
+
+  // Poll only while a gesture or the menu needs the timers, else wait for
+  // the next edge
+  bool active = buttonBusy() || menuIsOpen();
+  schedulerRunIn(buttonTaskId,
+                 active ? BUTTON_POLL_INTERVAL : IDLE_PARK_INTERVAL);
+}
+
+// Press feeds, long press opens the menu; the open menu takes all gestures,
+// a running feed takes them to answer its bowl prompt
+void handleButtonEvent(const ButtonEvent& event) {
+  // Scale is not tared yet
+  if (!bootIsReady()) {
+    uiShow(F("Starting up..."), F("Please wait"), QUICK_DISPLAY_TIME);
+    return;
   }
 
-  // Check if LCD should be turned off due to inactivity
-  if (currentMillis - lastUserActivityTime >= 60000UL) {
-    lcd.noBacklight();
+  if (feedActive()) {
+    feedConfirm();
+    return;
   }
 
-  // Update NTP time every minute
-  if (currentMillis - lastNtpUpdateTime >= 60000) {
-    lastNtpUpdateTime = currentMillis;
-    timeClient.update();
+  if (menuIsOpen()) {
+    unsigned int selected = menuHandleEvent(event);
+    if (selected != MENU_NONE) runMenuAction(selected);
+    return;
   }
 
-  // Check water level at intervals
-  if (currentMillis - lastWaterCheckTime >= WATER_CHECK_INTERVAL) {
-    lastWaterCheckTime = currentMillis;
-    checkWaterLevel();
+  switch (event.type) {
+    case BUTTON_PRESS:
+      feeding();
+      break;
+    case BUTTON_LONG_PRESS:
+      menuOpen();
+      break;
+    default:
+      break;
   }
+}
 
-  // Important: Short delay with yield to prevent WDT
-  delay(10);
-  yield();
+// Daily slots of the Schedule menu items, minutes since local midnight
+static const uint16_t MENU_SCHEDULE_MINUTES[] = {8 * 60, 16 * 60, 22 * 60};
+
+// Add a daily slot, or remove it if it is already set
+static void scheduleToggle(uint16_t minutes) {
+  loadSchedules();
+  uint16_t slots[MAX_SCHEDULES];
+  uint8_t count = 0;
+  bool found = false;
+  for (uint8_t i = 0; i < scheduleStore.count; i++) {
+    if (scheduleStore.slots[i].minutes == minutes) {
+      found = true;
+    } else {
+      slots[count++] = scheduleStore.slots[i].minutes;
+    }
+  }
+  if (!found) {
+    if (count >= MAX_SCHEDULES) {
+      uiShow(F("Schedule full"), F("Remove one first"), QUICK_DISPLAY_TIME);
+      return;
+    }
+    slots[count++] = minutes;
+  }
+  setSchedules(slots, count,
+               timeClient.isTimeSet() ? timeClient.getEpochTime() : 0);
+
+  char slotText[LCD_X + 1];
+  snprintf(slotText, sizeof(slotText), "%02u:%02u %s", minutes / 60,
+           minutes % 60, found ? "off" : "on");
+  uiShow(F("Daily feed"), slotText, QUICK_DISPLAY_TIME);
+  schedulerRunIn(scheduleTaskId, 0);
 }
 
-/* ----- Functions ------ */
+// Run a menu action item
+void runMenuAction(unsigned int id) {
+  switch (id) {
+    case MENU_FEED_AMOUNT_10:
+      feeding(false, 10.0f);
+      break;
+    case MENU_FEED_AMOUNT_20:
+      feeding(false, 20.0f);
+      break;
+    case MENU_FEED_AMOUNT_30:
+      feeding(false, 30.0f);
+      break;
+    case MENU_WIFI_CONNECT:
+      uiShow(F("Connect to WiFi"), F("Reconnecting..."));
+      // Cached AP first, like every other connect; wifiTask polls it
+      if (!wifiConnecting()) wifiConnectBegin(WIFI_SSID, WIFI_PSWD);
+      schedulerRunIn(wifiTaskId, 0);
+      break;
+    case MENU_FEED_PROFILE:
+      // Next kibble profile, the feeds learn into it from now on
+      feedProfileSelect((feedProfiles.active + 1) % FEED_PROFILE_COUNT);
+      uiShow(F("Food profile"), feedProfileActive().name, INFO_DISPLAY_TIME);
+      break;
+    case MENU_HATCH_CAL:
+      // Selecting it again stops a running calibration
+      if (hatchCalRunning()) {
+        hatchCalAbort("aborted");
+      } else if (hatchCalStart()) {
+        uiShow(F("Calibrating"), F("Keep bowl empty"), 0);
+        schedulerEnable(hatchCalTaskId, true);
+      } else {
+        uiShow(F("Calibration"), F("Scale not ready!"), INFO_DISPLAY_TIME);
+      }
+      break;
+    case MENU_HOPPER_REFILL:
+      hopperRefill(0, 0,
+                   timeClient.isTimeSet() ? timeClient.getEpochTime() : 0);
+      uiShow(F("Hopper refilled"), F("Level: 100%"), QUICK_DISPLAY_TIME);
+      break;
+    case MENU_SCHEDULE_1:
+    case MENU_SCHEDULE_2:
+    case MENU_SCHEDULE_3:
+      scheduleToggle(MENU_SCHEDULE_MINUTES[id - MENU_SCHEDULE_1]);
+      break;
+    default:
+      // Everything else is managed from the web dashboard
+      uiShow(F("Not available"), F("Use web app"), QUICK_DISPLAY_TIME);
+      break;
+  }
+}
 
-// Show a setup step with state machine for timeout detection
-enum SetupState {
-  SETUP_START,
-  SETUP_RUNNING,
-  SETUP_COMPLETE,
-  SETUP_TIMEOUT,
-  SETUP_ERROR,
-  SETUP_FINISHED
-};
+// Turn the LCD off due to inactivity (runs when the timeout is up)
+void backlightTask() {
+  uint32_t inactive = millis() - lastUserActivityTime;
+  if (inactive >= LCD_BACKLIGHT_TIMEOUT) {
+    lcd.noBacklight();
+    schedulerRunIn(backlightTaskId, IDLE_PARK_INTERVAL);
+  } else {
+    schedulerRunIn(backlightTaskId, LCD_BACKLIGHT_TIMEOUT - inactive);
+  }
+}
 
-void showSetupStep(const char* setupName, bool (*setupFunction)(),
-                   uint32_t timeout = SETUP_STEP_TIMEOUT) {
-  // Variables needed throughout the state machine
-  uint32_t startTime = millis();
-  SetupState state = SETUP_START;
-  bool setupSuccess = false;  // Default to failure
+// Drive the SNTP exchange, sleeping until the next send or reply check
+void ntpTask() {
+  timeClient.update();
+  schedulerRunIn(ntpTaskId, timeClient.pollDelay());
+}
 
-  while (state != SETUP_FINISHED) {
-    // Always yield to keep WiFi stack happy
-    yield();
-    delay(5);
+// Check water level, at a period adapted to how fast it drops
+void waterTask() { checkWaterLevel(); }
 
-    // Switch based on current state
-    switch (state) {
-      case SETUP_START:
-        // Initial display
-        lcd.clear();
-        lcd.setCursor(0, 0);
-        lcd.print(setupName);
-        lcd.setCursor(0, 1);
-        lcd.print(F("Initializing..."));
-        nonBlockingWait(LCD_TIMEOUT, startTime);
+// Advance a running hatch calibration, showing each measured angle and how
+// it ended (also when a feed aborted it)
+void hatchCalTask() {
+  bool progress = hatchCalStep();
 
-        // Move to next state
-        state = SETUP_RUNNING;
-        break;
+  if (hatchCalRunning()) {
+    if (!progress) return;
+    char pointText[LCD_X + 1];
+    snprintf(pointText, sizeof(pointText), "Angle %u of %u", hatchCalPoint,
+             HATCH_CAL_POINTS - 1);
+    uiShowLine(1, pointText, 0);
+    return;
+  }
 
-      case SETUP_RUNNING:
-        setupSuccess = false;  // Reset the variable
-        // Run the setup function
-        setupSuccess = setupFunction();
+  schedulerEnable(hatchCalTaskId, false);
+  if (hatchCalState == HATCH_CAL_DONE) {
+    char flowText[LCD_X + 1];
+    snprintf(flowText, sizeof(flowText), "Full: %.1fg/s",
+             hatchCal.flow[HATCH_CAL_POINTS - 1]);
+    uiShow(F("Hatch calibrated"), flowText, INFO_DISPLAY_TIME);
+  } else {
+    uiShow(F("Calibration fail"), hatchCalError, INFO_DISPLAY_TIME);
+  }
+}
 
-        // Check for timeout
-        if (millis() - startTime > timeout) {
-          state = SETUP_TIMEOUT;
-        } else {
-          setupSuccess ? state = SETUP_COMPLETE : state = SETUP_ERROR;
-        }
-        break;
+// Watch the bowl between feeds (restarting it after a feed or while the
+// hatch calibration drops food) and show eating sessions and bowl alerts
+void bowlTask() {
+  if (!bootIsReady()) return;
+  if (feedActive() || hatchCalRunning()) {
+    bowlMonitorRebase();
+  } else if (scale.is_ready()) {
+    bowlMonitorSample(scale.get_units(1), millis(),
+                      timeClient.isTimeSet() ? timeClient.getEpochTime() : 0);
+  }
 
-      case SETUP_COMPLETE:
-        // Success - show completion message
-        lcd.clear();
-        lcd.setCursor(0, 0);
-        lcd.print(setupName);
-        lcd.setCursor(0, 1);
-        lcd.print(F("Setup completed!"));
-        // Wait for LCD_TIMEOUT using our improved nonBlockingWait
-        nonBlockingWait(LCD_TIMEOUT);
-        // Set the result and exit state machine
-        state = SETUP_FINISHED;
-        break;
-
-      case SETUP_TIMEOUT:
-        // Timeout occurred - show error
-        lcd.clear();
-        lcd.setCursor(0, 0);
-        lcd.print(setupName);
-        lcd.setCursor(0, 1);
-        lcd.print(F("Setup timeout!"));
+  // No server to send them to, the LCD is the report
+  BowlSession session;
+  while (bowlNextUnsent(session)) {
+    char sessionText[LCD_X + 1];
+    snprintf(sessionText, sizeof(sessionText), "%.1fg in %u min",
+             session.decigrams / 10.0f, (session.durationS + 59) / 60);
+    uiShow(F("Pet has eaten"), sessionText, INFO_DISPLAY_TIME);
+    bowlMarkSent();
+  }
 
-        // Wait so user can read the error
-        nonBlockingWait(LCD_TIMEOUT);
+  uint8_t alerts = bowlTakeAlerts();
+  if (alerts & BOWL_ALERT_NOT_EATING) {
+    uiShow(F("Bowl"), F("No meal in a day"), INFO_DISPLAY_TIME);
+  }
+  if (alerts & BOWL_ALERT_REMOVED) {
+    uiShow(F("Bowl"), F("Lifted off scale"), INFO_DISPLAY_TIME);
+  }
+  if (alerts & BOWL_ALERT_SPILLED) {
+    uiShow(F("Bowl"), F("Food spilled"), INFO_DISPLAY_TIME);
+  }
+  if (alerts & BOWL_ALERT_ADDED) {
+    uiShow(F("Bowl"), F("Food added"), INFO_DISPLAY_TIME);
+  }
+}
 
-        // Set result and exit state machine
-        state = SETUP_FINISHED;
-        break;
+// Fire due schedules through the pre-feed gate, then sleep until the next
+// slot. A feed deferred by the gate is retried every interval.
+void scheduleTask() {
+  if (!bootIsReady() || !timeClient.isTimeSet()) return;
+  // A slot due meanwhile waits, SCHEDULE_DUE_WINDOW outlasts a feed
+  if (feedActive() || hatchCalRunning()) return;
 
-      case SETUP_ERROR:
-        // Error occurred - show error
-        lcd.clear();
-        lcd.setCursor(0, 0);
-        lcd.print(setupName);
-        lcd.setCursor(0, 1);
-        lcd.print(F("Setup failed!"));
+  uint32_t now = timeClient.getEpochTime();
+  serviceSchedules(now);
+  if (feedGatePending() || feedActive()) return;
+
+  uint32_t next = nextScheduleTime(now);
+  uint32_t wait = next > now ? (next - now) * 1000UL : IDLE_PARK_INTERVAL;
+  schedulerRunIn(scheduleTaskId, min(wait, (uint32_t)IDLE_PARK_INTERVAL));
+}
+
+// Reconnect after the link drops, trying the cached AP before a scan
+void wifiTask() {
+  static uint32_t lastAttempt = 0;
 
-        // Wait so user can read the error
-        nonBlockingWait(LCD_TIMEOUT);
+  wifiSeenUp = netWifiUp();
 
-        // Set result and exit state machine
-        state = SETUP_FINISHED;
-        break;
+  // The boot stage owns the first connection
+  if (!bootIsComplete()) return;
 
-      case SETUP_FINISHED:
-        // Do nothing, exit state machine
-        DEBUG_PRINTLN(F("Setup finished"));
-        break;
+  if (wifiConnecting()) {
+    if (!wifiConnectPoll() && wifiConnectElapsed() >= CONNECTION_TIMEOUT) {
+      wifiConnectAbort();
     }
+    return;
+  }
+
+  // Link is up, the idle watch wakes this task when it drops
+  if (netWifiUp()) {
+    lastAttempt = 0;
+    schedulerRunIn(wifiTaskId, IDLE_PARK_INTERVAL);
+    return;
+  }
+
+  // Retry right after a drop, then every WIFI_RECONNECT_INTERVAL
+  if (lastAttempt != 0 && millis() - lastAttempt < WIFI_RECONNECT_INTERVAL) {
+    return;
   }
+  lastAttempt = millis();
+  wifiConnectBegin(WIFI_SSID, WIFI_PSWD);
 }
 
-// Setup LCD display
+// Advance the LCD message queue
+void uiTask() {
+  uiUpdate();
+  schedulerRunIn(uiTaskId, IDLE_PARK_INTERVAL);
+}
+
+// Report loop jitter, idle percentage and scope timings on the serial monitor
+void statsTask() {
+  schedulerPrintStats(Serial);
+  profilerPrintReport(Serial);
+  bootPrintReport(Serial);
+  netPrintReport(Serial);
+  timeClient.printReport(Serial);
+  idlePrintReport(Serial);
+  feedJournalPrintReport(Serial);
+  tsdbPrintReport(Serial);
+
+  Serial.print(F("UI blocked: "));
+  Serial.print(uiBlockedMs);
+  Serial.print(F("ms total, "));
+  Serial.print(uiBlockedMsPerDay());
+  Serial.print(F("ms/day, dropped="));
+  Serial.println(uiDropped);
+
+  Serial.print(F("WiFi connects: direct="));
+  Serial.print(wifiFastConnects);
+  Serial.print(F(" fallback="));
+  Serial.print(wifiFastFallbacks);
+  Serial.print(F(" scan="));
+  Serial.println(wifiScanConnects);
+}
+
+/* ----- Functions ------ */
 
-bool setupLCD() {
+// No server in this firmware, schedule and feed gate events go to the debug
+// log (the LCD already showed them)
+bool sendLogEvent(const char* eventType, const char* details) {
+  DEBUG_PRINT(eventType);
+  DEBUG_PRINT(F(": "));
+  DEBUG_PRINTLN(details);
+  return false;
+}
+
+// Setup LCD display
+BootStatus setupLCD(bool starting) {
+  (void)starting;  // Completes in one call
   DEBUG_PRINT("\n[1/5] Setting up LCD display...");
 
   Wire.begin(SDA_PIN, SCL_PIN);  // Setting up I2C protocols
-  delay(50);  // Fixed: Changed from delayMicroseconds to delay
   DEBUG_PRINT("\nI2C protocol initiated successfully");
   DEBUG_PRINT("\nInitializing LCD...");
 
@@ -248,321 +564,183 @@ bool setupLCD() {
 
   if (error != 0) {
     DEBUG_PRINT("\nLCD not found. Please checking the wiring connection");
-    return false;
+    return BOOT_FAILED;
   } else {
     lcd.init();
     lcd.backlight();
-    delay(5);
     lcd.clear();
     DEBUG_PRINT("\nLCD initiation completed successful");
 
     // Show welcome message
-    lcd.clear();
-    lcd.print(F("IoT Pet Feeder"));
-    lcd.setCursor(0, 1);
-    lcd.print(F("Starting up..."));
-    nonBlockingWait(LCD_TIMEOUT);
-    return true;
+    uiShow(F("IoT Pet Feeder"), F("Starting up..."), BOOT_STATUS_TIME);
+    return BOOT_DONE;
   }
 }
 
 // Setup GPIO pins
-bool setupPins() {
+BootStatus setupPins(bool starting) {
+  (void)starting;  // Completes in one call
   DEBUG_PRINT("\n[2/5] Configuring I/O pins...");
 
   pinMode(TRIG_PIN, OUTPUT);  // Sets the TRIG_PIN as an Output
   pinMode(ECHO_PIN, INPUT);   // Sets the ECHO_PIN as an Input
-  pinMode(MANUAL_FEED_BUTTON_PIN, INPUT_PULLUP);
+  buttonBegin();  // Feed button with edge interrupt
   pinMode(WATER_PUMP_RELAY_PIN, OUTPUT);
 
-  delay(20);
   digitalWrite(WATER_PUMP_RELAY_PIN,
                LOW);  // set digital output as LOW for deactive relay, reduce
                       // power comsume
 
-  hatchServo.attach(SERVO_PIN);
-  hatchServo.write(SERVO_CLOSE_ANGLE);
+  hatchJump(SERVO_CLOSE_ANGLE);  // Detached again once it rests closed
 
   DEBUG_PRINT("\nPins initiation completed successful");
-  return true;
+  return BOOT_DONE;
 }
 
 /**
- * Sets up the HX711 load cell amplifier
- * @return true if setup was successful, false otherwise
+ * Sets up the HX711 load cell amplifier. The tare is averaged from one raw
+ * reading per poll, so it never holds up the other boot stages.
+ * @param starting true on the first call
+ * @return Stage status
  */
-
-bool setupScale() {
-  DEBUG_PRINTLN(F("[3/5] Initializing load cell scale..."));
-
-  // Initialize HX711 communication
-  scale.begin(LOADCELL_DOUT_PIN, LOADCELL_SCK_PIN);
-  yield();
-
-  // Check if scale is responding
-  DEBUG_PRINTLN(F("Checking for HX711 connection..."));
-
-  // Wait for scale to be ready with timeout
-  uint32_t startTime = millis();
-  uint32_t timeout = 3000;  // 3 seconds timeout
-  bool scaleDetected = false;
-  bool tareSuccess = false;
-
-  // Wait for scale with timeout
-  while (millis() - startTime < timeout) {
-    if (scale.is_ready()) {
-      scaleDetected = true;
-      break;
-    }
-    yield();
-    delay(10);
+BootStatus setupScale(bool starting) {
+  static uint32_t startTime = 0;
+  static bool scaleDetected = false;
+  static long tareSum = 0;
+  static uint8_t tareCount = 0;
+
+  if (starting) {
+    DEBUG_PRINTLN(F("[3/5] Initializing load cell scale..."));
+
+    // Initialize HX711 communication
+    scale.begin(LOADCELL_DOUT_PIN, LOADCELL_SCK_PIN);
+    startTime = millis();
+    scaleDetected = false;
+    tareSum = 0;
+    tareCount = 0;
   }
 
-  // Check if scale was detected
+  // Wait for scale with timeout
   if (!scaleDetected) {
-    DEBUG_PRINTLN(F("HX711 not detected. Check wiring connections."));
-    yield();  // for stability
-
-    clearLineLCD(0, 1, 16);
-    lcd.setCursor(0, 1);
-    lcd.print(F("HX711 not found!"));
-    nonBlockingWait(LCD_TIMEOUT);
+    if (!scale.is_ready()) {
+      if (millis() - startTime < SCALE_TIMEOUT) return BOOT_RUNNING;
 
-    return false;
-  }
-
-  // Scale detected, continue with setup
-  DEBUG_PRINTLN(F("HX711 detected successfully!"));
-
-  // Show progress on LCD
-  clearLineLCD(0, 1, 16);
-  lcd.setCursor(0, 1);
-  lcd.print(F("HX711 detected!"));
-  nonBlockingWait(1500);  // Short delay to show success message
-
-  // Apply calibration factor
-  scale.set_scale(CALIBRATION_FACTOR);
-  yield();
-
-  // Reset the scale to zero with better user feedback
-  DEBUG_PRINTLN(F("Taring scale (setting to zero)..."));
-
-  // Update LCD with taring status
-  lcd.setCursor(0, 1);
-  lcd.print(F("Taring scale... "));
-  nonBlockingWait(LCD_TIMEOUT);  // Short delay to show tare message
-  // Take multiple tare readings for accuracy
-  scale.tare(5);  // Average of 5 readings
-  yield();
-
-  // Verify scale is working after tare
-  startTime = millis();
-  while (millis() - startTime < 2000) {
-    if (scale.is_ready()) {
-      tareSuccess = true;
-      break;
+      DEBUG_PRINTLN(F("HX711 not detected. Check wiring connections."));
+      uiShowLine(1, F("HX711 not found!"), BOOT_STATUS_TIME);
+      return BOOT_FAILED;
     }
-    delay(100);
-    yield();
-  }
 
-  // Check if scale is still not responding
-  if (tareSuccess) {
-    DEBUG_PRINTLN(F("Scale tared successfully!"));
-
-    lcd.setCursor(0, 1);
-    lcd.print(F("Tare completed! "));
-    nonBlockingWait(LCD_TIMEOUT);
+    // Scale detected, apply calibration factor and start taring
+    DEBUG_PRINTLN(F("HX711 detected, taring scale..."));
+    uiShowLine(1, F("Taring scale..."), BOOT_STATUS_TIME);
+    scale.set_scale(CALIBRATION_FACTOR);
+    scaleDetected = true;
+  }
 
-  } else {
-    DEBUG_PRINTLN(F("Scale not responding after tare!"));
+  // Take one tare reading whenever a conversion is available
+  if (!scale.is_ready()) return BOOT_RUNNING;
+  tareSum += scale.read();
+  if (++tareCount < SCALE_TARE_SAMPLES) return BOOT_RUNNING;
 
-    lcd.setCursor(0, 1);
-    lcd.print(F("Scale not ready!"));
-    nonBlockingWait(LCD_TIMEOUT);
-
-    return false;
-  }
+  scale.set_offset(tareSum / tareCount);
 
   DEBUG_PRINTLN(F("Scale initialization complete!"));
-
-  // Update LCD with final status
-  lcd.setCursor(0, 1);
-  lcd.print(F("Scale ready!    "));
-  nonBlockingWait(LCD_TIMEOUT);
-  return true;
+  uiShowLine(1, F("Scale ready!"), BOOT_STATUS_TIME);
+  return BOOT_DONE;
 }
 
 /**
- * Setup WiFi connection with retry and timeout functionality
+ * Setup WiFi connection with retry, polled in the background. Each attempt
+ * first goes straight to the AP cached in RTC memory, then falls back to a
+ * full scan.
+ * @param starting true on the first call
+ * @return Stage status
  */
-bool setupWiFi() {
-  DEBUG_PRINTLN(F("\n[4/5] Setting up WiFi..."));
+BootStatus setupWiFi(bool starting) {
+  static uint8_t attempt = 0;
 
-  // Disconnect and prepare WiFi
-  WiFi.disconnect();
-  delay(150);
-  WiFi.mode(WIFI_STA);
-  WiFi.setAutoReconnect(true);
+  if (starting) {
+    DEBUG_PRINTLN(F("\n[4/5] Setting up WiFi..."));
 
-  // Try connecting up to MAX_RETRY_COUNT times
-  for (uint8_t attempt = 1; attempt <= MAX_RETRY_COUNT; attempt++) {
-    lcd.clear();
-    lcd.print(F("Attempt no. #"));
-    lcd.print(attempt);
-    // scrollTextContinuous(WIFI_SSID, 0, 1, 3);
-    lcd.setCursor(0, 1);
-    lcd.print(F(WIFI_SSID));
-    nonBlockingWait(LCD_TIMEOUT);
-
-    // Start connection attempt
-    DEBUG_PRINT(F("Connecting to SSID: "));
-    DEBUG_PRINTLN(WIFI_SSID);
-
-    // Display attempt information
-    DEBUG_PRINT(F("Connection attempt "));
-    DEBUG_PRINT(attempt);
-    DEBUG_PRINT(F(" of "));
-    DEBUG_PRINTLN(MAX_RETRY_COUNT);
-
-    WiFi.begin(WIFI_SSID, WIFI_PSWD);
-
-    // Important: Set status update interval
-    uint32_t startTime = millis();
-    uint32_t lastStatusTime = 0;
-    uint8_t dotCount = 0;
-
-    // Connection loop with timeout and regular status updates
-    while (WiFi.status() != WL_CONNECTED &&
-           millis() - startTime < CONNECTION_TIMEOUT) {
-      // Print status update every 500ms regardless of connection state
-      if (millis() - lastStatusTime >= 500) {
-        lastStatusTime = millis();
-
-        // Print dots to serial monitor
-        DEBUG_PRINT(F("."));
-
-        // Show elapsed time
-        DEBUG_PRINT((millis() - startTime) / 1000);
-        DEBUG_PRINTLN(F("s"));
-
-        // Update LCD dots
-        lcd.setCursor(strlen(WIFI_SSID), 1);
-        lcd.print(F("    "));  // Clear dot area
-        lcd.setCursor(strlen(WIFI_SSID), 1);
-        for (uint8_t i = 0; i < (dotCount % 4); i++) {
-          lcd.print('.');
-        }
-        dotCount++;
-      }
+    // Reconnects are handled by wifiTask so they can use the cache too
+    WiFi.setAutoReconnect(false);
+    netBegin();
+    attempt = 1;
+    wifiConnectBegin(WIFI_SSID, WIFI_PSWD);
+  }
 
-      // Short delay to prevent CPU hogging
-      delay(100);
-      yield();
-    }
+  // Check if connected
+  if (wifiConnectPoll()) {
+    DEBUG_PRINTLN(F("WiFi connected successfully!"));
+    DEBUG_PRINT(F("IP: "));
+    DEBUG_PRINTLN(WiFi.localIP().toString());
 
-    // Connection result
-    DEBUG_PRINTLN();
-    DEBUG_PRINT(F("Connection result: "));
-    DEBUG_PRINTLN(WiFi.status());
-
-    // Check if connected
-    if (WiFi.status() == WL_CONNECTED) {
-      // Success!
-      WiFi.persistent(true);
-
-      DEBUG_PRINTLN(F("WiFi connected successfully!"));
-      DEBUG_PRINT(F("IP: "));
-      DEBUG_PRINTLN(WiFi.localIP().toString());
-
-      lcd.clear();
-      lcd.print(F("WiFi Connected!"));
-      lcd.setCursor(0, 1);
-      lcd.print(WiFi.localIP().toString());
-      nonBlockingWait(2000);
-      return true;
-    }
+    uiShow(F("WiFi Connected!"), WiFi.localIP().toString().c_str(),
+           BOOT_STATUS_TIME);
+    return BOOT_DONE;
+  }
 
-    // Failed attempt - show which specific error occurred
-    DEBUG_PRINT(F("Connection failed. Status code: "));
-    DEBUG_PRINTLN(WiFi.status());
+  if (wifiConnectElapsed() < CONNECTION_TIMEOUT) return BOOT_RUNNING;
 
-    lcd.clear();
-    lcd.setCursor(0, 0);
-    lcd.print(F("WiFi Connection"));
-    lcd.setCursor(0, 1);
-
-    // Translate WiFi status to human-readable message
-    switch (WiFi.status()) {
-      case WL_NO_SSID_AVAIL:
-        lcd.print(F("SSID unavaiable "));
-        break;
-      case WL_CONNECT_FAILED:
-        lcd.print(F("WiFi Auth Failed"));
-        break;
-      case WL_DISCONNECTED:
-        lcd.print(F("WiFi Disconnect "));
-        break;
-      default:
-        lcd.print(F("Connect Failed"));
-        break;
-    }
-    nonBlockingWait(LCD_TIMEOUT);
+  // Failed attempt - show which specific error occurred
+  DEBUG_PRINT(F("Connection failed. Status code: "));
+  DEBUG_PRINTLN(WiFi.status());
+
+  // Translate WiFi status to human-readable message
+  const __FlashStringHelper* reason;
+  switch (WiFi.status()) {
+    case WL_NO_SSID_AVAIL:
+      reason = F("SSID unavaiable ");
+      break;
+    case WL_CONNECT_FAILED:
+      reason = F("WiFi Auth Failed");
+      break;
+    case WL_DISCONNECTED:
+      reason = F("WiFi Disconnect ");
+      break;
+    default:
+      reason = F("Connect Failed");
+      break;
   }
+  uiShow(F("WiFi Connection"), reason, BOOT_STATUS_TIME);
 
   // All attempts failed
-  DEBUG_PRINTLN(F("Failed to connect - all attempts exhausted"));
+  if (attempt >= MAX_RETRY_COUNT) {
+    DEBUG_PRINTLN(F("Failed to connect - all attempts exhausted"));
+    uiShow(F("Connect failed"), F("OFFLINE MODE"), BOOT_STATUS_TIME);
+    wifiConnectAbort();
+    return BOOT_FAILED;
+  }
 
-  lcd.clear();
-  lcd.print(F("Connect failed"));
-  lcd.setCursor(0, 1);
-  lcd.print(F("OFFLINE MODE"));
-  nonBlockingWait(LCD_TIMEOUT);
-  return false;
+  // Start the next connection attempt
+  attempt++;
+
+  DEBUG_PRINT(F("Connection attempt "));
+  DEBUG_PRINT(attempt);
+  DEBUG_PRINT(F(" of "));
+  DEBUG_PRINTLN(MAX_RETRY_COUNT);
+
+  wifiConnectBegin(WIFI_SSID, WIFI_PSWD);
+  return BOOT_RUNNING;
 }
 
-bool setupNTPTimer() {
-  if (WiFi.status() != WL_CONNECTED) {
-    DEBUG_PRINTLN("\nCannot start NTP timer without WiFi connection");
-    lcd.clear();
-    lcd.setCursor(0, 0);
-    lcd.print(F("NTP Timer"));
-    lcd.setCursor(0, 1);
-    lcd.print(F("Skipped: No WiFi"));
-    nonBlockingWait(LCD_TIMEOUT);
-    return false;  // Return false instead of handling display
-  } else {
+/**
+ * First NTP synchronization, started once WiFi is up
+ * @param starting true on the first call
+ * @return Stage status
+ */
+BootStatus setupNTPTimer(bool starting) {
+  if (starting) {
     DEBUG_PRINT("\n[5/5] Synchronizing time...\nSetting up NTP Client...");
     timeClient.begin();
-    timeClient.update();
-
-    DEBUG_PRINT("\nSetting up NTP Client successful!\nNTP time: ");
-    DEBUG_PRINTLN(timeClient.getFormattedTime());
-    return true;
   }
-}
 
-// Function to check for any button press
-bool checkAnyButtonPressed() {
-  // Check your button on analog pin (A0)
+  // The ntp task drives the exchange, just wait for the first sync
+  if (!timeClient.isTimeSet()) return BOOT_RUNNING;
 
-  int analogValue = analogRead(A0);
-
-  // DEBUG_PRINTLN("Analog value: " + String(analogValue));
-
-  // // Check if any button value is detected (adjust thresholds as needed)
-  // if ((analogValue >= BTN_PLUS_MIN && analogValue <= BTN_PLUS_MAX) ||
-  //     (analogValue >= BTN_SEL_MIN && analogValue <= BTN_SEL_MAX) ||
-  //     (analogValue >= BTN_MINUS_MIN && analogValue <= BTN_MINUS_MAX)) {
-  //   return true;
-  // }
-
-  // Check manual feed button
-  if (digitalRead(MANUAL_FEED_BUTTON_PIN) == LOW) {
-    return true;
-  }
-
-  return false;
+  DEBUG_PRINT("\nSetting up NTP Client successful!\nNTP time: ");
+  DEBUG_PRINTLN(timeClient.getFormattedTime());
+  return BOOT_DONE;
 }
 
 /**
@@ -632,8 +810,10 @@ unsigned int nonBlockingMedianPing(NewPing& sonar, uint8_t iterations = 5,
  * @return Average distance in centimeters, or 0 if all readings failed
  */
 float getDistance() {
-  uint32_t totalDistance = 0;  // Use unsigned 32-bit to accumulate distance
-  uint8_t validReadings = 0;   // 8-bit counter is enough for small sample count
+  PROFILE_SCOPE("ping");
+
+  uint32_t totalUs = 0;       // Echo times, converted once for mm resolution
+  uint8_t validReadings = 0;  // 8-bit counter is enough for small sample count
 
   // Take readings with minimal memory usage
   for (uint8_t pingIndex = 0; pingIndex < PING_SAMPLES; pingIndex++) {
@@ -643,9 +823,7 @@ float getDistance() {
 
     // Process valid readings only (non-zero response)
     if (uS > 0) {
-      // Add to total (convert to cm directly to avoid float)
-      // Distance = microseconds / 58 (for cm)
-      totalDistance += sonar.convert_cm(uS);
+      totalUs += uS;
       validReadings++;
     }
 
@@ -657,8 +835,9 @@ float getDistance() {
     return 0;
   }
 
-  // Calculate and return integer average
-  return totalDistance / validReadings;
+  // Average echo time to cm, without rounding each ping to whole cm (the
+  // water trend needs the sub-cm changes)
+  return (float)totalUs / validReadings / US_ROUNDTRIP_CM;
 }
 
 /**
@@ -670,6 +849,8 @@ float getDistance() {
  */
 
 void checkWaterLevel() {
+  PROFILE_SCOPE("water");
+
   // Static variables to track state between function calls
   static enum WaterState {
     CHECK_WATER,     // Normal water level checking
@@ -702,12 +883,14 @@ void checkWaterLevel() {
 
       // If readings failed completely, show error
       if (distanceCm <= 0 || distanceCm > 400) {  // Better range checking
-        lcd.clear();
-        lcd.setCursor(0, 0);
-        lcd.print(F("Sensor Error"));
-        lcd.setCursor(0, 1);
-        lcd.print(F("Check ultrasonic"));
         // Just display the message but continue normal operation
+        if (uiScreenFree()) {
+          lcd.clear();
+          lcd.setCursor(0, 0);
+          lcd.print(F("Sensor Error"));
+          lcd.setCursor(0, 1);
+          lcd.print(F("Check ultrasonic"));
+        }
         return;
       }
 
@@ -718,6 +901,17 @@ void checkWaterLevel() {
       waterHeight =
           constrain(waterHeight, 0, DISTANCE_WATER_EMPTY - DISTANCE_WATER_FULL);
 
+      if (timeClient.isTimeSet()) {
+        tsdbAppend(TSDB_WATER, timeClient.getEpochTime(), waterHeight);
+      }
+
+      // While the level is fine, check again when it could be getting close
+      // (a refill and its cooldown run at WATER_CHECK_INTERVAL)
+      if (waterHeight > WATER_CRITICAL_HEIGHT) {
+        schedulerRunIn(waterTaskId,
+                       waterTrendUpdate(waterHeight, currentMillis));
+      }
+
       // Calculate water percentage
       float waterPercentage =
           (waterHeight / (DISTANCE_WATER_EMPTY - DISTANCE_WATER_FULL)) * 100;
@@ -732,40 +926,28 @@ void checkWaterLevel() {
       DEBUG_PRINT(distanceCm);
       DEBUG_PRINTLN(F("cm"));
 
-      // Display on LCD
-      lcd.clear();
-      lcd.setCursor(0, 0);
-      lcd.print(F("Water Level:"));
-
       // Check if water level is critically low
       if (waterHeight <= WATER_CRITICAL_HEIGHT) {
         // Water level critically low - activate relay
         DEBUG_PRINTLN(F("Water level critically low! Activating relay."));
-
-        lcd.setCursor(0, 1);
-        lcd.print(F("LOW! "));
-        lcd.print(waterHeight, 1);
-        lcd.print(F("cm ("));
-        lcd.print(int(waterPercentage));
-        lcd.print(F("%)"));
         yield();  // Add yield before activating relay
 
         // Activate the relay
         digitalWrite(WATER_PUMP_RELAY_PIN, HIGH);
 
         // Show activation message
-        lcd.clear();
-        lcd.setCursor(0, 0);
-        lcd.print(F("Water low!"));
-        lcd.setCursor(0, 1);
-        lcd.print(F("Refilling..."));
+        uiShow(F("Water low!"), F("Refilling..."));
 
         // Change state and record start time
         state = REFILL_RUNNING;
+        crumbState(CRUMB_WATER, state);
         stateStartTime = currentMillis;
         lastDisplayUpdate = currentMillis;
-      } else {
-        // Water level OK
+      } else if (uiScreenFree()) {
+        // Water level OK - live screen, only when no message is showing
+        lcd.clear();
+        lcd.setCursor(0, 0);
+        lcd.print(F("Water Level:"));
         lcd.setCursor(0, 1);
         lcd.print(F("OK "));
         lcd.print(waterHeight, 1);
@@ -780,8 +962,8 @@ void checkWaterLevel() {
     }
 
     case REFILL_RUNNING: {
-      // Check if it's time to update the display
-      if (currentMillis - lastDisplayUpdate >= 200) {
+      // Check if it's time to update the display (refill message on screen)
+      if (currentMillis - lastDisplayUpdate >= 200 && uiPendingCount() == 0) {
         lastDisplayUpdate = currentMillis;
         yield();  // Add yield before display updates
 
@@ -811,14 +993,11 @@ void checkWaterLevel() {
         digitalWrite(WATER_PUMP_RELAY_PIN, LOW);
 
         // Show completion message
-        lcd.clear();
-        lcd.setCursor(0, 0);
-        lcd.print(F("Refill complete"));
-        lcd.setCursor(0, 1);
-        lcd.print(F("Cooldown: 5 min"));
+        uiShow(F("Refill complete"), F("Cooldown: 5 min"));
 
         // Change state to cooldown
         state = COOLDOWN;
+        crumbState(CRUMB_WATER, state);
         stateStartTime = currentMillis;
         lastDisplayUpdate = currentMillis;
 
@@ -829,7 +1008,8 @@ void checkWaterLevel() {
 
     case COOLDOWN: {
       // Check if it's time to update the display (every second)
-      if (currentMillis - lastDisplayUpdate >= DISPLAY_UPDATE_INTERVAL) {
+      if (currentMillis - lastDisplayUpdate >= DISPLAY_UPDATE_INTERVAL &&
+          uiPendingCount() == 0) {
         lastDisplayUpdate = currentMillis;
         yield();  // Add yield before display updates
 
@@ -857,578 +1037,662 @@ void checkWaterLevel() {
       if (currentMillis - stateStartTime >= COOLDOWN_PERIOD) {
         DEBUG_PRINTLN(F("Water level cooldown complete, resuming checks"));
         state = CHECK_WATER;
+        crumbState(CRUMB_WATER, state);
       }
       break;
     }
   }
 }
 
+/* ----- Feeding ------ */
+
+// Steps of a feed. The "feed" task runs one slice of the current step per
+// call, so loop() keeps running for the whole feed: the scale is only read
+// when a conversion is ready, waits are task delays and the "food already
+// in the bowl" prompt is answered through the button task.
+enum FeedState : uint8_t {
+  FEED_IDLE,
+  FEED_CHECK_SCALE,   // Waiting for the HX711 to answer
+  FEED_WEIGH_BOWL,    // Sampling what is already in the bowl
+  FEED_CONFIRM,       // Bowl not empty, waiting for a gesture or timeout
+  FEED_DISPENSE,      // Hatch open, weight read every WEIGHT_READ_INTERVAL
+  FEED_SETTLE,        // Pre-closed, waiting for the reading to be still
+  FEED_MEASURE,       // Re-measuring after the pre-close
+  FEED_CLOSE,         // Hatch closing at the end of the feed
+  FEED_FINAL_SETTLE,  // Closed, the last food still settling
+  FEED_FINAL          // Final measurement
+};
+
+// Constants for fine tuning the feeding behavior
+static const float FEED_ACCURACY = 0.90f;   // Accept 90% as "complete"
+static const float FEED_EXCESSIVE = 1.25f;  // 125% is too much
+static const float FEED_STABILITY = 0.3f;   // Bowl reading stability (g)
+static const uint32_t FEED_CONFIRM_TIMEOUT = 20000;  // Bowl prompt (ms)
+static const uint32_t FEED_SCALE_LOST = 500;  // No conversion this long
+static const uint8_t FEED_BOWL_ATTEMPTS = 3;    // Bowl checks before warning
+static const uint8_t FEED_BOWL_SAMPLES = 5;     // Readings per bowl check
+static const uint8_t FEED_SETTLED_SAMPLES = 5;  // Readings after a pre-close
+static const uint8_t FEED_FINAL_SAMPLES = 10;   // Readings at the end
+static const uint8_t FEED_MOVING_AVG = 3;       // Fast reads averaged
+
+struct FeedSession {
+  FeedState state;
+  float target;         // Grams to dispense
+  float initialWeight;  // Bowl before the hatch opened
+  float dispensed;
+  float samples[FEED_FINAL_SAMPLES];  // Readings of the current step
+  uint8_t sampleCount;
+  uint8_t attempts;  // Bowl checks so far
+  uint8_t retries;   // Reopenings after an underfeed
+  bool scheduled;  // From a schedule: top-up policy, no prompt
+  bool confirmed;  // Prompt answered with a gesture
+  float openingStart;    // Dispensed when the current opening started
+  float readingAtClose;  // Dispensed by this opening when it closed
+  float flowAtClose;     // Flow estimate when it closed (g/s)
+  float fullFlow;        // Steady wide-open flow of this opening (g/s)
+  float lastWeight;      // Previous reading while settling
+  uint32_t lastWeightAt;
+  uint32_t stillSince;  // First of the still readings
+  uint8_t stillReads;   // Still readings in a row
+  float moving[FEED_MOVING_AVG];
+  uint8_t movingIndex;
+  uint32_t stateAt;    // millis() the current step started
+  uint32_t startedAt;  // millis() the hatch first opened
+  uint32_t lastRead;   // Last conversion taken
+  uint32_t lastDisplay;
+};
+
+static FeedSession feed = {};
+
 /**
- * Real-time feeding function with weight monitoring
- * Checks for existing food, monitors dispensing, and ensures proper amount
+ * Enter a feeding step
  */
-void feeding() {
-  // Constants for fine tuning the feeding behavior
-  const float PRE_CLOSE_THRESHOLD = 0.85;   // Pre-close at 85% of target
-  const float FINAL_ACCURACY = 0.90;        // Accept 90% as "complete"
-  const float EXCESSIVE_THRESHOLD = 1.25;   // 125% is too much
-  const uint32_t MAX_FEEDING_TIME = 30000;  // 30 second timeout
-  const uint32_t SETTLE_TIME = 1500;        // 1.5s for food to settle
-  const float STABILITY_THRESHOLD = 0.3;    // 0.3g stability for readings
-  const int RETRY_MAX = 2;                  // Max retries for underfeeding
-
-  // Step 1: Initialize and check scale
-  DEBUG_PRINTLN("Start feeding sequence...");
+static void feedEnter(FeedState state) {
+  feed.state = state;
+  feed.stateAt = millis();
+  feed.sampleCount = 0;
+  crumbState(state == FEED_IDLE ? CRUMB_NONE : CRUMB_FEEDING, state);
+
+  // The task only runs while a feed does
+  if (state == FEED_IDLE) schedulerEnable(feedTaskId, false);
+}
 
-  lcd.clear();
-  lcd.setCursor(0, 0);
-  lcd.print(F("Feeding time"));
-  lcd.setCursor(0, 1);
-  lcd.print(F("Checking scale"));
-  nonBlockingWait(LCD_TIMEOUT);
+/**
+ * @return true while a feed runs
+ */
+static bool feedActive() { return feed.state != FEED_IDLE; }
+
+/**
+ * Take one scale reading if a conversion is ready
+ * @param weight Set to the reading
+ * @return false if no conversion was ready
+ */
+static bool feedRead(float& weight) {
+  if (!scale.is_ready()) return false;
+  PROFILE_SCOPE("scale");
+  weight = scale.get_units(1);
+  feed.lastRead = millis();
+  return true;
+}
 
-  // Check if scale is responding
-  uint32_t startCheck = millis();
-  bool scaleReady = false;
-  uint16_t timeout = 3000UL;
+/**
+ * Average of the readings of the current step
+ */
+static float feedSampleAverage() {
+  float total = 0;
+  for (uint8_t i = 0; i < feed.sampleCount; i++) total += feed.samples[i];
+  return feed.sampleCount > 0 ? total / feed.sampleCount : 0;
+}
 
-  while (millis() - startCheck < timeout) {
-    if (scale.is_ready()) {
-      scaleReady = true;
-    }
-    delay(50);
-    yield();
-  }
+/**
+ * @param wanted Readings the step takes
+ * @return true once they are in, or the scale took twice as long as it
+ *         should (the step goes on with what it has)
+ */
+static bool feedSamplesDone(uint8_t wanted) {
+  return feed.sampleCount >= wanted ||
+         millis() - feed.stateAt >= 2UL * wanted * WEIGHT_READ_INTERVAL;
+}
 
-  if (!scaleReady) {
-    lcd.setCursor(0, 1);
-    lcd.print(F("Scale not ready!"));
-    nonBlockingWait(LCD_TIMEOUT);
+/**
+ * Start a feed, the "feed" task runs it from here
+ * @param isScheduled From a schedule, the top-up policy sets the portion
+ * @param targetAmount Grams to dispense
+ */
+void feeding(bool isScheduled, float targetAmount) {
+  if (feedActive()) {
+    uiShow(F("Feeding..."), F("Please wait"), QUICK_DISPLAY_TIME);
     return;
   }
 
-  // Step 2: Check if there's already food on the scale
-  lcd.clear();
-  lcd.setCursor(0, 1);
-  lcd.print(F("Checking bowl..."));
-  nonBlockingWait(LCD_TIMEOUT);
-
-  // Get multiple readings for accuracy with stability check
-  float foodWeightReadings[5];
-  bool stableReading = false;
-  int readingAttempts = 0;
+  DEBUG_PRINTLN("Start feeding sequence...");
+  hatchCalAbort("feeding started");
+  uiShow(F("Feeding time"), F("Checking scale"));
+
+  feed = {};
+  feed.target = targetAmount;
+  feed.scheduled = isScheduled;
+  feedEnter(FEED_CHECK_SCALE);
+  schedulerEnable(feedTaskId, true);
+}
 
-  // Try to get stable initial reading
-  while (!stableReading && readingAttempts < 3) {
-    readingAttempts++;
+/**
+ * Answer the "food already in the bowl" prompt (any gesture feeds)
+ */
+static void feedConfirm() {
+  if (feed.state != FEED_CONFIRM) return;
+  feed.confirmed = true;
+  schedulerRunIn(feedTaskId, 0);
+}
 
-    // Take 5 readings
-    for (int i = 0; i < 5; i++) {
-      if (scale.is_ready()) {
-        foodWeightReadings[i] = scale.get_units(2);
-        lcd.setCursor(12, 1);
-        lcd.print(F("   "));  // Clear previous dots
-        lcd.setCursor(12, 1);
-        for (int j = 0; j <= i; j++) {
-          lcd.print(F("."));
-        }
-        delay(200);
-        yield();
-      } else {
-        lcd.clear();
-        lcd.setCursor(0, 0);
-        lcd.print(F("Scale error!"));
-        lcd.setCursor(0, 1);
-        lcd.print(F("Retry reading..."));
-        delay(500);
-        break;
-      }
-    }
+/**
+ * Open the hatch and start dispensing
+ */
+static void feedOpen() {
+  uiShow(F("Starting feed"), F("Opening hatch..."), 0);
 
-    // Check stability of readings
-    float minWeight = foodWeightReadings[0];
-    float maxWeight = foodWeightReadings[0];
-    float totalWeight = foodWeightReadings[0];
+  // Logged before the hatch opens so a power cut cannot hide the session
+  if (feed.scheduled) feedJournalCreditUsed();
+  feedJournalStart(feed.target, feed.initialWeight, feed.scheduled,
+                   timeClient.isTimeSet() ? timeClient.getEpochTime() : 0);
 
-    for (int i = 1; i < 5; i++) {
-      totalWeight += foodWeightReadings[i];
-      if (foodWeightReadings[i] < minWeight) minWeight = foodWeightReadings[i];
-      if (foodWeightReadings[i] > maxWeight) maxWeight = foodWeightReadings[i];
-    }
+  // The flow controller opens the hatch, the servo task drives the move
+  flowEstimateStart();
+  flowControlStart(feedProfileFlow(), feed.target);
+  jamStart();
 
-    // If max variation is less than threshold, readings are stable
-    if ((maxWeight - minWeight) < STABILITY_THRESHOLD * 2) {
-      stableReading = true;
-    } else if (readingAttempts < 3) {
-      lcd.clear();
-      lcd.setCursor(0, 0);
-      lcd.print(F("Unstable reading"));
-      lcd.setCursor(0, 1);
-      lcd.print(F("Retrying..."));
-      delay(1000);
-    }
+  for (uint8_t i = 0; i < FEED_MOVING_AVG; i++) {
+    feed.moving[i] = feed.initialWeight;
   }
+  feed.startedAt = millis();
+  feed.lastRead = feed.startedAt;
+  feedEnter(FEED_DISPENSE);
+}
 
-  // Calculate average weight
-  float currentFoodWeight = 0;
-  if (stableReading) {
-    for (int i = 0; i < 5; i++) {
-      currentFoodWeight += foodWeightReadings[i];
-    }
-    currentFoodWeight /= 5;
+/**
+ * Log how a jam ended once it is over: flow resumed, or the feed gave up
+ * on it (this firmware has no server to report it to)
+ */
+static void feedJamReport() {
+  DEBUG_PRINT(F("Jam: attempts="));
+  DEBUG_PRINT(jam.attempts);
+  DEBUG_PRINT(F(" detect="));
+  DEBUG_PRINT(jam.detectMs);
+  DEBUG_PRINT(F("ms recover="));
+  DEBUG_PRINT(jam.recoverMs);
+  DEBUG_PRINTLN(F("ms"));
+  if (jam.recoverMs > 0) uiShow(F("Food unstuck"), F("Feeding..."), 1000);
+  jamReported();
+}
+
+/**
+ * Close the hatch and go on to the final measurement
+ */
+static void feedClose() {
+  hatchJump(SERVO_CLOSE_ANGLE);
+  jamStop();
+  if (jam.open) feedJamReport();
+
+  if (millis() - feed.startedAt >= FEED_TIMEOUT) {
+    uiShow(F("Timeout reached!"), F("Closing hatch"), 1000);
   } else {
-    // If still unstable, use the last reading but warn
-    currentFoodWeight = foodWeightReadings[4];
-    lcd.clear();
-    lcd.setCursor(0, 0);
-    lcd.print(F("Warning: Unstable"));
-    lcd.setCursor(0, 1);
-    lcd.print(F("scale readings"));
-    delay(2000);
+    uiShow(F("Closing hatch"), F("Please wait..."), 1000);
   }
+  feedEnter(FEED_CLOSE);
+}
 
-  // Ensure non-negative weight
-  if (currentFoodWeight < 0) currentFoodWeight = 0;
+/**
+ * Take the feed out of the hopper inventory and show what that found: a
+ * refill nobody reported, or a hopper running low
+ */
+static void feedHopperEnd() {
+  HopperRefill refill = hopperFeedEnd(
+      feed.dispensed, timeClient.isTimeSet() ? timeClient.getEpochTime() : 0);
+  if (refill != HOPPER_REFILL_NONE) {
+    uiShow(F("Hopper refilled"), F("Level: 100%"), QUICK_DISPLAY_TIME);
+  }
 
-  if (currentFoodWeight >= FEED_THRESHOLD) {
-    // Food already present! Show notification
-    lcd.clear();
-    lcd.setCursor(0, 0);
-    lcd.print(F("Food detected!"));
-    lcd.setCursor(0, 1);
-    lcd.print(F("Weight: "));
-    lcd.print(currentFoodWeight, 1);
-    lcd.print(F("g"));
-    delay(2000);
+  if (hopperLowPending()) {
+    char emptyIn[6];
+    hopperFormatEmptyIn(emptyIn, sizeof(emptyIn));
+    char lowText[LCD_X + 1];
+    snprintf(lowText, sizeof(lowText), "%.0fg, empty %s", hopperGrams(),
+             emptyIn);
+    uiShow(F("Hopper low!"), lowText, INFO_DISPLAY_TIME);
+    hopperLowReported();
+  }
+}
 
-    // Show options
-    lcd.clear();
-    lcd.setCursor(0, 0);
-    lcd.print(F("Food already >10g"));
-    lcd.setCursor(0, 1);
-    lcd.print(F("Btn:feed / "));
-    lcd.print(F("Wait:20s"));
-
-    // Wait for button press or timeout
-    uint32_t notifyStartTime = millis();
-    const uint32_t NOTIFY_TIMEOUT = 20000;  // 20 second timeout
-    bool buttonPressed = false;
-
-    // Loop until button press or timeout
-    while (millis() - notifyStartTime < NOTIFY_TIMEOUT) {
-      // Check for button press
-      if (digitalRead(MANUAL_FEED_BUTTON_PIN) == LOW) {
-        // Debounce
-        delay(50);
-        if (digitalRead(MANUAL_FEED_BUTTON_PIN) == LOW) {
-          // Wait for button release
-          while (digitalRead(MANUAL_FEED_BUTTON_PIN) == LOW) {
-            delay(10);
-            yield();
-          }
-          buttonPressed = true;
-          break;
-        }
-      }
+/**
+ * Show the results and end the session
+ */
+static void feedFinish() {
+  float finalWeight = feed.initialWeight + feed.dispensed;
+  if (feed.sampleCount > 0) {
+    finalWeight = feedSampleAverage();
+    feed.dispensed = max(finalWeight - feed.initialWeight, 0.0f);
+  }
+  feedJournalEnd(feed.dispensed);
+  feedProfileFinishFeed();
 
-      // Update countdown timer every second
-      if ((millis() - notifyStartTime) / 1000 !=
-          ((millis() - notifyStartTime - 100) / 1000)) {
-        int secondsLeft =
-            (NOTIFY_TIMEOUT - (millis() - notifyStartTime)) / 1000;
-        lcd.setCursor(14, 1);
-        lcd.print(F("  "));  // Clear previous time
-        lcd.setCursor(14, 1);
-        lcd.print(secondsLeft);
-      }
+  // Results are queued, the loop keeps running while they show
+  char resultText[LCD_X + 1];
+  snprintf(resultText, sizeof(resultText), "Added: %.1fg", feed.dispensed);
+  uiShow(F("Feeding complete"), resultText, 2000);
 
-      delay(100);
-      yield();
-    }
+  // Calculate percentage of target
+  int feedPct = (feed.dispensed / feed.target) * 100;
+  feedPct = constrain(feedPct, 0, 999);
 
-    // If no button press, return to main screen
-    if (!buttonPressed) {
-      lcd.clear();
-      lcd.setCursor(0, 0);
-      lcd.print(F("Feeding canceled"));
-      lcd.setCursor(0, 1);
-      lcd.print(F("Bowl already has:"));
-      delay(1000);
-
-      lcd.clear();
-      lcd.setCursor(0, 0);
-      lcd.print(F("Food weight:"));
-      lcd.setCursor(0, 1);
-      lcd.print(currentFoodWeight, 1);
-      lcd.print(F("g in bowl"));
-      delay(3000);
-      return;
-    }
+  // Show accuracy info with a quality assessment
+  const __FlashStringHelper* quality;
+  if (feedPct >= 95 && feedPct <= 105) {
+    quality = F("Perfect portion!");
+  } else if (feedPct < 80) {
+    quality = F("Underfed - retry?");
+  } else if (feedPct > 120) {
+    quality = F("Overfed - adjust");
+  } else {
+    quality = F("Good enough");
+  }
+  snprintf(resultText, sizeof(resultText), "Accuracy: %d%%", feedPct);
+  uiShow(resultText, quality, 3000);
 
-    // User confirmed continuation
-    lcd.clear();
-    lcd.setCursor(0, 0);
-    lcd.print(F("Continuing..."));
-    lcd.setCursor(0, 1);
-    lcd.print(F("Adding more food"));
-    delay(1500);
+  // Show total food in bowl
+  snprintf(resultText, sizeof(resultText), "Total: %.1fg", finalWeight);
+  uiShow(F("Bowl now contains"), resultText, 3000);
+
+  feedHopperEnd();
+  feedEnter(FEED_IDLE);
+}
+
+/**
+ * Draw the dispense progress, unless a message is still showing
+ */
+static void feedDrawProgress() {
+  uint32_t now = millis();
+  if (now - feed.lastDisplay < LCD_UPDATE_INTERVAL || !uiScreenFree()) {
+    return;
   }
+  feed.lastDisplay = now;
 
-  // Step 4: Get initial weight (tare) before feeding
-  float initialWeight = currentFoodWeight;
+  float progressPercent = (feed.dispensed / feed.target) * 100.0;
+  progressPercent = constrain(progressPercent, 0, 100);
 
-  // Step 5: Start feeding process
   lcd.clear();
   lcd.setCursor(0, 0);
-  lcd.print(F("Starting feed"));
-  lcd.setCursor(0, 1);
-  lcd.print(F("Opening hatch..."));
-
-  // Open servo to begin dispensing
-  hatchServo.write(SERVO_OPEN_ANGLE);
-  delay(500);  // Give servo time to open
-
-  // Step 6: Setup moving average for stable readings
-  const int movingAvgSize = 3;
-  float weightReadings[movingAvgSize] = {initialWeight, initialWeight,
-                                         initialWeight};
-  int readingIndex = 0;
-  float currentWeight = initialWeight;
-
-  // Step 7: Feed until target weight or timeout
-  uint32_t startTime = millis();
-  uint32_t lastDisplayUpdate = 0;
-  uint32_t lastWeightRead = 0;
-
-  float targetWeight = initialWeight + FEED_WEIGHT;
-  bool targetReached = false;
-  bool preCloseExecuted = false;
-  float dispensedWeight = 0;
-  int retryCount = 0;
-  int stabilityCounter = 0;
-
-  // Main feeding loop - until target reached or timeout
-  while (!targetReached && (millis() - startTime < MAX_FEEDING_TIME)) {
-    uint32_t now = millis();
-
-    // Read weight at regular intervals
-    if (now - lastWeightRead >= 100) {
-      lastWeightRead = now;
-
-      // Verify scale is still working
-      if (!scale.is_ready()) {
-        // Try a few times before giving up
-        bool recovered = false;
-        for (int i = 0; i < 5; i++) {
-          delay(100);
-          yield();
-          if (scale.is_ready()) {
-            recovered = true;
-            break;
-          }
-        }
-
-        if (!recovered) {
-          lcd.clear();
-          lcd.setCursor(0, 0);
-          lcd.print(F("Scale error!"));
-          lcd.setCursor(0, 1);
-          lcd.print(F("Closing hatch"));
-          hatchServo.write(SERVO_CLOSE_ANGLE);
-          nonBlockingWait(LCD_TIMEOUT);
-          return;
-        }
-      }
-
-      // Update moving average
-      weightReadings[readingIndex] = scale.get_units(1);  // Fast read
-      readingIndex = (readingIndex + 1) % movingAvgSize;
+  lcd.print(F("Feeding: "));
+  lcd.print((int)progressPercent);
+  lcd.print(F("%"));
 
-      // Calculate current weight
-      float sumWeight = 0;
-      for (int i = 0; i < movingAvgSize; i++) {
-        sumWeight += weightReadings[i];
-      }
-      currentWeight = sumWeight / movingAvgSize;
+  // Target until close, then a progress bar
+  lcd.setCursor(0, 1);
+  if (progressPercent < 80) {
+    lcd.print(F("Target: "));
+    lcd.print(feed.target, 0);
+    lcd.print(F("g"));
+  } else {
+    int barWidth = (progressPercent * LCD_X) / 100;
+    for (int i = 0; i < LCD_X; i++) {
+      lcd.write(i < barWidth ? (byte)255 : ' ');
+    }
+  }
+}
 
-      // Calculate dispensed amount
-      dispensedWeight = currentWeight - initialWeight;
+/**
+ * Bowl check: a few readings, repeated while they disagree
+ */
+static void feedWeighBowl() {
+  float weight;
+  if (!feedRead(weight)) {
+    if (millis() - feed.stateAt < SCALE_TIMEOUT) return;
+    uiShow(F("Scale error!"), F("Feed canceled"));
+    feedEnter(FEED_IDLE);
+    return;
+  }
+  feed.samples[feed.sampleCount++] = weight;
+
+  if (uiPendingCount() == 0) {
+    lcd.setCursor(12, 1);
+    lcd.print(F("   "));  // Clear previous dots
+    lcd.setCursor(12, 1);
+    for (uint8_t j = 0; j < feed.sampleCount; j++) {
+      lcd.print(F("."));
+    }
+  }
+  if (feed.sampleCount < FEED_BOWL_SAMPLES) return;
 
-      // Ensure non-negative dispensed amount
-      if (dispensedWeight < 0) dispensedWeight = 0;
+  float minWeight = feed.samples[0];
+  float maxWeight = feed.samples[0];
+  for (uint8_t i = 1; i < feed.sampleCount; i++) {
+    minWeight = min(minWeight, feed.samples[i]);
+    maxWeight = max(maxWeight, feed.samples[i]);
+  }
+  feed.attempts++;
+
+  float bowlWeight;
+  if (maxWeight - minWeight < FEED_STABILITY * 2) {
+    bowlWeight = feedSampleAverage();
+  } else if (feed.attempts < FEED_BOWL_ATTEMPTS) {
+    // Let the bowl settle before retrying
+    uiShow(F("Unstable reading"), F("Retrying..."), 1000);
+    feedEnter(FEED_WEIGH_BOWL);
+    schedulerRunIn(feedTaskId, 1000);
+    return;
+  } else {
+    // Still unstable, use the last reading but warn
+    bowlWeight = feed.samples[feed.sampleCount - 1];
+    uiShow(F("Warning: Unstable"), F("scale readings"), 2000);
+  }
+  feed.initialWeight = max(bowlWeight, 0.0f);
+
+  // Nobody is there to answer a prompt for a scheduled feed, the top-up
+  // policy decides. A retry after a reset deducts what the cut-short
+  // session gave out.
+  if (feed.scheduled) {
+    float credit = feedJournalCreditGrams();
+    feed.target = scheduledPortion(feed.target, feed.initialWeight, credit);
+    if (feed.target >= SCHEDULE_CATCHUP_MIN_PORTION) {
+      feedOpen();
+    } else if (credit > 0 && feed.initialWeight < FEED_THRESHOLD) {
+      uiShow(F("Already fed"), F("before restart"), INFO_DISPLAY_TIME);
+      feedJournalCreditUsed();
+      feedEnter(FEED_IDLE);
+    } else {
+      char weightText[LCD_X + 1];
+      snprintf(weightText, sizeof(weightText), "%.1fg in bowl",
+               feed.initialWeight);
+      uiShow(F("Bowl is full"), weightText, INFO_DISPLAY_TIME);
+      sendLogEvent("feed_skipped", weightText);
+      feedEnter(FEED_IDLE);
+    }
+    return;
+  }
 
-      // IMPROVED PRE-CLOSE LOGIC: Close early to account for falling food
-      if (!preCloseExecuted &&
-          dispensedWeight >= FEED_WEIGHT * PRE_CLOSE_THRESHOLD) {
-        // Pre-close when we reach threshold
-        hatchServo.write(SERVO_CLOSE_ANGLE);
-        preCloseExecuted = true;
+  if (feed.initialWeight < FEED_THRESHOLD) {
+    feedOpen();
+    return;
+  }
 
-        // Show pre-close message
-        lcd.clear();
-        lcd.setCursor(0, 0);
-        lcd.print(F("Almost there..."));
-        lcd.setCursor(0, 1);
-        lcd.print(F("Food settling"));
-
-        // Give food time to fall and settle
-        delay(SETTLE_TIME);
-        yield();
-
-        // Re-measure after settling
-        float settledWeight = 0;
-        int validReadings = 0;
-
-        for (int j = 0; j < 5; j++) {
-          if (scale.is_ready()) {
-            settledWeight += scale.get_units(2);
-            validReadings++;
-            yield();
-            delay(100);
-          }
-        }
+  // Food already present, a gesture within the timeout feeds anyway
+  char weightText[LCD_X + 1];
+  snprintf(weightText, sizeof(weightText), "Weight: %.1fg",
+           feed.initialWeight);
+  uiShow(F("Food detected!"), weightText, 2000);
+  uiShow(F("Food already >10g"), F("Btn:feed / Wait:20s"), 0);
 
-        if (validReadings > 0) {
-          settledWeight /= validReadings;
-          dispensedWeight = settledWeight - initialWeight;
-          if (dispensedWeight < 0) dispensedWeight = 0;
+  // Only gestures made from now on answer the prompt
+  buttonClearEvents();
+  feedEnter(FEED_CONFIRM);
+}
 
-          // Update current weight and readings array
-          currentWeight = settledWeight;
-          for (int i = 0; i < movingAvgSize; i++) {
-            weightReadings[i] = currentWeight;
-          }
+/**
+ * Prompt: count down once it is on screen, feed on a gesture
+ */
+static void feedWaitConfirm() {
+  uint32_t waited = millis() - feed.stateAt;
 
-          // Check if we need to open again (underfeeding)
-          if (dispensedWeight < FEED_WEIGHT * FINAL_ACCURACY &&
-              retryCount < RETRY_MAX) {
-            retryCount++;
-            lcd.clear();
-            lcd.setCursor(0, 0);
-            lcd.print(F("Need more food"));
-            lcd.setCursor(0, 1);
-            lcd.print(F("Retry #"));
-            lcd.print(retryCount);
-
-            hatchServo.write(SERVO_OPEN_ANGLE);
-            delay(300);                // Brief open
-            preCloseExecuted = false;  // Reset to try again
-          }
-          // Handle successful dispense
-          else if (dispensedWeight >= FEED_WEIGHT * FINAL_ACCURACY) {
-            targetReached = true;
-            lcd.clear();
-            lcd.setCursor(0, 0);
-            lcd.print(F("Target reached!"));
-            lcd.setCursor(0, 1);
-            lcd.print(F("Dispensed: "));
-            lcd.print(dispensedWeight, 1);
-            lcd.print(F("g"));
-            delay(1000);
-          }
-          // Handle case where we can't reach target despite retries
-          else if (retryCount >= RETRY_MAX) {
-            lcd.clear();
-            lcd.setCursor(0, 0);
-            lcd.print(F("Warning: Only"));
-            lcd.setCursor(0, 1);
-            lcd.print(dispensedWeight, 1);
-            lcd.print(F("g dispensed"));
-            delay(1500);
-            targetReached = true;  // End the process after max retries
-          }
-        }
-      }
+  if (feed.confirmed) {
+    uiShow(F("Continuing..."), F("Adding more food"), 1500);
+    feedOpen();
+    return;
+  }
 
-      // Standard target check for when pre-close isn't active
-      if (!preCloseExecuted) {
-        // Check if target already reached (possible with fast-falling food)
-        if (dispensedWeight >= FEED_WEIGHT) {
-          hatchServo.write(SERVO_CLOSE_ANGLE);
-          preCloseExecuted = true;
+  if (waited >= FEED_CONFIRM_TIMEOUT) {
+    uiShow(F("Feeding canceled"), F("Bowl already has:"), 1000);
 
-          // Confirm with stable readings
-          if (stabilityCounter < 2) {
-            stabilityCounter++;
-          } else {
-            targetReached = true;
-          }
-        }
+    char foodText[LCD_X + 1];
+    snprintf(foodText, sizeof(foodText), "%.1fg in bowl", feed.initialWeight);
+    uiShow(F("Food weight:"), foodText, 3000);
+    feedEnter(FEED_IDLE);
+    return;
+  }
 
-        // Emergency stop if way too much food dispensed
-        if (dispensedWeight >= FEED_WEIGHT * EXCESSIVE_THRESHOLD) {
-          hatchServo.write(SERVO_CLOSE_ANGLE);
-          lcd.clear();
-          lcd.setCursor(0, 0);
-          lcd.print(F("Warning!"));
-          lcd.setCursor(0, 1);
-          lcd.print(F("Excess food!"));
-          delay(1000);
-          targetReached = true;
-        }
-      }
-    }
+  if (uiPendingCount() == 0) {
+    lcd.setCursor(14, 1);
+    lcd.print(F("  "));  // Clear previous time
+    lcd.setCursor(14, 1);
+    lcd.print((FEED_CONFIRM_TIMEOUT - waited) / 1000);
+  }
 
-    // Update display periodically
-    if (now - lastDisplayUpdate >= 500) {
-      lastDisplayUpdate = now;
+  // Next second, a gesture wakes the task sooner
+  schedulerRunIn(feedTaskId, 1000 - waited % 1000);
+}
 
-      // Calculate progress percentage
-      float progressPercent = (dispensedWeight / FEED_WEIGHT) * 100.0;
-      progressPercent = constrain(progressPercent, 0, 100);
+/**
+ * One weight reading of the dispense: pre-close near the target, stop on
+ * excess or timeout
+ */
+static void feedDispense() {
+  uint32_t now = millis();
 
-      lcd.clear();
-      lcd.setCursor(0, 0);
-      lcd.print(F("Feeding: "));
-      lcd.print((int)progressPercent);
-      lcd.print(F("%"));
+  if (now - feed.startedAt >= FEED_TIMEOUT) {
+    feedClose();
+    return;
+  }
 
-      // Show additional info based on progress
-      if (progressPercent < 80) {
-        lcd.setCursor(0, 1);
-        lcd.print(F("Target: "));
-        lcd.print(FEED_WEIGHT, 0);
-        lcd.print(F("g"));
-      } else {
-        // Show progress bar when getting close
-        lcd.setCursor(0, 1);
-        int barWidth = (progressPercent * 16) / 100;
-        for (int i = 0; i < 16; i++) {
-          if (i < barWidth) {
-            lcd.write(255);  // Full block character
-          } else {
-            lcd.write(' ');
-          }
-        }
-      }
+  // A jam recovery drives the hatch at the servo's pace until its wiggle
+  // is done, then the flow controller takes over again
+  if (jamRecovering()) {
+    if (!jamRecoveryUpdate()) {
+      schedulerRunIn(feedTaskId, SERVO_TICK_INTERVAL);
+      return;
     }
+    flowControlStart(feedProfileFlow(), feed.target - feed.dispensed);
+    jamRearm(feed.dispensed);
+    feed.lastRead = now;
+  }
 
-    // Allow ESP8266 background processing
-    yield();
-    delay(10);
+  float weight;
+  if (!feedRead(weight)) {
+    if (now - feed.lastRead < FEED_SCALE_LOST) return;
+    uiShow(F("Scale error!"), F("Closing hatch"));
+    hatchJump(SERVO_CLOSE_ANGLE);
+    jamStop();
+    feedJournalEnd(feed.dispensed);
+    feedHopperEnd();
+    feedEnter(FEED_IDLE);
+    return;
   }
 
-  // Step 8: Ensure servo is closed
-  hatchServo.write(SERVO_CLOSE_ANGLE);
+  // Moving average of the fast reads
+  feed.moving[feed.movingIndex] = weight;
+  feed.movingIndex = (feed.movingIndex + 1) % FEED_MOVING_AVG;
+  float sumWeight = 0;
+  for (uint8_t i = 0; i < FEED_MOVING_AVG; i++) sumWeight += feed.moving[i];
+
+  feed.dispensed = max(sumWeight / FEED_MOVING_AVG - feed.initialWeight,
+                       0.0f);
+  feedJournalCheckpoint(feed.dispensed);
+  flowObserve(feed.dispensed);
+
+  // Emergency stop if way too much food came out at once
+  if (feed.dispensed >= feed.target * FEED_EXCESSIVE) {
+    uiShow(F("Warning!"), F("Excess food!"), 1000);
+    feedClose();
+    return;
+  }
 
-  // Show closing message
-  lcd.clear();
-  lcd.setCursor(0, 0);
-  if (millis() - startTime >= MAX_FEEDING_TIME) {
-    lcd.print(F("Timeout reached!"));
-    lcd.setCursor(0, 1);
-    lcd.print(F("Closing hatch"));
+  // Taper the flow towards the close point, then close once the food in
+  // the air (predicted by the active feed profile) makes up the rest.
+  // Until the first flow estimate the calibrated flow at the hatch angle
+  // stands in.
+  float measuredFlow = flowRate();
+  float flowAtClose = measuredFlow > 0 ? measuredFlow : flowControlExpected();
+  float closeAt = feedProfileCloseAt(feed.target, flowAtClose);
+  if (feed.dispensed < closeAt) {
+    flowControlUpdate(closeAt - feed.dispensed, measuredFlow);
+
+    if (jamCheck(feed.dispensed) && !jamGaveUp()) {
+      char attemptText[LCD_X + 1];
+      snprintf(attemptText, sizeof(attemptText), "Shaking #%d",
+               jam.attempts);
+      uiShow(F("Food stuck"), attemptText, 0);
+    }
+    if (jamReportDue()) feedJamReport();
+    if (jamGaveUp()) {
+      char jamText[LCD_X + 1];
+      snprintf(jamText, sizeof(jamText), "%.1fg dispensed", feed.dispensed);
+      uiShow(F("Food jammed!"), jamText, INFO_DISPLAY_TIME);
+      feedClose();
+      return;
+    }
   } else {
-    lcd.print(F("Closing hatch"));
-    lcd.setCursor(0, 1);
-    lcd.print(F("Please wait..."));
+    feed.fullFlow = flowControlStop();
+    hopperObserveFlow(feed.fullFlow);
+    jamStop();
+    feed.flowAtClose = flowAtClose;
+    feed.readingAtClose = feed.dispensed - feed.openingStart;
+    uiShow(F("Almost there..."), F("Food settling"), 0);
+
+    feedEnter(FEED_SETTLE);
+    feed.lastWeight = weight;
+    feed.lastWeightAt = feed.stateAt;
+    feed.stillReads = 0;
+    return;
   }
-  delay(1000);  // Give servo time to close
-
-  // Step 9: Wait for food to settle and take final measurement
-  lcd.clear();
-  lcd.setCursor(0, 0);
-  lcd.print(F("Measuring final"));
-  lcd.setCursor(0, 1);
-  lcd.print(F("weight..."));
-
-  // Wait for food to fully settle
-  delay(2000);
 
-  // Get final stable weight
-  float finalWeight = 0;
-  int validFinalReadings = 0;
+  feedDrawProgress();
+}
 
-  for (int i = 0; i < 5; i++) {
-    if (scale.is_ready()) {
-      finalWeight += scale.get_units(5);
-      validFinalReadings++;
-      lcd.setCursor(15, 1);
-      lcd.print(i + 1);
-      yield();
-      delay(200);
+/**
+ * Wait after a pre-close until the reading stops moving, and teach the
+ * profile how long that took. Not before half the learned time, food may
+ * still be in the air; no longer than twice it.
+ */
+static void feedSettle() {
+  uint32_t expectMs = feedProfileSettleMs();
+  uint32_t waited = millis() - feed.stateAt;
+
+  float weight;
+  if (feedRead(weight)) {
+    if (fabs(weight - feed.lastWeight) > FEED_PROFILE_STILL_BAND) {
+      feed.stillReads = 0;
+    } else if (feed.stillReads++ == 0) {
+      feed.stillSince = feed.lastWeightAt;
     }
+    feed.lastWeight = weight;
+    feed.lastWeightAt = millis();
   }
 
-  // Calculate final dispensed weight
-  if (validFinalReadings > 0) {
-    finalWeight /= validFinalReadings;
-    dispensedWeight = finalWeight - initialWeight;
-    if (dispensedWeight < 0) dispensedWeight = 0;
+  if (feed.stillReads >= FEED_PROFILE_STILL_READS &&
+      waited >= expectMs / 2) {
+    feedProfileObserveSettle(feed.stillSince - feed.stateAt);
+  } else if (waited < expectMs * 2) {
+    return;
   }
+  feedEnter(FEED_MEASURE);
+}
 
-  // Step 10: Show results
-  lcd.clear();
-  lcd.setCursor(0, 0);
-  lcd.print(F("Feeding complete"));
-  lcd.setCursor(0, 1);
-  lcd.print(F("Added: "));
-  lcd.print(dispensedWeight, 1);
-  lcd.print(F("g"));
+/**
+ * Re-measure after a pre-close and teach the profile what landed, then
+ * reopen, finish or give up
+ */
+static void feedMeasure() {
+  float weight;
+  if (feedRead(weight)) feed.samples[feed.sampleCount++] = weight;
+  if (!feedSamplesDone(FEED_SETTLED_SAMPLES)) return;
+
+  float settledWeight = feed.initialWeight + feed.dispensed;
+  if (feed.sampleCount > 0) settledWeight = feedSampleAverage();
+  feed.dispensed = max(settledWeight - feed.initialWeight, 0.0f);
+  for (uint8_t i = 0; i < FEED_MOVING_AVG; i++) {
+    feed.moving[i] = settledWeight;
+  }
+  feedProfileObserveOpening(feed.fullFlow, feed.readingAtClose,
+                            feed.dispensed - feed.openingStart,
+                            feed.flowAtClose);
+
+  char text[LCD_X + 1];
+  if (feed.dispensed < feed.target * FEED_ACCURACY &&
+      feed.retries < FEED_RETRY_TIMEOUT) {
+    // Underfed, open again
+    feed.retries++;
+    snprintf(text, sizeof(text), "Retry #%d", feed.retries);
+    uiShow(F("Need more food"), text, 0);
+
+    flowControlStart(feedProfileFlow(), feed.target - feed.dispensed);
+    feed.openingStart = feed.dispensed;
+    feedEnter(FEED_DISPENSE);
+    return;
+  }
 
-  // Calculate percentage of target
-  int feedPct = (dispensedWeight / FEED_WEIGHT) * 100;
-  feedPct = constrain(feedPct, 0, 999);
+  if (feed.dispensed >= feed.target * FEED_ACCURACY) {
+    snprintf(text, sizeof(text), "Dispensed: %.1fg", feed.dispensed);
+    uiShow(F("Target reached!"), text, 1000);
+  } else {
+    snprintf(text, sizeof(text), "%.1fg dispensed", feed.dispensed);
+    uiShow(F("Warning: Only"), text, 1500);
+  }
+  feedClose();
+}
 
-  delay(2000);
+/**
+ * Run the current feeding step. Runs every WEIGHT_READ_INTERVAL while a
+ * feed runs; the waits move its next run instead.
+ */
+void feedTask() {
+  PROFILE_SCOPE("feeding");
 
-  // Show accuracy info
-  lcd.clear();
-  lcd.setCursor(0, 0);
-  lcd.print(F("Accuracy: "));
-  lcd.print(feedPct);
-  lcd.print(F("%"));
-  lcd.setCursor(0, 1);
+  switch (feed.state) {
+    case FEED_IDLE:
+      break;
 
-  // Show quality assessment
-  if (feedPct >= 95 && feedPct <= 105) {
-    lcd.print(F("Perfect portion!"));
-  } else if (feedPct < 80) {
-    lcd.print(F("Underfed - retry?"));
-  } else if (feedPct > 120) {
-    lcd.print(F("Overfed - adjust"));
-  } else {
-    lcd.print(F("Good enough"));
-  }
-  nonBlockingWait(3000);
+    case FEED_CHECK_SCALE:
+      if (scale.is_ready()) {
+        uiShow("", F("Checking bowl..."));
+        feedEnter(FEED_WEIGH_BOWL);
+      } else if (millis() - feed.stateAt >= SCALE_TIMEOUT) {
+        uiShowLine(1, F("Scale not ready!"));
+        feedEnter(FEED_IDLE);
+      }
+      break;
 
-  // Show total food in bowl
-  lcd.clear();
-  lcd.setCursor(0, 0);
-  lcd.print(F("Bowl now contains"));
-  lcd.setCursor(0, 1);
-  lcd.print(F("Total: "));
-  lcd.print(finalWeight, 1);
-  lcd.print(F("g"));
-  nonBlockingWait(3000);
-}
+    case FEED_WEIGH_BOWL:
+      feedWeighBowl();
+      break;
+
+    case FEED_CONFIRM:
+      feedWaitConfirm();
+      break;
 
-// Non-blocking wait that checks for minimum display time
-void nonBlockingWait(uint32_t waitTime, uint32_t startDisplayTime) {
-  uint32_t startWait = millis();
-  uint32_t actualWaitTime = waitTime;
+    case FEED_DISPENSE:
+      feedDispense();
+      break;
 
-  // If we need to ensure a minimum display time
-  if (LCD_TIMEOUT > 0 && startDisplayTime > 0) {
-    uint32_t elapsedDisplayTime = millis() - startDisplayTime;
+    case FEED_SETTLE:
+      feedSettle();
+      break;
 
-    // If we've already waited longer than minimum, don't wait more
-    if (elapsedDisplayTime >= LCD_TIMEOUT) {
-      return;
-    }
+    case FEED_MEASURE:
+      feedMeasure();
+      break;
 
-    // Calculate how much more time we need to wait
-    uint32_t remainingDisplayTime = LCD_TIMEOUT - elapsedDisplayTime;
+    case FEED_CLOSE:
+      // The servo task moves the hatch, wait until it has arrived
+      if (!hatchMoving()) {
+        uiShow(F("Measuring final"), F("weight..."), 0);
+        feedEnter(FEED_FINAL_SETTLE);
+        schedulerRunIn(feedTaskId, feedProfileSettleMs());
+      }
+      break;
 
-    // Use either the passed wait time or remaining display time, whichever is
-    // longer
-    actualWaitTime = max(waitTime, remainingDisplayTime);
-  }
+    case FEED_FINAL_SETTLE:
+      feedEnter(FEED_FINAL);
+      break;
 
-  // Do the actual waiting
-  while (millis() - startWait < actualWaitTime) {
-    yield();    // Keep WiFi working
-    delay(10);  // Don't hog the CPU
+    case FEED_FINAL: {
+      float weight;
+      if (feedRead(weight)) {
+        feed.samples[feed.sampleCount++] = weight;
+        if (uiPendingCount() == 0) {
+          lcd.setCursor(15, 1);
+          lcd.print(feed.sampleCount % 10);
+        }
+      }
+      if (feedSamplesDone(FEED_FINAL_SAMPLES)) feedFinish();
+      break;
+    }
   }
 }
 
@@ -1460,6 +1724,8 @@ void clearLineLCD(uint8_t col, uint8_t row, uint8_t length) {
 }
 
 void progressBar(float percentage) {
+  PROFILE_SCOPE("lcd");
+
   // Define the width of the progress bar in characters
   uint8_t partialBlock[8] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
 
@@ -1,3 +1,12 @@
+#ifndef MENU_H
+#define MENU_H
+
+#include <Arduino.h>
+
+#include "config.h"
+#include "helpers/button_helpers.h"
+#include "helpers/ui_queue.h"
+
 // Menu item structure
 struct MenuItem {
   const char* name;
@@ -20,6 +29,10 @@ struct MenuItem {
 #define MENU_SCHEDULE_3 11
 #define MENU_WIFI_CONNECT 12
 #define MENU_WIFI_RESET 13
+#define MENU_FEED_PROFILE 14
+#define MENU_HATCH_CAL 15
+#define MENU_HOPPER_REFILL 16
+#define MENU_NONE 0xFF  // No item selected
 
 #define MENU_ITEMS_COUNT (sizeof(menuItems) / sizeof(MenuItem))
 
@@ -38,4 +51,165 @@ const MenuItem menuItems[] = {
     {"At 4:00 PM", MENU_SCHEDULE_2, MENU_SCHEDULE},
     {"At 10:00 PM", MENU_SCHEDULE_3, MENU_SCHEDULE},
     {"Connect WiFi", MENU_WIFI_CONNECT, MENU_WIFI},
-    {"Reset WiFi", MENU_WIFI_RESET, MENU_WIFI}};
+    {"Reset WiFi", MENU_WIFI_RESET, MENU_WIFI},
+    {"Food profile", MENU_FEED_PROFILE, MENU_SETTINGS},
+    {"Calibrate hatch", MENU_HATCH_CAL, MENU_SETTINGS},
+    {"Hopper refilled", MENU_HOPPER_REFILL, MENU_SETTINGS}};
+
+//==============================================================================
+// Navigation (single button)
+//   press        next item
+//   long press   open submenu / select item
+//   double press back to parent (closes the menu from Main Menu)
+//==============================================================================
+
+static bool menuActive = false;
+static unsigned int menuParent = MENU_MAIN;  // Menu whose items are listed
+static uint8_t menuCursor = 0;               // Position among those items
+static uint32_t menuLastInput = 0;
+
+/**
+ * Find the n-th item of a menu
+ * @param parent Menu id
+ * @param position Item position within the menu
+ * @return Index into menuItems, or MENU_NONE
+ */
+static uint8_t menuItemAt(unsigned int parent, uint8_t position) {
+  for (uint8_t i = 0; i < MENU_ITEMS_COUNT; i++) {
+    if (menuItems[i].parentID != parent || menuItems[i].id == parent) continue;
+    if (position-- == 0) return i;
+  }
+  return MENU_NONE;
+}
+
+/**
+ * Find an item by id
+ * @return Index into menuItems, or MENU_NONE
+ */
+static uint8_t menuFind(unsigned int id) {
+  for (uint8_t i = 0; i < MENU_ITEMS_COUNT; i++) {
+    if (menuItems[i].id == id) return i;
+  }
+  return MENU_NONE;
+}
+
+/**
+ * @return true if the item opens a submenu
+ */
+static bool menuHasChildren(unsigned int id) {
+  return menuItemAt(id, 0) != MENU_NONE;
+}
+
+/**
+ * Show the current menu and the item under the cursor
+ */
+static void menuDraw() {
+  char line[LCD_X + 1];
+  snprintf(line, sizeof(line), "> %s",
+           menuItems[menuItemAt(menuParent, menuCursor)].name);
+
+  // Replace the previous menu screen instead of queueing behind it
+  uiEndHold();
+  uiShow(menuItems[menuFind(menuParent)].name, line, MENU_TIMEOUT);
+}
+
+/**
+ * @return true while the menu owns the button and the screen
+ */
+bool menuIsOpen() { return menuActive; }
+
+/**
+ * Open the main menu
+ */
+void menuOpen() {
+  menuActive = true;
+  menuParent = MENU_MAIN;
+  menuCursor = 0;
+  menuLastInput = millis();
+  menuDraw();
+}
+
+/**
+ * Close the menu and hand the screen back to the status displays
+ */
+void menuClose() {
+  menuActive = false;
+  uiEndHold();
+  uiShow(F("Menu closed"), "", QUICK_DISPLAY_TIME);
+}
+
+/**
+ * Go up one level, closing the menu from the top level
+ */
+static void menuBack() {
+  if (menuParent == MENU_MAIN) {
+    menuClose();
+    return;
+  }
+
+  // Put the cursor back on the submenu we are leaving
+  unsigned int child = menuParent;
+  menuParent = menuItems[menuFind(child)].parentID;
+  menuCursor = 0;
+  while (menuItems[menuItemAt(menuParent, menuCursor)].id != child) {
+    menuCursor++;
+  }
+  menuDraw();
+}
+
+/**
+ * Apply a button gesture to the open menu
+ * @param event Gesture from buttonPollEvent()
+ * @return Id of the selected action item, or MENU_NONE
+ */
+unsigned int menuHandleEvent(const ButtonEvent& event) {
+  if (!menuActive) return MENU_NONE;
+  menuLastInput = millis();
+
+  switch (event.type) {
+    case BUTTON_PRESS:
+      menuCursor++;
+      if (menuItemAt(menuParent, menuCursor) == MENU_NONE) menuCursor = 0;
+      menuDraw();
+      return MENU_NONE;
+
+    case BUTTON_DOUBLE_PRESS:
+      menuBack();
+      return MENU_NONE;
+
+    case BUTTON_LONG_PRESS: {
+      unsigned int id = menuItems[menuItemAt(menuParent, menuCursor)].id;
+
+      if (id == MENU_BACK) {
+        menuBack();
+        return MENU_NONE;
+      }
+      if (menuHasChildren(id)) {
+        menuParent = id;
+        menuCursor = 0;
+        menuDraw();
+        return MENU_NONE;
+      }
+
+      // Action item - the caller runs it, and its screen must not wait
+      // out the MENU_TIMEOUT hold of the menu screen
+      menuActive = false;
+      uiEndHold();
+      return id;
+    }
+
+    default:
+      return MENU_NONE;
+  }
+}
+
+/**
+ * Close the menu after MENU_TIMEOUT without input
+ */
+void menuCheckTimeout() {
+  if (menuActive && millis() - menuLastInput >= MENU_TIMEOUT) {
+    menuClose();
+  }
+}
+
+#endif  // MENU_H
@@ -0,0 +1,288 @@
+#ifndef ARDUINO_STUB_H
+#define ARDUINO_STUB_H
+
+// Host stand-in for the ESP8266 Arduino core, just enough for the helpers
+// under test. Time is simulated: millis()/micros() read simMicros, delay()
+// advances it. RTC user memory and pin levels are plain arrays the tests
+// can inspect, corrupt (power cut) or drive.
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <type_traits>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+using std::max;
+using std::min;
+using std::isnan;
+
+#define PROGMEM
+#define PGM_P const char*
+#define PSTR(s) (s)
+#define IRAM_ATTR
+#define ICACHE_RAM_ATTR
+
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper*>(s))
+
+inline char* strncpy_P(char* dest, PGM_P src, size_t size) {
+  return strncpy(dest, src, size);
+}
+inline int snprintf_P(char* dest, size_t size, PGM_P format, ...) {
+  va_list args;
+  va_start(args, format);
+  int written = vsnprintf(dest, size, format, args);
+  va_end(args);
+  return written;
+}
+
+#define constrain(amt, low, high) \
+  ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define RISING 1
+#define FALLING 2
+#define CHANGE 3
+#define DEC 10
+#define HEX 16
+
+#define D0 16
+#define D1 5
+#define D2 4
+#define D3 0
+#define D4 2
+#define D5 14
+#define D6 12
+#define D7 13
+#define D8 15
+#define A0 17
+
+//------------------------------------------------------------------------------
+// Simulated time
+//------------------------------------------------------------------------------
+inline uint64_t simMicros = 0;
+
+inline unsigned long millis() { return (unsigned long)(simMicros / 1000); }
+inline unsigned long micros() { return (unsigned long)(uint32_t)simMicros; }
+inline void delay(unsigned long ms) { simMicros += (uint64_t)ms * 1000; }
+inline void delayMicroseconds(unsigned int us) { simMicros += us; }
+inline void yield() {}
+
+/**
+ * Move the simulated clock to an absolute millis() value
+ */
+inline void simSetMillis(uint32_t ms) { simMicros = (uint64_t)ms * 1000; }
+
+//------------------------------------------------------------------------------
+// Pins and interrupts
+//------------------------------------------------------------------------------
+inline int simPinLevel[18] = {HIGH, HIGH, HIGH, HIGH, HIGH, HIGH,
+                              HIGH, HIGH, HIGH, HIGH, HIGH, HIGH,
+                              HIGH, HIGH, HIGH, HIGH, HIGH, HIGH};
+inline bool simInterruptsMasked = false;
+inline volatile uint32_t simGpcRegs[18];
+
+inline int digitalRead(uint8_t pin) { return simPinLevel[pin % 18]; }
+inline void digitalWrite(uint8_t pin, uint8_t level) {
+  simPinLevel[pin % 18] = level;
+}
+inline void pinMode(uint8_t, uint8_t) {}
+inline int analogRead(uint8_t) { return 0; }
+inline int digitalPinToInterrupt(int pin) { return pin; }
+inline void attachInterrupt(int, void (*)(), int) {}
+inline void detachInterrupt(int) {}
+inline void noInterrupts() { simInterruptsMasked = true; }
+inline void interrupts() { simInterruptsMasked = false; }
+
+#define GPC(pin) simGpcRegs[(pin) % 18]
+#define GPCI 7
+#define GPCWE 10
+
+inline long map(long x, long inMin, long inMax, long outMin, long outMax) {
+  return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+inline long random(long howBig) { return howBig > 0 ? rand() % howBig : 0; }
+inline long random(long howSmall, long howBig) {
+  return howSmall + random(howBig - howSmall);
+}
+
+//------------------------------------------------------------------------------
+// String and Print
+//------------------------------------------------------------------------------
+class String {
+ public:
+  String() {}
+  String(const char* text) : text_(text ? text : "") {}
+  String(const __FlashStringHelper* text)
+      : text_(reinterpret_cast<const char*>(text)) {}
+  template <typename T,
+            typename = std::enable_if_t<std::is_arithmetic<T>::value>>
+  String(T value) : text_(std::to_string(value)) {}
+
+  const char* c_str() const { return text_.c_str(); }
+  unsigned int length() const { return text_.size(); }
+  long toInt() const { return atol(text_.c_str()); }
+  float toFloat() const { return atof(text_.c_str()); }
+  String substring(unsigned int from) const {
+    return text_.substr(from).c_str();
+  }
+  String substring(unsigned int from, unsigned int to) const {
+    return text_.substr(from, to - from).c_str();
+  }
+  String& operator+=(const String& other) {
+    text_ += other.text_;
+    return *this;
+  }
+  String operator+(const String& other) const {
+    return (text_ + other.text_).c_str();
+  }
+  bool operator==(const char* other) const { return text_ == other; }
+
+ private:
+  std::string text_;
+};
+
+class Print {
+ public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t) { return 1; }
+  size_t write(const uint8_t* buffer, size_t size) {
+    for (size_t i = 0; i < size; i++) write(buffer[i]);
+    return size;
+  }
+
+  size_t print(const char* text) { return text ? writeText(text) : 0; }
+  size_t print(const __FlashStringHelper* text) {
+    return print(reinterpret_cast<const char*>(text));
+  }
+  size_t print(const String& text) { return print(text.c_str()); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(double value, int digits = 2) {
+    char text[32];
+    snprintf(text, sizeof(text), "%.*f", digits, value);
+    return print(text);
+  }
+  template <typename T,
+            typename = std::enable_if_t<std::is_integral<T>::value>>
+  size_t print(T value, int base = DEC) {
+    char text[24];
+    snprintf(text, sizeof(text), base == HEX ? "%llx" : "%lld",
+             (long long)value);
+    return print(text);
+  }
+
+  size_t println() { return print("\n"); }
+  template <typename T>
+  size_t println(T value) {
+    return print(value) + println();
+  }
+  template <typename T>
+  size_t println(T value, int format) {
+    return print(value, format) + println();
+  }
+
+  size_t printf(const char* format, ...) {
+    char text[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    return print(text);
+  }
+
+ private:
+  size_t writeText(const char* text) {
+    return write((const uint8_t*)text, strlen(text));
+  }
+};
+
+class Stream : public Print {
+ public:
+  int available() { return 0; }
+  int read() { return -1; }
+};
+
+// Debug output is dropped unless a test turns it on
+class HardwareSerial : public Stream {
+ public:
+  size_t write(uint8_t c) override {
+    if (echo) putchar(c);
+    return 1;
+  }
+  void begin(unsigned long) {}
+  void setDebugOutput(bool) {}
+  void flush() {}
+
+  bool echo = false;
+};
+
+inline HardwareSerial Serial;
+
+//------------------------------------------------------------------------------
+// ESP object
+//------------------------------------------------------------------------------
+struct rst_info {
+  uint32_t reason, exccause, epc1, epc2, epc3, excvaddr, depc;
+};
+
+enum rst_reason {
+  REASON_DEFAULT_RST = 0,
+  REASON_WDT_RST = 1,
+  REASON_EXCEPTION_RST = 2,
+  REASON_SOFT_WDT_RST = 3,
+  REASON_SOFT_RESTART = 4,
+  REASON_DEEP_SLEEP_AWAKE = 5,
+  REASON_EXT_SYS_RST = 6
+};
+
+static const uint32_t SIM_RTC_USER_BLOCKS = 128;
+
+class EspClass {
+ public:
+  uint32_t getCycleCount() { return (uint32_t)(simMicros * 80); }
+  uint8_t getCpuFreqMHz() { return 80; }
+  uint32_t getFreeHeap() { return 40000; }
+  rst_info* getResetInfoPtr() { return &resetInfo; }
+  String getResetReason() { return "Power on"; }
+  void restart() {}
+
+  bool rtcUserMemoryRead(uint32_t block, uint32_t* data, size_t size) {
+    if (block + size / 4 > SIM_RTC_USER_BLOCKS) return false;
+    memcpy(data, rtc + block, size);
+    return true;
+  }
+  bool rtcUserMemoryWrite(uint32_t block, uint32_t* data, size_t size) {
+    if (block + size / 4 > SIM_RTC_USER_BLOCKS) return false;
+    memcpy(rtc + block, data, size);
+    return true;
+  }
+
+  /**
+   * RTC memory after a power loss: whatever the cells settled to
+   */
+  void simLoseRtc() {
+    for (uint32_t i = 0; i < SIM_RTC_USER_BLOCKS; i++) {
+      rtc[i] = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+    }
+  }
+
+  uint32_t rtc[SIM_RTC_USER_BLOCKS] = {};
+  rst_info resetInfo = {};
+};
+
+inline EspClass ESP;
+
+#endif  // ARDUINO_STUB_H
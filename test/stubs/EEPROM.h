@@ -0,0 +1,87 @@
+#ifndef EEPROM_STUB_H
+#define EEPROM_STUB_H
+
+// EEPROM emulation as the ESP8266 core does it: begin() copies the flash
+// sector to RAM, commit() erases the whole sector and writes the RAM copy
+// back. A test can arm a power cut inside a later commit(), after the
+// erase and part way through the write, to see what a torn sector leaves.
+
+#include <Arduino.h>
+
+// Thrown where the simulated power dies; the test "reboots" on catch
+struct SimPowerCut {};
+
+static const size_t SIM_FLASH_SECTOR = 4096;
+
+class EEPROMClass {
+ public:
+  EEPROMClass() { memset(flash, 0xFF, sizeof(flash)); }
+
+  void begin(size_t size) {
+    size_ = size < SIM_FLASH_SECTOR ? size : SIM_FLASH_SECTOR;
+    memcpy(data_, flash, size_);
+  }
+
+  uint8_t read(int address) { return data_[address]; }
+  void write(int address, uint8_t value) { data_[address] = value; }
+  uint8_t* getDataPtr() { return data_; }
+
+  template <typename T>
+  T& get(int address, T& value) {
+    memcpy(&value, data_ + address, sizeof(T));
+    return value;
+  }
+
+  template <typename T>
+  const T& put(int address, const T& value) {
+    memcpy(data_ + address, &value, sizeof(T));
+    return value;
+  }
+
+  bool commit() {
+    commits++;
+    memset(flash, 0xFF, sizeof(flash));  // Sector erase
+
+    if (cutCountdown_ > 0 && --cutCountdown_ == 0) {
+      memcpy(flash, data_, cutBytes_ < size_ ? cutBytes_ : size_);
+      throw SimPowerCut();
+    }
+
+    memcpy(flash, data_, size_);
+    return true;
+  }
+
+  /**
+   * Cut the power during a later commit
+   * @param commit Which commit from now (1 = the next one)
+   * @param bytesWritten Bytes of the sector rewritten before the cut
+   *        (0 = right after the erase)
+   */
+  void simArmCut(uint32_t commit, size_t bytesWritten) {
+    cutCountdown_ = commit;
+    cutBytes_ = bytesWritten;
+  }
+
+  void simDisarmCut() { cutCountdown_ = 0; }
+
+  /**
+   * Forget the RAM copy, as a reset does (flash is kept)
+   */
+  void simReboot() {
+    memset(data_, 0, sizeof(data_));
+    size_ = 0;
+  }
+
+  uint8_t flash[SIM_FLASH_SECTOR];
+  uint32_t commits = 0;
+
+ private:
+  uint8_t data_[SIM_FLASH_SECTOR] = {};
+  size_t size_ = 0;
+  uint32_t cutCountdown_ = 0;
+  size_t cutBytes_ = 0;
+};
+
+inline EEPROMClass EEPROM;
+
+#endif  // EEPROM_STUB_H
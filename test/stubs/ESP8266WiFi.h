@@ -0,0 +1,162 @@
+#ifndef ESP8266WIFI_STUB_H
+#define ESP8266WIFI_STUB_H
+
+// Station-mode WiFi whose association is played by the test: begin()
+// records the attempt and asks simAssociate (if set) when the link comes
+// up; simPoll() then raises it at that time and fires the got-IP event. An
+// attempt that never comes up reports WL_NO_SSID_AVAIL after simNoApMs, as
+// the SDK does once its probe finds no AP (-1 = it keeps trying quietly).
+
+#include <Arduino.h>
+
+#include <functional>
+#include <memory>
+
+class IPAddress {
+ public:
+  IPAddress() {}
+  IPAddress(uint32_t address) : address_(address) {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+      : address_(a | (b << 8) | (c << 16) | ((uint32_t)d << 24)) {}
+  operator uint32_t() const { return address_; }
+  String toString() const {
+    char text[16];
+    snprintf(text, sizeof(text), "%u.%u.%u.%u", address_ & 0xFF,
+             (address_ >> 8) & 0xFF, (address_ >> 16) & 0xFF, address_ >> 24);
+    return text;
+  }
+
+ private:
+  uint32_t address_ = 0;
+};
+
+enum wl_status_t {
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_SCAN_COMPLETED = 2,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_CONNECTION_LOST = 5,
+  WL_WRONG_PASSWORD = 6,
+  WL_DISCONNECTED = 7
+};
+
+enum WiFiMode_t { WIFI_OFF = 0, WIFI_STA = 1, WIFI_AP = 2, WIFI_AP_STA = 3 };
+
+enum WiFiSleepType_t {
+  WIFI_NONE_SLEEP = 0,
+  WIFI_LIGHT_SLEEP = 1,
+  WIFI_MODEM_SLEEP = 2
+};
+
+struct WiFiEventStationModeGotIP {};
+struct WiFiEventStationModeDisconnected {};
+typedef std::shared_ptr<int> WiFiEventHandler;
+
+class ESP8266WiFiClass {
+ public:
+  // Delay until associated for an attempt (ms), or -1 if it never succeeds
+  typedef int32_t (*Associate)(bool direct, int32_t channel,
+                               const uint8_t* bssid);
+
+  void persistent(bool) {}
+  bool mode(WiFiMode_t) { return true; }
+  bool setAutoReconnect(bool) { return true; }
+  bool setSleepMode(WiFiSleepType_t type, uint8_t = 0) {
+    sleepMode = type;
+    return true;
+  }
+  bool config(IPAddress, IPAddress, IPAddress, IPAddress = IPAddress()) {
+    return true;
+  }
+
+  wl_status_t begin(const char*, const char*, int32_t channel = 0,
+                    const uint8_t* bssid = nullptr, bool = true) {
+    simLink(false);
+    begins++;
+    bool direct = channel != 0 && bssid != nullptr;
+    simNoApMs = -1;
+    int32_t delayMs = simAssociate ? simAssociate(direct, channel, bssid) : 0;
+    upAt_ = delayMs < 0 ? -1 : (int64_t)millis() + delayMs;
+    noApAt_ = delayMs < 0 && simNoApMs >= 0 ? (int64_t)millis() + simNoApMs
+                                            : -1;
+    return WL_DISCONNECTED;
+  }
+
+  bool disconnect(bool = false) {
+    upAt_ = -1;
+    noApAt_ = -1;
+    simLink(false);
+    return true;
+  }
+  bool reconnect() { return true; }
+
+  wl_status_t status() {
+    simPoll();
+    if (connected_) return WL_CONNECTED;
+    if (noApAt_ >= 0 && (int64_t)millis() >= noApAt_) return WL_NO_SSID_AVAIL;
+    return WL_DISCONNECTED;
+  }
+
+  uint8_t* BSSID() { return apBssid; }
+  int32_t channel() { return apChannel; }
+  int32_t RSSI() { return -60; }
+  IPAddress localIP() { return IPAddress(192, 168, 1, 50); }
+  IPAddress gatewayIP() { return IPAddress(192, 168, 1, 1); }
+  IPAddress subnetMask() { return IPAddress(255, 255, 255, 0); }
+  IPAddress dnsIP(uint8_t = 0) { return IPAddress(192, 168, 1, 1); }
+  int hostByName(const char*, IPAddress& result, uint32_t = 10000) {
+    result = IPAddress(192, 168, 1, 2);
+    return 1;
+  }
+
+  WiFiEventHandler onStationModeGotIP(
+      std::function<void(const WiFiEventStationModeGotIP&)> handler) {
+    gotIp_ = handler;
+    return std::make_shared<int>(0);
+  }
+  WiFiEventHandler onStationModeDisconnected(
+      std::function<void(const WiFiEventStationModeDisconnected&)> handler) {
+    disconnected_ = handler;
+    return std::make_shared<int>(0);
+  }
+
+  /**
+   * Bring the link up once the association delay has passed
+   */
+  void simPoll() {
+    if (!connected_ && upAt_ >= 0 && (int64_t)millis() >= upAt_) {
+      simLink(true);
+    }
+  }
+
+  /**
+   * Raise or drop the link and fire the matching station event
+   */
+  void simLink(bool up) {
+    if (up == connected_) return;
+    connected_ = up;
+    if (up && gotIp_) gotIp_(WiFiEventStationModeGotIP());
+    if (!up && disconnected_) {
+      disconnected_(WiFiEventStationModeDisconnected());
+    }
+  }
+
+  Associate simAssociate = nullptr;
+  int32_t simNoApMs = -1;  // Set by simAssociate for a failing attempt
+  uint8_t apBssid[6] = {0x02, 0x11, 0x22, 0x33, 0x44, 0x55};
+  int32_t apChannel = 6;
+  uint32_t begins = 0;
+  WiFiSleepType_t sleepMode = WIFI_NONE_SLEEP;
+
+ private:
+  bool connected_ = false;
+  int64_t upAt_ = -1;
+  int64_t noApAt_ = -1;
+  std::function<void(const WiFiEventStationModeGotIP&)> gotIp_;
+  std::function<void(const WiFiEventStationModeDisconnected&)> disconnected_;
+};
+
+inline ESP8266WiFiClass WiFi;
+
+#endif  // ESP8266WIFI_STUB_H
@@ -0,0 +1,27 @@
+#ifndef HX711_STUB_H
+#define HX711_STUB_H
+
+// Load cell amplifier whose reading comes from a test-supplied function
+
+#include <Arduino.h>
+
+class HX711 {
+ public:
+  void begin(uint8_t, uint8_t) {}
+  bool is_ready() { return ready; }
+  float get_units(uint8_t = 1) { return source ? source() : 0; }
+  double get_value(uint8_t = 1) { return get_units(); }
+  long read() { return (long)get_units(); }
+  void set_scale(float = 1.0f) {}
+  float get_scale() { return 1.0f; }
+  void set_offset(long) {}
+  long get_offset() { return 0; }
+  void tare(uint8_t = 10) {}
+  void power_up() {}
+  void power_down() {}
+
+  float (*source)() = nullptr;  // Grams on the scale
+  bool ready = true;
+};
+
+#endif  // HX711_STUB_H
@@ -0,0 +1,49 @@
+#ifndef LIQUID_CRYSTAL_I2C_STUB_H
+#define LIQUID_CRYSTAL_I2C_STUB_H
+
+// 16x2 character LCD that keeps its text in memory
+
+#include <Arduino.h>
+
+class LiquidCrystal_I2C : public Print {
+ public:
+  LiquidCrystal_I2C(uint8_t, uint8_t cols, uint8_t rows)
+      : cols_(cols < 20 ? cols : 20), rows_(rows < 4 ? rows : 4) {
+    clear();
+  }
+
+  void init() {}
+  void begin() {}
+  void backlight() { lit = true; }
+  void noBacklight() { lit = false; }
+  void createChar(uint8_t, uint8_t*) {}
+
+  void clear() {
+    for (uint8_t row = 0; row < 4; row++) {
+      memset(text[row], ' ', sizeof(text[row]) - 1);
+      text[row][cols_] = '\0';
+    }
+    col_ = row_ = 0;
+    clears++;
+  }
+
+  void setCursor(uint8_t col, uint8_t row) {
+    col_ = col;
+    row_ = row < rows_ ? row : rows_ - 1;
+  }
+
+  size_t write(uint8_t c) override {
+    if (col_ < cols_) text[row_][col_++] = c;
+    return 1;
+  }
+
+  char text[4][21];
+  bool lit = true;
+  uint32_t clears = 0;
+
+ private:
+  uint8_t cols_, rows_;
+  uint8_t col_ = 0, row_ = 0;
+};
+
+#endif  // LIQUID_CRYSTAL_I2C_STUB_H
@@ -0,0 +1,124 @@
+#ifndef LITTLEFS_STUB_H
+#define LITTLEFS_STUB_H
+
+// LittleFS as a map of path -> bytes, enough for the append-only stores.
+// Directories are implied by the paths. Writes and reads are counted so a
+// test can see how often and how much the helpers touch the flash.
+
+#include <Arduino.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+struct FSInfo {
+  size_t totalBytes;
+  size_t usedBytes;
+};
+
+static const size_t SIM_FS_SIZE = 2 * 1024 * 1024;
+
+class File {
+ public:
+  File() {}
+  File(std::vector<uint8_t>* data) : data_(data) {}
+
+  explicit operator bool() const { return data_ != nullptr; }
+
+  size_t write(const uint8_t* buffer, size_t size);
+  size_t read(uint8_t* buffer, size_t size);
+  bool seek(uint32_t position) {
+    position_ = position;
+    return data_ != nullptr;
+  }
+  size_t position() const { return position_; }
+  size_t size() const { return data_ ? data_->size() : 0; }
+  void flush() {}
+  void close() { data_ = nullptr; }
+
+ private:
+  std::vector<uint8_t>* data_ = nullptr;
+  size_t position_ = 0;
+};
+
+class Dir {
+ public:
+  Dir() {}
+  Dir(std::vector<std::string> names) : names_(names) {}
+
+  bool next() { return ++index_ < (int)names_.size(); }
+  String fileName() const { return names_[index_].c_str(); }
+
+ private:
+  std::vector<std::string> names_;
+  int index_ = -1;
+};
+
+class LittleFSClass {
+ public:
+  bool begin() { return true; }
+  void end() {}
+
+  File open(const char* path, const char* mode) {
+    bool exists = files.count(path) > 0;
+    if (mode[0] == 'r' && !exists) return File();
+    if (mode[0] == 'w') files[path].clear();
+    return File(&files[path]);
+  }
+
+  bool exists(const char* path) { return files.count(path) > 0; }
+  bool remove(const char* path) { return files.erase(path) > 0; }
+  bool mkdir(const char*) { return true; }
+
+  Dir openDir(const char* path) {
+    std::string prefix = std::string(path) + "/";
+    std::vector<std::string> names;
+    for (const auto& file : files) {
+      if (file.first.compare(0, prefix.size(), prefix) == 0 &&
+          file.first.find('/', prefix.size()) == std::string::npos) {
+        names.push_back(file.first.substr(prefix.size()));
+      }
+    }
+    return Dir(names);
+  }
+
+  bool info(FSInfo& info) {
+    info.usedBytes = 0;
+    for (const auto& file : files) info.usedBytes += file.second.size();
+    info.totalBytes = SIM_FS_SIZE;
+    return true;
+  }
+
+  /**
+   * Drop every file, as a format does
+   */
+  void simFormat() { files.clear(); }
+
+  std::map<std::string, std::vector<uint8_t>> files;
+  uint32_t writes = 0;
+  uint32_t writeBytes = 0;
+  uint32_t readBytes = 0;
+};
+
+inline LittleFSClass LittleFS;
+
+inline size_t File::write(const uint8_t* buffer, size_t size) {
+  if (!data_) return 0;
+  if (data_->size() < position_ + size) data_->resize(position_ + size);
+  memcpy(data_->data() + position_, buffer, size);
+  position_ += size;
+  LittleFS.writes++;
+  LittleFS.writeBytes += size;
+  return size;
+}
+
+inline size_t File::read(uint8_t* buffer, size_t size) {
+  if (!data_ || position_ >= data_->size()) return 0;
+  size = std::min(size, data_->size() - position_);
+  memcpy(buffer, data_->data() + position_, size);
+  position_ += size;
+  LittleFS.readBytes += size;
+  return size;
+}
+
+#endif  // LITTLEFS_STUB_H
@@ -0,0 +1,27 @@
+#ifndef SERVO_STUB_H
+#define SERVO_STUB_H
+
+// Hobby servo: remembers the last commanded angle
+
+#include <Arduino.h>
+
+class Servo {
+ public:
+  uint8_t attach(int) {
+    attached_ = true;
+    return 0;
+  }
+  uint8_t attach(int pin, int, int) { return attach(pin); }
+  void detach() { attached_ = false; }
+  bool attached() { return attached_; }
+  void write(int value) { angle = value; }
+  void writeMicroseconds(int) {}
+  int read() { return angle; }
+
+  int angle = 90;
+
+ private:
+  bool attached_ = false;
+};
+
+#endif  // SERVO_STUB_H
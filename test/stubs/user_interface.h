@@ -0,0 +1,24 @@
+#ifndef USER_INTERFACE_STUB_H
+#define USER_INTERFACE_STUB_H
+
+// SDK calls used for the light-sleep button wake-up
+
+#include <stdint.h>
+
+enum GPIO_INT_TYPE {
+  GPIO_PIN_INTR_DISABLE = 0,
+  GPIO_PIN_INTR_POSEDGE = 1,
+  GPIO_PIN_INTR_NEGEDGE = 2,
+  GPIO_PIN_INTR_ANYEDGE = 3,
+  GPIO_PIN_INTR_LOLEVEL = 4,
+  GPIO_PIN_INTR_HILEVEL = 5
+};
+
+inline bool simGpioWakeEnabled = false;
+
+inline void wifi_enable_gpio_wakeup(uint32_t, GPIO_INT_TYPE) {
+  simGpioWakeEnabled = true;
+}
+inline void wifi_disable_gpio_wakeup() { simGpioWakeEnabled = false; }
+
+#endif  // USER_INTERFACE_STUB_H
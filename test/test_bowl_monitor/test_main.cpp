@@ -0,0 +1,286 @@
+// Eating detection on a simulated bowl, and the cost of one sample. Two
+// weeks of 1 Hz scale readings are scripted with the truth known:
+//
+//   feeds      65 g at 08:00 and 18:00 (the monitor is rebased)
+//   meals      1-3 per feed, 15-65 bites each. A bite presses the bowl
+//              3-30 g for 1-3 s (a tenth are light 1.5 g nudges), takes
+//              0.2-0.6 g, and the pet chews over the bowl for 1-6 s.
+//   sniffs     two samples 8 g up, nothing eaten
+//   cleaning   the bowl is off the scale for two minutes once a week
+//   spill      the bowl is knocked and loses 25 g in a second (day 5)
+//   top-up     30 g added by hand (day 11)
+//   fast       a day without a meal (day 9)
+//
+// On top come 0.15 g noise, a 1.5 g daily temperature swing and slow
+// creep of the load cell. Sessions found are matched to the scripted
+// meals by overlap, and the detector is timed on the host.
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "helpers/bowl_monitor.h"
+
+static const uint32_t DAY_S = 86400;
+static const uint32_t DAYS = 14;
+static const uint32_t SAMPLES = DAY_S * DAYS;  // One per second
+static const uint32_t EPOCH = 1000000000;      // Local epoch at sample 0
+static const uint32_t MATCH_SLACK_S = 30;
+static const uint32_t FAST_DAY = 9;
+static const uint32_t SPILL_DAY = 5;
+static const uint32_t TOP_UP_DAY = 11;
+
+struct Meal {
+  uint32_t start;  // Seconds
+  uint32_t end;
+  float grams;
+  uint16_t bites;  // Presses a touch can see
+};
+
+static std::vector<float> samples(SAMPLES);
+static std::vector<bool> rebaseAt(SAMPLES);
+static std::vector<Meal> meals;
+static uint32_t removals = 0;
+
+static std::mt19937 rng;
+
+static float uniform() {
+  return std::uniform_real_distribution<float>(0, 1)(rng);
+}
+
+static float gauss(float spread) {
+  return std::normal_distribution<float>(0, spread)(rng);
+}
+
+// Script writer: t is the next second to fill, food what the bowl holds
+static uint32_t t = 0;
+static float food = 0;
+
+static void stillUntil(uint32_t until) {
+  for (; t < until && t < SAMPLES; t++) samples[t] = food;
+}
+
+static void hold(uint32_t seconds, float reading) {
+  for (uint32_t i = 0; i < seconds && t < SAMPLES; i++) samples[t++] = reading;
+}
+
+static void eatMeal() {
+  Meal meal = {t, t, 0, 0};
+  int bites = 15 + (int)(uniform() * 50);
+  for (int b = 0; b < bites && food > 1; b++) {
+    float press = uniform() < 0.1f ? 1.5f : 3 + uniform() * 27;
+    int length = 1 + (int)(uniform() * 3);
+    for (int i = 0; i < length && t < SAMPLES; i++) {
+      samples[t++] = food + press * (0.5f + uniform());
+    }
+
+    float grams = std::min(food, 0.2f + uniform() * 0.4f);
+    food -= grams;
+    meal.grams += grams;
+    if (press > BOWL_TOUCH_GRAMS) meal.bites++;
+    meal.end = t;
+
+    // Head over the bowl while chewing
+    int chew = 1 + (int)(uniform() * 6);
+    for (int i = 0; i < chew && t < SAMPLES; i++) {
+      samples[t++] = food + gauss(0.3f);
+    }
+  }
+  meals.push_back(meal);
+}
+
+static void scriptDays() {
+  rng.seed(11);
+  for (uint32_t day = 0; day < DAYS; day++) {
+    for (int feed = 0; feed < 2; feed++) {
+      stillUntil(day * DAY_S + (feed ? 18 : 8) * 3600);
+      food += 65;
+      rebaseAt[t] = true;
+
+      // Meals at least 10 min apart
+      int count = day == FAST_DAY ? 0 : 1 + (int)(uniform() * 3);
+      uint32_t next = t + 300 + (uint32_t)(uniform() * 3600);
+      for (int m = 0; m < count; m++) {
+        stillUntil(next);
+        eatMeal();
+        next = t + 600 + (uint32_t)(uniform() * 5400);
+      }
+
+      if (uniform() < 0.5f) {
+        stillUntil(t + 1800 + (uint32_t)(uniform() * 3600));
+        hold(2, food + 8);
+      }
+    }
+
+    if (day % 7 == 3) {
+      stillUntil(day * DAY_S + 12 * 3600);
+      hold(120, -150);
+      removals++;
+    }
+    if (day == SPILL_DAY) {
+      stillUntil(day * DAY_S + 22 * 3600);
+      hold(2, food + 40);
+      food = std::max(0.0f, food - 25);
+    }
+    if (day == TOP_UP_DAY) {
+      stillUntil(day * DAY_S + 14 * 3600);
+      hold(4, food + 20 + 30 * uniform());
+      food += 30;
+    }
+  }
+  stillUntil(SAMPLES);
+
+  // Noise, temperature swing and creep
+  for (uint32_t i = 0; i < SAMPLES; i++) {
+    samples[i] += gauss(0.15f) + 1.5f * sinf(i * 2 * M_PI / DAY_S) +
+                  i * 2e-6f;
+  }
+}
+
+static std::vector<BowlSession> sessions;
+static uint32_t alertCount[4];  // Per BowlAlert bit
+static uint32_t spillAlertDay = 0;
+static uint32_t addedAlertDay = 0;
+static double nsPerSample = 0;
+
+static void runMonitor() {
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < SAMPLES; i++) {
+    if (rebaseAt[i]) bowlMonitorRebase();
+    bowlMonitorSample(samples[i], i * BOWL_SAMPLE_INTERVAL, EPOCH + i);
+
+    BowlSession session;
+    while (bowlNextUnsent(session)) {
+      sessions.push_back(session);
+      bowlMarkSent();
+    }
+    uint8_t alerts = bowlTakeAlerts();
+    for (uint8_t bit = 0; bit < 4; bit++) {
+      if (alerts & (1 << bit)) alertCount[bit]++;
+    }
+    if (alerts & BOWL_ALERT_SPILLED) spillAlertDay = i / DAY_S;
+    if (alerts & BOWL_ALERT_ADDED) addedAlertDay = i / DAY_S;
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  nsPerSample =
+      std::chrono::duration<double, std::nano>(elapsed).count() / SAMPLES;
+}
+
+struct Matching {
+  uint32_t found;       // Meals with a session
+  uint32_t falseFound;  // Sessions without a meal
+  std::vector<float> gramsError;  // Relative, per found meal
+  std::vector<float> bitesError;
+};
+
+static Matching matching;
+
+static void matchSessions() {
+  std::vector<bool> used(meals.size());
+  for (const BowlSession& session : sessions) {
+    uint32_t start = session.start - EPOCH;
+    uint32_t end = start + session.durationS;
+    bool matched = false;
+    for (size_t m = 0; m < meals.size(); m++) {
+      const Meal& meal = meals[m];
+      if (start > meal.end + MATCH_SLACK_S ||
+          end + MATCH_SLACK_S < meal.start) {
+        continue;
+      }
+      matched = true;
+      if (used[m]) continue;
+      used[m] = true;
+      matching.found++;
+      matching.gramsError.push_back(
+          fabsf(session.decigrams / 10.0f - meal.grams) / meal.grams);
+      matching.bitesError.push_back(
+          fabsf((float)session.bites - meal.bites) / meal.bites);
+    }
+    if (!matched) matching.falseFound++;
+  }
+}
+
+static float percentile(std::vector<float> values, float fraction) {
+  std::sort(values.begin(), values.end());
+  return values[(size_t)(fraction * (values.size() - 1))];
+}
+
+static void report() {
+  char line[120];
+  snprintf(line, sizeof(line),
+           "%u meals: %u found, %u sessions, %u false",
+           (unsigned)meals.size(), (unsigned)matching.found,
+           (unsigned)sessions.size(), (unsigned)matching.falseFound);
+  TEST_MESSAGE(line);
+  snprintf(line, sizeof(line),
+           "grams error p50/p90 %.1f%%/%.1f%%, bites error p50/p90 "
+           "%.1f%%/%.1f%%",
+           100 * percentile(matching.gramsError, 0.5f),
+           100 * percentile(matching.gramsError, 0.9f),
+           100 * percentile(matching.bitesError, 0.5f),
+           100 * percentile(matching.bitesError, 0.9f));
+  TEST_MESSAGE(line);
+  snprintf(line, sizeof(line),
+           "alerts: not-eating %u, removed %u, spilled %u, added %u",
+           (unsigned)alertCount[0], (unsigned)alertCount[1],
+           (unsigned)alertCount[2], (unsigned)alertCount[3]);
+  TEST_MESSAGE(line);
+  snprintf(line, sizeof(line),
+           "cost %.1f ns per sample on the host, %u bytes of RTC memory",
+           nsPerSample, (unsigned)sizeof(BowlLog));
+  TEST_MESSAGE(line);
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_every_meal_is_found_without_false_sessions() {
+  TEST_ASSERT_EQUAL_UINT32(meals.size(), matching.found);
+  TEST_ASSERT_EQUAL_UINT32(0, matching.falseFound);
+}
+
+void test_meal_size_and_bites_are_close() {
+  TEST_ASSERT_LESS_THAN_FLOAT(0.08f, percentile(matching.gramsError, 0.5f));
+  TEST_ASSERT_LESS_THAN_FLOAT(0.15f, percentile(matching.gramsError, 0.9f));
+  TEST_ASSERT_LESS_THAN_FLOAT(0.08f, percentile(matching.bitesError, 0.5f));
+}
+
+void test_alerts_fire_as_scripted() {
+  // The fast day, and nothing else goes a day without a meal
+  TEST_ASSERT_EQUAL_UINT32(1, alertCount[0]);
+  TEST_ASSERT_EQUAL_UINT32(removals, alertCount[1]);
+  TEST_ASSERT_EQUAL_UINT32(1, alertCount[2]);
+  TEST_ASSERT_EQUAL_UINT32(SPILL_DAY, spillAlertDay);
+  TEST_ASSERT_EQUAL_UINT32(1, alertCount[3]);
+  TEST_ASSERT_EQUAL_UINT32(TOP_UP_DAY, addedAlertDay);
+}
+
+void test_log_fits_its_rtc_blocks() {
+  TEST_ASSERT_LESS_OR_EQUAL((RTC_FEED_GATE_BLOCK - RTC_BOWL_BLOCK) * 4,
+                            sizeof(BowlLog));
+}
+
+void test_sample_is_cheap() {
+  // A handful of float operations; the HX711 read dominates on the device
+  TEST_ASSERT_LESS_THAN_FLOAT(1000.0f, (float)nsPerSample);
+}
+
+int main() {
+  scriptDays();
+  runMonitor();
+  matchSessions();
+  report();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_every_meal_is_found_without_false_sessions);
+  RUN_TEST(test_meal_size_and_bites_are_close);
+  RUN_TEST(test_alerts_fire_as_scripted);
+  RUN_TEST(test_log_fits_its_rtc_blocks);
+  RUN_TEST(test_sample_is_cheap);
+  return UNITY_END();
+}
@@ -0,0 +1,215 @@
+// Button gestures from synthetic contact-bounce waveforms. Each press and
+// release is a burst of random toggles on the pin (up to BOUNCE_MAX_MS
+// long) ending at the new level. Every toggle goes through the interrupt
+// handler and buttonUpdate() runs every BUTTON_POLL_INTERVAL, as on the
+// device, so the ring, the debounce state machine and the overflow resync
+// are all exercised.
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "helpers/button_helpers.h"
+
+static const uint32_t BOUNCE_MAX_MS = 10;
+
+struct Edge {
+  uint32_t at;
+  bool pressed;
+};
+
+static std::vector<Edge> waveform;
+static std::vector<uint8_t> events;
+static std::mt19937 rng;
+
+static uint32_t randomBetween(uint32_t low, uint32_t high) {
+  return std::uniform_int_distribution<uint32_t>(low, high)(rng);
+}
+
+/**
+ * Append a bounce burst at time `at` that settles on `pressed`
+ * @return Time of the last edge
+ */
+static uint32_t bounce(uint32_t at, bool pressed, uint8_t maxExtraToggles,
+                       uint8_t minExtraToggles = 0) {
+  uint8_t toggles =
+      2 * randomBetween(minExtraToggles / 2, maxExtraToggles / 2) + 1;
+  std::vector<uint32_t> times;
+  for (uint8_t i = 0; i < toggles; i++) {
+    times.push_back(at + randomBetween(0, BOUNCE_MAX_MS));
+  }
+  std::sort(times.begin(), times.end());
+
+  // Odd toggle count, so the burst ends on the new level
+  bool level = !pressed;
+  for (uint32_t time : times) {
+    level = !level;
+    waveform.push_back({time, level});
+  }
+  return times.back();
+}
+
+/**
+ * Append a press held for holdMs
+ * @return Time of the last release edge
+ */
+static uint32_t press(uint32_t at, uint32_t holdMs, uint8_t toggles = 20) {
+  uint32_t down = bounce(at, true, toggles);
+  return bounce(down + holdMs, false, toggles);
+}
+
+static void resetButton() {
+  buttonEdgeHead = buttonEdgeTail = 0;
+  buttonEdgeOverflow = false;
+  buttonStable = buttonCandidate = false;
+  buttonCandidateSince = buttonPressedAt = buttonReleasedAt = 0;
+  buttonLastChange = 0;
+  buttonLongSent = buttonClickPending = false;
+  buttonEventHead = buttonEventCount = 0;
+  buttonEdgesDropped = 0;
+  buttonWakeArmed = false;
+  simPinLevel[MANUAL_FEED_BUTTON_PIN] = HIGH;
+}
+
+static void collectEvents() {
+  ButtonEvent event;
+  while (buttonPollEvent(event)) events.push_back(event.type);
+}
+
+/**
+ * Play the waveform through the interrupt handler, running buttonUpdate()
+ * every pollMs, and collect the gestures
+ */
+static void play(uint32_t pollMs = BUTTON_POLL_INTERVAL) {
+  uint32_t end = waveform.empty() ? 0 : waveform.back().at;
+  end += BUTTON_LONG_PRESS_TIME + BUTTON_DOUBLE_PRESS_GAP + pollMs;
+
+  size_t next = 0;
+  for (uint32_t now = 0; now <= end; now++) {
+    simSetMillis(now);
+    while (next < waveform.size() && waveform[next].at == now) {
+      bool pressed = waveform[next].pressed;
+      simPinLevel[MANUAL_FEED_BUTTON_PIN] = pressed ? LOW : HIGH;
+      buttonIsr();
+      next++;
+    }
+    if (now % pollMs == 0) {
+      buttonUpdate();
+      collectEvents();
+    }
+  }
+}
+
+void setUp() {
+  resetButton();
+  waveform.clear();
+  events.clear();
+  rng.seed(1);
+}
+
+void tearDown() {}
+
+void test_bouncy_short_press_is_one_press() {
+  press(100, 150);
+  play();
+
+  TEST_ASSERT_EQUAL(1, events.size());
+  TEST_ASSERT_EQUAL(BUTTON_PRESS, events[0]);
+}
+
+void test_bouncy_hold_is_one_long_press() {
+  press(100, 2000);
+  play();
+
+  TEST_ASSERT_EQUAL(1, events.size());
+  TEST_ASSERT_EQUAL(BUTTON_LONG_PRESS, events[0]);
+}
+
+void test_bouncy_double_press() {
+  uint32_t released = press(100, 120);
+  press(released + 150, 120);
+  play();
+
+  TEST_ASSERT_EQUAL(1, events.size());
+  TEST_ASSERT_EQUAL(BUTTON_DOUBLE_PRESS, events[0]);
+}
+
+void test_glitches_shorter_than_debounce_are_ignored() {
+  // Spikes that return to the idle level within the debounce time
+  for (uint32_t at = 100; at < 5000; at += 97) {
+    uint32_t spike = randomBetween(1, BUTTON_DEBOUNCE_TIME - 5);
+    waveform.push_back({at, true});
+    waveform.push_back({at + spike, false});
+  }
+  play();
+
+  TEST_ASSERT_EQUAL(0, events.size());
+  TEST_ASSERT_FALSE(buttonIsPressed());
+}
+
+void test_random_gestures_are_recognised_in_order() {
+  std::vector<uint8_t> expected;
+  uint32_t at = 100;
+
+  for (uint16_t i = 0; i < 500; i++) {
+    uint8_t type = randomBetween(0, 2);
+    uint32_t released;
+    if (type == BUTTON_PRESS) {
+      released = press(at, randomBetween(80, 600));
+    } else if (type == BUTTON_LONG_PRESS) {
+      released = press(at, randomBetween(BUTTON_LONG_PRESS_TIME + 50, 3000));
+    } else {
+      released = press(at, randomBetween(60, 200));
+      uint32_t gap = randomBetween(60, 200);
+      released = press(released + gap, randomBetween(60, 200));
+    }
+    expected.push_back(type);
+    at = released + BUTTON_DOUBLE_PRESS_GAP + randomBetween(100, 3000);
+  }
+  play();
+
+  TEST_ASSERT_EQUAL(expected.size(), events.size());
+  for (size_t i = 0; i < expected.size(); i++) {
+    TEST_ASSERT_EQUAL(expected[i], events[i]);
+  }
+  TEST_ASSERT_EQUAL_UINT32(0, buttonEdgesDropped);
+}
+
+void test_late_polling_still_measures_press_length() {
+  // buttonUpdate() held off by a feeding; edges keep their own timestamps
+  uint32_t released = press(100, 300, 4);
+  released = press(released + 1000, 1500, 4);
+  play(700);
+
+  TEST_ASSERT_EQUAL(2, events.size());
+  TEST_ASSERT_EQUAL(BUTTON_PRESS, events[0]);
+  TEST_ASSERT_EQUAL(BUTTON_LONG_PRESS, events[1]);
+}
+
+void test_ring_overflow_resyncs_from_the_pin() {
+  // A chattering contact overruns the edge ring between two polls
+  uint32_t down = bounce(101, true, 3 * BUTTON_EDGE_QUEUE_SIZE,
+                         2 * BUTTON_EDGE_QUEUE_SIZE);
+  bounce(down + 200, false, 4);
+  play();
+
+  TEST_ASSERT_GREATER_THAN(0, buttonEdgesDropped);
+  TEST_ASSERT_EQUAL(1, events.size());
+  TEST_ASSERT_EQUAL(BUTTON_PRESS, events[0]);
+  TEST_ASSERT_FALSE(buttonIsPressed());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_bouncy_short_press_is_one_press);
+  RUN_TEST(test_bouncy_hold_is_one_long_press);
+  RUN_TEST(test_bouncy_double_press);
+  RUN_TEST(test_glitches_shorter_than_debounce_are_ignored);
+  RUN_TEST(test_random_gestures_are_recognised_in_order);
+  RUN_TEST(test_late_polling_still_measures_press_length);
+  RUN_TEST(test_ring_overflow_resyncs_from_the_pin);
+  return UNITY_END();
+}
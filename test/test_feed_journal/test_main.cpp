@@ -0,0 +1,242 @@
+// Power cuts during feeding sessions. Each simulated session starts the
+// journal, dispenses a gram every 200 ms with a checkpoint per gram, ends
+// the journal and commits a neighbouring record (standing in for the
+// cursor, profile and hopper commits that share the flash sector). The
+// power then dies at a random point:
+//
+//   between steps   a reset (RTC memory kept) or a power cut (RTC lost)
+//   inside commit   after the sector erase, part way through the rewrite
+//
+// After every cut the journal is reconciled as on boot. A torn sector must
+// never be read as a record, the credit for an interrupted session must
+// not exceed what really went out, and the outcomes are counted.
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include <random>
+#include <vector>
+
+#include "helpers/feed_journal.h"
+
+// Shaped like the hopper record: magic, payload, CRC
+struct NeighbourRecord {
+  uint32_t magic;
+  uint32_t value;
+  float grams[6];
+  uint32_t crc;
+};
+
+static const uint32_t NEIGHBOUR_MAGIC = 0x4E424F52;  // "NBOR"
+
+static const uint32_t SESSIONS = 20000;
+static const uint32_t TICK_MS = 200;  // One gram per tick
+
+enum CutKind { CUT_NONE, CUT_RESET, CUT_POWER, CUT_COMMIT };
+
+struct Outcomes {
+  uint32_t sessions;
+  uint32_t clean;
+  uint32_t recoveredRtc;    // Open session found, RTC copy used
+  uint32_t recoveredFlash;  // Open session found, flash copy used
+  uint32_t lostOpen;        // Open session not found (sector torn)
+  uint32_t tornCommits;
+  uint32_t neighbourLost;   // Boots with the neighbour CRC failing
+};
+
+static Outcomes outcomes;
+static std::mt19937 rng;
+static NeighbourRecord neighbour;
+static uint32_t neighbourValue = 0;
+
+// Every journal record handed to a commit (the crc is set by then)
+static std::vector<FeedJournalRecord> journalHistory;
+
+static float actualGrams = 0;  // Food that really went out
+static int32_t cutTick = -1;   // Steps until a reset or power cut
+
+static uint32_t randomBetween(uint32_t low, uint32_t high) {
+  return std::uniform_int_distribution<uint32_t>(low, high)(rng);
+}
+
+static void step() {
+  delay(TICK_MS);
+  if (cutTick >= 0 && cutTick-- == 0) throw SimPowerCut();
+}
+
+static void runSession(float target) {
+  feedJournalStart(target, 3.0f, true, 0);
+  journalHistory.push_back(feedJournal);
+  step();
+
+  for (float grams = 1; grams <= target; grams++) {
+    actualGrams = grams;
+    uint32_t writes = feedJournalFlashWrites;
+    feedJournalCheckpoint(grams);
+    if (feedJournalFlashWrites != writes) journalHistory.push_back(feedJournal);
+    step();
+  }
+
+  feedJournalEnd(target);
+  journalHistory.push_back(feedJournal);
+  step();
+
+  neighbour.magic = NEIGHBOUR_MAGIC;
+  neighbour.value = ++neighbourValue;
+  persistSave(EEPROM_HOPPER_ADDR, neighbour);
+  step();
+}
+
+static void reboot(bool loseRtc) {
+  EEPROM.simDisarmCut();
+  EEPROM.simReboot();
+  if (loseRtc) ESP.simLoseRtc();
+  simSetMillis(0);
+
+  persistStarted = false;
+  feedJournalLoaded = false;
+  feedJournalLostPending = false;
+  feedJournalCredit = 0;
+  memset(&feedJournal, 0, sizeof(feedJournal));
+  memset(&feedJournalLost, 0, sizeof(feedJournalLost));
+  feedJournalFlashedAt = 0;
+  feedJournalFlashedGrams = 0;
+}
+
+// Flash can only hold one of the last few records committed
+static bool inHistory(const FeedJournalRecord& record) {
+  size_t oldest = journalHistory.size() > 64 ? journalHistory.size() - 64 : 0;
+  for (size_t i = journalHistory.size(); i-- > oldest;) {
+    if (memcmp(&journalHistory[i], &record, sizeof(record)) == 0) return true;
+  }
+  return false;
+}
+
+/**
+ * One session with a random cut, then the boot reconcile
+ */
+static void cutSession() {
+  CutKind kind = (CutKind)randomBetween(CUT_NONE, CUT_COMMIT);
+  float target = (float)randomBetween(10, 40);
+  cutTick = -1;
+
+  // Start, 2-6 journal writes and the neighbour: up to 7 commits
+  if (kind == CUT_COMMIT) {
+    EEPROM.simArmCut(randomBetween(1, 7),
+                     randomBetween(0, PERSIST_EEPROM_SIZE));
+  } else if (kind != CUT_NONE) {
+    cutTick = randomBetween(0, (uint32_t)target + 3);
+  }
+
+  bool cut = false;
+  actualGrams = 0;
+  try {
+    runSession(target);
+  } catch (const SimPowerCut&) {
+    cut = true;
+    journalHistory.push_back(feedJournal);  // Possibly torn
+  }
+  outcomes.sessions++;
+
+  bool sessionOpen = feedJournalActive();
+  bool torn = cut && kind == CUT_COMMIT;
+  if (!cut) {
+    // Armed commit never came; end the idle period with a reset
+    kind = CUT_RESET;
+    outcomes.clean++;
+  }
+  if (torn) outcomes.tornCommits++;
+
+  reboot(kind != CUT_RESET);
+  bool found = feedJournalReconcile();
+  if (found) journalHistory.push_back(feedJournal);  // Closed and flashed
+
+  // A torn sector is never taken for a record
+  FeedJournalRecord flash;
+  if (persistLoad(EEPROM_JOURNAL_ADDR, flash)) {
+    TEST_ASSERT_TRUE(inHistory(flash));
+  }
+  NeighbourRecord stored;
+  if (!persistLoad(EEPROM_HOPPER_ADDR, stored) ||
+      stored.magic != NEIGHBOUR_MAGIC) {
+    outcomes.neighbourLost++;
+  } else {
+    TEST_ASSERT_LESS_OR_EQUAL(neighbourValue, stored.value);
+  }
+
+  if (!cut) return;
+
+  // The credit is the last checkpoint, never more than went out
+  TEST_ASSERT_LESS_OR_EQUAL(actualGrams, feedJournalCredit);
+  if (found) {
+    if (kind == CUT_RESET) {
+      outcomes.recoveredRtc++;
+      TEST_ASSERT_EQUAL_FLOAT(actualGrams, feedJournalCredit);
+    } else {
+      outcomes.recoveredFlash++;
+    }
+  } else if (sessionOpen) {
+    TEST_ASSERT_EQUAL(CUT_COMMIT, kind);
+    outcomes.lostOpen++;
+  }
+}
+
+static void report() {
+  char line[120];
+  snprintf(line, sizeof(line),
+           "%u sessions: %u clean, %u torn commits; open session recovered "
+           "%u (RTC) + %u (flash), lost %u",
+           (unsigned)outcomes.sessions, (unsigned)outcomes.clean,
+           (unsigned)outcomes.tornCommits, (unsigned)outcomes.recoveredRtc,
+           (unsigned)outcomes.recoveredFlash, (unsigned)outcomes.lostOpen);
+  TEST_MESSAGE(line);
+  snprintf(line, sizeof(line),
+           "boots with the neighbour record lost %u, commits per session %.1f",
+           (unsigned)outcomes.neighbourLost,
+           (float)EEPROM.commits / outcomes.sessions);
+  TEST_MESSAGE(line);
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_random_cuts_never_misread_the_journal() {
+  rng.seed(11);
+  reboot(true);
+  for (uint32_t i = 0; i < SESSIONS; i++) cutSession();
+  report();
+
+  TEST_ASSERT_GREATER_THAN(0, outcomes.recoveredRtc);
+  TEST_ASSERT_GREATER_THAN(0, outcomes.recoveredFlash);
+}
+
+void test_cut_inside_commit_loses_the_whole_sector() {
+  reboot(true);
+  neighbour.magic = NEIGHBOUR_MAGIC;
+  neighbour.value = 7;
+  persistSave(EEPROM_HOPPER_ADDR, neighbour);
+  feedJournalReconcile();
+
+  // Right after the erase of the journal's start commit
+  EEPROM.simArmCut(1, 0);
+  bool cut = false;
+  try {
+    feedJournalStart(20, 0, true, 0);
+  } catch (const SimPowerCut&) {
+    cut = true;
+  }
+  TEST_ASSERT_TRUE(cut);
+
+  reboot(true);
+  NeighbourRecord stored;
+  TEST_ASSERT_FALSE(persistLoad(EEPROM_HOPPER_ADDR, stored));
+  TEST_ASSERT_FALSE(feedJournalReconcile());
+  TEST_ASSERT_EQUAL(0, feedJournal.sequence);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_random_cuts_never_misread_the_journal);
+  RUN_TEST(test_cut_inside_commit_loses_the_whole_sector);
+  return UNITY_END();
+}
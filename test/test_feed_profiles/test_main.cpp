@@ -0,0 +1,429 @@
+// Feed profile learning against a simulated hopper. Each kibble model
+// has a known wide-open flow, fall time and load cell lag; its profile
+// starts from the compile-time priors and is trained by the feeds
+// themselves, driven the way the dispense loop drives them (flow control,
+// close at feedProfileCloseAt(), settle wait, re-weigh, re-open if short).
+// The hopper, hatch and scale are the ones of test_flow_control.
+//
+// After every feed the learned flow, fall time and settle time are
+// recorded. A parameter has converged by feed N when every later value
+// stays within a band around where it ends up, and the end value must be
+// the kibble's own. The fall time is checked on full on/off openings as
+// well: a tapered close leaves too little food in the air to pin it down.
+// Small portions that never open the hatch wide must leave the flow model
+// alone without its variance growing.
+
+#include <Arduino.h>
+#include <HX711.h>
+#include <Servo.h>
+#include <unity.h>
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <random>
+#include <vector>
+
+#include "helpers/feed_profiles.h"
+#include "helpers/flow_control.h"
+#include "helpers/hatch_calibration.h"
+
+Servo hatchServo;
+HX711 scale;
+
+static const uint32_t TICK_MS = 10;
+static const uint8_t AVERAGE = 3;  // Moving average of the dispense loop
+static const uint8_t FEEDS = 30;
+static const uint8_t CONVERGE_FEEDS = 5;  // Learning allowed this long
+static const uint8_t SETTLE_FEEDS = 10;   // One noisy reading per opening
+
+struct Kibble {
+  const char* name;
+  float full;    // Wide-open flow (g/s)
+  float noise;   // Chunk-to-chunk spread of the flow
+  float fall;    // Hatch to bowl (s)
+  float settle;  // Scale time constant (s)
+  float crack;   // Angle where food starts to pass
+  float gamma;   // Shape of the curve above it
+};
+
+static const Kibble KIBBLES[] = {
+    {"small dense", 14.0f, 0.15f, 0.35f, 0.15f, 150, 1.5f},
+    {"standard", 8.0f, 0.2f, 0.45f, 0.25f, 155, 1.3f},
+    {"large light", 4.0f, 0.25f, 0.5f, 0.4f, 145, 1.8f},
+    {"clumpy", 2.5f, 0.5f, 0.4f, 0.2f, 150, 1.2f},
+    {"damped scale", 10.0f, 0.2f, 0.5f, 0.6f, 150, 1.5f},
+};
+static const uint8_t KIBBLE_COUNT = sizeof(KIBBLES) / sizeof(KIBBLES[0]);
+
+struct Falling {
+  uint32_t landsAt;
+  float grams;
+};
+
+static struct {
+  Kibble kibble;
+  float angle;  // Where the hatch physically is
+  float chunk;  // Current flow multiplier
+  uint32_t chunkAt;
+  std::deque<Falling> air;
+  float bowl;   // Food that landed
+  float shown;  // What the load cell settled to so far
+} hopper;
+
+static std::mt19937 rng;
+
+static float gauss(float spread) {
+  return std::normal_distribution<float>(0, spread)(rng);
+}
+
+static float trueFraction(float angle, const Kibble& kibble) {
+  float o = (kibble.crack - angle) / (kibble.crack - SERVO_OPEN_ANGLE);
+  return powf(std::min(1.0f, std::max(0.0f, o)), kibble.gamma);
+}
+
+static float scaleReading() { return hopper.shown + gauss(0.1f); }
+
+static void hopperTick() {
+  delay(TICK_MS);
+  uint32_t now = millis();
+  const Kibble& kibble = hopper.kibble;
+
+  float reach = SERVO_MAX_RATE * TICK_MS / 1000.0f;
+  float error = hatchServo.angle - hopper.angle;
+  hopper.angle += std::max(-reach, std::min(reach, error));
+
+  if (now - hopper.chunkAt >= 100) {
+    hopper.chunkAt = now;
+    hopper.chunk = std::max(0.0f, 1 + gauss(kibble.noise));
+  }
+  float rate = kibble.full * trueFraction(hopper.angle, kibble) * hopper.chunk;
+  if (rate > 0) {
+    hopper.air.push_back({now + (uint32_t)(kibble.fall * 1000),
+                          rate * TICK_MS / 1000.0f});
+  }
+  while (!hopper.air.empty() && hopper.air.front().landsAt <= now) {
+    hopper.bowl += hopper.air.front().grams;
+    hopper.air.pop_front();
+  }
+  hopper.shown += (hopper.bowl - hopper.shown) *
+                  (1 - expf(-(TICK_MS / 1000.0f) / kibble.settle));
+
+  if (now % SERVO_TICK_INTERVAL == 0) hatchTick();
+}
+
+static void runFor(uint32_t ms) {
+  for (uint32_t end = millis() + ms; millis() < end;) hopperTick();
+}
+
+struct Feed {
+  float target;
+  float landed;     // Everything that reached the bowl
+  float seconds;    // Until the hatch was closed for good and weighed
+  uint8_t openings;
+};
+
+// Wait for the reading to stop moving, the way the dispense loop does
+static bool settleTime(uint32_t& settleMs) {
+  uint32_t expect = feedProfileSettleMs();
+  uint32_t closedAt = millis();
+  uint32_t stillSince = closedAt;
+  uint8_t stillReads = 0;
+  float last = scale.get_units(1);
+
+  while (millis() - closedAt < expect * 2) {
+    runFor(WEIGHT_READ_INTERVAL);
+    float weight = scale.get_units(1);
+    if (fabsf(weight - last) <= FEED_PROFILE_STILL_BAND) {
+      if (stillReads++ == 0) stillSince = millis() - WEIGHT_READ_INTERVAL;
+    } else {
+      stillReads = 0;
+    }
+    last = weight;
+    if (stillReads >= FEED_PROFILE_STILL_READS &&
+        millis() - closedAt >= expect / 2) {
+      settleMs = stillSince - closedAt;
+      return true;
+    }
+  }
+  return false;
+}
+
+static float settledWeight() {
+  float sum = 0;
+  for (uint8_t i = 0; i < 5; i++) {
+    runFor(100);
+    sum += scale.get_units(2);
+  }
+  return sum / 5;
+}
+
+static Feed feed(float target, bool tapered = true) {
+  hopper.bowl = hopper.shown = 0;
+  hopper.air.clear();
+
+  Feed result = {target, 0, 0, 0};
+  uint32_t start = millis();
+  float readings[AVERAGE] = {};
+  uint8_t index = 0;
+  float dispensed = 0;
+  float openingStart = 0;
+
+  flowEstimateStart();
+  while (result.openings <= FEED_RETRY_TIMEOUT) {
+    result.openings++;
+    if (tapered) {
+      flowControlStart(feedProfileFlow(), target - dispensed);
+    } else {
+      hatchJump(SERVO_OPEN_ANGLE);
+    }
+
+    float flowAtClose = 0;
+    while (millis() - start < FEED_TIMEOUT) {
+      runFor(WEIGHT_READ_INTERVAL);
+      readings[index] = scale.get_units(1);
+      index = (index + 1) % AVERAGE;
+      float sum = 0;
+      for (float reading : readings) sum += reading;
+      dispensed = std::max(0.0f, sum / AVERAGE);
+      flowObserve(dispensed);
+
+      float measuredFlow = flowRate();
+      flowAtClose = measuredFlow > 0 ? measuredFlow : flowControlExpected();
+      float closeAt = feedProfileCloseAt(target, flowAtClose);
+      if (dispensed >= closeAt) break;
+      if (tapered) flowControlUpdate(closeAt - dispensed, measuredFlow);
+    }
+
+    float fullFlow = 0;
+    if (tapered) {
+      fullFlow = flowControlStop();
+    } else {
+      hatchJump(SERVO_CLOSE_ANGLE);
+    }
+    float reading = dispensed - openingStart;
+
+    uint32_t settleMs = 0;
+    bool settled = settleTime(settleMs);
+    dispensed = std::max(0.0f, settledWeight());
+    for (float& slot : readings) slot = dispensed;
+
+    feedProfileObserveOpening(fullFlow, reading, dispensed - openingStart,
+                              flowAtClose);
+    if (settled) feedProfileObserveSettle(settleMs);
+
+    if (dispensed >= target * FEED_COMPLETE_FACTOR ||
+        millis() - start >= FEED_TIMEOUT) {
+      break;
+    }
+    openingStart = dispensed;
+  }
+  feedProfileFinishFeed();
+  result.seconds = (millis() - start) / 1000.0f;
+
+  // Whatever is still falling lands as well
+  runFor(3000);
+  result.landed = hopper.bowl;
+  return result;
+}
+
+struct Learned {
+  float flow;
+  float fall;
+  float settle;
+  float error;  // Relative portion error of the feed
+};
+
+enum Mode { TAPERED, ON_OFF };
+
+static std::vector<Learned> history[KIBBLE_COUNT][2];
+
+static void resetHopper(const Kibble& kibble) {
+  hopper.kibble = kibble;
+  hopper.angle = SERVO_CLOSE_ANGLE;
+  hopper.chunk = 1;
+  hopper.chunkAt = millis();
+  hatchServo.angle = SERVO_CLOSE_ANGLE;
+  hatchMotion.lastMs = millis();
+  scale.source = scaleReading;
+  scale.ready = true;
+
+  feedProfilesLoaded = false;
+  feedProfilesBegin();
+  feedProfileReset(feedProfiles.active);
+}
+
+static void learn(uint8_t k, Mode mode) {
+  resetHopper(KIBBLES[k]);
+  std::uniform_real_distribution<float> portion(30, FEED_WEIGHT);
+  for (uint8_t i = 0; i < FEEDS; i++) {
+    Feed result = feed(portion(rng), mode == TAPERED);
+    history[k][mode].push_back({feedProfileFlow(), feedProfileFallTime(),
+                                (float)feedProfileSettleMs(),
+                                (result.landed - result.target) /
+                                    result.target});
+  }
+}
+
+// Where a parameter ends up: the mean of the last few feeds
+static float settledValue(const std::vector<Learned>& feeds,
+                          float Learned::*member) {
+  float sum = 0;
+  for (uint8_t i = FEEDS - 5; i < FEEDS; i++) sum += feeds[i].*member;
+  return sum / 5;
+}
+
+// First feed from which on a parameter stays within a band of where it
+// ends up
+static uint8_t convergedBy(const std::vector<Learned>& feeds,
+                           float Learned::*member, float band) {
+  float end = settledValue(feeds, member);
+  uint8_t by = 0;
+  for (uint8_t i = 0; i < FEEDS; i++) {
+    if (fabsf(feeds[i].*member - end) > band * end) by = i + 1;
+  }
+  return by;
+}
+
+static float worstError(const std::vector<Learned>& feeds, uint8_t from) {
+  float worst = 0;
+  for (uint8_t i = from; i < FEEDS; i++) {
+    worst = std::max(worst, fabsf(feeds[i].error));
+  }
+  return worst;
+}
+
+static void report() {
+  char line[140];
+  for (uint8_t k = 0; k < KIBBLE_COUNT; k++) {
+    for (uint8_t mode = TAPERED; mode <= ON_OFF; mode++) {
+      const std::vector<Learned>& feeds = history[k][mode];
+      snprintf(line, sizeof(line),
+               "%-12s %-8s flow %.2f g/s by feed %u, fall %.2f s by %u, "
+               "settle %.0f ms by %u, worst error %.1f%% after %u",
+               KIBBLES[k].name, mode == TAPERED ? "tapered" : "on/off",
+               settledValue(feeds, &Learned::flow),
+               convergedBy(feeds, &Learned::flow, 0.1f),
+               settledValue(feeds, &Learned::fall),
+               convergedBy(feeds, &Learned::fall, 0.25f),
+               settledValue(feeds, &Learned::settle),
+               convergedBy(feeds, &Learned::settle, 0.25f),
+               100 * worstError(feeds, CONVERGE_FEEDS), CONVERGE_FEEDS);
+      TEST_MESSAGE(line);
+    }
+  }
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_flow_converges_to_the_kibble() {
+  for (uint8_t k = 0; k < KIBBLE_COUNT; k++) {
+    const Kibble& kibble = KIBBLES[k];
+    const std::vector<Learned>& feeds = history[k][TAPERED];
+    TEST_ASSERT_LESS_OR_EQUAL(CONVERGE_FEEDS,
+                              convergedBy(feeds, &Learned::flow, 0.1f));
+
+    // A slow load cell is still catching up with the ramp when the wide-open
+    // flow is measured, FLOW_MEASURE_DELAY after the hatch got there
+    float lag = expf(-(FLOW_MEASURE_DELAY / 1000.0f) / kibble.settle);
+    float flow = settledValue(feeds, &Learned::flow);
+    TEST_ASSERT_FLOAT_WITHIN((0.08f + lag) * kibble.full, kibble.full, flow);
+  }
+}
+
+void test_fall_time_converges_on_full_openings() {
+  for (uint8_t k = 0; k < KIBBLE_COUNT; k++) {
+    const Kibble& kibble = KIBBLES[k];
+    const std::vector<Learned>& feeds = history[k][ON_OFF];
+    // Every opening is one noisy reading of the fall time, and the
+    // forgetting factor keeps only the last ten or so
+    float band = 0.15f + kibble.noise / 2;
+    TEST_ASSERT_LESS_OR_EQUAL(CONVERGE_FEEDS,
+                              convergedBy(feeds, &Learned::fall, band));
+
+    // The reading trails the food by the fall, the moving average and the
+    // load cell lag
+    float fall = settledValue(feeds, &Learned::fall);
+    TEST_ASSERT_GREATER_THAN_FLOAT(kibble.fall, fall);
+    TEST_ASSERT_LESS_THAN_FLOAT(kibble.fall + kibble.settle + 0.3f, fall);
+  }
+}
+
+void test_tapered_feeds_stay_on_target() {
+  // Closing at a fifth of the flow leaves little food in the air, so the
+  // fall time is barely excited and may wander; the portions must not
+  for (uint8_t k = 0; k < KIBBLE_COUNT; k++) {
+    const Kibble& kibble = KIBBLES[k];
+    const std::vector<Learned>& feeds = history[k][TAPERED];
+    TEST_ASSERT_LESS_THAN_FLOAT(0.1f, worstError(feeds, CONVERGE_FEEDS));
+    for (uint8_t i = CONVERGE_FEEDS; i < FEEDS; i++) {
+      TEST_ASSERT_LESS_THAN_FLOAT(kibble.fall + kibble.settle + 0.3f,
+                                  feeds[i].fall);
+    }
+  }
+}
+
+void test_settle_time_converges() {
+  for (uint8_t k = 0; k < KIBBLE_COUNT; k++) {
+    const Kibble& kibble = KIBBLES[k];
+    for (uint8_t mode = TAPERED; mode <= ON_OFF; mode++) {
+      const std::vector<Learned>& feeds = history[k][mode];
+      TEST_ASSERT_LESS_OR_EQUAL(SETTLE_FEEDS,
+                                convergedBy(feeds, &Learned::settle, 0.25f));
+      float settle = settledValue(feeds, &Learned::settle);
+      TEST_ASSERT_LESS_THAN_FLOAT(1000 * (kibble.fall + 3 * kibble.settle),
+                                  settle);
+    }
+  }
+}
+
+void test_small_portions_leave_the_flow_model_alone() {
+  rng.seed(11);
+  resetHopper(KIBBLES[1]);
+  for (uint8_t i = 0; i < CONVERGE_FEEDS; i++) feed(FEED_WEIGHT);
+  FeedRls flow = feedProfileActive().flow;
+
+  // 5 g never asks for the full flow, so the hatch is never wide open
+  for (uint8_t i = 0; i < FEEDS; i++) feed(5.0f);
+  const FeedProfile& profile = feedProfileActive();
+  TEST_ASSERT_EQUAL_FLOAT(flow.theta, profile.flow.theta);
+  TEST_ASSERT_EQUAL_FLOAT(flow.p, profile.flow.p);
+  TEST_ASSERT_LESS_OR_EQUAL_FLOAT(profile.inFlight.pMax, profile.inFlight.p);
+  TEST_ASSERT_LESS_OR_EQUAL_FLOAT(profile.settle.pMax, profile.settle.p);
+}
+
+void test_rls_variance_stays_bounded() {
+  // Observations that carry no information (x = 0) or almost none divide
+  // the variance by the forgetting factor every time
+  FeedRls rls;
+  feedRlsInit(rls, FEED_PROFILE_FALL_TIME, FEED_PROFILE_FALL_VAR);
+  for (uint16_t i = 0; i < 1000; i++) {
+    feedRlsUpdate(rls, i % 2 ? 0.0f : 0.01f, 0.005f);
+    TEST_ASSERT_LESS_OR_EQUAL_FLOAT(rls.pMax, rls.p);
+  }
+  TEST_ASSERT_FLOAT_WITHIN(0.3f, FEED_PROFILE_FALL_TIME, rls.theta);
+
+  // And the model still follows the first real observations at once
+  for (uint8_t i = 0; i < 5; i++) feedRlsUpdate(rls, 3.0f, 3.0f * 0.5f);
+  TEST_ASSERT_FLOAT_WITHIN(0.02f, 0.5f, rls.theta);
+}
+
+int main() {
+  rng.seed(11);
+  simSetMillis(1000);
+  for (uint8_t k = 0; k < KIBBLE_COUNT; k++) {
+    learn(k, TAPERED);
+    learn(k, ON_OFF);
+  }
+  report();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_flow_converges_to_the_kibble);
+  RUN_TEST(test_fall_time_converges_on_full_openings);
+  RUN_TEST(test_tapered_feeds_stay_on_target);
+  RUN_TEST(test_settle_time_converges);
+  RUN_TEST(test_small_portions_leave_the_flow_model_alone);
+  RUN_TEST(test_rls_variance_stays_bounded);
+  return UNITY_END();
+}
@@ -0,0 +1,381 @@
+// Flow control against a simulated hopper with a lagging, non-linear
+// hatch, compared with an on/off hatch. No hatch calibration is stored, so
+// the controller maps openings to angles linearly from FLOW_CRACK_ANGLE
+// while the real hatch cracks elsewhere and grows as a power of the
+// opening:
+//
+//   flow(angle) = full * o^gamma,  o = (crack - angle) / (crack - open)
+//
+// Food comes out in chunks (the rate is redrawn every 100 ms), falls for a
+// while, and the scale follows the bowl with a first-order lag plus noise.
+// The servo turns at SERVO_MAX_RATE towards the planner's last write.
+//
+// Both modes are driven the way the dispense loop drives them: a 3-sample
+// moving average every WEIGHT_READ_INTERVAL, flowObserve(), and a close
+// once the reading reaches the feed profile's close point, then a re-weigh
+// and up to FEED_RETRY_TIMEOUT more openings. The on/off hatch opens wide
+// and closes at the same learned point. Each mode learns its own profile
+// over a few warm-up feeds, then feeds random portions.
+
+#include <Arduino.h>
+#include <HX711.h>
+#include <Servo.h>
+#include <unity.h>
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <random>
+#include <vector>
+
+#include "helpers/feed_profiles.h"
+#include "helpers/flow_control.h"
+#include "helpers/hatch_calibration.h"
+
+Servo hatchServo;
+HX711 scale;
+
+static const uint32_t TICK_MS = 10;
+static const uint8_t AVERAGE = 3;  // Moving average of the dispense loop
+static const uint8_t WARM_UP_FEEDS = 5;
+static const uint16_t FEEDS = 100;
+
+struct Kibble {
+  const char* name;
+  float full;    // Wide-open flow (g/s)
+  float noise;   // Chunk-to-chunk spread of the flow
+  float fall;    // Hatch to bowl (s)
+  float settle;  // Scale time constant (s)
+  float crack;   // Angle where food starts to pass
+  float gamma;   // Shape of the curve above it
+};
+
+static const Kibble KIBBLES[] = {
+    {"small dense", 14.0f, 0.15f, 0.35f, 0.15f, 150, 1.5f},
+    {"standard", 8.0f, 0.2f, 0.45f, 0.25f, 155, 1.3f},
+    {"large light", 4.0f, 0.25f, 0.5f, 0.4f, 145, 1.8f},
+    {"clumpy", 2.5f, 0.5f, 0.4f, 0.2f, 150, 1.2f},
+};
+static const uint8_t KIBBLE_COUNT = sizeof(KIBBLES) / sizeof(KIBBLES[0]);
+
+struct Falling {
+  uint32_t landsAt;
+  float grams;
+};
+
+static struct {
+  Kibble kibble;
+  float angle;  // Where the hatch physically is
+  float chunk;  // Current flow multiplier
+  uint32_t chunkAt;
+  std::deque<Falling> air;
+  float bowl;   // Food that landed
+  float shown;  // What the load cell settled to so far
+  float watch;  // Grams whose arrival is timed
+  uint32_t reachedAt;
+} hopper;
+
+static std::mt19937 rng;
+
+static float gauss(float spread) {
+  return std::normal_distribution<float>(0, spread)(rng);
+}
+
+static float trueFraction(float angle, const Kibble& kibble) {
+  float o = (kibble.crack - angle) / (kibble.crack - SERVO_OPEN_ANGLE);
+  return powf(std::min(1.0f, std::max(0.0f, o)), kibble.gamma);
+}
+
+static float scaleReading() { return hopper.shown + gauss(0.1f); }
+
+static void hopperTick() {
+  delay(TICK_MS);
+  uint32_t now = millis();
+  const Kibble& kibble = hopper.kibble;
+
+  float reach = SERVO_MAX_RATE * TICK_MS / 1000.0f;
+  float error = hatchServo.angle - hopper.angle;
+  hopper.angle += std::max(-reach, std::min(reach, error));
+
+  if (now - hopper.chunkAt >= 100) {
+    hopper.chunkAt = now;
+    hopper.chunk = std::max(0.0f, 1 + gauss(kibble.noise));
+  }
+  float rate = kibble.full * trueFraction(hopper.angle, kibble) * hopper.chunk;
+  if (rate > 0) {
+    hopper.air.push_back({now + (uint32_t)(kibble.fall * 1000),
+                          rate * TICK_MS / 1000.0f});
+  }
+  while (!hopper.air.empty() && hopper.air.front().landsAt <= now) {
+    hopper.bowl += hopper.air.front().grams;
+    hopper.air.pop_front();
+  }
+  if (hopper.reachedAt == 0 && hopper.bowl >= hopper.watch) {
+    hopper.reachedAt = now;
+  }
+  hopper.shown += (hopper.bowl - hopper.shown) *
+                  (1 - expf(-(TICK_MS / 1000.0f) / kibble.settle));
+
+  if (now % SERVO_TICK_INTERVAL == 0) hatchTick();
+}
+
+static void runFor(uint32_t ms) {
+  for (uint32_t end = millis() + ms; millis() < end;) hopperTick();
+}
+
+struct Feed {
+  float target;
+  float landed;     // Everything that reached the bowl
+  float toTargetS;  // Until FEED_COMPLETE_FACTOR of the target had landed
+  float seconds;    // Until the hatch was closed for good and weighed
+  uint8_t openings;
+};
+
+// Wait for the reading to stop moving, the way the dispense loop does
+static uint32_t settleTime() {
+  uint32_t expect = feedProfileSettleMs();
+  uint32_t closedAt = millis();
+  uint32_t stillSince = closedAt;
+  uint8_t stillReads = 0;
+  float last = scale.get_units(1);
+
+  while (millis() - closedAt < expect * 2) {
+    runFor(WEIGHT_READ_INTERVAL);
+    float weight = scale.get_units(1);
+    if (fabsf(weight - last) <= FEED_PROFILE_STILL_BAND) {
+      if (stillReads++ == 0) stillSince = millis() - WEIGHT_READ_INTERVAL;
+    } else {
+      stillReads = 0;
+    }
+    last = weight;
+    if (stillReads >= FEED_PROFILE_STILL_READS &&
+        millis() - closedAt >= expect / 2) {
+      return stillSince - closedAt;
+    }
+  }
+  return 0;
+}
+
+static float settledWeight() {
+  float sum = 0;
+  for (uint8_t i = 0; i < 5; i++) {
+    runFor(100);
+    sum += scale.get_units(2);
+  }
+  return sum / 5;
+}
+
+static Feed feed(float target, bool tapered) {
+  hopper.bowl = hopper.shown = 0;
+  hopper.air.clear();
+  hopper.watch = target * FEED_COMPLETE_FACTOR;
+  hopper.reachedAt = 0;
+
+  Feed result = {target, 0, 0, 0, 0};
+  uint32_t start = millis();
+  float readings[AVERAGE] = {};
+  uint8_t index = 0;
+  float dispensed = 0;
+  float openingStart = 0;
+
+  flowEstimateStart();
+  while (result.openings <= FEED_RETRY_TIMEOUT) {
+    result.openings++;
+    if (tapered) {
+      flowControlStart(feedProfileFlow(), target - dispensed);
+    } else {
+      hatchJump(SERVO_OPEN_ANGLE);
+    }
+
+    float flowAtClose = 0;
+    while (millis() - start < FEED_TIMEOUT) {
+      runFor(WEIGHT_READ_INTERVAL);
+      readings[index] = scale.get_units(1);
+      index = (index + 1) % AVERAGE;
+      float sum = 0;
+      for (float reading : readings) sum += reading;
+      dispensed = std::max(0.0f, sum / AVERAGE);
+      flowObserve(dispensed);
+
+      float measuredFlow = flowRate();
+      flowAtClose = measuredFlow > 0 ? measuredFlow : flowControlExpected();
+      float closeAt = feedProfileCloseAt(target, flowAtClose);
+      if (dispensed >= closeAt) break;
+      if (tapered) flowControlUpdate(closeAt - dispensed, measuredFlow);
+    }
+
+    float fullFlow = 0;
+    if (tapered) {
+      fullFlow = flowControlStop();
+    } else {
+      hatchJump(SERVO_CLOSE_ANGLE);
+    }
+    float reading = dispensed - openingStart;
+
+    uint32_t settleMs = settleTime();
+    dispensed = std::max(0.0f, settledWeight());
+    for (float& slot : readings) slot = dispensed;
+
+    feedProfileObserveOpening(fullFlow, reading, dispensed - openingStart,
+                              flowAtClose);
+    if (settleMs > 0) feedProfileObserveSettle(settleMs);
+
+    if (dispensed >= target * FEED_COMPLETE_FACTOR ||
+        millis() - start >= FEED_TIMEOUT) {
+      break;
+    }
+    openingStart = dispensed;
+  }
+  feedProfileFinishFeed();
+  result.seconds = (millis() - start) / 1000.0f;
+
+  // Whatever is still falling lands as well
+  runFor(3000);
+  result.landed = hopper.bowl;
+  result.toTargetS =
+      hopper.reachedAt ? (hopper.reachedAt - start) / 1000.0f : result.seconds;
+  return result;
+}
+
+struct Stats {
+  float overshootP50;  // Relative to the target, signed
+  float absErrorP95;   // Relative to the target
+  float worstOver;
+  float toTargetP50;   // Seconds per 50 g
+  float secondsP50;    // Whole feed, per 50 g
+  float openings;      // Mean per feed
+};
+
+static Stats stats[KIBBLE_COUNT][2];
+
+static float percentile(std::vector<float> values, float fraction) {
+  std::sort(values.begin(), values.end());
+  return values[(size_t)(fraction * (values.size() - 1))];
+}
+
+static Stats run(const Kibble& kibble, bool tapered) {
+  hopper.kibble = kibble;
+  hopper.angle = SERVO_CLOSE_ANGLE;
+  hopper.chunk = 1;
+  hopper.chunkAt = millis();
+  hatchServo.angle = SERVO_CLOSE_ANGLE;
+  hatchMotion.lastMs = millis();
+  scale.source = scaleReading;
+  scale.ready = true;
+
+  feedProfilesLoaded = false;
+  feedProfilesBegin();
+  feedProfileReset(feedProfiles.active);
+
+  for (uint8_t i = 0; i < WARM_UP_FEEDS; i++) feed(FEED_WEIGHT, tapered);
+
+  std::uniform_real_distribution<float> portion(15, FEED_WEIGHT);
+  std::vector<float> overshoot, absError, toTarget, seconds;
+  uint32_t openings = 0;
+  for (uint16_t i = 0; i < FEEDS; i++) {
+    Feed result = feed(portion(rng), tapered);
+    float error = (result.landed - result.target) / result.target;
+    overshoot.push_back(error);
+    absError.push_back(fabsf(error));
+    toTarget.push_back(result.toTargetS * 50 / result.target);
+    seconds.push_back(result.seconds * 50 / result.target);
+    openings += result.openings;
+  }
+
+  Stats result;
+  result.overshootP50 = percentile(overshoot, 0.5f);
+  result.absErrorP95 = percentile(absError, 0.95f);
+  result.worstOver = *std::max_element(overshoot.begin(), overshoot.end());
+  result.toTargetP50 = percentile(toTarget, 0.5f);
+  result.secondsP50 = percentile(seconds, 0.5f);
+  result.openings = (float)openings / FEEDS;
+  return result;
+}
+
+static void report() {
+  char line[120];
+  for (uint8_t i = 0; i < KIBBLE_COUNT; i++) {
+    for (uint8_t tapered = 0; tapered < 2; tapered++) {
+      const Stats& s = stats[i][tapered];
+      snprintf(line, sizeof(line),
+               "%-12s %-6s error p50 %+.1f%% p95 %.1f%% worst %+.1f%%, "
+               "to target %.1f s, feed %.1f s per 50 g, %.2f openings",
+               KIBBLES[i].name, tapered ? "PI" : "on/off",
+               100 * s.overshootP50, 100 * s.absErrorP95, 100 * s.worstOver,
+               s.toTargetP50, s.secondsP50, s.openings);
+      TEST_MESSAGE(line);
+    }
+  }
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_tapering_cuts_the_overshoot() {
+  for (uint8_t i = 0; i < KIBBLE_COUNT; i++) {
+    const Stats& onOff = stats[i][0];
+    const Stats& pi = stats[i][1];
+    TEST_ASSERT_LESS_THAN_FLOAT(onOff.overshootP50, pi.overshootP50);
+    TEST_ASSERT_LESS_THAN_FLOAT(onOff.absErrorP95, pi.absErrorP95);
+    TEST_ASSERT_LESS_THAN_FLOAT(0.08f, pi.absErrorP95);
+    TEST_ASSERT_LESS_THAN_FLOAT(0.15f, pi.worstOver);
+  }
+}
+
+void test_tapering_costs_little_time() {
+  for (uint8_t i = 0; i < KIBBLE_COUNT; i++) {
+    const Stats& onOff = stats[i][0];
+    const Stats& pi = stats[i][1];
+    // The taper only covers the last FLOW_APPROACH_TIME of the portion
+    TEST_ASSERT_LESS_THAN_FLOAT(onOff.toTargetP50 + 0.5f, pi.toTargetP50);
+    TEST_ASSERT_LESS_THAN_FLOAT(onOff.secondsP50 * 1.15f, pi.secondsP50);
+    TEST_ASSERT_LESS_OR_EQUAL_FLOAT(1.05f, pi.openings);
+  }
+}
+
+void test_controller_does_not_wind_up() {
+  rng.seed(11);
+  run(KIBBLES[1], true);
+
+  // A blocked hatch: no flow at all while 2.5 g/s is asked for. The output
+  // saturates and the integrator stops where it got there.
+  float remaining = 2.0f;
+  flowControlStart(feedProfileFlow(), remaining);
+  for (uint8_t i = 0; i < 50; i++) {
+    runFor(WEIGHT_READ_INTERVAL);
+    flowControlUpdate(remaining, 0);
+  }
+  float setpoint = flowSetpoint(remaining);
+  float error = setpoint / flowControl.fullFlow;
+  float saturatesAt = 1 - setpoint / flowControl.fullFlow - FLOW_KP * error;
+  TEST_ASSERT_EQUAL_FLOAT(1.0f, flowControl.opening);
+  TEST_ASSERT_LESS_OR_EQUAL_FLOAT(
+      saturatesAt + FLOW_KI * error * WEIGHT_READ_INTERVAL / 1000.0f,
+      flowControl.integral);
+
+  // Food bursts through at twice the setpoint: the hatch backs off at once
+  // instead of first unwinding 50 samples of integral
+  runFor(WEIGHT_READ_INTERVAL);
+  flowControlUpdate(remaining, 2 * setpoint);
+  TEST_ASSERT_LESS_THAN_FLOAT(1.0f, flowControl.opening);
+
+  flowControlStop();
+  TEST_ASSERT_EQUAL_FLOAT(SERVO_CLOSE_ANGLE, hatchMotion.target);
+}
+
+int main() {
+  rng.seed(11);
+  simSetMillis(1000);
+  for (uint8_t i = 0; i < KIBBLE_COUNT; i++) {
+    for (uint8_t tapered = 0; tapered < 2; tapered++) {
+      stats[i][tapered] = run(KIBBLES[i], tapered);
+    }
+  }
+  report();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_tapering_cuts_the_overshoot);
+  RUN_TEST(test_tapering_costs_little_time);
+  RUN_TEST(test_controller_does_not_wind_up);
+  return UNITY_END();
+}
@@ -0,0 +1,286 @@
+// Hatch calibration against a simulated hopper with a known flow curve.
+// The hatch passes no food until it opens past a crack angle; beyond it
+// the flow grows as a power of the opening:
+//
+//   flow(angle) = full * o^gamma,  o = (crack - angle) / (crack - open)
+//
+// Food comes out in chunks (the rate is redrawn every 100 ms), takes a
+// while to fall into the bowl, and the scale reading follows the bowl
+// with a first-order lag plus noise. The servo turns at SERVO_MAX_RATE
+// towards whatever the planner last wrote. The routine runs the way the
+// calibration task drives it, one hatchCalStep() per WEIGHT_READ_INTERVAL,
+// and the table it saves is compared with the true curve.
+
+#include <Arduino.h>
+#include <HX711.h>
+#include <Servo.h>
+#include <unity.h>
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <random>
+
+#include "helpers/hatch_calibration.h"
+
+Servo hatchServo;
+HX711 scale;
+
+static const uint32_t TICK_MS = 10;
+
+struct Kibble {
+  const char* name;
+  float full;       // Wide-open flow (g/s)
+  float noise;      // Chunk-to-chunk spread of the flow
+  float fall;       // Hatch to bowl (s)
+  float settle;     // Scale time constant (s)
+  float crack;      // Angle where food starts to pass
+  float gamma;      // Shape of the curve above it
+};
+
+static const Kibble KIBBLES[] = {
+    {"small dense", 14.0f, 0.15f, 0.35f, 0.15f, 150, 1.5f},
+    {"standard", 8.0f, 0.2f, 0.45f, 0.25f, 155, 1.3f},
+    {"large light", 4.0f, 0.25f, 0.5f, 0.4f, 145, 1.8f},
+    {"clumpy", 2.5f, 0.5f, 0.4f, 0.2f, 150, 1.2f},
+};
+static const uint8_t KIBBLE_COUNT = sizeof(KIBBLES) / sizeof(KIBBLES[0]);
+
+struct Falling {
+  uint32_t landsAt;
+  float grams;
+};
+
+static struct {
+  Kibble kibble;
+  float angle;   // Where the hatch physically is
+  float chunk;   // Current flow multiplier
+  uint32_t chunkAt;
+  std::deque<Falling> air;
+  float bowl;    // Food that landed
+  float shown;   // What the load cell settled to so far
+} hopper;
+
+static std::mt19937 rng;
+
+static float gauss(float spread) {
+  return std::normal_distribution<float>(0, spread)(rng);
+}
+
+// True flow at an angle, as a fraction of the wide-open flow
+static float trueFraction(float angle, const Kibble& kibble) {
+  float o = (kibble.crack - angle) / (kibble.crack - SERVO_OPEN_ANGLE);
+  return powf(std::min(1.0f, std::max(0.0f, o)), kibble.gamma);
+}
+
+// Three standard deviations of a fitted flow: the fit at full flow
+// averages the chunks of HATCH_CAL_MEASURE_MS, or fewer once
+// HATCH_CAL_STEP_GRAMS fell
+static float tolerance(const Kibble& kibble) {
+  float fitMs = std::min((float)HATCH_CAL_MEASURE_MS,
+                         1000 * HATCH_CAL_STEP_GRAMS / kibble.full);
+  return 3 * kibble.noise / sqrtf(fitMs / 100);
+}
+
+static float scaleReading() { return hopper.shown + gauss(0.1f); }
+
+static void resetHopper(const Kibble& kibble) {
+  hopper.kibble = kibble;
+  hopper.angle = SERVO_CLOSE_ANGLE;
+  hopper.chunk = 1;
+  hopper.chunkAt = millis();
+  hopper.air.clear();
+  hopper.bowl = hopper.shown = 0;
+  hatchServo.angle = SERVO_CLOSE_ANGLE;
+  scale.source = scaleReading;
+  scale.ready = true;
+}
+
+static void hopperTick() {
+  delay(TICK_MS);
+  uint32_t now = millis();
+  const Kibble& kibble = hopper.kibble;
+
+  float reach = SERVO_MAX_RATE * TICK_MS / 1000.0f;
+  float error = hatchServo.angle - hopper.angle;
+  hopper.angle += std::max(-reach, std::min(reach, error));
+
+  if (now - hopper.chunkAt >= 100) {
+    hopper.chunkAt = now;
+    hopper.chunk = std::max(0.0f, 1 + gauss(kibble.noise));
+  }
+  float rate = kibble.full * trueFraction(hopper.angle, kibble) * hopper.chunk;
+  if (rate > 0) {
+    hopper.air.push_back({now + (uint32_t)(kibble.fall * 1000),
+                          rate * TICK_MS / 1000.0f});
+  }
+  while (!hopper.air.empty() && hopper.air.front().landsAt <= now) {
+    hopper.bowl += hopper.air.front().grams;
+    hopper.air.pop_front();
+  }
+  hopper.shown += (hopper.bowl - hopper.shown) *
+                  (1 - expf(-(TICK_MS / 1000.0f) / kibble.settle));
+}
+
+// The calibration task and the servo task, on their own periods
+static void runCalibration() {
+  hatchCalState = HATCH_CAL_IDLE;
+  hatchMotion.lastMs = millis();
+  if (!hatchCalStart()) return;
+
+  while (hatchCalRunning()) {
+    hopperTick();
+    if (millis() % SERVO_TICK_INTERVAL == 0) hatchTick();
+    if (millis() % WEIGHT_READ_INTERVAL == 0) hatchCalStep();
+  }
+}
+
+struct Accuracy {
+  float pointError;   // Worst table point, fraction of full flow
+  float interpError;  // Worst interpolated fraction, 1 degree steps
+  float fullError;    // Wide-open flow, relative
+  float grams;        // Food used
+  float seconds;
+};
+
+static Accuracy accuracy[KIBBLE_COUNT];
+
+static Accuracy calibrate(const Kibble& kibble) {
+  resetHopper(kibble);
+  hatchCalLoaded = true;
+  hatchCalValid = false;
+  uint32_t start = millis();
+  runCalibration();
+
+  Accuracy result = {};
+  result.grams = hopper.bowl;
+  result.seconds = (millis() - start) / 1000.0f;
+  if (hatchCalState != HATCH_CAL_DONE) return result;
+
+  for (uint8_t i = 0; i < HATCH_CAL_POINTS; i++) {
+    float truth = kibble.full * trueFraction(hatchCal.angle[i], kibble);
+    result.pointError = std::max(
+        result.pointError, fabsf(hatchCal.flow[i] - truth) / kibble.full);
+  }
+  for (int angle = SERVO_OPEN_ANGLE; angle <= SERVO_CLOSE_ANGLE; angle++) {
+    float error = fabsf(hatchCalFraction(angle) -
+                        trueFraction(angle, kibble));
+    result.interpError = std::max(result.interpError, error);
+  }
+  result.fullError =
+      fabsf(hatchCal.flow[HATCH_CAL_POINTS - 1] - kibble.full) / kibble.full;
+  return result;
+}
+
+static void report() {
+  char line[120];
+  for (uint8_t i = 0; i < KIBBLE_COUNT; i++) {
+    const Accuracy& result = accuracy[i];
+    snprintf(line, sizeof(line),
+             "%-12s error: point %.1f%%, interpolated %.1f%%, full flow "
+             "%.1f%%; %.0f g in %.0f s",
+             KIBBLES[i].name, 100 * result.pointError,
+             100 * result.interpError, 100 * result.fullError, result.grams,
+             result.seconds);
+    TEST_MESSAGE(line);
+  }
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_table_follows_the_flow_curve() {
+  for (uint8_t i = 0; i < KIBBLE_COUNT; i++) {
+    TEST_ASSERT_GREATER_THAN_FLOAT(0, accuracy[i].seconds);
+    // Interpolation adds a little between points of a curved flow
+    float allowed = tolerance(KIBBLES[i]);
+    TEST_ASSERT_LESS_THAN_FLOAT(allowed, accuracy[i].pointError);
+    TEST_ASSERT_LESS_THAN_FLOAT(allowed + 0.03f, accuracy[i].interpError);
+    TEST_ASSERT_LESS_THAN_FLOAT(allowed, accuracy[i].fullError);
+    TEST_ASSERT_LESS_THAN_FLOAT(HATCH_CAL_MAX_GRAMS, accuracy[i].grams);
+  }
+}
+
+void test_table_is_monotone_and_survives_a_reboot() {
+  rng.seed(11);
+  calibrate(KIBBLES[1]);
+  TEST_ASSERT_EQUAL(HATCH_CAL_DONE, hatchCalState);
+  for (uint8_t i = 1; i < HATCH_CAL_POINTS; i++) {
+    TEST_ASSERT_TRUE(hatchCal.flow[i] >= hatchCal.flow[i - 1]);
+  }
+  TEST_ASSERT_EQUAL_FLOAT(0, hatchCal.flow[0]);
+  TEST_ASSERT_EQUAL(SERVO_CLOSE_ANGLE, hatchMotion.target);
+
+  HatchCalStore saved = hatchCal;
+  EEPROM.simReboot();
+  persistStarted = false;
+  memset(&hatchCal, 0, sizeof(hatchCal));
+  hatchCalLoaded = false;
+  hatchCalValid = false;
+  TEST_ASSERT_TRUE(hatchCalAvailable());
+  TEST_ASSERT_EQUAL_MEMORY(&saved, &hatchCal, sizeof(saved));
+}
+
+void test_inverse_lookup_matches_the_table() {
+  for (float fraction = 0.05f; fraction <= 1.0f; fraction += 0.05f) {
+    float angle = hatchCalAngleFor(fraction);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, fraction, hatchCalFraction(angle));
+  }
+}
+
+void test_overflowing_bowl_stops_and_keeps_the_old_table() {
+  rng.seed(11);
+  calibrate(KIBBLES[1]);
+  HatchCalStore before = hatchCal;
+
+  // A flood: full flow would need far more than the bowl takes
+  Kibble flood = {"flood", 150.0f, 0.2f, 0.3f, 0.2f, 170, 1.0f};
+  resetHopper(flood);
+  runCalibration();
+  TEST_ASSERT_EQUAL(HATCH_CAL_FAILED, hatchCalState);
+  TEST_ASSERT_EQUAL_STRING("bowl full", hatchCalError);
+  TEST_ASSERT_EQUAL(SERVO_CLOSE_ANGLE, hatchMotion.target);
+  TEST_ASSERT_EQUAL_MEMORY(&before, &hatchCal, sizeof(before));
+}
+
+void test_silent_scale_stops_the_routine() {
+  rng.seed(11);
+  resetHopper(KIBBLES[0]);
+  hatchCalState = HATCH_CAL_IDLE;
+  hatchMotion.lastMs = millis();
+  TEST_ASSERT_TRUE(hatchCalStart());
+
+  uint32_t silentAt = millis() + 3000;
+  while (hatchCalRunning()) {
+    hopperTick();
+    if (millis() == silentAt) scale.ready = false;
+    if (millis() % SERVO_TICK_INTERVAL == 0) hatchTick();
+    if (millis() % WEIGHT_READ_INTERVAL == 0) hatchCalStep();
+  }
+  TEST_ASSERT_EQUAL(HATCH_CAL_FAILED, hatchCalState);
+  TEST_ASSERT_EQUAL_STRING("scale stopped responding", hatchCalError);
+  TEST_ASSERT_LESS_OR_EQUAL(silentAt + HATCH_CAL_SCALE_WAIT +
+                                WEIGHT_READ_INTERVAL,
+                            millis());
+
+  // Not even started while the scale is down
+  TEST_ASSERT_FALSE(hatchCalStart());
+  TEST_ASSERT_EQUAL_STRING("scale not ready", hatchCalError);
+}
+
+int main() {
+  rng.seed(11);
+  simSetMillis(1000);
+  for (uint8_t i = 0; i < KIBBLE_COUNT; i++) {
+    accuracy[i] = calibrate(KIBBLES[i]);
+  }
+  report();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_table_follows_the_flow_curve);
+  RUN_TEST(test_table_is_monotone_and_survives_a_reboot);
+  RUN_TEST(test_inverse_lookup_matches_the_table);
+  RUN_TEST(test_overflowing_bowl_stops_and_keeps_the_old_table);
+  RUN_TEST(test_silent_scale_stops_the_routine);
+  return UNITY_END();
+}
@@ -0,0 +1,205 @@
+// Energy model of the idle manager. The firmware's task set after boot
+// (see setupTasks() in main.cpp) runs for a simulated day with the idle
+// hook installed and WiFi connected:
+//
+//   button, ui, wifi  parked, woken by their idle watches
+//   backlight         runs when the backlight timeout is up
+//   ntp               one exchange per NTP_UPDATE_INTERVAL, reply polled
+//   water             adaptive period from water_schedule.h
+//   history           bowl weight sample every TSDB_SAMPLE_INTERVAL
+//
+// Run costs are rough ESP8266 figures. A dozen button presses arrive at
+// random times, through the same interrupt path as on the device. The
+// result is compared with the old delay(10) loop, which woke 100 times a
+// second and never left modem sleep.
+
+#include <Arduino.h>
+#include <LiquidCrystal_I2C.h>
+#include <unity.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "helpers/idle_helpers.h"
+#include "helpers/ui_queue.h"
+#include "helpers/water_schedule.h"
+
+LiquidCrystal_I2C lcd(0x27, LCD_X, LCD_Y);
+
+static const uint32_t DAY_MS = 86400000UL;
+static const uint32_t START_MS = 1000;
+static const uint32_t BUSY_LOOP_WAKES_PER_HOUR = 3600000UL / 10;
+
+static int8_t buttonTaskId, uiTaskId, backlightTaskId, ntpTaskId;
+static int8_t waterTaskId, wifiTaskId;
+
+static std::vector<uint32_t> pressAt;  // Press times, released 150 ms later
+static size_t nextEdge = 0;            // Even = press, odd = release
+static uint32_t gestures = 0;
+static uint32_t backlightOnAt = 0;
+
+// The interrupt: a press or release whose time has come
+static void pressInterrupts() {
+  while (nextEdge < 2 * pressAt.size()) {
+    bool press = nextEdge % 2 == 0;
+    uint32_t at = pressAt[nextEdge / 2] + (press ? 0 : 150);
+    if (millis() < at) return;
+
+    simPinLevel[MANUAL_FEED_BUTTON_PIN] = press ? LOW : HIGH;
+    if (buttonWakeArmed) buttonRestoreEdgeIrq();
+    buttonFeedEdge(press, at);
+    nextEdge++;
+  }
+}
+
+static void buttonTask() {
+  delayMicroseconds(40);
+  buttonUpdate();
+
+  ButtonEvent event;
+  while (buttonPollEvent(event)) {
+    gestures++;
+    backlightOnAt = millis();
+    schedulerRunIn(backlightTaskId, LCD_BACKLIGHT_TIMEOUT);
+  }
+  schedulerRunIn(buttonTaskId,
+                 buttonBusy() ? BUTTON_POLL_INTERVAL : IDLE_PARK_INTERVAL);
+}
+
+static void uiTask() {
+  delayMicroseconds(30);
+  schedulerRunIn(uiTaskId, IDLE_PARK_INTERVAL);
+}
+
+static void backlightTask() {
+  delayMicroseconds(20);
+  uint32_t inactive = millis() - backlightOnAt;
+  schedulerRunIn(backlightTaskId, inactive >= LCD_BACKLIGHT_TIMEOUT
+                                      ? IDLE_PARK_INTERVAL
+                                      : LCD_BACKLIGHT_TIMEOUT - inactive);
+}
+
+// Send, then poll for the reply until it arrives ~40 ms later
+static void ntpTask() {
+  static uint32_t sentAt = 0;
+  delayMicroseconds(150);
+  if (sentAt == 0) {
+    sentAt = millis();
+    schedulerRunIn(ntpTaskId, NTP_RESPONSE_POLL);
+  } else if (millis() - sentAt < 40) {
+    schedulerRunIn(ntpTaskId, NTP_RESPONSE_POLL);
+  } else {
+    sentAt = 0;
+    schedulerRunIn(ntpTaskId, NTP_UPDATE_INTERVAL);
+  }
+}
+
+// Tank loses 0.2 cm/h, the pet drinks 1 cm at four times of the day
+static float tankHeight(uint32_t now) {
+  float hours = now / 3600000.0f;
+  float height = 10.0f - 0.2f * hours;
+  const float drinks[] = {7.5f, 12.2f, 18.1f, 21.7f};
+  for (float at : drinks) {
+    if (hours > at) height -= min((hours - at) * 12.0f, 1.0f);
+  }
+  return height;
+}
+
+static void waterTask() {
+  delayMicroseconds(30000);  // Ultrasonic ping and echo
+  schedulerRunIn(waterTaskId, waterTrendUpdate(tankHeight(millis()),
+                                               millis()));
+}
+
+static void wifiTask() {
+  delayMicroseconds(50);
+  schedulerRunIn(wifiTaskId, IDLE_PARK_INTERVAL);
+}
+
+static void historyTask() { delayMicroseconds(2000); }
+
+static void runDay() {
+  std::mt19937 rng(3);
+  for (uint8_t i = 0; i < 12; i++) {
+    pressAt.push_back(std::uniform_int_distribution<uint32_t>(
+        START_MS + 60000, DAY_MS - 60000)(rng));
+  }
+  std::sort(pressAt.begin(), pressAt.end());
+
+  simSetMillis(START_MS);
+  netSetWifi(true);
+
+  buttonTaskId = schedulerAddTask("button", buttonTask, BUTTON_POLL_INTERVAL,
+                                  TASK_PRIORITY_HIGH);
+  uiTaskId = schedulerAddTask("ui", uiTask, UI_UPDATE_INTERVAL);
+  backlightTaskId = schedulerAddTask("backlight", backlightTask,
+                                     BACKLIGHT_CHECK_INTERVAL,
+                                     TASK_PRIORITY_LOW);
+  ntpTaskId = schedulerAddTask("ntp", ntpTask, NTP_RESPONSE_POLL,
+                               TASK_PRIORITY_HIGH);
+  waterTaskId = schedulerAddTask("water", waterTask, WATER_CHECK_INTERVAL);
+  wifiTaskId = schedulerAddTask("wifi", wifiTask, WIFI_CHECK_INTERVAL,
+                                TASK_PRIORITY_LOW);
+  schedulerAddTask("history", historyTask, TSDB_SAMPLE_INTERVAL,
+                   TASK_PRIORITY_LOW);
+
+  idleWatch(buttonTaskId, []() -> uint32_t {
+    pressInterrupts();
+    return buttonEdgesPending() ? 0 : IDLE_NEVER;
+  });
+  idleWatch(uiTaskId, uiNextUpdateIn);
+  idleBegin();
+
+  while (millis() < START_MS + DAY_MS) {
+    schedulerRun();
+    schedulerIdle();
+  }
+}
+
+static void report() {
+  char line[120];
+  snprintf(line, sizeof(line),
+           "time: active %.2f%%, modem %.2f%%, light %.2f%%",
+           idlePercent(IDLE_ACTIVE), idlePercent(IDLE_MODEM),
+           idlePercent(IDLE_LIGHT));
+  TEST_MESSAGE(line);
+  snprintf(line, sizeof(line),
+           "average current %.2f mA (busy loop %.2f mA); wake-ups/h %u "
+           "(busy loop %u)",
+           idleAverageCurrent(), idleBusyLoopCurrent(),
+           (unsigned)idleWakesPerHour(), (unsigned)BUSY_LOOP_WAKES_PER_HOUR);
+  TEST_MESSAGE(line);
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_idle_time_is_mostly_light_sleep() {
+  TEST_ASSERT_GREATER_THAN(90.0f, idlePercent(IDLE_LIGHT));
+}
+
+void test_average_current_is_far_below_the_busy_loop() {
+  TEST_ASSERT_LESS_THAN(idleBusyLoopCurrent() / 3, idleAverageCurrent());
+}
+
+void test_wake_ups_drop_by_two_orders_of_magnitude() {
+  TEST_ASSERT_LESS_THAN(BUSY_LOOP_WAKES_PER_HOUR / 100, idleWakesPerHour());
+}
+
+void test_every_press_wakes_the_button_task() {
+  TEST_ASSERT_EQUAL_UINT32(pressAt.size(), gestures);
+  TEST_ASSERT_GREATER_OR_EQUAL(pressAt.size(), idleEarlyWakes);
+}
+
+int main() {
+  runDay();
+  report();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_idle_time_is_mostly_light_sleep);
+  RUN_TEST(test_average_current_is_far_below_the_busy_loop);
+  RUN_TEST(test_wake_ups_drop_by_two_orders_of_magnitude);
+  RUN_TEST(test_every_press_wakes_the_button_task);
+  return UNITY_END();
+}
@@ -0,0 +1,455 @@
+// Jam detection and recovery against a simulated hopper that bridges. The
+// hopper, hatch and scale are the ones of test_flow_control; feeds are
+// driven the way dispenseFoodWithFeedback drives them (flow control,
+// jamCheck on every weight sample while not pre-closed, the wiggle from
+// jamRecoveryUpdate, re-weigh and re-open if short).
+//
+// A bridge forms once the hatch has been open for a scripted time and
+// stops the flow at once; food already in the air still lands. It breaks
+// the first time the hatch swings at least its strength towards closed,
+// so a bridge of strength s needs at most ceil(s / JAM_WIGGLE_ANGLE)
+// attempts, and one stronger than JAM_MAX_ATTEMPTS swings never breaks.
+//
+// Clean feeds of every kibble, down to a slow one that trickles at a
+// little over 1 g/s, must never trip the detector, from the compile-time
+// priors on.
+
+#include <Arduino.h>
+#include <HX711.h>
+#include <Servo.h>
+#include <unity.h>
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <random>
+#include <vector>
+
+#include "helpers/feed_profiles.h"
+#include "helpers/flow_control.h"
+#include "helpers/hatch_calibration.h"
+#include "helpers/jam_detector.h"
+
+Servo hatchServo;
+HX711 scale;
+
+static const uint32_t TICK_MS = 10;
+static const uint8_t AVERAGE = 3;  // Moving average of the dispense loop
+static const uint8_t CLEAN_FEEDS = 40;
+static const uint8_t BRIDGED_FEEDS = 40;
+static const float NEVER = 1000;  // Bridge strength no wiggle reaches
+
+struct Kibble {
+  const char* name;
+  float full;    // Wide-open flow (g/s)
+  float noise;   // Chunk-to-chunk spread of the flow
+  float fall;    // Hatch to bowl (s)
+  float settle;  // Scale time constant (s)
+  float crack;   // Angle where food starts to pass
+  float gamma;   // Shape of the curve above it
+};
+
+static const Kibble KIBBLES[] = {
+    {"small dense", 14.0f, 0.15f, 0.35f, 0.15f, 150, 1.5f},
+    {"standard", 8.0f, 0.2f, 0.45f, 0.25f, 155, 1.3f},
+    {"large light", 4.0f, 0.25f, 0.5f, 0.4f, 145, 1.8f},
+    {"clumpy", 2.5f, 0.5f, 0.4f, 0.2f, 150, 1.2f},
+    {"slow", 1.2f, 0.4f, 0.5f, 0.3f, 150, 1.5f},
+};
+static const uint8_t KIBBLE_COUNT = sizeof(KIBBLES) / sizeof(KIBBLES[0]);
+
+// Bridge strengths, degrees towards closed
+static const float STRENGTHS[] = {20, 50, 80, NEVER};
+static const uint8_t STRENGTH_COUNT = sizeof(STRENGTHS) / sizeof(STRENGTHS[0]);
+
+struct Falling {
+  uint32_t landsAt;
+  float grams;
+};
+
+static struct {
+  Kibble kibble;
+  float angle;  // Where the hatch physically is
+  float chunk;  // Current flow multiplier
+  uint32_t chunkAt;
+  std::deque<Falling> air;
+  float bowl;   // Food that landed
+  float shown;  // What the load cell settled to so far
+
+  uint32_t openMs;     // Time the hatch passed food in this feed
+  uint32_t bridgeAt;   // openMs when the bridge forms (0 = none)
+  float strength;      // Swing towards closed that breaks it
+  uint32_t bridgedAt;  // millis() it formed (0 = not yet)
+  uint32_t brokeAt;    // millis() it broke (0 = not yet)
+  float swingFrom;     // Most open angle since it formed
+} hopper;
+
+static std::mt19937 rng;
+
+static float uniform() {
+  return std::uniform_real_distribution<float>(0, 1)(rng);
+}
+
+static float gauss(float spread) {
+  return std::normal_distribution<float>(0, spread)(rng);
+}
+
+static float trueFraction(float angle, const Kibble& kibble) {
+  float o = (kibble.crack - angle) / (kibble.crack - SERVO_OPEN_ANGLE);
+  return powf(std::min(1.0f, std::max(0.0f, o)), kibble.gamma);
+}
+
+static float scaleReading() { return hopper.shown + gauss(0.1f); }
+
+static bool bridged() { return hopper.bridgedAt && !hopper.brokeAt; }
+
+static void bridgeTick(uint32_t now, float fraction) {
+  if (fraction > 0) hopper.openMs += TICK_MS;
+  if (hopper.bridgeAt && !hopper.bridgedAt &&
+      hopper.openMs >= hopper.bridgeAt) {
+    hopper.bridgedAt = now;
+    hopper.swingFrom = hopper.angle;
+  }
+  if (!bridged()) return;
+
+  hopper.swingFrom = std::min(hopper.swingFrom, hopper.angle);
+  if (hopper.angle - hopper.swingFrom >= hopper.strength) {
+    hopper.brokeAt = now;
+  }
+}
+
+static void hopperTick() {
+  delay(TICK_MS);
+  uint32_t now = millis();
+  const Kibble& kibble = hopper.kibble;
+
+  float reach = SERVO_MAX_RATE * TICK_MS / 1000.0f;
+  float error = hatchServo.angle - hopper.angle;
+  hopper.angle += std::max(-reach, std::min(reach, error));
+
+  if (now - hopper.chunkAt >= 100) {
+    hopper.chunkAt = now;
+    hopper.chunk = std::max(0.0f, 1 + gauss(kibble.noise));
+  }
+  float fraction = trueFraction(hopper.angle, kibble);
+  bridgeTick(now, fraction);
+  float rate = bridged() ? 0 : kibble.full * fraction * hopper.chunk;
+  if (rate > 0) {
+    hopper.air.push_back({now + (uint32_t)(kibble.fall * 1000),
+                          rate * TICK_MS / 1000.0f});
+  }
+  while (!hopper.air.empty() && hopper.air.front().landsAt <= now) {
+    hopper.bowl += hopper.air.front().grams;
+    hopper.air.pop_front();
+  }
+  hopper.shown += (hopper.bowl - hopper.shown) *
+                  (1 - expf(-(TICK_MS / 1000.0f) / kibble.settle));
+
+  if (now % SERVO_TICK_INTERVAL == 0) hatchTick();
+}
+
+static void runFor(uint32_t ms) {
+  for (uint32_t end = millis() + ms; millis() < end;) hopperTick();
+}
+
+static float settledWeight() {
+  float sum = 0;
+  for (uint8_t i = 0; i < 5; i++) {
+    runFor(100);
+    sum += scale.get_units(2);
+  }
+  return sum / 5;
+}
+
+struct Feed {
+  float target;
+  float landed;
+  float strength;      // Of its bridge, 0 = clean
+  bool bridged;        // The bridge formed before the hatch closed
+  uint8_t trips;       // jamCheck() detections
+  uint32_t detectMs;   // Bridge to first detection (0 = not detected)
+  uint32_t stalledMs;  // No-progress time the detector reported
+  uint32_t recoverMs;  // Detection to resumed flow, as reported
+  uint32_t brokeMs;    // Bridge to its breaking (0 = never)
+  uint32_t gaveUpMs;   // Bridge to the feed giving up
+  uint8_t attempts;
+  bool gaveUp;
+};
+
+// The dispense loop, one pass per TICK_MS
+static Feed feed(float target, float strength) {
+  hopper.bowl = hopper.shown = 0;
+  hopper.air.clear();
+  hopper.openMs = hopper.bridgedAt = hopper.brokeAt = 0;
+  hopper.strength = strength;
+  hopper.bridgeAt = 0;
+  if (strength > 0) {
+    // Somewhere in the wide-open part of the feed
+    float openS = target / hopper.kibble.full;
+    hopper.bridgeAt = (uint32_t)(1000 * (0.3f + 0.5f * openS * uniform()));
+  }
+
+  Feed result = {target, 0, strength};
+  uint32_t start = millis();
+  float readings[AVERAGE] = {};
+  uint8_t index = 0;
+  float dispensed = 0;
+  float openingStart = 0;
+  uint8_t retries = 0;
+
+  flowEstimateStart();
+  flowControlStart(feedProfileFlow(), target);
+  jamStart();
+  while (millis() - start < FEED_TIMEOUT) {
+    hopperTick();
+    if (jamRecoveryUpdate()) {
+      flowControlStart(feedProfileFlow(), target - dispensed);
+      jamRearm(dispensed);
+    }
+    if (millis() % WEIGHT_READ_INTERVAL != 0) continue;
+
+    readings[index] = scale.get_units(1);
+    index = (index + 1) % AVERAGE;
+    float sum = 0;
+    for (float reading : readings) sum += reading;
+    dispensed = std::max(0.0f, sum / AVERAGE);
+    flowObserve(dispensed);
+
+    float measuredFlow = flowRate();
+    float flowAtClose =
+        measuredFlow > 0 ? measuredFlow : flowControlExpected();
+    float closeAt = feedProfileCloseAt(target, flowAtClose);
+    if (!jamRecovering()) {
+      flowControlUpdate(closeAt - dispensed, measuredFlow);
+      if (jamCheck(dispensed)) {
+        result.trips++;
+        if (!result.detectMs && hopper.bridgedAt) {
+          result.detectMs = millis() - hopper.bridgedAt;
+        }
+      }
+    }
+    if (jamReportDue()) {
+      result.stalledMs = jam.detectMs;
+      result.recoverMs = jam.recoverMs;
+      jamReported();
+    }
+    if (jamGaveUp()) {
+      result.gaveUp = true;
+      result.gaveUpMs = millis() - hopper.bridgedAt;
+      break;
+    }
+    if (dispensed < closeAt) continue;
+
+    float fullFlow = flowControlStop();
+    jamStop();
+    float reading = dispensed - openingStart;
+    runFor(feedProfileSettleMs());
+    dispensed = std::max(0.0f, settledWeight());
+    for (float& slot : readings) slot = dispensed;
+    feedProfileObserveOpening(fullFlow, reading, dispensed - openingStart,
+                              flowAtClose);
+
+    if (dispensed >= target * FEED_COMPLETE_FACTOR ||
+        retries >= FEED_RETRY_TIMEOUT) {
+      break;
+    }
+    retries++;
+    openingStart = dispensed;
+    flowControlStart(feedProfileFlow(), target - dispensed);
+    jamRearm(dispensed);
+  }
+  flowControlStop();
+  hatchJump(SERVO_CLOSE_ANGLE);
+  jamStop();
+  feedProfileFinishFeed();
+  result.attempts = jam.attempts;
+  result.bridged = hopper.bridgedAt != 0;
+  if (hopper.brokeAt) result.brokeMs = hopper.brokeAt - hopper.bridgedAt;
+
+  runFor(3000);
+  result.landed = hopper.bowl;
+  return result;
+}
+
+static void resetHopper(const Kibble& kibble) {
+  hopper.kibble = kibble;
+  hopper.angle = SERVO_CLOSE_ANGLE;
+  hopper.chunk = 1;
+  hopper.chunkAt = millis();
+  hatchServo.angle = SERVO_CLOSE_ANGLE;
+  hatchMotion.lastMs = millis();
+  scale.source = scaleReading;
+  scale.ready = true;
+
+  feedProfilesLoaded = false;
+  feedProfilesBegin();
+  feedProfileReset(feedProfiles.active);
+}
+
+static std::vector<Feed> clean[KIBBLE_COUNT];
+static std::vector<Feed> jammed[KIBBLE_COUNT];
+
+// Clean feeds first, from the priors, then bridged ones
+static void run(uint8_t k) {
+  resetHopper(KIBBLES[k]);
+  // Portions the kibble can deliver well within FEED_TIMEOUT
+  float most = std::min(FEED_WEIGHT,
+                        0.6f * KIBBLES[k].full * FEED_TIMEOUT / 1000);
+  std::uniform_real_distribution<float> portion(15, most);
+  for (uint8_t i = 0; i < CLEAN_FEEDS; i++) {
+    clean[k].push_back(feed(portion(rng), 0));
+  }
+  for (uint8_t i = 0; i < BRIDGED_FEEDS; i++) {
+    Feed result = feed(portion(rng), STRENGTHS[i % STRENGTH_COUNT]);
+    if (result.bridged) jammed[k].push_back(result);
+  }
+}
+
+// Attempts a bridge of this strength needs
+static uint8_t attemptsFor(float strength) {
+  return (uint8_t)ceilf(strength / JAM_WIGGLE_ANGLE);
+}
+
+// Time the reading trails the food at the hatch: the fall, the load
+// cell and the moving average
+static uint32_t lagMs(const Kibble& kibble) {
+  return (uint32_t)(1000 * (kibble.fall + 3 * kibble.settle)) +
+         AVERAGE * WEIGHT_READ_INTERVAL;
+}
+
+// No-progress time before a stall counts: JAM_DETECT_MS, or longer until
+// JAM_EXPECTED_GRAMS should have fallen at the learned flow (a little
+// under the kibble's)
+static uint32_t stallMs(const Kibble& kibble) {
+  float expected = 1000 * JAM_EXPECTED_GRAMS / (0.9f * kibble.full);
+  return std::max((uint32_t)JAM_DETECT_MS, (uint32_t)expected) +
+         WEIGHT_READ_INTERVAL;
+}
+
+// Longest the detector may take after the bridge formed. Noise on the
+// tail of the lag can pass for one last JAM_PROGRESS_GRAMS and restart
+// the stall once.
+static uint32_t detectBound(const Kibble& kibble) {
+  return lagMs(kibble) + 2 * stallMs(kibble);
+}
+
+// One wiggle, and the wait after it until the next detection: the grace
+// (the learned fall time stands in for the lag) and the stall
+static uint32_t attemptMs(const Kibble& kibble) {
+  uint32_t wiggle = 2 * JAM_PULSES * (JAM_PULSE_MS + SERVO_TICK_INTERVAL);
+  return wiggle + JAM_GRACE_MS + lagMs(kibble) + stallMs(kibble);
+}
+
+// Longest a recovery may take: every attempt up to the one that breaks
+// the bridge, then JAM_PROGRESS_GRAMS has to reach the reading
+static uint32_t recoverBound(const Kibble& kibble, uint8_t attempts) {
+  return attempts * attemptMs(kibble) + lagMs(kibble) +
+         (uint32_t)(1000 * JAM_PROGRESS_GRAMS / kibble.full);
+}
+
+static uint32_t worst(const std::vector<Feed>& feeds, uint32_t Feed::*member) {
+  uint32_t value = 0;
+  for (const Feed& result : feeds) value = std::max(value, result.*member);
+  return value;
+}
+
+static void report() {
+  char line[160];
+  for (uint8_t k = 0; k < KIBBLE_COUNT; k++) {
+    uint32_t trips = 0;
+    for (const Feed& result : clean[k]) trips += result.trips;
+    uint32_t recovered = 0;
+    uint32_t gaveUp = 0;
+    for (const Feed& result : jammed[k]) {
+      if (result.recoverMs) recovered++;
+      if (result.gaveUp) gaveUp++;
+    }
+    snprintf(line, sizeof(line),
+             "%-11s clean: %u trips in %u feeds; bridged %u: detect <= %u "
+             "ms (bound %u), recovered %u in <= %u ms, gave up %u",
+             KIBBLES[k].name, (unsigned)trips, (unsigned)clean[k].size(),
+             (unsigned)jammed[k].size(),
+             (unsigned)worst(jammed[k], &Feed::detectMs),
+             (unsigned)detectBound(KIBBLES[k]),
+             (unsigned)recovered,
+             (unsigned)worst(jammed[k], &Feed::recoverMs), (unsigned)gaveUp);
+    TEST_MESSAGE(line);
+  }
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_clean_feeds_never_trip() {
+  for (uint8_t k = 0; k < KIBBLE_COUNT; k++) {
+    for (const Feed& result : clean[k]) {
+      TEST_ASSERT_EQUAL_UINT8(0, result.trips);
+      TEST_ASSERT_FALSE(result.gaveUp);
+    }
+  }
+}
+
+void test_every_bridge_is_detected_in_time() {
+  for (uint8_t k = 0; k < KIBBLE_COUNT; k++) {
+    TEST_ASSERT_GREATER_THAN(BRIDGED_FEEDS / 2, jammed[k].size());
+    for (const Feed& result : jammed[k]) {
+      // The taper's own moves towards closed may break a weak bridge
+      if (result.brokeMs && result.brokeMs < detectBound(KIBBLES[k])) {
+        continue;
+      }
+      TEST_ASSERT_GREATER_THAN_UINT32(0, result.detectMs);
+      TEST_ASSERT_LESS_OR_EQUAL_UINT32(detectBound(KIBBLES[k]),
+                                       result.detectMs);
+      // The detector does not trip before JAM_DETECT_MS without progress
+      TEST_ASSERT_GREATER_OR_EQUAL_UINT32(JAM_DETECT_MS, result.stalledMs);
+    }
+  }
+}
+
+void test_bridges_break_by_the_attempt_that_reaches_them() {
+  for (uint8_t k = 0; k < KIBBLE_COUNT; k++) {
+    for (const Feed& result : jammed[k]) {
+      if (result.strength == NEVER) continue;
+      if (!result.detectMs) continue;  // Broke before it was noticed
+      // The controller throttling the hatch swings it towards closed too
+      uint8_t attempts = attemptsFor(result.strength);
+      TEST_ASSERT_GREATER_THAN_UINT8(0, result.attempts);
+      TEST_ASSERT_LESS_OR_EQUAL_UINT8(attempts, result.attempts);
+      TEST_ASSERT_FALSE(result.gaveUp);
+      TEST_ASSERT_GREATER_THAN_UINT32(0, result.recoverMs);
+      TEST_ASSERT_LESS_OR_EQUAL_UINT32(recoverBound(KIBBLES[k], attempts),
+                                       result.recoverMs);
+      // Back on target once the flow resumed
+      TEST_ASSERT_GREATER_OR_EQUAL_FLOAT(
+          result.target * FEED_COMPLETE_FACTOR - 0.5f, result.landed);
+    }
+  }
+}
+
+void test_stuck_bridge_gives_up_early() {
+  for (uint8_t k = 0; k < KIBBLE_COUNT; k++) {
+    for (const Feed& result : jammed[k]) {
+      if (result.strength != NEVER) continue;
+      TEST_ASSERT_TRUE(result.gaveUp);
+      TEST_ASSERT_EQUAL_UINT8(JAM_MAX_ATTEMPTS, result.attempts);
+      TEST_ASSERT_EQUAL_UINT32(0, result.recoverMs);
+      TEST_ASSERT_LESS_OR_EQUAL_UINT32(
+          detectBound(KIBBLES[k]) + JAM_MAX_ATTEMPTS * attemptMs(KIBBLES[k]),
+          result.gaveUpMs);
+    }
+  }
+}
+
+int main() {
+  rng.seed(11);
+  simSetMillis(1000);
+  for (uint8_t k = 0; k < KIBBLE_COUNT; k++) run(k);
+  report();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_clean_feeds_never_trip);
+  RUN_TEST(test_every_bridge_is_detected_in_time);
+  RUN_TEST(test_bridges_break_by_the_attempt_that_reaches_them);
+  RUN_TEST(test_stuck_bridge_gives_up_early);
+  return UNITY_END();
+}
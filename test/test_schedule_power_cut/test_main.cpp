@@ -0,0 +1,350 @@
+// Power-cut tests for the schedule cursors. A simulated feeder runs for
+// weeks with three daily slots while the power dies at random points:
+// between checks, inside the cursor commit (after the sector erase, part
+// way through the write) and around the hatch opening. After every cut
+// the RTC memory is garbage, the outage lasts minutes to more than a day,
+// and the server pushes the schedule list again on boot. Whatever the cut
+// point and catch-up policy, no slot occurrence may be fed twice. The
+// portions the catch-up and top-up policies hand out are checked on their
+// own, including for a record written before the top-up policy existed.
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include <random>
+#include <vector>
+
+#include "helpers/schedule_helpers.h"
+
+LiquidCrystal_I2C lcd(0x27, LCD_X, LCD_Y);
+
+static const uint16_t SLOTS[] = {8 * 60, 12 * 60 + 30, 18 * 60};
+static const uint8_t SLOT_COUNT = sizeof(SLOTS) / sizeof(SLOTS[0]);
+static const uint32_t START_EPOCH = 19700UL * SECONDS_PER_DAY + 6 * 3600;
+static const uint32_t TICK_S = 30;
+
+enum FeedCut { FEED_CUT_NONE, FEED_CUT_BEFORE_HATCH, FEED_CUT_AFTER_HATCH };
+
+static uint32_t simEpoch = 0;
+static FeedCut feedCut = FEED_CUT_NONE;
+static std::vector<uint32_t> fedAt;  // Local epoch of every hatch opening
+static float fedGrams = 0;
+
+void feeding(bool, float grams) {
+  if (feedCut == FEED_CUT_BEFORE_HATCH) throw SimPowerCut();
+  fedAt.push_back(simEpoch);
+  fedGrams += grams;
+  if (feedCut == FEED_CUT_AFTER_HATCH) throw SimPowerCut();
+}
+
+bool sendLogEvent(const char*, const char*) { return true; }
+
+/**
+ * Lose everything a power cut loses: RAM state and RTC memory
+ */
+static void powerCycle() {
+  EEPROM.simDisarmCut();
+  EEPROM.simReboot();
+  ESP.simLoseRtc();
+  feedCut = FEED_CUT_NONE;
+
+  persistStarted = false;
+  scheduleStoreLoaded = false;
+  feedDeferralLoaded = false;
+  feedGateNextAt = 0;
+  feedGateAttempts = 0;
+}
+
+/**
+ * Boot as the firmware does once time is valid: the server pushes the
+ * schedule list, then the cursors are serviced
+ */
+static void boot() {
+  setSchedules(SLOTS, SLOT_COUNT, simEpoch);
+}
+
+/**
+ * Service the schedules once, surviving a cut
+ * @return true if the power was cut
+ */
+static bool tick() {
+  try {
+    serviceSchedules(simEpoch);
+  } catch (const SimPowerCut&) {
+    powerCycle();
+    return true;
+  }
+  return false;
+}
+
+/**
+ * Slot occurrence a feed at this time belongs to (the latest at or before)
+ */
+static uint32_t occurrenceOf(uint32_t epoch) {
+  uint32_t latest = 0;
+  for (uint8_t i = 0; i < SLOT_COUNT; i++) {
+    uint32_t occurrence = lastScheduleOccurrence(SLOTS[i], epoch);
+    if (occurrence > latest) latest = occurrence;
+  }
+  return latest;
+}
+
+/**
+ * Fail if two feeds answered the same slot occurrence
+ */
+static void assertNoDoubleFeed() {
+  for (size_t i = 1; i < fedAt.size(); i++) {
+    if (occurrenceOf(fedAt[i]) <= occurrenceOf(fedAt[i - 1])) {
+      char message[96];
+      snprintf(message, sizeof(message),
+               "Slot at %lu fed twice (feeds at %lu and %lu)",
+               (unsigned long)occurrenceOf(fedAt[i]),
+               (unsigned long)fedAt[i - 1], (unsigned long)fedAt[i]);
+      TEST_FAIL_MESSAGE(message);
+    }
+  }
+}
+
+/**
+ * Fresh device with an erased flash sector and the given policy
+ */
+static void factoryReset(uint8_t policy) {
+  memset(EEPROM.flash, 0xFF, sizeof(EEPROM.flash));
+  powerCycle();
+  fedAt.clear();
+  fedGrams = 0;
+  simEpoch = START_EPOCH;
+  boot();
+  setCatchUpPolicy(policy);
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_feeds_every_slot_without_cuts() {
+  factoryReset(CATCHUP_FEED_ONCE);
+  for (uint32_t day = 0; day < 7; day++) {
+    for (uint32_t s = 0; s < SECONDS_PER_DAY; s += TICK_S) {
+      simEpoch += TICK_S;
+      TEST_ASSERT_FALSE(tick());
+    }
+  }
+
+  TEST_ASSERT_EQUAL(7 * SLOT_COUNT, fedAt.size());
+  assertNoDoubleFeed();
+}
+
+void test_cut_at_every_byte_of_the_cursor_commit() {
+  for (size_t bytes = 0; bytes <= PERSIST_EEPROM_SIZE; bytes += 4) {
+    factoryReset(CATCHUP_FEED_ONCE);
+
+    // Run up to the 08:00 slot and die inside its cursor commit
+    simEpoch = lastScheduleOccurrence(SLOTS[0], START_EPOCH) +
+               SECONDS_PER_DAY - TICK_S;
+    TEST_ASSERT_FALSE(tick());
+    EEPROM.simArmCut(1, bytes);
+    simEpoch += TICK_S;
+    TEST_ASSERT_TRUE(tick());
+
+    // Back a minute later, inside the due window, then on until 12:30
+    simEpoch += 60;
+    boot();
+    while (simEpoch < occurrenceOf(simEpoch) + 4 * 3600) {
+      simEpoch += TICK_S;
+      TEST_ASSERT_FALSE(tick());
+    }
+
+    TEST_ASSERT_LESS_OR_EQUAL(2, fedAt.size());
+    assertNoDoubleFeed();
+  }
+}
+
+void test_cut_around_the_hatch_is_not_repeated() {
+  const FeedCut cuts[] = {FEED_CUT_BEFORE_HATCH, FEED_CUT_AFTER_HATCH};
+  for (FeedCut cut : cuts) {
+    factoryReset(CATCHUP_FEED_ONCE);
+    simEpoch = lastScheduleOccurrence(SLOTS[0], START_EPOCH) +
+               SECONDS_PER_DAY;
+    feedCut = cut;
+    TEST_ASSERT_TRUE(tick());
+
+    // Rebooted well inside the due window: the cursor is already durable
+    simEpoch += 30;
+    boot();
+    for (uint32_t s = 0; s < SCHEDULE_DUE_WINDOW + 600; s += TICK_S) {
+      simEpoch += TICK_S;
+      TEST_ASSERT_FALSE(tick());
+    }
+
+    TEST_ASSERT_EQUAL(cut == FEED_CUT_AFTER_HATCH ? 1 : 0, fedAt.size());
+  }
+}
+
+/**
+ * Weeks of operation with cuts at random points for one policy
+ */
+static void runRandomCuts(uint8_t policy, uint32_t seed) {
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<float> chance(0.0f, 1.0f);
+  std::uniform_int_distribution<uint32_t> outage(60, 30 * 3600);
+  std::uniform_int_distribution<size_t> tornBytes(0, PERSIST_EEPROM_SIZE);
+
+  uint32_t cuts = 0;
+
+  factoryReset(policy);
+  uint32_t end = START_EPOCH + 60 * SECONDS_PER_DAY;
+  while (simEpoch < end) {
+    simEpoch += TICK_S;
+
+    // Arm a cut for the next commit or hatch opening now and then, so cuts
+    // land on the interesting instructions and not only between checks
+    float roll = chance(rng);
+    if (roll < 0.0004f) {
+      EEPROM.simArmCut(1, tornBytes(rng));
+    } else if (roll < 0.0006f) {
+      feedCut = FEED_CUT_BEFORE_HATCH;
+    } else if (roll < 0.0008f) {
+      feedCut = FEED_CUT_AFTER_HATCH;
+    }
+
+    bool cut = tick();
+    if (!cut && chance(rng) < 0.0002f) {
+      powerCycle();
+      cut = true;
+    }
+    if (cut) {
+      cuts++;
+      simEpoch += outage(rng);
+      boot();
+    }
+  }
+
+  assertNoDoubleFeed();
+
+  uint32_t occurrences = 0;
+  for (uint32_t at = occurrenceOf(simEpoch); at > START_EPOCH;
+       at = occurrenceOf(at - 1)) {
+    occurrences++;
+  }
+
+  char message[96];
+  snprintf(message, sizeof(message),
+           "policy %u: %u cuts, %u of %u slot occurrences fed, %.0f g",
+           (unsigned)policy, (unsigned)cuts, (unsigned)fedAt.size(),
+           (unsigned)occurrences, fedGrams);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_GREATER_THAN(20, cuts);
+}
+
+void test_random_cuts_skip_policy() {
+  for (uint32_t seed = 1; seed <= 5; seed++) runRandomCuts(CATCHUP_SKIP, seed);
+}
+
+void test_random_cuts_feed_once_policy() {
+  for (uint32_t seed = 1; seed <= 5; seed++) {
+    runRandomCuts(CATCHUP_FEED_ONCE, seed);
+  }
+}
+
+void test_random_cuts_proportional_policy() {
+  for (uint32_t seed = 1; seed <= 5; seed++) {
+    runRandomCuts(CATCHUP_PROPORTIONAL, seed);
+  }
+}
+
+void test_catch_up_portion_per_policy() {
+  const uint8_t policies[] = {CATCHUP_SKIP, CATCHUP_FEED_ONCE,
+                              CATCHUP_PROPORTIONAL};
+  const float expected[] = {0, FEED_WEIGHT, 0};
+  for (uint8_t i = 0; i < 3; i++) {
+    factoryReset(policies[i]);
+
+    // Back two hours after the 08:00 slot, 2.5 h before the 12:30 one
+    uint32_t missed =
+        lastScheduleOccurrence(SLOTS[0], START_EPOCH) + SECONDS_PER_DAY;
+    simEpoch = missed + 2 * 3600;
+    float grams = collectScheduledFeeding(simEpoch);
+
+    if (policies[i] == CATCHUP_PROPORTIONAL) {
+      TEST_ASSERT_FLOAT_WITHIN(0.01f, FEED_WEIGHT * 2.5f / 4.5f, grams);
+    } else {
+      TEST_ASSERT_EQUAL_FLOAT(expected[i], grams);
+    }
+    TEST_ASSERT_EQUAL_FLOAT(0, collectScheduledFeeding(simEpoch));
+  }
+}
+
+void test_top_up_portion_per_policy() {
+  factoryReset(CATCHUP_FEED_ONCE);
+
+  // Bowl holding 20 g (under FEED_THRESHOLD) and 55 g (over it), with and
+  // without 15 g given out by a session a reset cut short
+  struct Case {
+    uint8_t policy;
+    float partly;
+    float full;
+    float partlyCredit;
+  };
+  const Case cases[] = {
+      {TOPUP_THRESHOLD, FEED_WEIGHT, 0, FEED_WEIGHT - 15},
+      {TOPUP_FULL, FEED_WEIGHT, FEED_WEIGHT, FEED_WEIGHT - 15},
+      {TOPUP_DIFFERENCE, FEED_WEIGHT - 20, FEED_WEIGHT - 55, FEED_WEIGHT - 20},
+  };
+  for (const Case& c : cases) {
+    setTopUpPolicy(c.policy);
+    TEST_ASSERT_EQUAL(c.policy, topUpPolicy());
+    TEST_ASSERT_EQUAL_FLOAT(c.partly, scheduledPortion(FEED_WEIGHT, 20));
+    TEST_ASSERT_EQUAL_FLOAT(c.full, scheduledPortion(FEED_WEIGHT, 55));
+    TEST_ASSERT_EQUAL_FLOAT(c.partlyCredit,
+                            scheduledPortion(FEED_WEIGHT, 20, 15));
+  }
+
+  // The choice survives a reboot
+  setTopUpPolicy(TOPUP_FULL);
+  powerCycle();
+  TEST_ASSERT_EQUAL(TOPUP_FULL, topUpPolicy());
+}
+
+void test_old_record_gets_the_configured_top_up() {
+  // The layout before the top-up policy: a zeroed 16-bit reserved field
+  struct LegacyScheduleStore {
+    uint32_t magic;
+    uint8_t count;
+    uint8_t policy;
+    uint16_t reserved;
+    ScheduleSlot slots[MAX_SCHEDULES];
+    uint32_t crc;
+  };
+  static_assert(sizeof(LegacyScheduleStore) == sizeof(ScheduleStore),
+                "Layout changed");
+
+  factoryReset(CATCHUP_FEED_ONCE);
+  LegacyScheduleStore legacy;
+  memset(&legacy, 0, sizeof(legacy));
+  legacy.magic = SCHEDULE_STORE_MAGIC;
+  legacy.count = 1;
+  legacy.policy = CATCHUP_PROPORTIONAL;
+  legacy.slots[0].minutes = SLOTS[0];
+  legacy.slots[0].lastFired = START_EPOCH - 3600;
+  TEST_ASSERT_TRUE(persistSave(EEPROM_SCHEDULE_ADDR, legacy));
+  powerCycle();
+
+  TEST_ASSERT_TRUE(hasStoredSchedules());
+  TEST_ASSERT_EQUAL(CATCHUP_PROPORTIONAL, scheduleStore.policy);
+  TEST_ASSERT_EQUAL(FEED_TOPUP_POLICY, topUpPolicy());
+  TEST_ASSERT_EQUAL_FLOAT(FEED_WEIGHT - 20, scheduledPortion(FEED_WEIGHT, 20));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_feeds_every_slot_without_cuts);
+  RUN_TEST(test_cut_at_every_byte_of_the_cursor_commit);
+  RUN_TEST(test_cut_around_the_hatch_is_not_repeated);
+  RUN_TEST(test_random_cuts_skip_policy);
+  RUN_TEST(test_random_cuts_feed_once_policy);
+  RUN_TEST(test_random_cuts_proportional_policy);
+  RUN_TEST(test_catch_up_portion_per_policy);
+  RUN_TEST(test_top_up_portion_per_policy);
+  RUN_TEST(test_old_record_gets_the_configured_top_up);
+  return UNITY_END();
+}
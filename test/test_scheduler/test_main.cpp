@@ -0,0 +1,212 @@
+// Loop jitter and CPU idle with and without the task scheduler. The same
+// periodic jobs, with rough ESP8266 run costs, are driven for a simulated
+// hour two ways:
+//
+//   legacy     loop() checks a millis() timer per job, polls the button
+//              with analogRead() and ends every pass with delay(10)
+//   scheduler  the jobs are scheduler tasks, loop() is schedulerRun() plus
+//              schedulerIdle() sleeping until the next deadline
+//
+// Jitter is how late a job starts against its own cadence. Idle is the
+// share of time spent in delay() (legacy) or the idle hook (scheduler).
+// The water check re-arms itself from the end of each run, as the adaptive
+// waterTask() does, so it drifts off the grid of the fixed-period tasks.
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "helpers/task_scheduler.h"
+
+struct Job {
+  const char* name;
+  uint32_t interval;  // ms
+  uint32_t costUs;
+  uint8_t priority;
+  bool rearms;  // Schedules its next run from its own end
+  std::vector<uint32_t> latenessUs;
+  uint32_t legacyLast;
+};
+
+static Job jobs[] = {
+    {"web", WEB_LOOP_INTERVAL, 150, TASK_PRIORITY_HIGH, false, {}, 0},
+    {"ui", UI_UPDATE_INTERVAL, 40, TASK_PRIORITY_NORMAL, false, {}, 0},
+    {"lcd", LCD_UPDATE_INTERVAL, 6000, TASK_PRIORITY_NORMAL, false, {}, 0},
+    {"feed-sched", SCHEDULE_CHECK_INTERVAL, 80, TASK_PRIORITY_NORMAL, false,
+     {}, 0},
+    {"bowl", BOWL_SAMPLE_INTERVAL, 150, TASK_PRIORITY_LOW, false, {}, 0},
+    {"water", WATER_CHECK_INTERVAL, 45000, TASK_PRIORITY_NORMAL, true, {},
+     0},
+    {"ntp", 60000, 3000, TASK_PRIORITY_HIGH, false, {}, 0},
+};
+static const uint8_t JOB_COUNT = sizeof(jobs) / sizeof(jobs[0]);
+
+static const uint32_t LEGACY_ANALOG_READ_US = 100;  // Button poll per pass
+static const uint32_t SIM_DURATION_MS = 3600000UL;
+
+struct LoopStats {
+  float idlePercent;
+  float wakesPerSecond;
+};
+
+static LoopStats legacy;
+static LoopStats scheduled;
+static std::vector<uint32_t> legacyLateness[JOB_COUNT];
+static std::vector<uint32_t> scheduledLateness[JOB_COUNT];
+
+static uint32_t percentile(std::vector<uint32_t> values, float fraction) {
+  if (values.empty()) return 0;
+  std::sort(values.begin(), values.end());
+  return values[(size_t)(fraction * (values.size() - 1))];
+}
+
+static void runLegacyLoop() {
+  uint64_t idleUs = 0;
+  uint32_t passes = 0;
+
+  simMicros = 0;
+  for (uint8_t i = 0; i < JOB_COUNT; i++) jobs[i].legacyLast = 0;
+
+  while (millis() < SIM_DURATION_MS) {
+    uint32_t currentMillis = millis();
+    passes++;
+
+    delayMicroseconds(LEGACY_ANALOG_READ_US);
+
+    for (uint8_t i = 0; i < JOB_COUNT; i++) {
+      Job& job = jobs[i];
+      if (currentMillis - job.legacyLast < job.interval) continue;
+
+      uint64_t due = (uint64_t)(job.legacyLast + job.interval) * 1000;
+      legacyLateness[i].push_back((uint32_t)(simMicros - due));
+      job.legacyLast = currentMillis;
+      delayMicroseconds(job.costUs);
+    }
+
+    delay(10);
+    idleUs += 10000;
+  }
+
+  legacy.idlePercent = 100.0f * idleUs / simMicros;
+  legacy.wakesPerSecond = passes * 1000.0f / millis();
+}
+
+template <uint8_t N>
+static void jobTask() {
+  Job& job = jobs[N];
+  uint64_t due = (uint64_t)tasks[N].nextRun * 1000;
+  scheduledLateness[N].push_back((uint32_t)(simMicros - due));
+  delayMicroseconds(job.costUs);
+  if (job.rearms) schedulerRunIn(N, job.interval);
+}
+
+static const TaskCallback jobTasks[] = {jobTask<0>, jobTask<1>, jobTask<2>,
+                                        jobTask<3>, jobTask<4>, jobTask<5>,
+                                        jobTask<6>};
+
+static uint32_t idleCalls = 0;
+static void countingIdleHook(uint32_t idleMs) {
+  idleCalls++;
+  delay(idleMs);
+}
+
+static void runScheduledLoop() {
+  simMicros = 0;
+  taskCount = 0;
+  taskHeapSize = 0;
+  schedulerStatsStart = 0;
+  schedulerIdleMs = 0;
+
+  // Same phase as the legacy timers, which all fire on the first pass
+  for (uint8_t i = 0; i < JOB_COUNT; i++) {
+    schedulerAddTask(jobs[i].name, jobTasks[i], jobs[i].interval,
+                     jobs[i].priority, 0, jobs[i].interval);
+  }
+  schedulerSetIdleHook(countingIdleHook);
+
+  while (millis() < SIM_DURATION_MS) {
+    schedulerRun();
+    schedulerIdle();
+  }
+
+  scheduled.idlePercent = schedulerIdlePercent();
+  scheduled.wakesPerSecond = idleCalls * 1000.0f / millis();
+}
+
+static void report() {
+  char line[120];
+  snprintf(line, sizeof(line),
+           "idle: legacy %.1f%%, scheduler %.1f%%; loop wake-ups/s: %.1f, "
+           "%.1f",
+           legacy.idlePercent, scheduled.idlePercent, legacy.wakesPerSecond,
+           scheduled.wakesPerSecond);
+  TEST_MESSAGE(line);
+
+  for (uint8_t i = 0; i < JOB_COUNT; i++) {
+    snprintf(line, sizeof(line),
+             "%-10s jitter p50/p99/max (us): legacy %u/%u/%u, "
+             "scheduler %u/%u/%u",
+             jobs[i].name, (unsigned)percentile(legacyLateness[i], 0.5f),
+             (unsigned)percentile(legacyLateness[i], 0.99f),
+             (unsigned)percentile(legacyLateness[i], 1.0f),
+             (unsigned)percentile(scheduledLateness[i], 0.5f),
+             (unsigned)percentile(scheduledLateness[i], 0.99f),
+             (unsigned)percentile(scheduledLateness[i], 1.0f));
+    TEST_MESSAGE(line);
+  }
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_scheduler_keeps_the_cadence() {
+  // Deadlines advance by the interval, so lateness does not accumulate;
+  // the legacy timers restart from the late start and drift. Tasks shorter
+  // than a stall skip the missed runs instead of bursting, by design.
+  uint32_t batchMs = 0;
+  for (uint8_t i = 0; i < JOB_COUNT; i++) batchMs += jobs[i].costUs / 1000;
+
+  for (uint8_t i = 0; i < JOB_COUNT; i++) {
+    if (jobs[i].interval <= batchMs || jobs[i].rearms) continue;
+    uint32_t expected = SIM_DURATION_MS / jobs[i].interval;
+    TEST_ASSERT_UINT32_WITHIN(1, expected, scheduledLateness[i].size());
+  }
+  TEST_ASSERT_LESS_THAN(SIM_DURATION_MS / SCHEDULE_CHECK_INTERVAL - 1,
+                        legacyLateness[3].size());
+}
+
+void test_scheduler_is_idle_more() {
+  TEST_ASSERT_GREATER_THAN(legacy.idlePercent, scheduled.idlePercent);
+
+  // Tasks skipping runs after a stall stay on their grid, so everything
+  // but the drifting water check wakes together with the web task
+  uint32_t webWakes = 1000 / WEB_LOOP_INTERVAL;
+  TEST_ASSERT_LESS_THAN_FLOAT(webWakes + 1.0f, scheduled.wakesPerSecond);
+}
+
+void test_high_priority_jitter() {
+  TEST_ASSERT_LESS_THAN(percentile(legacyLateness[0], 0.5f),
+                        percentile(scheduledLateness[0], 0.5f));
+  TEST_ASSERT_LESS_THAN(percentile(legacyLateness[0], 0.99f),
+                        percentile(scheduledLateness[0], 0.99f));
+
+  // At worst the web task waits for one batch of due tasks to finish
+  uint32_t batchUs = 0;
+  for (uint8_t i = 0; i < JOB_COUNT; i++) batchUs += jobs[i].costUs;
+  TEST_ASSERT_LESS_OR_EQUAL(batchUs + 1000,
+                            percentile(scheduledLateness[0], 1.0f));
+}
+
+int main() {
+  runLegacyLoop();
+  runScheduledLoop();
+  report();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_scheduler_keeps_the_cadence);
+  RUN_TEST(test_scheduler_is_idle_more);
+  RUN_TEST(test_high_priority_jitter);
+  return UNITY_END();
+}
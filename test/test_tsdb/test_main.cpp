@@ -0,0 +1,561 @@
+// The history store fed a synthetic day and a synthetic week, one bowl
+// weight and one water height every TSDB_SAMPLE_INTERVAL, through
+// tsdbAppend() with tsdbSync() on its own period, as the firmware does:
+//
+//   bowl   65 g at 07:00, 12:00 and 18:00, eaten in 3 g bites, on a
+//          load cell with 0.15 g noise
+//   water  0-3 cm in the tank, drunk in sips and evaporating, refilled
+//          when it runs low, read to the mm with 0.1 cm noise
+//
+// Every tier is read back with tsdbRead() and compared with the truth:
+// raw points must come back as appended, rounded to tsdbResolution, and
+// rollup points must hold the min/max/avg of their bucket to the same
+// resolution. The compression is measured as sealed bytes per point.
+//
+// A month is then fed and queried the way the web page asks for history,
+// over the last day and the last 30 days: every chunk from
+// tsdbQueryNext() is checked against the buckets the truth gives for the
+// tier and step tsdbQueryBegin() picked, and each chunk is timed and its
+// flash reads counted. Tier choice, step alignment and ranges running to
+// the end of the 32-bit epoch are checked on their own.
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <unity.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "helpers/tsdb_helpers.h"
+
+static const uint32_t DAY_S = 86400;
+static const uint32_t EPOCH = 1759968000;  // A local midnight
+static const uint32_t SAMPLE_S = TSDB_SAMPLE_INTERVAL / 1000;
+
+struct Sample {
+  uint32_t time;
+  float value;
+};
+
+static std::vector<Sample> truth[TSDB_METRICS];
+static std::mt19937 rng;
+
+static float uniform() {
+  return std::uniform_real_distribution<float>(0, 1)(rng);
+}
+
+static float gauss(float spread) {
+  return std::normal_distribution<float>(0, spread)(rng);
+}
+
+/**
+ * Empty store, as after a format
+ */
+static void resetStore() {
+  LittleFS.simFormat();
+  LittleFS.writes = 0;
+  memset(tsdbSeries, 0, sizeof(tsdbSeries));
+  memset(tsdbBuckets, 0, sizeof(tsdbBuckets));
+  for (uint8_t tier = 0; tier < TSDB_TIERS; tier++) {
+    tsdbPoints[tier] = tsdbSealedPoints[tier] = tsdbSealedBlocks[tier] = 0;
+  }
+  tsdbFlashWrites = 0;
+  tsdbStarted = false;
+  tsdbBegin();
+  for (auto& samples : truth) samples.clear();
+}
+
+static void feedDays(uint32_t days) {
+  float bowl = 20;
+  float water = 2.5f;
+  uint32_t sinceSync = 0;
+
+  for (uint32_t t = EPOCH; t < EPOCH + days * DAY_S; t += SAMPLE_S) {
+    uint32_t clock = (t - EPOCH) % DAY_S;
+    if (clock == 7 * 3600 || clock == 12 * 3600 || clock == 18 * 3600) {
+      bowl += 65;
+    }
+    if (bowl > 1 && uniform() < 0.01f) bowl -= std::min(bowl, 3.0f);
+
+    if (uniform() < 0.002f) water -= 0.2f;  // A drink
+    water -= 0.00002f * SAMPLE_S;
+    if (water < 0.5f) water = 3.0f;
+
+    float weight = bowl + gauss(0.15f);
+    float height = roundf((water + gauss(0.1f)) * 10) / 10;
+    height = constrain(height, 0.0f,
+                       DISTANCE_WATER_EMPTY - DISTANCE_WATER_FULL);
+
+    tsdbAppend(TSDB_WEIGHT, t, weight);
+    tsdbAppend(TSDB_WATER, t, height);
+    truth[TSDB_WEIGHT].push_back({t, weight});
+    truth[TSDB_WATER].push_back({t, height});
+
+    sinceSync += SAMPLE_S;
+    if (sinceSync * 1000 >= TSDB_SYNC_INTERVAL) {
+      sinceSync = 0;
+      tsdbSync();
+    }
+  }
+}
+
+static float rounded(uint8_t metric, float value) {
+  float resolution = tsdbResolution[metric];
+  return roundf(value / resolution) * resolution;
+}
+
+struct Readback {
+  std::vector<uint32_t> time;
+  std::vector<float> values[TSDB_MAX_VALUES];
+};
+
+static void collect(uint32_t time, const float* values, uint8_t count,
+                    void* context) {
+  Readback& readback = *(Readback*)context;
+  readback.time.push_back(time);
+  for (uint8_t i = 0; i < count; i++) readback.values[i].push_back(values[i]);
+}
+
+struct Check {
+  uint32_t points;      // Read back
+  uint32_t expected;    // In the range
+  uint32_t misplaced;   // Wrong timestamp
+  float worstError;     // Largest value error, in units of the resolution
+};
+
+/**
+ * Read a tier over the last span seconds and compare with the truth
+ */
+static Check checkTier(uint8_t metric, uint8_t tier, uint32_t span) {
+  const std::vector<Sample>& samples = truth[metric];
+  uint32_t end = samples.back().time;
+  uint32_t step = tsdbTiers[tier].step;
+
+  // The newest bucket of a rollup tier is still open
+  if (step) end = end - end % step - 1;
+  uint32_t from = end - span + 1;
+
+  Readback readback;
+  Check check = {};
+  check.points = tsdbRead(metric, tier, from, end, collect, &readback);
+
+  float resolution = tsdbResolution[metric];
+  size_t next = 0;
+  if (!step) {
+    for (const Sample& sample : samples) {
+      if (sample.time < from || sample.time > end) continue;
+      check.expected++;
+      if (next >= readback.time.size()) continue;
+      if (readback.time[next] != sample.time) check.misplaced++;
+      float error = fabsf(readback.values[0][next] -
+                          rounded(metric, sample.value));
+      check.worstError = std::max(check.worstError, error / resolution);
+      next++;
+    }
+    return check;
+  }
+
+  for (uint32_t start = from - from % step; start <= end; start += step) {
+    if (start < from) continue;
+    float low = INFINITY, high = -INFINITY;
+    double sum = 0;
+    uint32_t count = 0;
+    for (const Sample& sample : samples) {
+      if (sample.time < start || sample.time >= start + step) continue;
+      low = std::min(low, sample.value);
+      high = std::max(high, sample.value);
+      sum += sample.value;
+      count++;
+    }
+    if (!count) continue;
+    check.expected++;
+    if (next >= readback.time.size()) continue;
+    if (readback.time[next] != start) check.misplaced++;
+
+    // Min and max are rounded once; the average also carries the float
+    // sum, well below the resolution
+    float truths[3] = {rounded(metric, low), rounded(metric, high),
+                       (float)(sum / count)};
+    for (uint8_t i = 0; i < 3; i++) {
+      float error = fabsf(readback.values[i][next] - truths[i]);
+      check.worstError = std::max(check.worstError, error / resolution);
+    }
+    next++;
+  }
+  return check;
+}
+
+static float bytesPerPoint(uint8_t tier) {
+  if (!tsdbSealedPoints[tier]) return 0;
+  return (float)tsdbSealedBlocks[tier] * sizeof(TsdbBlock) /
+         tsdbSealedPoints[tier];
+}
+
+// Results of the day and the week
+struct Run {
+  uint32_t days;
+  float bytesPerPoint[TSDB_TIERS];
+  Check checks[TSDB_METRICS][TSDB_TIERS];
+  uint32_t flashWrites;
+  size_t fileBytes;
+};
+
+static Run runs[2] = {{1}, {7}};
+
+static void runDays(Run& run) {
+  resetStore();
+  feedDays(run.days);
+  for (uint8_t tier = 0; tier < TSDB_TIERS; tier++) {
+    run.bytesPerPoint[tier] = bytesPerPoint(tier);
+  }
+
+  // Each tier over what it keeps, no more than was fed
+  uint32_t fed = run.days * DAY_S;
+  uint32_t spans[TSDB_TIERS] = {
+      TSDB_RAW_RETENTION, std::min<uint32_t>(TSDB_MINUTE_RETENTION, fed) - 900,
+      std::min<uint32_t>(TSDB_QUARTER_RETENTION, fed) - 900};
+  for (uint8_t metric = 0; metric < TSDB_METRICS; metric++) {
+    for (uint8_t tier = 0; tier < TSDB_TIERS; tier++) {
+      run.checks[metric][tier] = checkTier(metric, tier, spans[tier]);
+    }
+  }
+
+  run.flashWrites = tsdbFlashWrites;
+  FSInfo info;
+  LittleFS.info(info);
+  run.fileBytes = info.usedBytes;
+}
+
+static void report() {
+  char line[140];
+  for (const Run& run : runs) {
+    snprintf(line, sizeof(line),
+             "%u day(s): bytes/point raw %.2f, 1m %.2f, 15m %.2f; %u flash "
+             "writes, %u KB of files",
+             (unsigned)run.days, run.bytesPerPoint[TSDB_RAW],
+             run.bytesPerPoint[TSDB_MINUTE], run.bytesPerPoint[TSDB_QUARTER],
+             (unsigned)run.flashWrites, (unsigned)(run.fileBytes / 1024));
+    TEST_MESSAGE(line);
+    for (uint8_t metric = 0; metric < TSDB_METRICS; metric++) {
+      for (uint8_t tier = 0; tier < TSDB_TIERS; tier++) {
+        const Check& check = run.checks[metric][tier];
+        snprintf(line, sizeof(line),
+                 "  %-6s %-3s %u of %u points, worst error %.2f x "
+                 "resolution",
+                 metric == TSDB_WEIGHT ? "weight" : "water",
+                 tsdbTierName(tier), (unsigned)check.points,
+                 (unsigned)check.expected, check.worstError);
+        TEST_MESSAGE(line);
+      }
+    }
+  }
+}
+
+// A query replayed chunk by chunk against the truth
+struct QueryRun {
+  const char* name;
+  uint32_t span;  // Seconds back from to
+  uint16_t maxPoints;
+  uint8_t tier;  // Expected
+  TsdbQuery query;
+  uint32_t from;  // Asked for
+  uint32_t buckets;
+  uint32_t chunks;
+  uint32_t misplaced;  // Out of their chunk, repeated or out of order
+  float worstError;    // In units of the resolution
+  double worstChunkUs;
+  uint32_t worstChunkBytes;  // Read from flash
+};
+
+static const uint32_t MONTH_DAYS = 31;
+
+// The newest 15-minute bucket is still open, end the ranges before it
+static const uint32_t QUERY_TO = EPOCH + MONTH_DAYS * DAY_S - 900 - 1;
+
+static QueryRun queryRuns[2] = {
+    {"1 day", DAY_S, 100, TSDB_MINUTE},
+    {"30 days", 30 * DAY_S, TSDB_QUERY_MAX_POINTS, TSDB_QUARTER}};
+
+/**
+ * Compare a bucket with the samples of [start, start + step)
+ */
+static float bucketError(uint32_t start, uint32_t step, float low,
+                         float high, float avg) {
+  const std::vector<Sample>& samples = truth[TSDB_WEIGHT];
+  uint32_t first = start > EPOCH ? (start - EPOCH + SAMPLE_S - 1) / SAMPLE_S
+                                 : 0;
+  float trueLow = INFINITY, trueHigh = -INFINITY;
+  double sum = 0;
+  uint32_t count = 0;
+  uint32_t end = std::min<uint64_t>(start + (uint64_t)step, QUERY_TO + 1ULL);
+  for (uint32_t i = first; i < samples.size() && samples[i].time < end;
+       i++) {
+    trueLow = std::min(trueLow, samples[i].value);
+    trueHigh = std::max(trueHigh, samples[i].value);
+    sum += samples[i].value;
+    count++;
+  }
+  if (!count) return INFINITY;
+
+  // Bucket averages are means of stored averages, each within half the
+  // resolution
+  float errors[3] = {fabsf(low - rounded(TSDB_WEIGHT, trueLow)),
+                     fabsf(high - rounded(TSDB_WEIGHT, trueHigh)),
+                     fabsf(avg - (float)(sum / count))};
+  return *std::max_element(errors, errors + 3) /
+         tsdbResolution[TSDB_WEIGHT];
+}
+
+static void runQuery(QueryRun& run) {
+  run.from = QUERY_TO + 1 - run.span;
+  tsdbQueryBegin(run.query, TSDB_WEIGHT, run.from, QUERY_TO, run.maxPoints,
+                 QUERY_TO + 1);
+
+  TsdbQuery& query = run.query;
+  uint32_t previous = 0;
+  while (!tsdbQueryDone(query)) {
+    uint32_t chunkStart = query.next;
+    uint32_t readBytes = LittleFS.readBytes;
+    TsdbChunk chunk;
+    auto start = std::chrono::steady_clock::now();
+    tsdbQueryNext(query, chunk);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    run.worstChunkUs = std::max(
+        run.worstChunkUs,
+        std::chrono::duration<double, std::micro>(elapsed).count());
+    run.worstChunkBytes =
+        std::max(run.worstChunkBytes, LittleFS.readBytes - readBytes);
+    run.chunks++;
+
+    for (uint8_t i = 0; i < chunk.count; i++) {
+      uint32_t time = chunk.time[i];
+      if (time < chunkStart ||
+          time - chunkStart >= query.step * TSDB_CHUNK_POINTS ||
+          time % query.step || (run.buckets && time <= previous)) {
+        run.misplaced++;
+      }
+      previous = time;
+      run.buckets++;
+      run.worstError = std::max(
+          run.worstError,
+          bucketError(time, query.step, chunk.min[i], chunk.max[i],
+                      chunk.sum[i] / chunk.points[i]));
+    }
+  }
+}
+
+static void runMonth() {
+  resetStore();
+  feedDays(MONTH_DAYS);
+  LittleFS.readBytes = 0;
+  for (QueryRun& run : queryRuns) runQuery(run);
+}
+
+static void reportQueries() {
+  char line[140];
+  for (const QueryRun& run : queryRuns) {
+    snprintf(line, sizeof(line),
+             "%s: tier %s, step %u s, %u buckets in %u chunks, worst error "
+             "%.2f x resolution",
+             run.name, tsdbTierName(run.query.tier), (unsigned)run.query.step,
+             (unsigned)run.buckets, (unsigned)run.chunks, run.worstError);
+    TEST_MESSAGE(line);
+    snprintf(line, sizeof(line),
+             "  worst chunk %.0f us on the host, %u bytes read",
+             run.worstChunkUs, (unsigned)run.worstChunkBytes);
+    TEST_MESSAGE(line);
+  }
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_every_point_comes_back_in_place() {
+  for (const Run& run : runs) {
+    for (uint8_t metric = 0; metric < TSDB_METRICS; metric++) {
+      for (uint8_t tier = 0; tier < TSDB_TIERS; tier++) {
+        const Check& check = run.checks[metric][tier];
+        TEST_ASSERT_GREATER_THAN_UINT32(0, check.expected);
+        TEST_ASSERT_EQUAL_UINT32(check.expected, check.points);
+        TEST_ASSERT_EQUAL_UINT32(0, check.misplaced);
+      }
+    }
+  }
+}
+
+void test_values_round_trip_at_the_resolution() {
+  for (const Run& run : runs) {
+    for (uint8_t metric = 0; metric < TSDB_METRICS; metric++) {
+      // Raw points come back exactly as rounded on the way in
+      TEST_ASSERT_LESS_THAN_FLOAT(0.001f, run.checks[metric][TSDB_RAW]
+                                              .worstError);
+      for (uint8_t tier = TSDB_MINUTE; tier < TSDB_TIERS; tier++) {
+        TEST_ASSERT_LESS_OR_EQUAL_FLOAT(
+            0.51f, run.checks[metric][tier].worstError);
+      }
+    }
+  }
+}
+
+void test_points_compress() {
+  // Uncompressed a point is a 4-byte epoch and 4 bytes per value: 8 raw,
+  // 16 for a min/max/avg rollup
+  for (const Run& run : runs) {
+    TEST_ASSERT_LESS_THAN_FLOAT(4.5f, run.bytesPerPoint[TSDB_RAW]);
+    TEST_ASSERT_LESS_THAN_FLOAT(11.0f, run.bytesPerPoint[TSDB_MINUTE]);
+    TEST_ASSERT_LESS_THAN_FLOAT(12.0f, run.bytesPerPoint[TSDB_QUARTER]);
+  }
+}
+
+void test_query_picks_the_finest_tier_holding_the_start() {
+  const uint32_t now = 2000000000;
+  const uint32_t ages[] = {0,
+                           TSDB_RAW_RETENTION,
+                           TSDB_RAW_RETENTION + 1,
+                           TSDB_MINUTE_RETENTION,
+                           TSDB_MINUTE_RETENTION + 1,
+                           TSDB_QUARTER_RETENTION + DAY_S};
+  const uint8_t tiers[] = {TSDB_RAW,    TSDB_RAW,     TSDB_MINUTE,
+                           TSDB_MINUTE, TSDB_QUARTER, TSDB_QUARTER};
+  for (uint8_t i = 0; i < sizeof(ages) / sizeof(ages[0]); i++) {
+    TsdbQuery query;
+    TEST_ASSERT_TRUE(
+        tsdbQueryBegin(query, TSDB_WEIGHT, now - ages[i], now, 100, now));
+    TEST_ASSERT_EQUAL_UINT8(tiers[i], query.tier);
+  }
+  for (const QueryRun& run : queryRuns) {
+    TEST_ASSERT_EQUAL_UINT8(run.tier, run.query.tier);
+  }
+}
+
+void test_query_steps_align_and_fit_max_points() {
+  // Random ranges of every size: the step is a whole number of tier
+  // steps, the first bucket holds from, and the buckets fit maxPoints
+  std::mt19937 ranges(7);
+  for (uint32_t i = 0; i < 100000; i++) {
+    uint32_t to = ranges();
+    uint32_t back = ranges() >> (ranges() % 32);
+    uint32_t from = to - std::min(back, to);
+    uint32_t now = to + (ranges() >> (ranges() % 32));
+    if (now < to) now = to;
+    uint16_t maxPoints = 1 + ranges() % (TSDB_QUERY_MAX_POINTS + 20);
+
+    TsdbQuery query;
+    TEST_ASSERT_TRUE(
+        tsdbQueryBegin(query, TSDB_WATER, from, to, maxPoints, now));
+    uint32_t unit = tsdbTiers[query.tier].step;
+    TEST_ASSERT_GREATER_THAN_UINT32(0, query.step);
+    if (unit) TEST_ASSERT_EQUAL_UINT32(0, query.step % unit);
+    TEST_ASSERT_EQUAL_UINT32(0, query.from % query.step);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(from, query.from);
+    TEST_ASSERT_GREATER_THAN_UINT32(from - query.from, query.step);
+
+    // A bucket starting at the last step of the epoch is cut short
+    uint32_t buckets = (to - query.from) / query.step + 1;
+    if (query.step < UINT32_MAX - UINT32_MAX % (unit ? unit : 1)) {
+      TEST_ASSERT_LESS_OR_EQUAL_UINT32(
+          std::min<uint16_t>(maxPoints, TSDB_QUERY_MAX_POINTS), buckets);
+    }
+  }
+}
+
+void test_query_buckets_match_the_truth() {
+  for (const QueryRun& run : queryRuns) {
+    // Every bucket of the range holds samples, none may be missing
+    uint32_t expected = (QUERY_TO - run.query.from) / run.query.step + 1;
+    TEST_ASSERT_EQUAL_UINT32(expected, run.buckets);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(run.maxPoints, run.buckets);
+    TEST_ASSERT_EQUAL_UINT32(0, run.misplaced);
+    TEST_ASSERT_EQUAL_UINT32(
+        (expected + TSDB_CHUNK_POINTS - 1) / TSDB_CHUNK_POINTS, run.chunks);
+    TEST_ASSERT_LESS_OR_EQUAL_FLOAT(0.51f, run.worstError);
+  }
+}
+
+void test_query_chunks_split_at_the_chunk_size() {
+  // A range of exactly TSDB_CHUNK_POINTS raw buckets, then one more
+  const uint32_t now = EPOCH + MONTH_DAYS * DAY_S;
+  for (uint32_t extra = 0; extra < 2; extra++) {
+    uint32_t count = TSDB_CHUNK_POINTS + extra;
+    uint32_t from = now - count * SAMPLE_S;
+    TsdbQuery query;
+    tsdbQueryBegin(query, TSDB_WEIGHT, from, from + count * SAMPLE_S - 1,
+                   count, now);
+    TEST_ASSERT_EQUAL_UINT32(SAMPLE_S, query.step);
+
+    TsdbChunk chunk;
+    tsdbQueryNext(query, chunk);
+    TEST_ASSERT_EQUAL_UINT8(TSDB_CHUNK_POINTS, chunk.count);
+    TEST_ASSERT_EQUAL_UINT32(from + (TSDB_CHUNK_POINTS - 1) * SAMPLE_S,
+                             chunk.time[TSDB_CHUNK_POINTS - 1]);
+    TEST_ASSERT_EQUAL(extra == 0, tsdbQueryDone(query));
+    if (!extra) continue;
+
+    tsdbQueryNext(query, chunk);
+    TEST_ASSERT_EQUAL_UINT8(1, chunk.count);
+    TEST_ASSERT_EQUAL_UINT32(from + TSDB_CHUNK_POINTS * SAMPLE_S,
+                             chunk.time[0]);
+    TEST_ASSERT_TRUE(tsdbQueryDone(query));
+  }
+}
+
+void test_query_ends_at_the_end_of_the_epoch() {
+  // Ranges running to UINT32_MAX must finish, not wrap to epoch 0
+  struct Range {
+    uint32_t from;
+    uint16_t maxPoints;
+  } ranges[] = {{0, TSDB_QUERY_MAX_POINTS},
+                {0, 1},
+                {UINT32_MAX - 100, 10},
+                {UINT32_MAX - TSDB_RAW_RETENTION, TSDB_QUERY_MAX_POINTS},
+                {UINT32_MAX, 1}};
+  for (const Range& range : ranges) {
+    TsdbQuery query;
+    TEST_ASSERT_TRUE(tsdbQueryBegin(query, TSDB_WEIGHT, range.from,
+                                    UINT32_MAX, range.maxPoints,
+                                    UINT32_MAX));
+    TEST_ASSERT_GREATER_THAN_UINT32(0, query.step);
+    uint32_t chunks = 0;
+    TsdbChunk chunk;
+    while (!tsdbQueryDone(query) && chunks <= TSDB_QUERY_MAX_POINTS) {
+      tsdbQueryNext(query, chunk);
+      chunks++;
+    }
+    TEST_ASSERT_TRUE(tsdbQueryDone(query));
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(
+        (range.maxPoints + TSDB_CHUNK_POINTS - 1) / TSDB_CHUNK_POINTS + 1,
+        chunks);
+  }
+}
+
+void test_query_chunks_are_quick() {
+  // One chunk per scheduler slot, it must not hold the loop up. The host
+  // runs far faster than the ESP8266, the bytes read are what carry over.
+  for (const QueryRun& run : queryRuns) {
+    TEST_ASSERT_LESS_THAN_FLOAT(2000.0f, (float)run.worstChunkUs);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(4096, run.worstChunkBytes);
+  }
+}
+
+int main() {
+  rng.seed(11);
+  for (Run& run : runs) runDays(run);
+  report();
+  runMonth();
+  reportQueries();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_every_point_comes_back_in_place);
+  RUN_TEST(test_values_round_trip_at_the_resolution);
+  RUN_TEST(test_points_compress);
+  RUN_TEST(test_query_picks_the_finest_tier_holding_the_start);
+  RUN_TEST(test_query_steps_align_and_fit_max_points);
+  RUN_TEST(test_query_buckets_match_the_truth);
+  RUN_TEST(test_query_chunks_split_at_the_chunk_size);
+  RUN_TEST(test_query_ends_at_the_end_of_the_epoch);
+  RUN_TEST(test_query_chunks_are_quick);
+  return UNITY_END();
+}
@@ -0,0 +1,265 @@
+// Blocked time per day with and without the LCD message queue. One
+// simulated day of screens (boot, four scheduled feeds, hourly water
+// notices, two refills, a WiFi drop) is replayed two ways:
+//
+//   before  every screen is drawn and then held with a busy wait, as
+//           lcdMessage() + nonBlockingWait() did
+//   after   every screen is posted with uiShow() and the "ui" task
+//           (uiUpdate() every UI_UPDATE_INTERVAL) shows it
+//
+// Waits for the hardware itself (scale tare, dispensing, settling) block
+// in both versions and are counted in both. Blocked time is measured in
+// simulated time, not estimated from the hold values.
+
+#include <Arduino.h>
+#include <LiquidCrystal_I2C.h>
+#include <unity.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "helpers/ui_queue.h"
+
+LiquidCrystal_I2C lcd(0x27, LCD_X, LCD_Y);
+
+struct Screen {
+  const char* line1;  // NULL keeps the line
+  const char* line2;
+  uint16_t holdMs;
+  uint16_t physicalMs;  // Hardware wait that follows the screen
+};
+
+struct Event {
+  uint32_t at;  // ms into the day
+  const Screen* screens;
+  uint8_t count;
+};
+
+static const Screen BOOT[] = {
+    {"IoT Pet Feeder", "Starting up...", BOOT_STATUS_TIME, 0},
+    {NULL, "Taring scale...", BOOT_STATUS_TIME, 1500},
+    {NULL, "Scale ready!", BOOT_STATUS_TIME, 0},
+    {"WiFi Connected!", "192.168.1.42", BOOT_STATUS_TIME, 0},
+    {"Setup completed!", "System ready!", BOOT_STATUS_TIME, 0},
+    {"IoT Pet Feeder", "Ready", BOOT_STATUS_TIME, 0},
+};
+
+static const Screen FEED[] = {
+    {"Feeding time", "Checking scale", QUICK_DISPLAY_TIME, 0},
+    {NULL, "Checking bowl...", QUICK_DISPLAY_TIME, 800},
+    {"Starting feed", "Opening hatch...", QUICK_DISPLAY_TIME, 8000},
+    {"Target reached!", "25.1g dispensed", QUICK_DISPLAY_TIME, 0},
+    {"Measuring final", "weight...", 0, SETTLE_FINAL_TIME},
+    {"Feeding complete", "Added: 25.3g", QUICK_DISPLAY_TIME, 0},
+    {"Accuracy: 101%", "Good enough", INFO_DISPLAY_TIME, 0},
+    {"Bowl now contains", "Total: 27.0g", INFO_DISPLAY_TIME, 0},
+};
+
+static const Screen WATER_LEVEL[] = {
+    {"Water Level:", "8.2cm (68%)", QUICK_DISPLAY_TIME, 0},
+};
+
+static const Screen REFILL_START[] = {
+    {"Water Level:", "LOW! 2.9cm (24%)", QUICK_DISPLAY_TIME, 0},
+    {"Water low!", "Refilling...", LCD_TIMEOUT, 0},
+};
+
+static const Screen REFILL_DONE[] = {
+    {"Refill complete", "Cooldown: 5 min", LCD_TIMEOUT, 0},
+};
+
+static const Screen WIFI_DROP[] = {
+    {"Connect to WiFi", "Reconnecting...", LCD_TIMEOUT, 0},
+};
+
+#define SCREENS(list) list, sizeof(list) / sizeof(list[0])
+
+static const uint32_t HOUR_MS = 3600000UL;
+static const uint32_t DAY_MS = 24 * HOUR_MS;
+
+static std::vector<Event> day;
+
+static void buildDay() {
+  day.clear();
+  day.push_back({5000, SCREENS(BOOT)});
+  for (uint32_t hour = 1; hour < 24; hour++) {
+    day.push_back({hour * HOUR_MS, SCREENS(WATER_LEVEL)});
+  }
+  const uint32_t feeds[] = {7, 12, 18, 22};
+  for (uint32_t hour : feeds) {
+    day.push_back({hour * HOUR_MS + 60000, SCREENS(FEED)});
+  }
+  day.push_back({9 * HOUR_MS + 300000, SCREENS(REFILL_START)});
+  day.push_back({9 * HOUR_MS + 420000, SCREENS(REFILL_DONE)});
+  day.push_back({20 * HOUR_MS + 300000, SCREENS(REFILL_START)});
+  day.push_back({20 * HOUR_MS + 420000, SCREENS(REFILL_DONE)});
+  day.push_back({15 * HOUR_MS + 1234567, SCREENS(WIFI_DROP)});
+
+  std::sort(day.begin(), day.end(),
+            [](const Event& a, const Event& b) { return a.at < b.at; });
+}
+
+struct DayResult {
+  uint32_t blockedMs;  // Whole day, display and hardware waits
+  uint32_t physicalMs;
+  uint32_t postMs;  // Time spent inside the calls that put up a screen
+  uint32_t screens;
+};
+
+static DayResult before;
+static DayResult after;
+
+// Draw order and times of the queued run, to check the hold times
+static std::vector<uint32_t> postedAt;
+static std::vector<uint16_t> postedHold;
+static std::vector<uint32_t> drawnAt;
+
+static void resetClock() { simMicros = 0; }
+
+static void idleUntil(uint32_t at, void (*task)()) {
+  while (millis() < at) {
+    if (task) task();
+    delay(UI_UPDATE_INTERVAL);
+  }
+}
+
+// Baseline: draw, then busy-wait for the hold time
+static void lcdMessageBlocking(const Screen& screen) {
+  if (screen.line1 && screen.line2) lcd.clear();
+  if (screen.line1) {
+    lcd.setCursor(0, 0);
+    lcd.print(screen.line1);
+  }
+  if (screen.line2) {
+    lcd.setCursor(0, 1);
+    lcd.print(screen.line2);
+  }
+  delay(screen.holdMs);
+}
+
+static void runBefore() {
+  resetClock();
+  before = {};
+
+  for (const Event& event : day) {
+    idleUntil(event.at, NULL);
+    for (uint8_t i = 0; i < event.count; i++) {
+      const Screen& screen = event.screens[i];
+      uint32_t start = millis();
+      lcdMessageBlocking(screen);
+      before.postMs += millis() - start;
+      delay(screen.physicalMs);
+      before.physicalMs += screen.physicalMs;
+      before.screens++;
+    }
+  }
+  idleUntil(DAY_MS, NULL);
+  before.blockedMs = before.postMs + before.physicalMs;
+}
+
+// Note every screen drawn since the last call (drawn = posted - pending)
+static void noteDraws() {
+  uint32_t drawn = postedAt.size() - uiPendingCount() - uiDropped;
+  while (drawnAt.size() < drawn) drawnAt.push_back(millis());
+}
+
+static void uiTask() {
+  uiUpdate();
+  noteDraws();
+}
+
+// Same as the firmware's nonBlockingWait(): pumps the queue, counts the time
+static void hardwareWait(uint32_t waitTime) {
+  uint32_t startWait = millis();
+  while (millis() - startWait < waitTime) {
+    delay(10);
+    uiTask();
+  }
+  uiRecordBlocked(millis() - startWait);
+}
+
+static void runAfter() {
+  resetClock();
+  after = {};
+  uiHead = uiCount = 0;
+  uiShownAt = uiHoldMs = 0;
+  uiDropped = uiBlockedMs = 0;
+
+  for (const Event& event : day) {
+    idleUntil(event.at, uiTask);
+    for (uint8_t i = 0; i < event.count; i++) {
+      const Screen& screen = event.screens[i];
+      uint32_t start = millis();
+      postedAt.push_back(start);
+      postedHold.push_back(screen.holdMs);
+      if (screen.line1) {
+        uiShow(screen.line1, screen.line2, screen.holdMs);
+      } else {
+        uiShowLine(1, screen.line2, screen.holdMs);
+      }
+      noteDraws();
+      after.postMs += millis() - start;
+      hardwareWait(screen.physicalMs);
+      after.physicalMs += screen.physicalMs;
+      after.screens++;
+    }
+  }
+  idleUntil(DAY_MS, uiTask);
+  after.blockedMs = uiBlockedMsPerDay();
+}
+
+static void report() {
+  char line[120];
+  snprintf(line, sizeof(line),
+           "%u screens/day; blocked ms/day: before %u (display %u), "
+           "after %u (display %u)",
+           (unsigned)before.screens, (unsigned)before.blockedMs,
+           (unsigned)before.postMs, (unsigned)after.blockedMs,
+           (unsigned)after.postMs);
+  TEST_MESSAGE(line);
+  snprintf(line, sizeof(line), "hardware waits %u ms/day in both, dropped %u",
+           (unsigned)before.physicalMs, (unsigned)uiDropped);
+  TEST_MESSAGE(line);
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_posting_a_screen_never_blocks() {
+  TEST_ASSERT_EQUAL_UINT32(0, after.postMs);
+  TEST_ASSERT_GREATER_THAN(0, before.postMs);
+}
+
+void test_only_hardware_waits_remain() {
+  TEST_ASSERT_EQUAL_UINT32(before.physicalMs, after.physicalMs);
+  TEST_ASSERT_UINT32_WITHIN(1, after.physicalMs, after.blockedMs);
+  TEST_ASSERT_LESS_THAN(before.blockedMs, after.blockedMs);
+}
+
+void test_every_screen_is_shown_for_its_hold_time() {
+  TEST_ASSERT_EQUAL_UINT32(0, uiDropped);
+  TEST_ASSERT_EQUAL(postedAt.size(), drawnAt.size());
+
+  for (size_t i = 0; i + 1 < drawnAt.size(); i++) {
+    TEST_ASSERT_GREATER_OR_EQUAL(postedAt[i], drawnAt[i]);
+    TEST_ASSERT_GREATER_OR_EQUAL(postedHold[i], drawnAt[i + 1] - drawnAt[i]);
+
+    // Shown by the first ui task run after it may be
+    uint32_t earliest = max(postedAt[i + 1], drawnAt[i] + postedHold[i]);
+    TEST_ASSERT_LESS_OR_EQUAL(earliest + UI_UPDATE_INTERVAL,
+                              drawnAt[i + 1]);
+  }
+}
+
+int main() {
+  buildDay();
+  runBefore();
+  runAfter();
+  report();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_posting_a_screen_never_blocks);
+  RUN_TEST(test_only_hardware_waits_remain);
+  RUN_TEST(test_every_screen_is_shown_for_its_hold_time);
+  return UNITY_END();
+}
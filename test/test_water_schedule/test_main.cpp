@@ -0,0 +1,214 @@
+// The adaptive water check over a scripted day, second by second, against
+// the fixed WATER_CHECK_INTERVAL it replaced:
+//
+//   night      the tank evaporates from 2.8 cm
+//   07:00      a drinking burst, five drinks of 0.1 cm in 30 s each
+//   12:00      refilled to 3 cm by hand
+//   afternoon  a dozen drinks of 0.03-0.1 cm over 30-90 s
+//   19:00      a long session of drinks at up to 12 cm/h, through critical
+//
+// A check reads the height as getDistance() does, averaging the echo
+// times of PING_SAMPLES pings. At or below WATER_CRITICAL_HEIGHT the pump
+// refills the tank and the checks resume after the refill and cooldown,
+// as in checkWaterLevel(). Each crossing is timed from the moment the
+// true level reaches critical to the check that sees it; a reading may
+// also dip under critical early, by up to the sensor resolution.
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "helpers/water_schedule.h"
+
+static const uint32_t DAY_S = 86400;
+static const float US_ROUNDTRIP_CM = 57;  // NewPing's echo time per cm
+static const float FULL_CM = DISTANCE_WATER_EMPTY - DISTANCE_WATER_FULL;
+
+struct Drink {
+  uint32_t start;  // Seconds into the day
+  uint32_t length;
+  float depth;  // cm
+};
+
+static std::vector<Drink> drinks;
+static uint32_t handRefillAt = 12 * 3600;
+static std::mt19937 rng;
+
+static float uniform() {
+  return std::uniform_real_distribution<float>(0, 1)(rng);
+}
+
+static void scriptDay() {
+  // The burst, each drink as fast as a pet drinks
+  for (uint32_t i = 0; i < 5; i++) {
+    drinks.push_back({7 * 3600 + i * 60, 30, 0.1f});
+  }
+  for (uint32_t i = 0; i < 12; i++) {
+    uint32_t start = 13 * 3600 + (uint32_t)(uniform() * 5 * 3600);
+    drinks.push_back({start, 30 + (uint32_t)(uniform() * 60),
+                      0.03f + uniform() * 0.07f});
+  }
+  // The evening session, a drink every 1-3 minutes
+  uint32_t start = 19 * 3600;
+  for (uint32_t i = 0; i < 20; i++) {
+    uint32_t length = 30 + (uint32_t)(uniform() * 30);
+    drinks.push_back({start, length, 0.1f * length / 30});
+    start += length + 60 + (uint32_t)(uniform() * 120);
+  }
+  std::sort(drinks.begin(), drinks.end(),
+            [](const Drink& a, const Drink& b) { return a.start < b.start; });
+}
+
+/**
+ * Height read the way getDistance() reads it
+ */
+static float readHeight(float height) {
+  float distance = DISTANCE_WATER_EMPTY - height;
+  uint32_t totalUs = 0;
+  for (uint8_t i = 0; i < PING_SAMPLES; i++) {
+    totalUs += (uint32_t)(distance * US_ROUNDTRIP_CM + uniform());
+  }
+  float measured = DISTANCE_WATER_EMPTY -
+                   (float)totalUs / PING_SAMPLES / US_ROUNDTRIP_CM;
+  return constrain(measured, 0.0f, FULL_CM);
+}
+
+struct Run {
+  uint32_t checks;
+  uint32_t crossings;     // Of the true level
+  uint32_t seen;          // Crossings a check read as critical
+  uint32_t early;         // Critical readings before the true crossing
+  uint32_t worstDetectS;  // Crossing to the check that saw it
+  float worstEarlyCm;     // True margin left at an early reading
+  bool refillReset;       // The hand refill restarted the drop rate
+};
+
+static Run runs[2];  // Fixed, adaptive
+
+static Run simulate(bool adaptive) {
+  waterTrend = {0, 0, 0, false};
+  waterNextCheckMs = 0;
+  waterCheckedAt = 0;
+
+  Run run = {};
+  float height = 2.8f;
+  size_t drink = 0;
+  int64_t crossedAt = -1;
+  uint32_t nextCheck = 0;
+  bool refilled = false;
+
+  for (uint32_t t = 0; t < DAY_S; t++) {
+    while (drink < drinks.size() &&
+           drinks[drink].start + drinks[drink].length <= t) {
+      drink++;
+    }
+    for (size_t i = drink; i < drinks.size() && drinks[i].start <= t; i++) {
+      if (t < drinks[i].start + drinks[i].length) {
+        height -= drinks[i].depth / drinks[i].length;
+      }
+    }
+    height -= 0.003f / 3600;  // Evaporation
+    if (t == handRefillAt) {
+      height = FULL_CM;
+      refilled = true;
+    }
+    if (height <= WATER_CRITICAL_HEIGHT && crossedAt < 0) {
+      crossedAt = t;
+      run.crossings++;
+    }
+
+    if (t < nextCheck) continue;
+    run.checks++;
+
+    float reading = readHeight(height);
+    if (reading <= WATER_CRITICAL_HEIGHT) {
+      if (crossedAt >= 0) {
+        run.seen++;
+        run.worstDetectS = std::max(run.worstDetectS, t - (uint32_t)crossedAt);
+      } else {
+        run.early++;
+        run.worstEarlyCm =
+            std::max(run.worstEarlyCm, height - (float)WATER_CRITICAL_HEIGHT);
+      }
+      height = FULL_CM;
+      crossedAt = -1;
+      nextCheck = t + (REFILL_DURATION + COOLDOWN_PERIOD) / 1000;
+      continue;
+    }
+
+    uint32_t delayMs = WATER_CHECK_INTERVAL;
+    if (adaptive) {
+      delayMs = waterTrendUpdate(reading, t * 1000);
+      if (refilled) run.refillReset = waterTrend.dropRate == 0;
+    }
+    refilled = false;
+    nextCheck = t + delayMs / 1000;
+  }
+  return run;
+}
+
+static void report() {
+  char line[120];
+  const char* names[2] = {"fixed", "adaptive"};
+  for (uint8_t i = 0; i < 2; i++) {
+    const Run& run = runs[i];
+    snprintf(line, sizeof(line),
+             "%-8s %u checks (%u pings), %u of %u crossings seen, worst "
+             "%u s late; %u early",
+             names[i], (unsigned)run.checks,
+             (unsigned)(run.checks * PING_SAMPLES), (unsigned)run.seen,
+             (unsigned)run.crossings, (unsigned)run.worstDetectS,
+             (unsigned)run.early);
+    TEST_MESSAGE(line);
+  }
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_adaptive_checks_ping_less() {
+  // Every 10 s, less the refills and their cooldowns
+  uint32_t lows = runs[0].seen + runs[0].early;
+  TEST_ASSERT_EQUAL_UINT32(DAY_S * 1000 / WATER_CHECK_INTERVAL -
+                               lows *
+                                   (REFILL_DURATION + COOLDOWN_PERIOD -
+                                    WATER_CHECK_INTERVAL) /
+                                   WATER_CHECK_INTERVAL,
+                           runs[0].checks);
+  TEST_ASSERT_LESS_THAN_UINT32(runs[0].checks / 5, runs[1].checks);
+}
+
+void test_critical_is_seen_within_the_shortest_period() {
+  for (const Run& run : runs) {
+    // The evening session crosses, at least once
+    TEST_ASSERT_GREATER_THAN_UINT32(0, run.crossings);
+    TEST_ASSERT_EQUAL_UINT32(run.crossings, run.seen);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(WATER_CHECK_MIN / 1000,
+                                     run.worstDetectS);
+    // An echo-time step is 1/57 cm
+    TEST_ASSERT_LESS_THAN_FLOAT(0.05f, run.worstEarlyCm);
+  }
+}
+
+void test_refill_restarts_the_trend() {
+  // A 0.7 cm rise, the drop rate of the burst must not carry over
+  TEST_ASSERT_TRUE(runs[1].refillReset);
+}
+
+int main() {
+  rng.seed(11);
+  scriptDay();
+  runs[0] = simulate(false);
+  runs[1] = simulate(true);
+  report();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_adaptive_checks_ping_less);
+  RUN_TEST(test_critical_is_seen_within_the_shortest_period);
+  RUN_TEST(test_refill_restarts_the_trend);
+  return UNITY_END();
+}
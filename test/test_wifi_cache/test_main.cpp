@@ -0,0 +1,200 @@
+// Association time with and without the RTC fast-reconnect cache, from a
+// simple network model. A full connect scans all 13 channels before it
+// can authenticate; a direct connect only probes the cached channel. Both
+// then need association and a DHCP lease, which now and then loses a
+// packet and retransmits. Between connects the link drops, the chip
+// soft-resets (RTC memory kept) or loses power (RTC memory lost), and the
+// router occasionally moves to another channel. The direct attempt then
+// finds no AP on the cached channel and falls back to a scan.
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "helpers/wifi_cache.h"
+
+static const char* SSID = "feeder-net";
+static const char* PASSWORD = "secret";
+
+static const uint32_t CONNECTS = 2000;
+static const uint32_t POLL_MS = 10;
+static const float SOFT_RESET_CHANCE = 0.3f;
+static const float POWER_CUT_CHANCE = 0.1f;
+static const float AP_MOVE_CHANCE = 0.03f;
+
+static std::mt19937 rng;
+
+static uint32_t uniform(uint32_t low, uint32_t high) {
+  return std::uniform_int_distribution<uint32_t>(low, high)(rng);
+}
+
+static uint32_t exponential(float mean) {
+  return (uint32_t)std::exponential_distribution<float>(1.0f / mean)(rng);
+}
+
+static bool chance(float p) {
+  return std::uniform_real_distribution<float>(0, 1)(rng) < p;
+}
+
+// Authentication, association and the 4-way handshake
+static uint32_t associateMs() { return 20 + exponential(40); }
+
+// DISCOVER/OFFER/REQUEST/ACK; a lost packet costs a 1 s retransmit
+static uint32_t dhcpMs() {
+  uint32_t ms = 150 + exponential(250);
+  while (chance(0.05f)) ms += 1000;
+  return ms;
+}
+
+static const uint32_t DWELL_MAX_MS = 160;  // Active probe on one channel
+
+static uint32_t directMisses = 0;  // Direct attempts aimed at a moved AP
+
+static int32_t networkModel(bool direct, int32_t channel,
+                            const uint8_t* bssid) {
+  if (direct) {
+    if (channel != WiFi.apChannel ||
+        memcmp(bssid, WiFi.apBssid, sizeof(WiFi.apBssid)) != 0) {
+      // The probe on the cached channel goes unanswered
+      directMisses++;
+      WiFi.simNoApMs = uniform(100, DWELL_MAX_MS);
+      return -1;
+    }
+    // Probe on one channel until the AP answers
+    return uniform(30, 120) + associateMs() + dhcpMs();
+  }
+
+  // Active scan, 13 channels with a 100-160 ms dwell each
+  uint32_t scan = 0;
+  for (uint8_t i = 0; i < 13; i++) scan += uniform(100, DWELL_MAX_MS);
+  return scan + associateMs() + dhcpMs();
+}
+
+struct RunResult {
+  std::vector<uint32_t> connectMs;
+  uint32_t apMoves;
+  uint32_t fastConnects;
+  uint32_t fastFallbacks;
+  uint32_t scanConnects;
+};
+
+static RunResult withoutCache;
+static RunResult withCache;
+
+static uint32_t percentile(std::vector<uint32_t> values, float fraction) {
+  std::sort(values.begin(), values.end());
+  return values[(size_t)(fraction * (values.size() - 1))];
+}
+
+static uint32_t connectOnce() {
+  uint32_t start = millis();
+  wifiConnectBegin(SSID, PASSWORD);
+  while (!wifiConnectPoll()) delay(POLL_MS);
+  return millis() - start;
+}
+
+static RunResult run(bool useCache) {
+  RunResult result = {};
+  rng.seed(7);
+  simMicros = 0;
+  ESP.simLoseRtc();
+  wifiCacheValid = false;
+  wifiFastConnects = wifiFastFallbacks = wifiScanConnects = 0;
+  WiFi.apChannel = 6;
+  WiFi.simAssociate = networkModel;
+
+  for (uint32_t i = 0; i < CONNECTS; i++) {
+    if (!useCache) {
+      wifiCacheValid = false;
+      ESP.simLoseRtc();
+    }
+
+    result.connectMs.push_back(connectOnce());
+    delay(uniform(60000, 3600000));
+
+    // What happens before the next connect
+    if (chance(POWER_CUT_CHANCE)) {
+      ESP.simLoseRtc();
+      wifiCacheValid = false;
+    } else if (chance(SOFT_RESET_CHANCE)) {
+      wifiCacheValid = false;
+    }
+    if (chance(AP_MOVE_CHANCE)) {
+      WiFi.apChannel = WiFi.apChannel % 13 + 1;
+      result.apMoves++;
+    }
+    WiFi.disconnect();
+  }
+
+  result.fastConnects = wifiFastConnects;
+  result.fastFallbacks = wifiFastFallbacks;
+  result.scanConnects = wifiScanConnects;
+  return result;
+}
+
+static void reportRun(const char* name, const RunResult& result) {
+  char line[120];
+  snprintf(line, sizeof(line),
+           "%-8s connect ms p50/p90/p99/max %u/%u/%u/%u; fast %u, "
+           "fallback %u, scan %u",
+           name, (unsigned)percentile(result.connectMs, 0.5f),
+           (unsigned)percentile(result.connectMs, 0.9f),
+           (unsigned)percentile(result.connectMs, 0.99f),
+           (unsigned)percentile(result.connectMs, 1.0f),
+           (unsigned)result.fastConnects, (unsigned)result.fastFallbacks,
+           (unsigned)result.scanConnects);
+  TEST_MESSAGE(line);
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_cache_halves_the_typical_connect() {
+  uint32_t scanP50 = percentile(withoutCache.connectMs, 0.5f);
+  uint32_t cacheP50 = percentile(withCache.connectMs, 0.5f);
+  TEST_ASSERT_LESS_THAN(scanP50 / 2, cacheP50);
+  TEST_ASSERT_LESS_OR_EQUAL(percentile(withoutCache.connectMs, 0.9f),
+                            percentile(withCache.connectMs, 0.9f));
+}
+
+void test_without_cache_every_connect_scans() {
+  TEST_ASSERT_EQUAL_UINT32(0, withoutCache.fastConnects);
+  TEST_ASSERT_EQUAL_UINT32(CONNECTS, withoutCache.scanConnects);
+}
+
+void test_moved_ap_falls_back_once() {
+  // Each miss costs one timeout and a scan; the next connect is fast again
+  TEST_ASSERT_GREATER_THAN(0, withCache.fastFallbacks);
+  TEST_ASSERT_EQUAL_UINT32(directMisses, withCache.fastFallbacks);
+  TEST_ASSERT_LESS_OR_EQUAL(withCache.apMoves, withCache.fastFallbacks);
+  TEST_ASSERT_EQUAL_UINT32(CONNECTS,
+                           withCache.fastConnects + withCache.scanConnects);
+}
+
+void test_fallback_is_bounded() {
+  // A miss costs one dwell on the cached channel before the scan, never
+  // the timeout, so the tail is no worse than scanning every time
+  uint32_t worstScan = percentile(withoutCache.connectMs, 1.0f);
+  TEST_ASSERT_LESS_OR_EQUAL(worstScan + DWELL_MAX_MS + POLL_MS,
+                            percentile(withCache.connectMs, 1.0f));
+  TEST_ASSERT_LESS_OR_EQUAL(percentile(withoutCache.connectMs, 0.99f),
+                            percentile(withCache.connectMs, 0.99f));
+}
+
+int main() {
+  withoutCache = run(false);
+  directMisses = 0;
+  withCache = run(true);
+  reportRun("no cache", withoutCache);
+  reportRun("cache", withCache);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_cache_halves_the_typical_connect);
+  RUN_TEST(test_without_cache_every_connect_scans);
+  RUN_TEST(test_moved_ap_falls_back_once);
+  RUN_TEST(test_fallback_is_bounded);
+  return UNITY_END();
+}